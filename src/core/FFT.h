@@ -0,0 +1,226 @@
+/**
+ * This class is a precomputed plan for complex fast Fourier transforms of one
+ * size, in float or double. The size is factored into radix 4, 2, 3 and 5
+ * stages (other prime factors get a direct DFT stage in O(p^2)), and the
+ * twiddle factors of every stage are computed once, so a plan is built per
+ * size and applied to every row or column of an image.
+ *
+ * Transforms are computed by Stockham stages (see simd::fftStage()), which
+ * leave the output in natural order without a bit reversal pass: each stage
+ * reads one buffer and writes the other, so transforms take a scratch buffer
+ * of the same size. Plans are immutable and can be shared by threads.
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "Simd.h"
+
+
+namespace owl
+{
+    template<typename T>
+    class FFT
+    {
+        public:
+
+            /**
+             * Instantiates a plan of size 0.
+             */
+            FFT();
+
+            /**
+             * Instantiates a plan.
+             * @param size Number of points of the transforms.
+             */
+            explicit FFT( unsigned int size );
+
+            /**
+             * Gets the number of points of the transforms.
+             * @return Transform size.
+             */
+            unsigned int getSize() const;
+
+            /**
+             * Computes the forward transform in place:
+             *     X[k] = sum over j of x[j] e^(-2 pi i j k / n)
+             * @param data getSize() complexes, replaced by their transform.
+             * @param scratch A buffer of getSize() complexes.
+             */
+            void forward( std::complex<T>* data, std::complex<T>* scratch ) const;
+
+            /**
+             * Computes the inverse transform in place, without the 1 / n
+             * scale factor:
+             *     x[j] = sum over k of X[k] e^(2 pi i j k / n)
+             * @param data getSize() complexes, replaced by their transform.
+             * @param scratch A buffer of getSize() complexes.
+             */
+            void inverse( std::complex<T>* data, std::complex<T>* scratch ) const;
+
+            /**
+             * Finds the smallest size that is at least a given size and has
+             * no prime factors other than 2, 3 and 5, the sizes that are
+             * fastest to transform. Used to zero pad signals.
+             * @param size A size.
+             * @return The smallest 2^a 3^b 5^c >= size.
+             */
+            static unsigned int optimalSize( unsigned int size );
+
+
+        private:
+
+            /**
+             * Runs the stages in one direction.
+             */
+            template<bool Inverse>
+            void transform( std::complex<T>* data, std::complex<T>* scratch ) const;
+
+            unsigned int mSize;
+
+            /**
+             * Radix of each stage, the product of the previous radices (span
+             * of the stage, see simd::fftStage()) and its twiddle factors and
+             * roots of unity.
+             */
+            std::vector<unsigned int> mRadices;
+            std::vector<unsigned int> mSpans;
+            std::vector< std::vector< std::complex<T> > > mTwiddles;
+            std::vector< std::vector< std::complex<T> > > mRoots;
+    };
+
+
+    template<typename T>
+    FFT<T>::FFT() :
+        mSize( 0 )
+    {
+    }
+
+    template<typename T>
+    FFT<T>::FFT( unsigned int size ) :
+        mSize( size )
+    {
+        // Radix 4 first: fewer stages, and the spans of the later stages are
+        // even, so float butterflies work on pairs of complexes
+        unsigned int remaining = size;
+
+        while ( remaining % 4 == 0 )
+        {
+            mRadices.push_back( 4 );
+            remaining /= 4;
+        }
+
+        for ( unsigned int factor = 2; remaining > 1; )
+        {
+            if ( remaining % factor == 0 )
+            {
+                mRadices.push_back( factor );
+                remaining /= factor;
+            }
+            else
+            {
+                factor = factor * factor > remaining ? remaining : factor + 1;
+            }
+        }
+
+        const double pi = 3.14159265358979323846;
+        unsigned int span = 1;
+
+        for ( unsigned int radix : mRadices )
+        {
+            std::vector< std::complex<T> > twiddles( ( radix - 1 ) * span );
+            std::vector< std::complex<T> > roots( radix );
+
+            for ( unsigned int q = 1; q < radix; ++q )
+            {
+                for ( unsigned int k = 0; k < span; ++k )
+                {
+                    double angle = -2.0 * pi * q * k / ( static_cast<double>( radix ) * span );
+                    twiddles[( q - 1 ) * span + k] = std::complex<T>( static_cast<T>( std::cos( angle ) ), static_cast<T>( std::sin( angle ) ) );
+                }
+            }
+
+            for ( unsigned int j = 0; j < radix; ++j )
+            {
+                double angle = -2.0 * pi * j / radix;
+                roots[j] = std::complex<T>( static_cast<T>( std::cos( angle ) ), static_cast<T>( std::sin( angle ) ) );
+            }
+
+            mSpans.push_back( span );
+            mTwiddles.push_back( twiddles );
+            mRoots.push_back( roots );
+            span *= radix;
+        }
+    }
+
+    template<typename T>
+    unsigned int FFT<T>::getSize() const
+    {
+        return mSize;
+    }
+
+    template<typename T>
+    void FFT<T>::forward( std::complex<T>* data, std::complex<T>* scratch ) const
+    {
+        transform<false>( data, scratch );
+    }
+
+    template<typename T>
+    void FFT<T>::inverse( std::complex<T>* data, std::complex<T>* scratch ) const
+    {
+        transform<true>( data, scratch );
+    }
+
+    template<typename T>
+    unsigned int FFT<T>::optimalSize( unsigned int size )
+    {
+        for ( unsigned int candidate = std::max( size, 1u ); ; ++candidate )
+        {
+            unsigned int remaining = candidate;
+
+            for ( unsigned int factor : { 2u, 3u, 5u } )
+            {
+                while ( remaining % factor == 0 )
+                {
+                    remaining /= factor;
+                }
+            }
+
+            if ( remaining == 1 )
+            {
+                return candidate;
+            }
+        }
+    }
+
+    template<typename T>
+    template<bool Inverse>
+    void FFT<T>::transform( std::complex<T>* data, std::complex<T>* scratch ) const
+    {
+        std::complex<T>* input = data;
+        std::complex<T>* output = scratch;
+
+        for ( std::size_t s = 0; s < mRadices.size(); ++s )
+        {
+            simd::fftStage<T, Inverse>( input, output, mSize, mRadices[s], mSpans[s], &mTwiddles[s][0], &mRoots[s][0] );
+            std::swap( input, output );
+        }
+
+        if ( input != data )
+        {
+            std::copy( input, input + mSize, data );
+        }
+    }
+}
+
+#endif // FFT_H
@@ -0,0 +1,392 @@
+/**
+ * This class holds per-channel histograms of images. Bins evenly split a
+ * range of channel values [minimum, maximum); values outside the range are
+ * not counted. The default range of floating point channels is [0, 1], with
+ * 1, the saturated value, in the last bin.
+ *
+ * Histograms are computed in parallel: every thread fills private counters
+ * that are merged at the end. For BYTE images each thread also spreads
+ * consecutive pixels over several sub-histograms, so runs of equal values
+ * do not serialize on increments of the same counter.
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "Image.h"
+#include "Parallel.h"
+
+
+namespace owl
+{
+    class Histogram
+    {
+        public:
+
+            /**
+             * Instantiates an empty histogram. compute() will use the default
+             * bins of the image channel type.
+             */
+            Histogram();
+
+            /**
+             * Instantiates a histogram with given bins.
+             * @param numberOfBins Number of bins.
+             * @param minimum Lowest value of the first bin.
+             * @param maximum Upper bound (excluded) of the last bin.
+             */
+            Histogram( unsigned int numberOfBins, double minimum, double maximum );
+
+            /**
+             * Sets the bins used by the next calls to compute(). All previous
+             * counts will be destroyed.
+             * @param numberOfBins Number of bins. 0 restores the default bins
+             * of the image channel type.
+             * @param minimum Lowest value of the first bin.
+             * @param maximum Upper bound (excluded) of the last bin.
+             */
+            void setBins( unsigned int numberOfBins, double minimum, double maximum );
+
+            /**
+             * Counts the values of each channel of an image. If no bins were
+             * set, integer channels get one bin per value for BYTE and 256 bins
+             * over the whole range for the other types, and floating point
+             * channels get 256 bins over [0, 1], the last bin including 1.
+             * @param image An image.
+             * @param region (Optional) Region of the image to be counted. It is
+             * clipped to the image bounds. An empty rectangle (default) counts
+             * the whole image.
+             * @param parallel (Optional) False to count on the calling thread
+             * only, e.g. from a task of a parallel loop over tiles. Default is
+             * true.
+             */
+            template<typename Channel>
+            void compute( const Image<Channel>& image, const Rect& region = Rect(), bool parallel = true );
+
+            /**
+             * Gets the number of bins.
+             * @return Number of bins per channel.
+             */
+            unsigned int getNumberOfBins() const;
+
+            /**
+             * Gets the number of channels of the last computed image.
+             * @return Number of channels.
+             */
+            unsigned int getNumberOfChannels() const;
+
+            /**
+             * Gets the lowest value of the first bin.
+             * @return Range minimum.
+             */
+            double getMinimum() const;
+
+            /**
+             * Gets the upper bound of the last bin, excluded except for the
+             * default bins of floating point channels.
+             * @return Range maximum.
+             */
+            double getMaximum() const;
+
+            /**
+             * Gets the bin a value falls into.
+             * @param value A channel value.
+             * @return Bin index, or -1 if the value is outside the range.
+             */
+            int getBin( double value ) const;
+
+            /**
+             * Gets the counts of a channel.
+             * @param channel Channel index.
+             * @return Array of getNumberOfBins() counts.
+             */
+            const uint64_t* getCounts( unsigned int channel = 0 ) const;
+
+            /**
+             * Gets the number of counted values of a channel, i.e. the sum of
+             * its bins.
+             * @param channel Channel index.
+             * @return Number of values inside the range.
+             */
+            uint64_t getTotal( unsigned int channel = 0 ) const;
+
+
+        private:
+
+            /**
+             * Sets the default bins of a channel type, if no bins were set.
+             */
+            template<typename Channel>
+            void setDefaultBins();
+
+            /**
+             * Counts a band of rows with one set of private counters per
+             * channel, then adds them to mCounts.
+             */
+            template<typename Channel>
+            void countRows( const Image<Channel>& image, const Rect& region, unsigned int firstRow, unsigned int lastRow, std::mutex& mutex );
+            void countRows( const Image<BYTE>& image, const Rect& region, unsigned int firstRow, unsigned int lastRow, std::mutex& mutex );
+
+            unsigned int mNumberOfBins;
+            unsigned int mNumberOfChannels;
+            double mMinimum;
+            double mMaximum;
+            bool mDefaultBins;
+
+            /**
+             * True if mMaximum is counted in the last bin.
+             */
+            bool mInclusiveMaximum;
+
+            /**
+             * mNumberOfChannels x mNumberOfBins counts.
+             */
+            std::vector<uint64_t> mCounts;
+    };
+
+
+    inline Histogram::Histogram() :
+        mNumberOfBins( 0 ),
+        mNumberOfChannels( 0 ),
+        mMinimum( 0.0 ),
+        mMaximum( 0.0 ),
+        mDefaultBins( true ),
+        mInclusiveMaximum( false )
+    {
+    }
+
+    inline Histogram::Histogram( unsigned int numberOfBins, double minimum, double maximum ) :
+        Histogram()
+    {
+        setBins( numberOfBins, minimum, maximum );
+    }
+
+    inline void Histogram::setBins( unsigned int numberOfBins, double minimum, double maximum )
+    {
+        mNumberOfBins = numberOfBins;
+        mMinimum = minimum;
+        mMaximum = maximum;
+        mDefaultBins = numberOfBins == 0 || !( maximum > minimum );
+        mInclusiveMaximum = false;
+        mCounts.clear();
+    }
+
+    template<typename Channel>
+    void Histogram::setDefaultBins()
+    {
+        if ( !mDefaultBins )
+        {
+            return;
+        }
+
+        mNumberOfBins = 256;
+        mInclusiveMaximum = !std::numeric_limits<Channel>::is_integer;
+
+        if ( std::numeric_limits<Channel>::is_integer )
+        {
+            mMinimum = static_cast<double>( std::numeric_limits<Channel>::lowest() );
+            mMaximum = static_cast<double>( std::numeric_limits<Channel>::max() ) + 1.0;
+        }
+        else
+        {
+            mMinimum = 0.0;
+            mMaximum = 1.0;
+        }
+    }
+
+    template<typename Channel>
+    void Histogram::compute( const Image<Channel>& image, const Rect& region, bool parallel )
+    {
+        setDefaultBins<Channel>();
+
+        mNumberOfChannels = image.getNumberOfChannels();
+        mCounts.assign( mNumberOfChannels * mNumberOfBins, 0 );
+
+        if ( image.getData() == nullptr || region.x >= image.getWidth() || region.y >= image.getHeight() )
+        {
+            return;
+        }
+
+        Rect area = region.isEmpty() ? Rect( 0, 0, image.getWidth(), image.getHeight() ) :
+                    Rect( region.x, region.y,
+                          std::min( region.width, image.getWidth() - region.x ),
+                          std::min( region.height, image.getHeight() - region.y ) );
+
+        std::mutex mutex;
+
+        if ( !parallel )
+        {
+            countRows( image, area, area.y, area.y + area.height, mutex );
+            return;
+        }
+
+        unsigned int grain = Parallel::calculateGrain( area.width * mNumberOfChannels );
+
+        Parallel::forRange( area.y, area.y + area.height, grain, [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            countRows( image, area, firstRow, lastRow, mutex );
+        } );
+    }
+
+    template<typename Channel>
+    void Histogram::countRows( const Image<Channel>& image, const Rect& region, unsigned int firstRow, unsigned int lastRow, std::mutex& mutex )
+    {
+        std::vector<uint64_t> counts( mCounts.size(), 0 );
+        const double binsPerUnit = mNumberOfBins / ( mMaximum - mMinimum );
+
+        for ( unsigned int y = firstRow; y < lastRow; ++y )
+        {
+            const Channel* pixel = image( y, region.x );
+
+            for ( unsigned int x = 0; x < region.width; ++x )
+            {
+                for ( unsigned int c = 0; c < mNumberOfChannels; ++c )
+                {
+                    const double value = static_cast<double>( *pixel++ );
+                    const double bin = ( value - mMinimum ) * binsPerUnit;
+
+                    // NaNs fail both comparisons
+                    if ( bin >= 0.0 && bin < mNumberOfBins )
+                    {
+                        ++counts[c * mNumberOfBins + static_cast<unsigned int>( bin )];
+                    }
+                    else if ( mInclusiveMaximum && value == mMaximum )
+                    {
+                        ++counts[c * mNumberOfBins + mNumberOfBins - 1];
+                    }
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+
+        for ( unsigned int i = 0; i < counts.size(); ++i )
+        {
+            mCounts[i] += counts[i];
+        }
+    }
+
+    inline void Histogram::countRows( const Image<BYTE>& image, const Rect& region, unsigned int firstRow, unsigned int lastRow, std::mutex& mutex )
+    {
+        // Custom bins take the generic path
+        if ( mNumberOfBins != 256 || mMinimum != 0.0 || mMaximum != 256.0 )
+        {
+            countRows<BYTE>( image, region, firstRow, lastRow, mutex );
+            return;
+        }
+
+        // Consecutive pixels go to different sub-histograms, so increments of
+        // the same value do not wait for each other
+        const unsigned int subHistograms = 4;
+        const unsigned int channels = mNumberOfChannels;
+        const unsigned int stride = channels * 256;
+        std::vector<uint32_t> counts( subHistograms * stride, 0 );
+        const unsigned int length = region.width * channels;
+
+        for ( unsigned int y = firstRow; y < lastRow; ++y )
+        {
+            const BYTE* row = image( y, region.x );
+            unsigned int i = 0;
+
+            if ( channels == 1 )
+            {
+                for ( ; i + 4 <= length; i += 4 )
+                {
+                    ++counts[row[i]];
+                    ++counts[256 + row[i + 1]];
+                    ++counts[512 + row[i + 2]];
+                    ++counts[768 + row[i + 3]];
+                }
+            }
+            else
+            {
+                for ( unsigned int sub = 0; i + channels <= length; i += channels, sub = ( sub + 1 ) % subHistograms )
+                {
+                    uint32_t* sums = &counts[sub * stride];
+
+                    for ( unsigned int c = 0; c < channels; ++c )
+                    {
+                        ++sums[c * 256 + row[i + c]];
+                    }
+                }
+            }
+
+            for ( ; i < length; ++i )
+            {
+                ++counts[( i % channels ) * 256 + row[i]];
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+
+        for ( unsigned int sub = 0; sub < subHistograms; ++sub )
+        {
+            for ( unsigned int i = 0; i < stride; ++i )
+            {
+                mCounts[i] += counts[sub * stride + i];
+            }
+        }
+    }
+
+    inline unsigned int Histogram::getNumberOfBins() const
+    {
+        return mNumberOfBins;
+    }
+
+    inline unsigned int Histogram::getNumberOfChannels() const
+    {
+        return mNumberOfChannels;
+    }
+
+    inline double Histogram::getMinimum() const
+    {
+        return mMinimum;
+    }
+
+    inline double Histogram::getMaximum() const
+    {
+        return mMaximum;
+    }
+
+    inline int Histogram::getBin( double value ) const
+    {
+        double bin = ( value - mMinimum ) * mNumberOfBins / ( mMaximum - mMinimum );
+
+        if ( mInclusiveMaximum && value == mMaximum )
+        {
+            return mNumberOfBins - 1;
+        }
+
+        return bin >= 0.0 && bin < mNumberOfBins ? static_cast<int>( bin ) : -1;
+    }
+
+    inline const uint64_t* Histogram::getCounts( unsigned int channel ) const
+    {
+        return &mCounts[channel * mNumberOfBins];
+    }
+
+    inline uint64_t Histogram::getTotal( unsigned int channel ) const
+    {
+        uint64_t total = 0;
+
+        for ( unsigned int i = 0; i < mNumberOfBins; ++i )
+        {
+            total += mCounts[channel * mNumberOfBins + i];
+        }
+
+        return total;
+    }
+}
+
+#endif // HISTOGRAM_H
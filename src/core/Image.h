@@ -43,6 +43,10 @@ namespace owl
     typedef Image<BYTE> ImageByte;
     typedef Image<float> ImageFloat;
     typedef Image<double> ImageDouble;
+    typedef Image<uint16_t> ImageUShort;
+    typedef Image<int16_t> ImageShort;
+    typedef Image<int32_t> ImageInt;
+    typedef Image<Half> ImageHalf;
 
     template<typename Channel>
     class Image
@@ -51,10 +55,14 @@ namespace owl
 
             /**
              * Check for wrong declaration in the type of a owl::Image channel.
-             * A owl::Image channel type must be one of BYTE, float or double
-             * types.
+             * A owl::Image channel type must be one of BYTE, uint16_t, int16_t,
+             * int32_t, Half, float or double types.
              */
             static_assert( std::is_same< BYTE, Channel >::value ||
+                           std::is_same< uint16_t, Channel >::value ||
+                           std::is_same< int16_t, Channel >::value ||
+                           std::is_same< int32_t, Channel >::value ||
+                           std::is_same< Half, Channel >::value ||
                            std::is_same< float, Channel >::value ||
                            std::is_same< double, Channel >::value,
                            "owl::Image assertion: Invalid type for color channel." );
@@ -124,6 +132,15 @@ namespace owl
              */
             ColorSpace::Type getColorSpace() const;
             
+            /**
+             * Changes the color space of the image without touching its pixels,
+             * e.g. to label an image whose channels were reordered in place.
+             * @param colorSpace New color space. Must have the same number of
+             * channels as the current one.
+             * @return True if the color space was changed.
+             */
+            bool setColorSpace( ColorSpace::Type colorSpace );
+            
             /**
              * Gets the number of channels per pixel.
              * @return Image number of channels per pixel.
@@ -225,11 +242,11 @@ namespace owl
         mHeight( height ),
         mRowSize( calculateRowSize( mWidth, mBpp ) ),
         mNumberOfChannels( ColorSpace::calculateNumberOfChannels( colorSpace ) ),
-        mData( new Channel[mRowSize * mHeight] )
+        mData( new Channel[mRowSize / sizeof(Channel) * mHeight] )
     {
         if ( data != nullptr )
         {
-            std::memcpy(mData, data, sizeof(BYTE) * mRowSize * mHeight);
+            std::memcpy(mData, data, mRowSize * mHeight);
         }
     }
 
@@ -273,11 +290,11 @@ namespace owl
         mRowSize = calculateRowSize( mWidth, mBpp );
         mNumberOfChannels = ColorSpace::calculateNumberOfChannels( colorSpace );
 
-        mData = new BYTE[mRowSize * mHeight];
+        mData = new Channel[mRowSize / sizeof(Channel) * mHeight];
         
         if ( data != nullptr )
         {
-            memcpy( mData, data, sizeof(BYTE) * mRowSize * mHeight );
+            memcpy( mData, data, mRowSize * mHeight );
         }
     }
     
@@ -305,6 +322,19 @@ namespace owl
         return mColorSpace;
     }
 
+    template<typename Channel>
+    bool Image<Channel>::setColorSpace( ColorSpace::Type colorSpace )
+    {
+        if ( ColorSpace::calculateNumberOfChannels( colorSpace ) != mNumberOfChannels )
+        {
+            return false;
+        }
+
+        mColorSpace = colorSpace;
+
+        return true;
+    }
+
     template<typename Channel>
     int Image<Channel>::getNumberOfChannels() const
     {
@@ -326,17 +356,26 @@ namespace owl
     template<typename Channel>
     Channel* Image<Channel>::operator()( unsigned int row, unsigned int column )
     {
-        return mData + (row * mRowSize + column * mNumberOfChannels);
+        // Row size is in bytes, and always a multiple of the channel size
+        return mData + (row * (mRowSize / sizeof(Channel)) + column * mNumberOfChannels);
     }
     template<typename Channel>
     const Channel* Image<Channel>::operator()( unsigned int row, unsigned int column ) const
     {
-        return mData + (row * mRowSize + column * mNumberOfChannels);
+        return mData + (row * (mRowSize / sizeof(Channel)) + column * mNumberOfChannels);
     }
     
     template<typename Channel>
     Image<Channel>* Image<Channel>::operator=(const Image<Channel>& image)
     {
+        if ( &image == this )
+        {
+            return this;
+        }
+
+        unsigned int sourceSize = image.mRowSize * image.mHeight;
+        unsigned int destSize = mRowSize * mHeight;
+
         mWidth = image.mWidth;
         mHeight = image.mHeight;
         mRowSize = image.mRowSize;
@@ -344,13 +383,10 @@ namespace owl
         mColorSpace = image.mColorSpace;
         mBpp = image.mBpp;
 
-        unsigned int sourceSize = image.mRowSize * image.mHeight;
-        unsigned int destSize = mRowSize * mHeight;
-
-        if ( sourceSize != destSize )
+        if ( sourceSize != destSize || mData == nullptr )
         {
             delete[] mData;
-            mData = new Channel[ sourceSize ];
+            mData = new Channel[ sourceSize / sizeof(Channel) ];
         }
 
         memcpy( mData, image.mData, sourceSize );
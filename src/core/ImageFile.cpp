@@ -7,26 +7,66 @@
  * @author: Eder Perez.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <vector>
 #include <jpeglib.h>
 #include "ImageFile.h"
 #include "Image.h"
 
 namespace owl
 {
-    bool ImageFile::load( const std::string& path, Image<BYTE>& image )
+    namespace
+    {
+        /**
+         * Reverse the order of the pixels of a scanline in place.
+         * @param row Scanline.
+         * @param width Number of pixels in the scanline.
+         * @param numberOfChannels Number of channels per pixel.
+         */
+        void reversePixels( BYTE* row, unsigned int width, unsigned int numberOfChannels )
+        {
+            BYTE* left = row;
+            BYTE* right = row + ( width - 1 ) * numberOfChannels;
+
+            for ( ; left < right; left += numberOfChannels, right -= numberOfChannels )
+            {
+                for ( unsigned int c = 0; c < numberOfChannels; ++c )
+                {
+                    std::swap( left[c], right[c] );
+                }
+            }
+        }
+    }
+
+    bool ImageFile::load( const std::string& path, Image<BYTE>& image, const LoadOptions& options )
     {
         Format format = checkFileExtension( path );
 
         switch ( format )
         {
             case Format::JPEG:
-                return loadJPEG( path, image );
+                return loadJPEG( path, image, options );
                 
             default:
                 return false;
         }
     }
+
+    ImageFile::Transform ImageFile::readOrientation( const std::string& path )
+    {
+        Format format = checkFileExtension( path );
+
+        switch ( format )
+        {
+            case Format::JPEG:
+                return readOrientationJPEG( path );
+
+            default:
+                return Transform::NONE;
+        }
+    }
     
     bool ImageFile::save( const std::string& path, const Image<BYTE>& image )
     {
@@ -42,6 +82,25 @@ namespace owl
         }
     }
     
+    bool ImageFile::transform( const std::string& inputPath, const std::string& outputPath, Transform transform, const Rect& crop )
+    {
+        Format format = checkFileExtension( inputPath );
+
+        if ( format != checkFileExtension( outputPath ) || inputPath == outputPath )
+        {
+            return false;
+        }
+
+        switch ( format )
+        {
+            case Format::JPEG:
+                return transformJPEG( inputPath, outputPath, transform, crop );
+
+            default:
+                return false;
+        }
+    }
+    
     ImageFile::Format ImageFile::checkFileExtension( const std::string& path )
     {
         if ( path.empty() )
@@ -62,7 +121,7 @@ namespace owl
         return ColorSpace::calculateNumberOfChannels( colorSpace ) * channelSize * 8;
     }
 
-    bool ImageFile::loadJPEG( const std::string& path, ImageByte& image )
+    bool ImageFile::loadJPEG( const std::string& path, ImageByte& image, const LoadOptions& options )
     {
         // Based on source code from http://www.aaronmr.com/en/2010/03/test/
         
@@ -86,9 +145,97 @@ namespace owl
         // This makes the library read from file
         jpeg_stdio_src( &cInfo, file );
 
+        // The orientation is stored in the EXIF marker (APP1)
+        if ( options.applyOrientation )
+        {
+            jpeg_save_markers( &cInfo, JPEG_APP0 + 1, 0xFFFF );
+        }
+
         // Reading the image header which contains image information
         jpeg_read_header( &cInfo, TRUE );
 
+        Transform orientation = Transform::NONE;
+        for ( jpeg_saved_marker_ptr marker = cInfo.marker_list; marker != nullptr && orientation == Transform::NONE; marker = marker->next )
+        {
+            orientation = parseExifOrientation( marker->data, marker->data_length );
+        }
+
+        // Let the decoder write pixels in the requested layout. libjpeg can
+        // not convert between CMYK and the other color spaces.
+        bool cmykFile = cInfo.jpeg_color_space == JCS_CMYK || cInfo.jpeg_color_space == JCS_YCCK;
+
+        if ( options.colorSpace != ColorSpace::Type::UNKNOWN )
+        {
+            if ( cmykFile != ( options.colorSpace == ColorSpace::Type::CMYK ) )
+            {
+                jpeg_destroy_decompress( &cInfo );
+                fclose( file );
+                return false;
+            }
+
+            switch ( options.colorSpace )
+            {
+                case ColorSpace::Type::GRAYSCALE:
+                    cInfo.out_color_space = JCS_GRAYSCALE;
+                    break;
+
+                case ColorSpace::Type::RGB:
+                    cInfo.out_color_space = JCS_EXT_RGB;
+                    break;
+
+                case ColorSpace::Type::RGBA:
+                    cInfo.out_color_space = JCS_EXT_RGBA;
+                    break;
+
+                case ColorSpace::Type::BGR:
+                    cInfo.out_color_space = JCS_EXT_BGR;
+                    break;
+
+                case ColorSpace::Type::BGRA:
+                    cInfo.out_color_space = JCS_EXT_BGRA;
+                    break;
+
+                case ColorSpace::Type::ARGB:
+                    cInfo.out_color_space = JCS_EXT_ARGB;
+                    break;
+
+                case ColorSpace::Type::ABGR:
+                    cInfo.out_color_space = JCS_EXT_ABGR;
+                    break;
+
+                case ColorSpace::Type::CMYK:
+                    cInfo.out_color_space = JCS_CMYK;
+                    break;
+
+                default:
+                    jpeg_destroy_decompress( &cInfo );
+                    fclose( file );
+                    return false;
+            }
+        }
+
+        bool transpose, flipHorizontal, flipVertical;
+        decomposeTransform( orientation, transpose, flipHorizontal, flipVertical );
+
+        // Let the decoder scale the image down by 1/2, 1/4 or 1/8 while it
+        // computes the inverse DCT
+        if ( options.minimumWidth > 0 || options.minimumHeight > 0 )
+        {
+            unsigned int minimumWidth = transpose ? options.minimumHeight : options.minimumWidth;
+            unsigned int minimumHeight = transpose ? options.minimumWidth : options.minimumHeight;
+            unsigned int denominator = 8;
+
+            while ( denominator > 1 &&
+                    ( ( cInfo.image_width + denominator - 1 ) / denominator < minimumWidth ||
+                      ( cInfo.image_height + denominator - 1 ) / denominator < minimumHeight ) )
+            {
+                denominator /= 2;
+            }
+
+            cInfo.scale_num = 1;
+            cInfo.scale_denom = denominator;
+        }
+
         // Start decompression jpeg here
         jpeg_start_decompress( &cInfo );
         
@@ -106,39 +253,213 @@ namespace owl
                 break;
                 
             case JCS_EXT_RGBA: // red/green/blue/alpha
+            case JCS_EXT_RGBX:
                 colorSpace = ColorSpace::Type::RGBA;
                 break;
+
+            case JCS_EXT_BGR: // blue/green/red
+                colorSpace = ColorSpace::Type::BGR;
+                break;
+
+            case JCS_EXT_BGRA: // blue/green/red/alpha
+            case JCS_EXT_BGRX:
+                colorSpace = ColorSpace::Type::BGRA;
+                break;
+
+            case JCS_EXT_ARGB: // alpha/red/green/blue
+            case JCS_EXT_XRGB:
+                colorSpace = ColorSpace::Type::ARGB;
+                break;
+
+            case JCS_EXT_ABGR: // alpha/blue/green/red
+            case JCS_EXT_XBGR:
+                colorSpace = ColorSpace::Type::ABGR;
+                break;
+
+            case JCS_CMYK: // C/M/Y/K
+                colorSpace = ColorSpace::Type::CMYK;
+                break;
                 
             default:
                 //JCS_YCbCr: // Y/Cb/Cr (also known as YUV)
-                //JCS_CMYK: // C/M/Y/K
                 //JCS_YCCK: // Y/Cb/Cr/K
-                //JCS_EXT_BGR: // blue/green/red
-                //JCS_EXT_BGRA: // blue/green/red/alpha
-                //JCS_EXT_ABGR: // alpha/blue/green/red
-                //JCS_EXT_ARGB: // alpha/red/green/blue
                 
-                // Wrap up decompression, destroy objects and close open files
-                jpeg_finish_decompress(&cInfo);
+                // Abort decompression, destroy objects and close open files
+                jpeg_abort_decompress(&cInfo);
                 jpeg_destroy_decompress(&cInfo);
                 fclose(file);
                 return false;
         }
         
-        image.create( cInfo.output_width, cInfo.output_height, colorSpace );
+        unsigned int numberOfChannels = cInfo.output_components;
+
+        // Region to be decoded in file coordinates. The requested region is
+        // given in the coordinates of the loaded (oriented) image.
+        Rect region( 0, 0, cInfo.output_width, cInfo.output_height );
 
-        // Read one scan line at a time
-        unsigned int row = 0;
-        while ( cInfo.output_scanline < cInfo.image_height )
+        if ( !options.region.isEmpty() )
         {
-            // libjpeg data structure for storing one row, that is, scanline of an image
-            JSAMPROW rowPointer[1];
-            rowPointer[0] = image(row++, 0);
-            jpeg_read_scanlines( &cInfo, rowPointer, 1 );
+            unsigned int orientedWidth = transpose ? cInfo.output_height : cInfo.output_width;
+            unsigned int orientedHeight = transpose ? cInfo.output_width : cInfo.output_height;
+
+            if ( options.region.x >= orientedWidth || options.region.y >= orientedHeight )
+            {
+                jpeg_abort_decompress( &cInfo );
+                jpeg_destroy_decompress( &cInfo );
+                fclose( file );
+                return false;
+            }
+
+            unsigned int regionWidth = std::min( options.region.width, orientedWidth - options.region.x );
+            unsigned int regionHeight = std::min( options.region.height, orientedHeight - options.region.y );
+            unsigned int x = flipHorizontal ? orientedWidth - options.region.x - regionWidth : options.region.x;
+            unsigned int y = flipVertical ? orientedHeight - options.region.y - regionHeight : options.region.y;
+
+            region = transpose ? Rect( y, x, regionHeight, regionWidth ) : Rect( x, y, regionWidth, regionHeight );
+        }
+
+        unsigned int width = region.width;
+        unsigned int height = region.height;
+        unsigned int outputWidth = transpose ? height : width;
+        unsigned int outputHeight = transpose ? width : height;
+
+        // Where the decoded pixels go in the output image
+        unsigned int firstOutputRow = 0;
+        unsigned int firstOutputColumn = 0;
+
+        if ( options.reuseImage )
+        {
+            firstOutputRow = options.destinationRow;
+            firstOutputColumn = options.destinationColumn;
+
+            if ( image.getColorSpace() != colorSpace ||
+                 firstOutputColumn > image.getWidth() || outputWidth > image.getWidth() - firstOutputColumn ||
+                 firstOutputRow > image.getHeight() || outputHeight > image.getHeight() - firstOutputRow )
+            {
+                jpeg_abort_decompress( &cInfo );
+                jpeg_destroy_decompress( &cInfo );
+                fclose( file );
+                return false;
+            }
+        }
+        else
+        {
+            image.create( outputWidth, outputHeight, colorSpace );
+        }
+
+        // Skip the columns and scanlines that are outside the region. Only the
+        // iMCU columns and rows covering it are decoded by libjpeg-turbo.
+        // Other libjpeg implementations decode whole scanlines, and the region
+        // columns are copied from them.
+        unsigned int cropOffset = region.x;
+
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+        if ( width < cInfo.output_width )
+        {
+            // Moves xOffset left to an iMCU boundary and widens cropWidth. One
+            // extra column on each side keeps a region that starts or ends at
+            // a boundary away from the edges of the decoded area, where
+            // chroma upsampling has no neighbours.
+            JDIMENSION xOffset = region.x > 0 ? region.x - 1 : 0;
+            JDIMENSION cropWidth = std::min( region.x + width + 1, (unsigned int) cInfo.output_width ) - xOffset;
+            jpeg_crop_scanline( &cInfo, &xOffset, &cropWidth );
+            cropOffset = region.x - xOffset;
+        }
+
+        if ( region.y > 0 )
+        {
+            jpeg_skip_scanlines( &cInfo, region.y );
+        }
+#endif
+
+        bool directRead = cropOffset == 0 && cInfo.output_width == width;
+        std::vector<BYTE> scanline( cInfo.output_width * numberOfChannels );
+
+        while ( cInfo.output_scanline < region.y )
+        {
+            JSAMPROW rowPointer = &scanline[0];
+            jpeg_read_scanlines( &cInfo, &rowPointer, 1 );
+        }
+
+        // Read the next scanlines of the region
+        auto readScanlines = [&]( JSAMPROW* rowPointers, unsigned int count )
+        {
+            for ( unsigned int i = 0; i < count; ++i )
+            {
+                // libjpeg data structure for storing one row, that is, scanline of an image
+                JSAMPROW rowPointer = directRead ? rowPointers[i] : &scanline[0];
+                jpeg_read_scanlines( &cInfo, &rowPointer, 1 );
+
+                if ( !directRead )
+                {
+                    std::memcpy( rowPointers[i], &scanline[cropOffset * numberOfChannels], width * numberOfChannels );
+                }
+            }
+        };
+
+        if ( !transpose )
+        {
+            // Read one scan line at a time straight into its final row
+            for ( unsigned int row = 0; row < height; ++row )
+            {
+                JSAMPROW rowPointer = image( firstOutputRow + ( flipVertical ? height - 1 - row : row ), firstOutputColumn );
+                readScanlines( &rowPointer, 1 );
+
+                if ( flipHorizontal )
+                {
+                    reversePixels( rowPointer, width, numberOfChannels );
+                }
+            }
+        }
+        else
+        {
+            // Scanlines become columns. Decode a small strip of scanlines and
+            // scatter it as a band of columns, so each destination row receives
+            // a contiguous run of pixels instead of a single one.
+            const unsigned int stripHeight = 16;
+            std::vector<BYTE> strip( stripHeight * width * numberOfChannels );
+
+            JSAMPROW rowPointers[stripHeight];
+            for ( unsigned int i = 0; i < stripHeight; ++i )
+            {
+                rowPointers[i] = &strip[i * width * numberOfChannels];
+            }
+
+            for ( unsigned int firstRow = 0; firstRow < height; firstRow += stripHeight )
+            {
+                unsigned int rows = std::min( stripHeight, height - firstRow );
+                readScanlines( rowPointers, rows );
+
+                for ( unsigned int column = 0; column < width; ++column )
+                {
+                    BYTE* destination = image( firstOutputRow + ( flipVertical ? width - 1 - column : column ), firstOutputColumn );
+                    const BYTE* source = &strip[column * numberOfChannels];
+
+                    for ( unsigned int i = 0; i < rows; ++i, source += width * numberOfChannels )
+                    {
+                        unsigned int row = firstRow + i;
+                        BYTE* pixel = destination + ( flipHorizontal ? height - 1 - row : row ) * numberOfChannels;
+
+                        for ( unsigned int c = 0; c < numberOfChannels; ++c )
+                        {
+                            pixel[c] = source[c];
+                        }
+                    }
+                }
+            }
+        }
+
+        // Wrap up decompression, destroy objects, free pointers and close open
+        // files. Scanlines below the region are never decoded.
+        if ( cInfo.output_scanline < cInfo.output_height )
+        {
+            jpeg_abort_decompress( &cInfo );
+        }
+        else
+        {
+            jpeg_finish_decompress( &cInfo );
         }
 
-        // Wrap up decompression, destroy objects, free pointers and close open files
-        jpeg_finish_decompress( &cInfo );
         jpeg_destroy_decompress( &cInfo );
         fclose( file );
 
@@ -181,14 +502,37 @@ namespace owl
             case owl::ColorSpace::Type::RGBA:
                 cinfo.in_color_space = JCS_EXT_RGBA;
                 break;
+
+            case owl::ColorSpace::Type::BGR:
+                cinfo.in_color_space = JCS_EXT_BGR;
+                break;
+
+            case owl::ColorSpace::Type::BGRA:
+                cinfo.in_color_space = JCS_EXT_BGRA;
+                break;
+
+            case owl::ColorSpace::Type::ARGB:
+                cinfo.in_color_space = JCS_EXT_ARGB;
+                break;
+
+            case owl::ColorSpace::Type::ABGR:
+                cinfo.in_color_space = JCS_EXT_ABGR;
+                break;
+
+            case owl::ColorSpace::Type::CMYK:
+                cinfo.in_color_space = JCS_CMYK;
+                break;
                 
             default:
+                jpeg_destroy_compress(&cinfo);
+                fclose(outfile);
                 return false;
         }
         
         // Default compression parameters, we shouldn't be worried about these
+        // (this also sets the number of components of the file, which is not
+        // the number of channels of the image for formats with alpha)
         jpeg_set_defaults(&cinfo);
-        cinfo.num_components = image.getNumberOfChannels();
         //cinfo.data_precision = 4;
         cinfo.dct_method = JDCT_FLOAT;
         jpeg_set_quality(&cinfo, quality, TRUE);
@@ -213,4 +557,439 @@ namespace owl
 
         return true;
     }
+    
+    bool ImageFile::transformJPEG( const std::string& inputPath, const std::string& outputPath, Transform transform, const Rect& crop )
+    {
+        FILE* inputFile = fopen( inputPath.c_str(), "rb" );
+
+        if ( inputFile == nullptr )
+        {
+            return false;
+        }
+
+        struct jpeg_decompress_struct srcInfo;
+        struct jpeg_compress_struct dstInfo;
+        struct jpeg_error_mgr jSrcError;
+        struct jpeg_error_mgr jDstError;
+
+        srcInfo.err = jpeg_std_error( &jSrcError );
+        jpeg_create_decompress( &srcInfo );
+        dstInfo.err = jpeg_std_error( &jDstError );
+        jpeg_create_compress( &dstInfo );
+
+        jpeg_stdio_src( &srcInfo, inputFile );
+
+        // Keep comments and application markers (EXIF, ICC profile, ...)
+        jpeg_save_markers( &srcInfo, JPEG_COM, 0xFFFF );
+        for ( int marker = 0; marker < 16; ++marker )
+        {
+            jpeg_save_markers( &srcInfo, JPEG_APP0 + marker, 0xFFFF );
+        }
+
+        jpeg_read_header( &srcInfo, TRUE );
+
+        bool transpose, flipHorizontal, flipVertical;
+        decomposeTransform( transform, transpose, flipHorizontal, flipVertical );
+
+        // Size of an iMCU in pixels. Non-interleaved (single component) files
+        // are coded in single blocks regardless of the sampling factors.
+        bool singleComponent = srcInfo.num_components == 1;
+        unsigned int mcuWidth = singleComponent ? DCTSIZE : srcInfo.max_h_samp_factor * DCTSIZE;
+        unsigned int mcuHeight = singleComponent ? DCTSIZE : srcInfo.max_v_samp_factor * DCTSIZE;
+
+        // Source region, with its origin aligned to the iMCU grid
+        unsigned int x0 = 0;
+        unsigned int y0 = 0;
+        unsigned int width = srcInfo.image_width;
+        unsigned int height = srcInfo.image_height;
+
+        if ( !crop.isEmpty() )
+        {
+            if ( crop.x >= width || crop.y >= height )
+            {
+                jpeg_destroy_compress( &dstInfo );
+                jpeg_destroy_decompress( &srcInfo );
+                fclose( inputFile );
+                return false;
+            }
+
+            x0 = ( crop.x / mcuWidth ) * mcuWidth;
+            y0 = ( crop.y / mcuHeight ) * mcuHeight;
+            width = std::min( crop.x + crop.width, width ) - x0;
+            height = std::min( crop.y + crop.height, height ) - y0;
+        }
+
+        // A mirrored axis must be made of whole iMCUs, otherwise the partial
+        // iMCU would end up at the start of the axis. Trim it.
+        if ( flipHorizontal )
+        {
+            if ( transpose )
+            {
+                height -= height % mcuHeight;
+            }
+            else
+            {
+                width -= width % mcuWidth;
+            }
+        }
+
+        if ( flipVertical )
+        {
+            if ( transpose )
+            {
+                width -= width % mcuWidth;
+            }
+            else
+            {
+                height -= height % mcuHeight;
+            }
+        }
+
+        if ( width == 0 || height == 0 )
+        {
+            jpeg_destroy_compress( &dstInfo );
+            jpeg_destroy_decompress( &srcInfo );
+            fclose( inputFile );
+            return false;
+        }
+
+        // Request the destination coefficient arrays before the source is
+        // read, so that libjpeg realizes all of them at once.
+        jvirt_barray_ptr dstArrays[MAX_COMPONENTS];
+        JDIMENSION dstWidthInBlocks[MAX_COMPONENTS];
+        JDIMENSION dstHeightInBlocks[MAX_COMPONENTS];
+
+        // Number of meaningful blocks along each destination axis. Blocks past
+        // them only exist to complete the last MCU.
+        JDIMENSION usedWidthInBlocks[MAX_COMPONENTS];
+        JDIMENSION usedHeightInBlocks[MAX_COMPONENTS];
+
+        for ( int c = 0; c < srcInfo.num_components; ++c )
+        {
+            const jpeg_component_info& component = srcInfo.comp_info[c];
+            unsigned int hSamp = singleComponent ? 1 : component.h_samp_factor;
+            unsigned int vSamp = singleComponent ? 1 : component.v_samp_factor;
+
+            // Size in blocks of the region for this component, rounded up to
+            // whole MCUs as required by the coefficient controller.
+            JDIMENSION regionWidth = ( width * hSamp + mcuWidth - 1 ) / mcuWidth;
+            JDIMENSION regionHeight = ( height * vSamp + mcuHeight - 1 ) / mcuHeight;
+
+            usedWidthInBlocks[c] = transpose ? regionHeight : regionWidth;
+            usedHeightInBlocks[c] = transpose ? regionWidth : regionHeight;
+
+            regionWidth = ( regionWidth + hSamp - 1 ) / hSamp * hSamp;
+            regionHeight = ( regionHeight + vSamp - 1 ) / vSamp * vSamp;
+
+            dstWidthInBlocks[c] = transpose ? regionHeight : regionWidth;
+            dstHeightInBlocks[c] = transpose ? regionWidth : regionHeight;
+
+            dstArrays[c] = ( *srcInfo.mem->request_virt_barray )( (j_common_ptr) &srcInfo, JPOOL_IMAGE, FALSE,
+                                                                  dstWidthInBlocks[c], dstHeightInBlocks[c],
+                                                                  transpose ? hSamp : vSamp );
+        }
+
+        jvirt_barray_ptr* srcArrays = jpeg_read_coefficients( &srcInfo );
+
+        // Destination parameters
+        jpeg_copy_critical_parameters( &srcInfo, &dstInfo );
+        dstInfo.image_width = transpose ? height : width;
+        dstInfo.image_height = transpose ? width : height;
+
+        if ( srcInfo.progressive_mode )
+        {
+            jpeg_simple_progression( &dstInfo );
+        }
+
+        for ( int c = 0; c < dstInfo.num_components; ++c )
+        {
+            jpeg_component_info& component = dstInfo.comp_info[c];
+
+            if ( singleComponent )
+            {
+                component.h_samp_factor = 1;
+                component.v_samp_factor = 1;
+            }
+            else if ( transpose )
+            {
+                std::swap( component.h_samp_factor, component.v_samp_factor );
+            }
+        }
+
+        if ( transpose )
+        {
+            // Coefficients are transposed, and so must be their quantizers
+            for ( int t = 0; t < NUM_QUANT_TBLS; ++t )
+            {
+                JQUANT_TBL* table = dstInfo.quant_tbl_ptrs[t];
+
+                if ( table != nullptr )
+                {
+                    for ( int v = 0; v < DCTSIZE; ++v )
+                    {
+                        for ( int u = v + 1; u < DCTSIZE; ++u )
+                        {
+                            std::swap( table->quantval[v * DCTSIZE + u], table->quantval[u * DCTSIZE + v] );
+                        }
+                    }
+                }
+            }
+        }
+
+        // Move the blocks. Each destination block comes from one source block
+        // whose coefficients are transposed and/or have their odd
+        // frequencies negated (mirroring a cosine basis function flips the
+        // sign of odd frequencies).
+        for ( int c = 0; c < srcInfo.num_components; ++c )
+        {
+            const jpeg_component_info& component = srcInfo.comp_info[c];
+            unsigned int hSamp = singleComponent ? 1 : component.h_samp_factor;
+            unsigned int vSamp = singleComponent ? 1 : component.v_samp_factor;
+
+            JDIMENSION srcX0 = x0 / mcuWidth * hSamp;
+            JDIMENSION srcY0 = y0 / mcuHeight * vSamp;
+            JDIMENSION srcWidth = ( component.width_in_blocks + hSamp - 1 ) / hSamp * hSamp;
+            JDIMENSION srcHeight = ( component.height_in_blocks + vSamp - 1 ) / vSamp * vSamp;
+
+            JDIMENSION usedWidth = usedWidthInBlocks[c];
+            JDIMENSION usedHeight = usedHeightInBlocks[c];
+
+            for ( JDIMENSION by = 0; by < dstHeightInBlocks[c]; ++by )
+            {
+                JBLOCKROW dstRow = ( *srcInfo.mem->access_virt_barray )( (j_common_ptr) &srcInfo, dstArrays[c], by, 1, TRUE )[0];
+
+                for ( JDIMENSION bx = 0; bx < dstWidthInBlocks[c]; ++bx )
+                {
+                    JCOEF* dst = dstRow[bx];
+
+                    // Position in the transposed region
+                    JDIMENSION ty = ( flipVertical && by < usedHeight ) ? usedHeight - 1 - by : by;
+                    JDIMENSION tx = ( flipHorizontal && bx < usedWidth ) ? usedWidth - 1 - bx : bx;
+
+                    JDIMENSION sy = srcY0 + ( transpose ? tx : ty );
+                    JDIMENSION sx = srcX0 + ( transpose ? ty : tx );
+
+                    if ( sy >= srcHeight || sx >= srcWidth )
+                    {
+                        std::memset( dst, 0, sizeof(JBLOCK) );
+                        continue;
+                    }
+
+                    const JCOEF* src = ( *srcInfo.mem->access_virt_barray )( (j_common_ptr) &srcInfo, srcArrays[c], sy, 1, FALSE )[0][sx];
+
+                    for ( int v = 0; v < DCTSIZE; ++v )
+                    {
+                        for ( int u = 0; u < DCTSIZE; ++u )
+                        {
+                            JCOEF value = transpose ? src[u * DCTSIZE + v] : src[v * DCTSIZE + u];
+                            bool negate = ( flipHorizontal && ( u & 1 ) ) != ( flipVertical && ( v & 1 ) );
+                            dst[v * DCTSIZE + u] = negate ? -value : value;
+                        }
+                    }
+                }
+            }
+        }
+
+        FILE* outputFile = fopen( outputPath.c_str(), "wb" );
+
+        if ( outputFile == nullptr )
+        {
+            jpeg_destroy_compress( &dstInfo );
+            jpeg_finish_decompress( &srcInfo );
+            jpeg_destroy_decompress( &srcInfo );
+            fclose( inputFile );
+            return false;
+        }
+
+        jpeg_stdio_dest( &dstInfo, outputFile );
+        jpeg_write_coefficients( &dstInfo, dstArrays );
+
+        // Copy markers, except for the ones libjpeg already writes by itself
+        for ( jpeg_saved_marker_ptr marker = srcInfo.marker_list; marker != nullptr; marker = marker->next )
+        {
+            const JOCTET* data = marker->data;
+
+            if ( dstInfo.write_JFIF_header && marker->marker == JPEG_APP0 &&
+                 marker->data_length >= 5 && std::memcmp( data, "JFIF", 5 ) == 0 )
+            {
+                continue;
+            }
+
+            if ( dstInfo.write_Adobe_marker && marker->marker == JPEG_APP0 + 14 &&
+                 marker->data_length >= 5 && std::memcmp( data, "Adobe", 5 ) == 0 )
+            {
+                continue;
+            }
+
+            // The pixels no longer have the stored orientation: reset it to
+            // 1 (upright) so that it is not applied again when loading
+            bool littleEndian;
+            unsigned int orientation = 0;
+
+            if ( transform != Transform::NONE && marker->marker == JPEG_APP0 + 1 )
+            {
+                orientation = findExifOrientation( data, marker->data_length, littleEndian );
+            }
+
+            if ( orientation != 0 )
+            {
+                std::vector<JOCTET> exif( data, data + marker->data_length );
+                exif[orientation] = littleEndian ? 1 : 0;
+                exif[orientation + 1] = littleEndian ? 0 : 1;
+                jpeg_write_marker( &dstInfo, marker->marker, &exif[0], marker->data_length );
+            }
+            else
+            {
+                jpeg_write_marker( &dstInfo, marker->marker, data, marker->data_length );
+            }
+        }
+
+        jpeg_finish_compress( &dstInfo );
+        jpeg_destroy_compress( &dstInfo );
+        jpeg_finish_decompress( &srcInfo );
+        jpeg_destroy_decompress( &srcInfo );
+        fclose( outputFile );
+        fclose( inputFile );
+
+        return true;
+    }
+
+    void ImageFile::decomposeTransform( Transform transform, bool& transpose, bool& flipHorizontal, bool& flipVertical )
+    {
+        transpose = transform == Transform::TRANSPOSE || transform == Transform::TRANSVERSE ||
+                    transform == Transform::ROTATE_90 || transform == Transform::ROTATE_270;
+
+        flipHorizontal = transform == Transform::FLIP_HORIZONTAL || transform == Transform::TRANSVERSE ||
+                         transform == Transform::ROTATE_90 || transform == Transform::ROTATE_180;
+
+        flipVertical = transform == Transform::FLIP_VERTICAL || transform == Transform::TRANSVERSE ||
+                       transform == Transform::ROTATE_180 || transform == Transform::ROTATE_270;
+    }
+
+    ImageFile::Transform ImageFile::readOrientationJPEG( const std::string& path )
+    {
+        FILE* file = fopen( path.c_str(), "rb" );
+
+        if ( file == nullptr )
+        {
+            return Transform::NONE;
+        }
+
+        struct jpeg_decompress_struct cInfo;
+        struct jpeg_error_mgr jError;
+
+        cInfo.err = jpeg_std_error( &jError );
+        jpeg_create_decompress( &cInfo );
+        jpeg_stdio_src( &cInfo, file );
+        jpeg_save_markers( &cInfo, JPEG_APP0 + 1, 0xFFFF );
+        jpeg_read_header( &cInfo, TRUE );
+
+        Transform orientation = Transform::NONE;
+        for ( jpeg_saved_marker_ptr marker = cInfo.marker_list; marker != nullptr && orientation == Transform::NONE; marker = marker->next )
+        {
+            orientation = parseExifOrientation( marker->data, marker->data_length );
+        }
+
+        jpeg_destroy_decompress( &cInfo );
+        fclose( file );
+
+        return orientation;
+    }
+
+    ImageFile::Transform ImageFile::parseExifOrientation( const BYTE* data, unsigned int length )
+    {
+        bool littleEndian;
+        unsigned int offset = findExifOrientation( data, length, littleEndian );
+
+        if ( offset == 0 )
+        {
+            return Transform::NONE;
+        }
+
+        switch ( littleEndian ? data[offset] | ( data[offset + 1] << 8 ) : ( data[offset] << 8 ) | data[offset + 1] )
+        {
+            case 2: return Transform::FLIP_HORIZONTAL;
+            case 3: return Transform::ROTATE_180;
+            case 4: return Transform::FLIP_VERTICAL;
+            case 5: return Transform::TRANSPOSE;
+            case 6: return Transform::ROTATE_90;
+            case 7: return Transform::TRANSVERSE;
+            case 8: return Transform::ROTATE_270;
+            default: return Transform::NONE;
+        }
+    }
+
+    unsigned int ImageFile::findExifOrientation( const BYTE* data, unsigned int length, bool& littleEndian )
+    {
+        // EXIF block layout:
+        //   "Exif\0\0"
+        //   TIFF header: byte order ("II" or "MM"), 42, offset of IFD0
+        //   IFD0: number of entries, then 12-byte entries (tag, type, count, value)
+        const unsigned int tiffStart = 6;
+
+        if ( length < tiffStart + 8 || std::memcmp( data, "Exif\0\0", 6 ) != 0 )
+        {
+            return 0;
+        }
+
+        const BYTE* tiff = data + tiffStart;
+        unsigned int tiffLength = length - tiffStart;
+
+        if ( tiff[0] == 'I' && tiff[1] == 'I' )
+        {
+            littleEndian = true;
+        }
+        else if ( tiff[0] == 'M' && tiff[1] == 'M' )
+        {
+            littleEndian = false;
+        }
+        else
+        {
+            return 0;
+        }
+
+        auto read16 = [&]( unsigned int offset ) -> unsigned int
+        {
+            return littleEndian ? tiff[offset] | ( tiff[offset + 1] << 8 ) :
+                                  ( tiff[offset] << 8 ) | tiff[offset + 1];
+        };
+
+        auto read32 = [&]( unsigned int offset ) -> uint32_t
+        {
+            return littleEndian ? read16( offset ) | ( read16( offset + 2 ) << 16 ) :
+                                  ( read16( offset ) << 16 ) | read16( offset + 2 );
+        };
+
+        if ( read16( 2 ) != 42 )
+        {
+            return 0;
+        }
+
+        uint32_t ifdOffset = read32( 4 );
+
+        if ( ifdOffset > tiffLength - 2 )
+        {
+            return 0;
+        }
+
+        unsigned int numberOfEntries = read16( ifdOffset );
+
+        for ( unsigned int i = 0; i < numberOfEntries; ++i )
+        {
+            uint32_t entry = ifdOffset + 2 + i * 12;
+
+            if ( entry + 12 > tiffLength )
+            {
+                break;
+            }
+
+            // Orientation tag, a SHORT value stored in the entry itself
+            if ( read16( entry ) == 0x0112 && read16( entry + 2 ) == 3 )
+            {
+                return tiffStart + entry + 8;
+            }
+        }
+
+        return 0;
+    }
 }
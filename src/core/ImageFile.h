@@ -28,6 +28,92 @@ namespace owl
                 JPEG
             };
 
+            /**
+             * Geometric transformations that can be applied losslessly to an
+             * image file, i.e. without decoding and re-encoding its pixels.
+             */
+            enum class Transform
+            {
+                NONE,
+                FLIP_HORIZONTAL,    // Mirror around the vertical axis
+                FLIP_VERTICAL,      // Mirror around the horizontal axis
+                TRANSPOSE,          // Mirror around the top-left/bottom-right diagonal
+                TRANSVERSE,         // Mirror around the top-right/bottom-left diagonal
+                ROTATE_90,          // Rotate 90 degrees clockwise
+                ROTATE_180,
+                ROTATE_270          // Rotate 270 degrees clockwise
+            };
+
+            /**
+             * Options to control how an image file is loaded.
+             */
+            struct LoadOptions
+            {
+                LoadOptions() :
+                    colorSpace( ColorSpace::Type::UNKNOWN ),
+                    applyOrientation( false ),
+                    minimumWidth( 0 ),
+                    minimumHeight( 0 ),
+                    reuseImage( false ),
+                    destinationRow( 0 ),
+                    destinationColumn( 0 )
+                {
+                }
+
+                /**
+                 * Color space of the loaded image. The decoder writes pixels
+                 * directly in this layout (e.g. BGRA for display surfaces),
+                 * so no conversion pass is needed afterwards. UNKNOWN
+                 * (default) keeps the color space of the file. CMYK can only
+                 * be requested for CMYK files, which can not be loaded in any
+                 * other color space.
+                 */
+                ColorSpace::Type colorSpace;
+
+                /**
+                 * If true, the orientation stored in the file metadata (EXIF
+                 * orientation tag) is applied while the pixels are decoded,
+                 * so the loaded image is upright. The transformation is
+                 * fused into the decoding, so no extra pass or buffer is
+                 * needed.
+                 */
+                bool applyOrientation;
+
+                /**
+                 * Region of the image to be decoded, in the coordinates of the
+                 * loaded image (i.e. after the orientation is applied). It is
+                 * clipped to the image bounds. Only the parts of the file
+                 * covering the region are decoded when the decoder supports
+                 * it. An empty rectangle (default) decodes the whole image.
+                 */
+                Rect region;
+
+                /**
+                 * If not zero, the image is decoded at the smallest reduced
+                 * size (1/2, 1/4 or 1/8 for JPEG files) that is still at least
+                 * minimumWidth x minimumHeight. The reduction is done by the
+                 * decoder (on the DCT coefficients for JPEG files), so it is
+                 * much faster than decoding the full image, and is meant as the
+                 * coarse first step of a downscale: load with the target size
+                 * as minimum, then ImageOperator::resize() to the exact size.
+                 * The minimum size and the region are given in the
+                 * coordinates of the loaded image.
+                 */
+                unsigned int minimumWidth;
+                unsigned int minimumHeight;
+
+                /**
+                 * If true, the decoded pixels are written into the Image
+                 * passed to load() at (destinationRow, destinationColumn)
+                 * instead of reallocating it. The image must have the color
+                 * space of the file and be large enough to hold the decoded
+                 * region at that position, otherwise loading fails.
+                 */
+                bool reuseImage;
+                unsigned int destinationRow;
+                unsigned int destinationColumn;
+            };
+
             /**
              * Load an image file into an Image object.
              * 
@@ -35,8 +121,19 @@ namespace owl
              * extension is correct.
              * @param path File path.
              * @param image An Image object to be populated with the loaded image.
+             * @param options (Optional) Loading options.
              */
-            static bool load( const std::string& path, ImageByte& image );
+            static bool load( const std::string& path, ImageByte& image, const LoadOptions& options = LoadOptions() );
+
+            /**
+             * Read the orientation stored in the metadata of an image file
+             * (EXIF orientation tag), without decoding its pixels.
+             * @param path File path.
+             * @return The transformation that must be applied to the stored
+             * pixels to display the image upright. Transform::NONE if the file
+             * has no orientation information or can not be read.
+             */
+            static Transform readOrientation( const std::string& path );
             
             /**
              * Save an Image into an image file.
@@ -48,6 +145,31 @@ namespace owl
              */
             static bool save( const std::string& path, const ImageByte& image );
 
+            /**
+             * Apply a lossless transformation and/or crop to an image file and
+             * save the result into another file of the same format.
+             * 
+             * For JPEG files the transformation is done directly on the DCT
+             * coefficients, so there is no generation loss and it is much
+             * faster than a load/transform/save cycle. As a consequence:
+             * - The crop origin is moved up/left to the nearest iMCU boundary
+             *   (8 or 16 pixels, depending on the chroma subsampling). The
+             *   crop is extended so that it still covers the requested area.
+             * - Flips and rotations can not move partial iMCUs at the right or
+             *   bottom edges, so these edges are trimmed when needed.
+             * Metadata markers (EXIF, ICC profiles, comments) are copied. When
+             * transform is not Transform::NONE the EXIF orientation tag is set
+             * to 1 (upright), so that readOrientation() on the output returns
+             * Transform::NONE and the orientation is not applied twice.
+             * @param inputPath Source file path.
+             * @param outputPath Destination file path. Must not be inputPath.
+             * @param transform Transformation to be applied.
+             * @param crop (Optional) Region of the source image to keep. An
+             * empty rectangle (default) keeps the whole image.
+             * @return True if the output file was successfully written.
+             */
+            static bool transform( const std::string& inputPath, const std::string& outputPath, Transform transform, const Rect& crop = Rect() );
+
         private:
             
             /**
@@ -78,8 +200,15 @@ namespace owl
              * Load a jpeg file using libjpeg
              * @param path File path.
              * @param image An Image object to be populated with the loaded image.
+             * @param options Loading options.
+             */
+            static bool loadJPEG( const std::string& path, ImageByte& image, const LoadOptions& options );
+
+            /**
+             * Read the orientation of a jpeg file from its EXIF marker.
+             * @param path File path.
              */
-            static bool loadJPEG( const std::string& path, ImageByte& image );
+            static Transform readOrientationJPEG( const std::string& path );
             
             /**
              * Save a jpeg file using libjpeg
@@ -87,6 +216,47 @@ namespace owl
              * @param image An Image object to be saved into path.
              */
             static bool saveJPEG( const std::string& path, const ImageByte& image, int quality );
+
+            /**
+             * Losslessly transform a jpeg file using libjpeg's coefficient
+             * access API.
+             * @param inputPath Source file path.
+             * @param outputPath Destination file path.
+             * @param transform Transformation to be applied.
+             * @param crop Region of the source image to keep.
+             */
+            static bool transformJPEG( const std::string& inputPath, const std::string& outputPath, Transform transform, const Rect& crop );
+
+            /**
+             * Decompose a transformation into a transposition followed by
+             * horizontal and/or vertical flips.
+             * @param transform A transformation.
+             * @param transpose Set to true if the transformation transposes.
+             * @param flipHorizontal Set to true if columns are mirrored after
+             * the transposition.
+             * @param flipVertical Set to true if rows are mirrored after the
+             * transposition.
+             */
+            static void decomposeTransform( Transform transform, bool& transpose, bool& flipHorizontal, bool& flipVertical );
+
+            /**
+             * Parse the orientation tag of an EXIF block.
+             * @param data EXIF block, starting with the "Exif" identifier.
+             * @param length Length of the block in bytes.
+             * @return The transformation that brings the image upright, or
+             * Transform::NONE if there is no valid orientation tag.
+             */
+            static Transform parseExifOrientation( const BYTE* data, unsigned int length );
+
+            /**
+             * Find the value of the orientation tag of an EXIF block.
+             * @param data EXIF block, starting with the "Exif" identifier.
+             * @param length Length of the block in bytes.
+             * @param littleEndian Set to the byte order of the block.
+             * @return Offset in data of the 16-bit orientation value, or 0 if
+             * there is no valid orientation tag.
+             */
+            static unsigned int findExifOrientation( const BYTE* data, unsigned int length, bool& littleEndian );
     };
 }
 #endif	// IMAGE_FILE_H
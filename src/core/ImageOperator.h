@@ -11,7 +11,23 @@
 #ifndef IMAGE_OPERATOR_H
 #define IMAGE_OPERATOR_H
 
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FFT.h"
+#include "Histogram.h"
 #include "Image.h"
+#include "IntegralImage.h"
+#include "LUT.h"
+#include "Parallel.h"
+#include "RemapTable.h"
+#include "Simd.h"
 
 
 namespace owl
@@ -31,7 +47,8 @@ namespace owl
              * @param imageA An input image.
              * @param imageB An input image.
              */
-            static void template<typename Channel> add( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB );
+            template<typename Channel>
+            static void add( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB );
             
             /**
              * Compute the difference of two images. The output image and the
@@ -44,7 +61,8 @@ namespace owl
              * @param imageA An input image.
              * @param imageB An input image.
              */
-            static void template<typename Channel> subtract( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB );
+            template<typename Channel>
+            static void subtract( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB );
             
             /**
              * Multiply an image by a scalar value. The output image and the
@@ -57,7 +75,8 @@ namespace owl
              * @param inputImage An input image.
              * @param scalar A scalar value.
              */
-            static void template<typename Channel, typename S> multiply( Image<Channel>& outputImage, const Image<Channel>& inputImage, const S scalar );
+            template<typename Channel, typename S>
+            static void multiply( Image<Channel>& outputImage, const Image<Channel>& inputImage, const S scalar );
             
             /**
              * Multiply two images pixel by pixel. The output image can not be
@@ -70,7 +89,8 @@ namespace owl
              * @param imageA An input image.
              * @param imageB An input image.
              */
-            static void template<typename Channel> multiply( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB );
+            template<typename Channel>
+            static void multiply( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB );
             
             /**
              * Compute a grayscale image from an RGB image using the following
@@ -85,43 +105,7235 @@ namespace owl
              * @param outputImage The grayscale resulting image.
              * @param inputImage A RGB image.
              */
-            static void template<typename Channel> luminance( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+            template<typename Channel>
+            static void luminance( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Reorder, drop or insert channels to convert an image to another
+             * channel layout, e.g. RGB to BGR, RGBA to RGB (drop alpha), RGB
+             * to BGRA (insert an opaque alpha) or grayscale to RGB
+             * (replicate). Channels are matched by name; an alpha channel
+             * missing in the input is set to opaque (the maximum value of the
+             * channel type, or 1 for floating point types). Conversions that
+             * need arithmetic (e.g. RGB to grayscale, RGB to CMYK or HSV) are
+             * not swizzles and leave the output image untouched, see
+             * convertColor().
+             * 
+             * The output image and the input image can be the same if both
+             * color spaces have the same number of channels.
+             * @param outputImage The reordered image.
+             * @param inputImage An input image.
+             * @param colorSpace Color space of the output image.
+             */
+            template<typename Channel>
+            static void swizzle( Image<Channel>& outputImage, const Image<Channel>& inputImage, ColorSpace::Type colorSpace );
+
+            /**
+             * Build an image whose channels are taken from arbitrary channels of
+             * an input image.
+             * 
+             * The output image and the input image can be the same if both
+             * color spaces have the same number of channels.
+             * @param outputImage The reordered image.
+             * @param inputImage An input image.
+             * @param colorSpace Color space of the output image.
+             * @param order For each output channel, the index of the input
+             * channel it is copied from, or -1 to set it to opaque (the maximum
+             * value of the channel type, or 1 for floating point types).
+             */
+            template<typename Channel>
+            static void swizzle( Image<Channel>& outputImage, const Image<Channel>& inputImage, ColorSpace::Type colorSpace, const int* order );
+
+            /**
+             * Split an interleaved image into one grayscale image (plane) per
+             * channel.
+             * @param planes The resulting planes, in channel order.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void split( std::vector< Image<Channel> >& planes, const Image<Channel>& inputImage );
+
+            /**
+             * Merge grayscale images (planes) into an interleaved image. All
+             * planes must have the same dimension and there must be one plane
+             * per channel of the output color space.
+             * @param outputImage The interleaved image.
+             * @param planes Input planes, in channel order.
+             * @param colorSpace Color space of the output image.
+             */
+            template<typename Channel>
+            static void merge( Image<Channel>& outputImage, const std::vector< Image<Channel> >& planes, ColorSpace::Type colorSpace );
             
-        private:
+            /**
+             * Convert an image to another channel type, e.g. ImageByte to
+             * ImageFloat, computing:
+             *
+             * o(x, y) = i(x, y) * scale + offset
+             * 
+             * Integer outputs are rounded to the nearest value and saturated to
+             * the range of the output channel type. Common conversions (BYTE to
+             * float and back) are vectorized and large images are processed by
+             * several threads.
+             * @param outputImage The converted image, with the same dimension and
+             * color space as inputImage.
+             * @param inputImage An input image.
+             * @param scale (Optional) Scale factor, e.g. 1.0 / 255 to map BYTE
+             * to [0, 1]. Default is 1.
+             * @param offset (Optional) Offset added after scaling. Default is 0.
+             */
+            template<typename OutputChannel, typename InputChannel>
+            static void convert( Image<OutputChannel>& outputImage, const Image<InputChannel>& inputImage, double scale = 1.0, double offset = 0.0 );
             
             /**
-             * Check if two images have the same color space and dimensions.
-             * @param imageA Input image.
-             * @param imageB Input image.
-             * @return True if they have equal color space.
+             * Filter an image with a separable kernel: each row is filtered
+             * with kernelX and then each column with kernelY. Kernel element i
+             * weights the pixel at offset i - size / 2 (kernels are not
+             * flipped, as usual in image processing).
+             * 
+             * Rows are filtered once into a small ring buffer of kernelY.size()
+             * rows, and wide images are processed in column tiles sized so that
+             * this buffer stays in the L2 cache. BYTE images filtered with
+             * normalized non-negative kernels (smoothing kernels) use 8.8 fixed
+             * point arithmetic in 16-bit SIMD lanes; everything else is
+             * computed in float and saturated to the output channel type.
+             * Large images are processed by several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The filtered image.
+             * @param inputImage An input image.
+             * @param kernelX Horizontal kernel.
+             * @param kernelY Vertical kernel.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
              */
-            static bool template<typename Channel> areCompatible( const Image<Channel>& imageA, const Image<Channel>& imageB );
-    };
-    
-    
+            template<typename Channel>
+            static void convolveSeparable( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                           const std::vector<float>& kernelX, const std::vector<float>& kernelY,
+                                           BorderMode border = BorderMode::REFLECT, double borderValue = 0.0 );
+
+            /**
+             * Blur an image with a Gaussian kernel (see convolveSeparable()).
+             * The output image and the input image can be the same.
+             * @param outputImage The blurred image.
+             * @param inputImage An input image.
+             * @param sigmaX Standard deviation of the Gaussian along rows.
+             * @param sigmaY (Optional) Standard deviation along columns. If 0
+             * (default), sigmaX is used.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT.
+             */
+            template<typename Channel>
+            static void gaussianBlur( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                      double sigmaX, double sigmaY = 0.0, BorderMode border = BorderMode::REFLECT );
+
+            /**
+             * Compute a normalized 1D Gaussian kernel.
+             * @param sigma Standard deviation.
+             * @param radius (Optional) Kernel radius, the kernel has
+             * 2 * radius + 1 elements. If 0 (default), ceil(3 * sigma) is used.
+             * @return The kernel.
+             */
+            static std::vector<float> gaussianKernel( double sigma, unsigned int radius = 0 );
+            
+            /**
+             * Replace each pixel by the mean of the (2 * radiusX + 1) x
+             * (2 * radiusY + 1) box centered on it. The cost per pixel does not
+             * depend on the radii: each row keeps a running horizontal sum, and
+             * a row of running column sums is updated by adding the row that
+             * enters the box and subtracting the row that leaves it. Sums use
+             * the exact accumulators of IntegralImage. Large images are
+             * processed by several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The filtered image.
+             * @param inputImage An input image.
+             * @param radiusX Horizontal radius.
+             * @param radiusY Vertical radius.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void boxFilter( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                   unsigned int radiusX, unsigned int radiusY,
+                                   BorderMode border = BorderMode::REFLECT, double borderValue = 0.0 );
+            
+            /**
+             * Resize an image. Resampling is separable: rows are resampled
+             * horizontally and then combined vertically, both through tables
+             * of per-column and per-row coefficients computed once per call.
+             * When downscaling, the filters are stretched by the scale factor
+             * so the result is antialiased, and factors of 4 or more are first
+             * reduced by area averaging to twice the target size. BYTE images
+             * use 16-bit fixed point coefficients in SIMD lanes, other channel
+             * types are computed in float. Large images are processed by
+             * several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The resized image.
+             * @param inputImage An input image.
+             * @param width Output width.
+             * @param height Output height.
+             * @param interpolation (Optional) Resampling filter. Default is
+             * Interpolation::BILINEAR.
+             */
+            template<typename Channel>
+            static void resize( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                unsigned int width, unsigned int height,
+                                Interpolation interpolation = Interpolation::BILINEAR );
+
+            /**
+             * Resize a region of an image, without copying the region first
+             * (see resize()). Pixels outside the region are not sampled.
+             * @param outputImage The resized image. Can not be inputImage.
+             * @param inputImage An input image.
+             * @param region Region of inputImage to be resized. It is clipped
+             * to the image bounds.
+             * @param width Output width.
+             * @param height Output height.
+             * @param interpolation (Optional) Resampling filter. Default is
+             * Interpolation::BILINEAR.
+             */
+            template<typename Channel>
+            static void resize( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Rect& region,
+                                unsigned int width, unsigned int height,
+                                Interpolation interpolation = Interpolation::BILINEAR );
+
+            /**
+             * Transpose an image: pixel (x, y) moves to (y, x). The image is
+             * split recursively into blocks that fit in the cache, whose tiles
+             * are transposed in SIMD registers when pixels are 1, 2, 4 or 8
+             * bytes (e.g. 16x16 tiles of grayscale bytes). Large images are
+             * processed by several threads.
+             * 
+             * The output image and the input image can be the same. Square
+             * images are then transposed in place.
+             * @param outputImage The transposed image.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void transpose( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Rotate an image 90 degrees clockwise: a transposition followed by
+             * a horizontal flip, done in a single pass (see transpose()).
+             * @param outputImage The rotated image. Can be inputImage; square
+             * images are then rotated in place.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void rotate90( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Rotate an image 180 degrees, i.e. flip it both ways.
+             * @param outputImage The rotated image. Can be inputImage.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void rotate180( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Rotate an image 270 degrees clockwise: a transposition followed
+             * by a vertical flip (see rotate90()).
+             * @param outputImage The rotated image. Can be inputImage; square
+             * images are then rotated in place.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void rotate270( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Mirror an image around its vertical axis. Rows are reversed 16
+             * bytes at a time when pixels are 1, 2, 4 or 8 bytes.
+             * @param outputImage The flipped image. Can be inputImage.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void flipHorizontal( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Mirror an image around its horizontal axis.
+             * @param outputImage The flipped image. Can be inputImage.
+             * @param inputImage An input image.
+             */
+            template<typename Channel>
+            static void flipVertical( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Warp an image with an affine transform, which maps input
+             * coordinates to output coordinates (pixel centers are at integer
+             * coordinates):
+             *     x' = matrix[0] * x + matrix[1] * y + matrix[2]
+             *     y' = matrix[3] * x + matrix[4] * y + matrix[5]
+             * Each output pixel samples the input at the inverse image of its
+             * position. Source positions are stepped along output rows in fixed
+             * point, adding per-column offsets computed once per call, and are
+             * resolved to 1/32 pixel. The output is processed in blocks, so the
+             * input pixels read by a block stay in the cache whatever the
+             * rotation. BYTE images are interpolated in fixed point, in SIMD
+             * lanes for grayscale and 4 channel pixels; other channel types
+             * are interpolated in float. Large images are processed by several
+             * threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The warped image.
+             * @param inputImage An input image.
+             * @param matrix Row-major 2x3 matrix. Nothing is done if it can not
+             * be inverted.
+             * @param width Output width.
+             * @param height Output height.
+             * @param interpolation (Optional) Interpolation::NEAREST,
+             * Interpolation::BILINEAR (default) or Interpolation::BICUBIC.
+             * Interpolation::AREA is computed as BILINEAR and
+             * Interpolation::LANCZOS as BICUBIC.
+             * @param border (Optional) How pixels outside the input image are
+             * sampled. Default is BorderMode::CONSTANT.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void warpAffine( Image<Channel>& outputImage, const Image<Channel>& inputImage, const double* matrix,
+                                    unsigned int width, unsigned int height,
+                                    Interpolation interpolation = Interpolation::BILINEAR,
+                                    BorderMode border = BorderMode::CONSTANT, double borderValue = 0.0 );
+
+            /**
+             * Warp an image with a perspective transform (homography), which
+             * maps input coordinates to output coordinates:
+             *     w  = matrix[6] * x + matrix[7] * y + matrix[8]
+             *     x' = ( matrix[0] * x + matrix[1] * y + matrix[2] ) / w
+             *     y' = ( matrix[3] * x + matrix[4] * y + matrix[5] ) / w
+             * Source positions are computed in double precision along output
+             * rows and sampled as in warpAffine().
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The warped image.
+             * @param inputImage An input image.
+             * @param matrix Row-major 3x3 matrix. Nothing is done if it can not
+             * be inverted.
+             * @param width Output width.
+             * @param height Output height.
+             * @param interpolation (Optional) Interpolation filter, see
+             * warpAffine(). Default is Interpolation::BILINEAR.
+             * @param border (Optional) How pixels outside the input image are
+             * sampled. Default is BorderMode::CONSTANT.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void warpPerspective( Image<Channel>& outputImage, const Image<Channel>& inputImage, const double* matrix,
+                                         unsigned int width, unsigned int height,
+                                         Interpolation interpolation = Interpolation::BILINEAR,
+                                         BorderMode border = BorderMode::CONSTANT, double borderValue = 0.0 );
+
+            /**
+             * Remap an image with a precomputed table (e.g. a lens undistortion
+             * map): output pixel (x, y) samples the input at the position the
+             * table holds for it. The table is traversed in its storage order,
+             * so the geometry costs only a sequential read of 6 bytes per
+             * pixel. Pixels are interpolated as in warpAffine(), with SIMD
+             * bilinear interpolation of BYTE grayscale and 4 channel images.
+             * Large images are processed by several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The remapped image, with the size of the table.
+             * @param inputImage An input image, at most 32767 pixels wide and
+             * high.
+             * @param table Input positions of the output pixels.
+             * @param interpolation (Optional) Interpolation filter, see
+             * warpAffine(). Default is Interpolation::BILINEAR.
+             * @param border (Optional) How pixels outside the input image are
+             * sampled. Default is BorderMode::CONSTANT.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void remap( Image<Channel>& outputImage, const Image<Channel>& inputImage, const RemapTable& table,
+                               Interpolation interpolation = Interpolation::BILINEAR,
+                               BorderMode border = BorderMode::CONSTANT, double borderValue = 0.0 );
+
+            /**
+             * Multiply the color channels of an image by its alpha channel,
+             * e.g. before filtering or resampling it, so that the colors of
+             * transparent pixels do not bleed into their neighbors. Alpha is
+             * normalized by its opaque value (the maximum value of integer
+             * channel types, or 1 for floating point types). BYTE images are
+             * rounded to nearest with exact SIMD integer arithmetic.
+             * 
+             * The output image and the input image can be the same. Images
+             * without an alpha channel leave the output image untouched.
+             * @param outputImage The premultiplied image.
+             * @param inputImage An image with an alpha channel (e.g. RGBA).
+             */
+            template<typename Channel>
+            static void premultiply( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Divide the color channels of a premultiplied image by its alpha
+             * channel, see premultiply(). Colors are saturated, and colors of
+             * fully transparent pixels are set to 0.
+             * 
+             * The output image and the input image can be the same. Images
+             * without an alpha channel leave the output image untouched.
+             * @param outputImage The image with straight colors.
+             * @param inputImage A premultiplied image with an alpha channel.
+             */
+            template<typename Channel>
+            static void unpremultiply( Image<Channel>& outputImage, const Image<Channel>& inputImage );
+
+            /**
+             * Blend an overlay (e.g. a watermark) onto an image with the
+             * Porter-Duff "over" operator. With a the normalized alpha of the
+             * overlay, each color becomes
+             * 
+             * overlay * a + image * (1 - a)
+             * 
+             * on images without alpha, which are opaque. On images with
+             * alpha b, the output alpha is a + b * (1 - a) and the colors are
+             * weighted by a and b * (1 - a) and divided by it (fully
+             * transparent outputs are set to 0). With premultiplied colors,
+             * every channel becomes overlay + image * (1 - a).
+             * 
+             * The overlay needs an alpha channel and the image the color
+             * channels of the overlay, in any order (e.g. BGRA onto RGB). The
+             * overlay is clipped to the image. BYTE images are blended with
+             * SIMD kernels that divide by 255 exactly, fastest when the image
+             * has the channel order of the overlay (e.g. RGBA onto RGB or
+             * RGBA). Rows are blended by several threads for large overlays.
+             * @param image The image, blended in place.
+             * @param overlay An image with an alpha channel.
+             * @param x Column of the image where the left column of the
+             * overlay goes. It can be negative.
+             * @param y Row of the image where the top row of the overlay goes.
+             * It can be negative.
+             * @param premultiplied (Optional) True if the colors of both
+             * images are premultiplied by their alpha. Default is false.
+             */
+            template<typename Channel>
+            static void blendOver( Image<Channel>& image, const Image<Channel>& overlay, int x, int y, bool premultiplied = false );
+
+            /**
+             * Blend a region of an overlay (e.g. a sprite of an atlas) onto an
+             * image, see blendOver().
+             * @param image The image, blended in place.
+             * @param overlay An image with an alpha channel.
+             * @param region Region of the overlay that is blended. It must be
+             * inside the overlay.
+             * @param x Column of the image where the left column of the
+             * region goes. It can be negative.
+             * @param y Row of the image where the top row of the region goes.
+             * It can be negative.
+             * @param premultiplied (Optional) True if the colors of both
+             * images are premultiplied by their alpha. Default is false.
+             */
+            template<typename Channel>
+            static void blendOver( Image<Channel>& image, const Image<Channel>& overlay, const Rect& region,
+                                   int x, int y, bool premultiplied = false );
+
+            /**
+             * Convert an image between an RGB color space (or grayscale, as
+             * input) and HSV, HSL, YCbCr, CIE L*a*b* or planar 4:2:0 YCbCr
+             * (I420, NV12), see ColorSpace::Type for the ranges of the
+             * channels. Input alpha is dropped and output alpha is opaque.
+             * Other pairs of color spaces are converted through RGB, and
+             * pairs of RGB color spaces are swizzled.
+             * 
+             * RGB values are sRGB encoded; they are linearized for L*a*b*
+             * with lookup tables. 4:2:0 chromas are the mean of the chromas of
+             * 2x2 pixel blocks, and they are replicated to the 4 pixels when
+             * decoding. BYTE conversions between RGB and YCbCr, I420 or NV12
+             * use SIMD fixed point matrices, within 1 of the exact values;
+             * other conversions are computed in float. Rows are converted by
+             * several threads.
+             * 
+             * The output image and the input image can be the same.
+             * Unsupported conversions (e.g. to CMYK, or to grayscale) leave
+             * the output image untouched.
+             * @param outputImage The converted image. Planar frames are 3/2 as
+             * high as the input image.
+             * @param inputImage An input image.
+             * @param colorSpace Color space of the output image.
+             * @param standard (Optional) Encoding of YCbCr, I420 and NV12
+             * images. Default is YCbCrStandard::BT601_FULL.
+             */
+            template<typename Channel>
+            static void convertColor( Image<Channel>& outputImage, const Image<Channel>& inputImage, ColorSpace::Type colorSpace,
+                                      YCbCrStandard standard = YCbCrStandard::BT601_FULL );
+
+            /**
+             * Compute statistics of each channel of an image in a single pass:
+             * count, minimum and maximum with their locations, sum, mean,
+             * variance, standard deviation and L1, L2 and infinity norms.
+             * Fixed bands of rows are accumulated by several threads and
+             * reduced in band order, so results do not depend on the number of
+             * threads. BYTE images are accumulated with SIMD integer lanes and
+             * are exact; other types are accumulated in double.
+             * @param stats Statistics of each channel. Mismatched masks leave
+             * it untouched.
+             * @param image An input image.
+             * @param mask (Optional) A grayscale mask of the size of the image:
+             * only pixels where it is nonzero are used. nullptr (default) uses
+             * all pixels.
+             */
+            template<typename Channel>
+            static void statistics( std::vector<ChannelStats>& stats, const Image<Channel>& image, const ImageByte* mask = nullptr );
+
+            /**
+             * Compute statistics of the difference image1 - image2 in a single
+             * pass, see statistics(): its norms are the L1, L2 and infinity
+             * distances between the images, and its mean is their mean error.
+             * @param stats Statistics of each channel. Images of different
+             * layouts leave it untouched.
+             * @param image1 An input image.
+             * @param image2 An input image of the same layout.
+             * @param mask (Optional) A grayscale mask of the size of the
+             * images, nullptr (default) to use all pixels.
+             */
+            template<typename Channel>
+            static void differenceStatistics( std::vector<ChannelStats>& stats, const Image<Channel>& image1,
+                                              const Image<Channel>& image2, const ImageByte* mask = nullptr );
+
+            /**
+             * Compute the peak signal-to-noise ratio between two images,
+             * 10 log10( peak^2 / MSE ), where the mean squared error is taken
+             * over all channels and peak is 255 for BYTE and 1 for floating
+             * point images (see differenceStatistics()).
+             * @param image1 An image.
+             * @param image2 An image of the same layout.
+             * @return PSNR in decibels, infinity for equal images, or NaN if
+             * the images are empty or have different layouts.
+             */
+            template<typename Channel>
+            static double psnr( const Image<Channel>& image1, const Image<Channel>& image2 );
+
+            /**
+             * Compute the mean structural similarity (SSIM) of two images,
+             * with the 11x11 Gaussian window (sigma 1.5) and the constants
+             * K1 = 0.01, K2 = 0.03 of Wang et al., over the pixels where the
+             * window fits in the images, averaged over the channels.
+             * 
+             * Local means, mean squares and mean products are computed in a
+             * single strip-wise pass: each input row is converted to float and
+             * filtered horizontally once into a ring of 11 rows, which is
+             * filtered vertically for each output row, with SIMD kernels. Strips
+             * of rows are processed by several threads and their sums are added
+             * in row order.
+             * @param image1 An image.
+             * @param image2 An image of the same layout.
+             * @return SSIM, 1 for equal images, or NaN if the images have
+             * different layouts or are smaller than the window.
+             */
+            template<typename Channel>
+            static double ssim( const Image<Channel>& image1, const Image<Channel>& image2 );
+
+            /**
+             * Compute the multi-scale structural similarity (MS-SSIM) of two
+             * images: the contrast-structure terms of 5 scales, each half the
+             * size of the previous one (by 2x2 averaging in float), and the
+             * SSIM of the coarsest scale, weighted with the exponents of Wang
+             * et al. (0.0448, 0.2856, 0.3001, 0.2363, 0.1333). Images too small
+             * for 5 scales use the scales whose size fits the 11x11 window,
+             * with renormalized exponents. Negative terms count as 0.
+             * @param image1 An image.
+             * @param image2 An image of the same layout.
+             * @return MS-SSIM, or NaN if the images have different layouts or
+             * are smaller than the window.
+             */
+            template<typename Channel>
+            static double msssim( const Image<Channel>& image1, const Image<Channel>& image2 );
+
+            /**
+             * Compute the 2D discrete Fourier transform of a grayscale
+             * ImageFloat or ImageDouble:
+             *     spectrum(v, u) = sum over rows y and columns x of
+             *         image(y, x) e^(-2 pi i (u x / width + v y / height))
+             * The image is real, so spectrum(v, u) is the complex conjugate of
+             * spectrum(-v, -u), and only columns u = 0 .. width / 2 are stored.
+             * 
+             * Rows are transformed two at a time, as the real and imaginary
+             * parts of one complex FFT whose output is split into their two
+             * spectra, then the columns are transformed, by several threads
+             * for large images (see FFT). Sizes with no prime factors other
+             * than 2, 3 and 5 are the fastest (see FFT::optimalSize()).
+             * @param spectrum The spectrum, height rows of width / 2 + 1
+             * values.
+             * @param image A grayscale image.
+             */
+            template<typename Channel>
+            static void dft( std::vector< std::complex<Channel> >& spectrum, const Image<Channel>& image );
+
+            /**
+             * Compute the inverse of dft(), including the 1 / (width * height)
+             * scale factor, so that the inverse of the spectrum of an image is
+             * the image. The spectrum must be that of a real image, or a
+             * product of such spectra (see dft()).
+             * @param image The grayscale image.
+             * @param spectrum A spectrum of height rows of width / 2 + 1
+             * values.
+             * @param width Image width.
+             * @param height Image height.
+             */
+            template<typename Channel>
+            static void inverseDft( Image<Channel>& image, const std::vector< std::complex<Channel> >& spectrum,
+                                    unsigned int width, unsigned int height );
+
+            /**
+             * Filter an ImageFloat or ImageDouble with a 2D kernel. As with
+             * convolveSeparable(), the kernel is not flipped: element (i, j)
+             * weights the pixel at offset (i - kernel height / 2,
+             * j - kernel width / 2). Each channel is filtered with the same
+             * grayscale kernel.
+             * 
+             * The image is extended by the border, then the kernel is applied
+             * either directly, summing weighted rows in SIMD registers, or in
+             * the frequency domain: the extended image and the kernel are zero
+             * padded to FFT::optimalSize(), transformed with dft(), multiplied
+             * and transformed back. The cheaper method is chosen from the
+             * image and kernel sizes; the FFT wins for kernels larger than
+             * about 13x13 pixels.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The filtered image.
+             * @param inputImage An input image.
+             * @param kernel A grayscale kernel.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void convolve( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Image<Channel>& kernel,
+                                  BorderMode border = BorderMode::REFLECT, double borderValue = 0.0 );
+
+            /**
+             * Cross-correlate an ImageFloat or ImageDouble with a template at
+             * every position where the template fits in the image, for
+             * template matching:
+             *     output(y, x) = sum over i, j of templateImage(i, j) image(y + i, x + j)
+             * Each channel is correlated with the same grayscale template.
+             * Like convolve(), small templates are applied directly and large
+             * ones in the frequency domain.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The correlation, of (width - template width
+             * + 1) x (height - template height + 1) pixels.
+             * @param inputImage An input image.
+             * @param templateImage A grayscale template, not larger than the
+             * image.
+             */
+            template<typename Channel>
+            static void crossCorrelate( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Image<Channel>& templateImage );
+            
+            /**
+             * Erode an image with a (2 * radiusX + 1) x (2 * radiusY + 1)
+             * rectangle: each channel value becomes the minimum of the
+             * rectangle centered on it. The rectangle is decomposed into a
+             * horizontal and a vertical pass. Small passes take the minimum of
+             * shifted rows with SIMD instructions; larger ones use the van
+             * Herk/Gil-Werman algorithm, which needs about three comparisons
+             * per pixel whatever the size. Large images are processed by
+             * several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The eroded image.
+             * @param inputImage An input image.
+             * @param radiusX Horizontal radius.
+             * @param radiusY Vertical radius.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REPLICATE, which is the same as
+             * ignoring them.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void erode( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                               unsigned int radiusX, unsigned int radiusY,
+                               BorderMode border = BorderMode::REPLICATE, double borderValue = 0.0 );
+
+            /**
+             * Dilate an image with a rectangle: each channel value becomes the
+             * maximum of the rectangle centered on it (see erode()).
+             * @param outputImage The dilated image.
+             * @param inputImage An input image.
+             * @param radiusX Horizontal radius.
+             * @param radiusY Vertical radius.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REPLICATE.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            template<typename Channel>
+            static void dilate( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                unsigned int radiusX, unsigned int radiusY,
+                                BorderMode border = BorderMode::REPLICATE, double borderValue = 0.0 );
+
+            /**
+             * Morphological opening (erosion followed by dilation) with a
+             * rectangle. Removes bright details smaller than the rectangle.
+             * The output image and the input image can be the same.
+             * @param outputImage The opened image.
+             * @param inputImage An input image.
+             * @param radiusX Horizontal radius.
+             * @param radiusY Vertical radius.
+             */
+            template<typename Channel>
+            static void open( Image<Channel>& outputImage, const Image<Channel>& inputImage, unsigned int radiusX, unsigned int radiusY );
+
+            /**
+             * Morphological closing (dilation followed by erosion) with a
+             * rectangle. Fills dark details smaller than the rectangle.
+             * The output image and the input image can be the same.
+             * @param outputImage The closed image.
+             * @param inputImage An input image.
+             * @param radiusX Horizontal radius.
+             * @param radiusY Vertical radius.
+             */
+            template<typename Channel>
+            static void close( Image<Channel>& outputImage, const Image<Channel>& inputImage, unsigned int radiusX, unsigned int radiusY );
+
+            /**
+             * Replace each channel value by the median of the
+             * (2 * radius + 1) x (2 * radius + 1) square centered on it.
+             * 3x3 and 5x5 medians are computed for 32 pixels at once with
+             * min/max selection networks. Larger radii keep a histogram per
+             * column and slide a window histogram along each row (Perreault and
+             * Hebert), so the cost per pixel does not depend on the radius.
+             * Large images are processed by several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The filtered image.
+             * @param inputImage An input image.
+             * @param radius Window radius, up to 127.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REPLICATE.
+             * @param borderValue (Optional) Value of pixels outside the image
+             * for BorderMode::CONSTANT. Default is 0.
+             */
+            static void medianFilter( ImageByte& outputImage, const ImageByte& inputImage, unsigned int radius,
+                                      BorderMode border = BorderMode::REPLICATE, double borderValue = 0.0 );
+
+            /**
+             * Compute a derivative of an image with the 3x3 Sobel operator,
+             * i.e. a [-1 0 1] (first order) or [1 -2 1] (second order)
+             * difference along one axis and a [1 2 1] smoothing along the
+             * other one. Channels are filtered independently. BYTE to int16_t
+             * derivatives are computed exactly in 16-bit SIMD lanes, other
+             * combinations in float, saturated to the output type. Large
+             * images are processed by several threads.
+             * @param outputImage The derivative, int16_t or float.
+             * @param inputImage An input image.
+             * @param dx Order of the derivative along x, 0 to 2.
+             * @param dy Order of the derivative along y, 0 to 2. dx + dy must
+             * be 1 or 2.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT. CONSTANT uses 0.
+             */
+            template<typename Derivative, typename Channel>
+            static void sobel( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                               unsigned int dx, unsigned int dy, BorderMode border = BorderMode::REFLECT );
+
+            /**
+             * Compute a first derivative of an image with the 3x3 Scharr
+             * operator, which has the [3 10 3] smoothing and is more rotation
+             * invariant than Sobel (see sobel()).
+             * @param outputImage The derivative, int16_t or float.
+             * @param inputImage An input image.
+             * @param dx Order of the derivative along x, 0 or 1.
+             * @param dy Order of the derivative along y, 0 or 1. dx + dy must
+             * be 1.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT. CONSTANT uses 0.
+             */
+            template<typename Derivative, typename Channel>
+            static void scharr( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                                unsigned int dx, unsigned int dy, BorderMode border = BorderMode::REFLECT );
+
+            /**
+             * Compute the gradient magnitude and orientation of an image in a
+             * single pass: both derivatives are computed row by row and never
+             * stored as images. Channels are processed independently.
+             * @param magnitude Gradient magnitude, sqrt(dx^2 + dy^2).
+             * @param orientation Gradient orientation, atan2(dy, dx), in
+             * radians. The y axis points down.
+             * @param inputImage An input image.
+             * @param useScharr (Optional) Use the Scharr operator instead of
+             * Sobel. Default is false.
+             * @param border (Optional) How pixels outside the image are
+             * sampled. Default is BorderMode::REFLECT. CONSTANT uses 0.
+             */
+            template<typename Channel>
+            static void gradient( ImageFloat& magnitude, ImageFloat& orientation, const Image<Channel>& inputImage,
+                                  bool useScharr = false, BorderMode border = BorderMode::REFLECT );
+
+            /**
+             * Canny edge detector for grayscale images. Gaussian smoothing,
+             * Sobel gradient and non-maximum suppression are fused into one
+             * pass over bands of rows, which only keeps a few rows of each
+             * stage. Hysteresis then grows the strong edges into the weak ones
+             * with a flood fill driven by a stack.
+             * @param edges Edge map: 255 on edges, 0 elsewhere.
+             * @param inputImage A grayscale image. Other color spaces are not
+             * supported and leave the edge map untouched.
+             * @param lowThreshold Gradient magnitudes above this value are edges
+             * if they are connected to a strong edge.
+             * @param highThreshold Gradient magnitudes above this value are
+             * strong edges.
+             * @param sigma (Optional) Standard deviation of the smoothing. 0 (no
+             * smoothing) by default.
+             */
+            static void canny( ImageByte& edges, const ImageByte& inputImage,
+                               double lowThreshold, double highThreshold, double sigma = 0.0 );
+
+            /**
+             * Threshold every channel value v against a fixed threshold t, as
+             * described by ThresholdType. Comparisons run in SIMD registers for
+             * BYTE, int16_t, uint16_t and float images. Large images are
+             * processed by several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The thresholded image.
+             * @param inputImage An input image.
+             * @param threshold Threshold t. For integer images, v > t is the
+             * same as v > floor(t).
+             * @param maxValue Value of BINARY and BINARY_INVERTED outputs,
+             * saturated to the channel type.
+             * @param type (Optional) Threshold type. Default is
+             * ThresholdType::BINARY.
+             */
+            template<typename Channel>
+            static void threshold( Image<Channel>& outputImage, const Image<Channel>& inputImage, double threshold,
+                                   double maxValue, ThresholdType type = ThresholdType::BINARY );
+
+            /**
+             * Compute the threshold of a channel with Otsu's method, which
+             * maximizes the variance between the two classes of values. The
+             * histogram of the image is computed once, with the default bins
+             * of the channel type (see Histogram), and then swept once.
+             * @param image An image.
+             * @param channel (Optional) Channel index. Default is 0.
+             * @return Threshold t: values v > t form the upper class. Meant to be
+             * passed to threshold().
+             */
+            template<typename Channel>
+            static double otsuThreshold( const Image<Channel>& image, unsigned int channel = 0 );
+
+            /**
+             * Compute the threshold of a channel with the triangle method: the
+             * threshold is the bin farthest below the line from the histogram
+             * peak to the far end of its longer tail. Suited to images where
+             * the objects are a small part of the pixels, e.g. text. The
+             * histogram is computed as in otsuThreshold().
+             * @param image An image.
+             * @param channel (Optional) Channel index. Default is 0.
+             * @return Threshold t: values v > t are on the side of the peak's
+             * longer tail when it is above the peak, below it otherwise.
+             */
+            template<typename Channel>
+            static double triangleThreshold( const Image<Channel>& image, unsigned int channel = 0 );
+
+            /**
+             * Threshold every channel value against a threshold computed from
+             * its neighborhood: the (optionally Gaussian weighted) mean of the
+             * (2 * radius + 1)^2 window around it, minus an offset. Window means
+             * are taken from an integral image, so the cost does not depend on
+             * the radius. The Gaussian mean is approximated by three successive
+             * box means. Windows are clipped to the image bounds. Large images
+             * are processed by several threads.
+             * 
+             * The output image and the input image can be the same.
+             * @param outputImage The thresholded image.
+             * @param inputImage An input image.
+             * @param maxValue Value of BINARY and BINARY_INVERTED outputs,
+             * saturated to the channel type.
+             * @param radius Window radius.
+             * @param offset (Optional) Subtracted from the local mean. Default is
+             * 0. Positive values keep flat regions below the threshold.
+             * @param method (Optional) How the local mean is weighted. Default is
+             * AdaptiveMethod::MEAN.
+             * @param type (Optional) Threshold type. Default is
+             * ThresholdType::BINARY.
+             */
+            template<typename Channel>
+            static void adaptiveThreshold( Image<Channel>& outputImage, const Image<Channel>& inputImage, double maxValue,
+                                           unsigned int radius, double offset = 0.0, AdaptiveMethod method = AdaptiveMethod::MEAN,
+                                           ThresholdType type = ThresholdType::BINARY );
+
+            /**
+             * Label the connected components of a mask: nonzero pixels that
+             * are neighbors belong to the same component. With 8-connectivity
+             * the mask is scanned in 2x2 blocks, whose foreground pixels are
+             * always connected, so union-find runs on a quarter of the pixels.
+             * Bands of rows are labeled by several threads, each in its own
+             * range of provisional labels, and then merged along the band
+             * borders. Final labels and statistics are computed in a second
+             * parallel pass.
+             * @param labels Label image (grayscale): 0 for the background, 1 to
+             * n for the components, numbered in the order their first pixel is
+             * met in a block-wise scan.
+             * @param stats Statistics of each label, indexed by label; entry 0
+             * describes the background.
+             * @param mask A grayscale mask. Other color spaces are not supported
+             * and leave the outputs untouched.
+             * @param connectivity (Optional) 4 or 8 (default).
+             * @return Number of components n.
+             */
+            static unsigned int connectedComponents( ImageInt& labels, std::vector<ComponentStats>& stats,
+                                                     const ImageByte& mask, unsigned int connectivity = 8 );
+
+            /**
+             * Replace every channel value by its entry in a lookup table. The
+             * LUT must be shared by all channels or have one table per channel
+             * of the image, otherwise the output image is not modified. The
+             * output image and the input image can be the same.
+             * @param outputImage The mapped image.
+             * @param inputImage An input image.
+             * @param lut The lookup table. Chains of tables should be composed
+             * with LUT::then() to be applied in a single pass.
+             */
+            static void applyLUT( ImageByte& outputImage, const ImageByte& inputImage, const LUT& lut );
+
+            /**
+             * Equalize the histogram of each color channel, so that values are
+             * spread evenly over [0, 255]. Alpha channels are copied
+             * unchanged. The output image and the input image can be the
+             * same.
+             * @param outputImage The equalized image.
+             * @param inputImage An input image.
+             */
+            static void equalizeHistogram( ImageByte& outputImage, const ImageByte& inputImage );
+
+            /**
+             * Contrast limited adaptive histogram equalization (CLAHE). The
+             * image is split in tilesX x tilesY tiles, and each tile gets an
+             * equalization mapping from its own histogram, clipped at
+             * clipLimit times the mean bin count so noise in flat areas is not
+             * amplified. The mappings of the four nearest tiles are bilinearly
+             * interpolated at each pixel. Alpha channels are copied unchanged.
+             * The output image and the input image can be the same.
+             * @param outputImage The equalized image.
+             * @param inputImage An input image.
+             * @param tilesX (Optional) Number of tile columns. Default is 8.
+             * @param tilesY (Optional) Number of tile rows. Default is 8.
+             * @param clipLimit (Optional) Maximum bin count relative to the mean
+             * bin count. Values of 1 or less disable equalization. Default is
+             * 2.
+             */
+            static void clahe( ImageByte& outputImage, const ImageByte& inputImage,
+                               unsigned int tilesX = 8, unsigned int tilesY = 8, double clipLimit = 2.0 );
+
+        private:
+
+            /**
+             * Rectangular erosion or dilation engine.
+             * @param outputImage The filtered image. Can not be inputImage.
+             * @param inputImage An input image.
+             * @param radiusX Horizontal radius.
+             * @param radiusY Vertical radius.
+             * @param dilation True for maximum, false for minimum.
+             * @param border Border mode.
+             * @param borderValue Value of pixels outside the image for
+             * BorderMode::CONSTANT.
+             */
+            template<typename Channel>
+            static void morphology( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                    unsigned int radiusX, unsigned int radiusY, bool dilation,
+                                    BorderMode border, double borderValue );
+
+            /**
+             * Median filter with a selection network, for radius 1 or 2.
+             * @param outputImage The filtered image, already allocated. Can
+             * not be inputImage.
+             * @param inputImage An input image.
+             * @param radius 1 or 2.
+             * @param border Border mode.
+             * @param borderValue Value of pixels outside the image for
+             * BorderMode::CONSTANT.
+             */
+            static void medianNetwork( ImageByte& outputImage, const ImageByte& inputImage, unsigned int radius,
+                                       BorderMode border, BYTE borderValue );
+
+            /**
+             * Median filter with sliding histograms, for any radius.
+             * @param outputImage The filtered image, already allocated. Can
+             * not be inputImage.
+             * @param inputImage An input image.
+             * @param radius Window radius.
+             * @param border Border mode.
+             * @param borderValue Value of pixels outside the image for
+             * BorderMode::CONSTANT.
+             */
+            static void medianHistogram( ImageByte& outputImage, const ImageByte& inputImage, unsigned int radius,
+                                         BorderMode border, BYTE borderValue );
+
+            /**
+             * Convert an image row to another type, with padding pixels
+             * sampled according to a border mode on both sides.
+             * @param image An image.
+             * @param row Row index, mapped if outside the image.
+             * @param border Border mode. CONSTANT uses 0.
+             * @param padding Number of pixels added on each side.
+             * @param output Row of (width + 2 * padding) pixels.
+             */
+            template<typename Channel, typename Output>
+            static void padRow( const Image<Channel>& image, int row, BorderMode border, unsigned int padding, Output* output );
+
+            /**
+             * Apply a separable 3x3 integer kernel to one row, from three
+             * padded rows (one pixel on each side).
+             * @param above Row above, pointing to its first unpadded element.
+             * @param center Center row, likewise.
+             * @param below Row below, likewise.
+             * @param kx Horizontal kernel.
+             * @param ky Vertical kernel.
+             * @param vertical Scratch row of count + 2 * channels elements.
+             * @param output Output row.
+             * @param count Number of elements in a row.
+             * @param channels Number of channels.
+             */
+            template<typename T>
+            static void filterRow3x3( const T* above, const T* center, const T* below, const int* kx, const int* ky,
+                                      T* vertical, T* output, unsigned int count, unsigned int channels );
+
+            /**
+             * Derivative filter engine, computing in Accumulator (float, or
+             * uint16_t holding int16_t bits).
+             * @param outputImage The filtered image.
+             * @param inputImage An input image.
+             * @param kx Horizontal kernel.
+             * @param ky Vertical kernel.
+             * @param border Border mode.
+             */
+            template<typename Accumulator, typename Derivative, typename Channel>
+            static void derivativeFilter( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                                          const int* kx, const int* ky, BorderMode border );
+
+            /**
+             * Store a row of derivatives.
+             */
+            template<typename Derivative>
+            static void storeDerivative( const float* input, Derivative* output, unsigned int count );
+            static void storeDerivative( const uint16_t* input, int16_t* output, unsigned int count );
+
+            /**
+             * Run derivativeFilter() in 16-bit integers for BYTE to int16_t.
+             * @return False if the filter must be computed in float.
+             */
+            template<typename Derivative, typename Channel>
+            static bool derivativeFixedPoint( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                                              const int* kx, const int* ky, BorderMode border );
+            static bool derivativeFixedPoint( Image<int16_t>& outputImage, const ImageByte& inputImage,
+                                              const int* kx, const int* ky, BorderMode border );
+
+            /**
+             * Convert the last bin of the lower class of a histogram computed
+             * with default bins to a threshold in channel values.
+             * @param histogram A histogram.
+             * @param bin Bin index, -1 if the lower class is empty.
+             * @return Threshold t such that values v > t are in the upper class.
+             */
+            template<typename Channel>
+            static double binToThreshold( const Histogram& histogram, int bin );
+
+            /**
+             * Compute the mean of the window around each pixel, clipped to the
+             * image bounds, one row at a time.
+             * @param inputImage An input image.
+             * @param radius Window radius.
+             * @param rowFunction Called as rowFunction(y, means) for every row
+             * y, from several threads, with the means of the row.
+             */
+            template<typename Channel, typename RowFunction>
+            static void windowMean( const Image<Channel>& inputImage, unsigned int radius, const RowFunction& rowFunction );
+
+            /**
+             * Orientation engine: an optional transposition followed by
+             * optional flips, as ImageFile::decomposeTransform() describes the
+             * orientations.
+             * @param outputImage The oriented image.
+             * @param inputImage An input image.
+             * @param transpose True to transpose.
+             * @param flipHorizontal True to mirror columns after transposing.
+             * @param flipVertical True to mirror rows after transposing.
+             */
+            template<typename Channel>
+            static void orient( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                bool transpose, bool flipHorizontal, bool flipVertical );
+
+            /**
+             * orient() for pixels of PixelSize bytes.
+             */
+            template<unsigned int PixelSize, typename Channel>
+            static void orientPixels( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                      bool transpose, bool flipHorizontal, bool flipVertical );
+
+            /**
+             * Copy the rows of an image, optionally reversing their pixels
+             * and/or their order. The output image can be the input image.
+             */
+            template<unsigned int PixelSize, typename Channel>
+            static void flipRows( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                  bool flipHorizontal, bool flipVertical );
+
+            /**
+             * Transpose (and flip) the block [firstRow, lastRow) x
+             * [firstColumn, lastColumn) of an image into another image,
+             * splitting it in halves until it fits in the cache.
+             */
+            template<unsigned int PixelSize, typename Channel>
+            static void transposeBlock( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                        unsigned int firstRow, unsigned int lastRow,
+                                        unsigned int firstColumn, unsigned int lastColumn,
+                                        bool flipHorizontal, bool flipVertical );
+
+            /**
+             * Transpose a square image in place by swapping pairs of tiles
+             * across the diagonal.
+             */
+            template<unsigned int PixelSize, typename Channel>
+            static void transposeSquare( Image<Channel>& image );
+
+            /**
+             * Side of the tiles transposed by simd::transposeTile(): 16 pixels,
+             * a whole number of register blocks, when the pixel size divides 16,
+             * otherwise 8.
+             */
+            static unsigned int transposeTileSize( unsigned int pixelSize );
+
+            /**
+             * Interpolation weights of warps and remaps. Source positions have
+             * 5 fractional bits, so there are 32 sets of weights per axis.
+             */
+            struct RemapKernel
+            {
+                Interpolation interpolation;    // NEAREST, BILINEAR or BICUBIC
+                unsigned int taps;              // Taps per axis: 1, 2 or 4
+                float weights[32 * 4];          // taps weights per position
+                int16_t fixedPoint[32 * 4];     // Same, with 10 fractional bits
+            };
+
+            /**
+             * Compute the weights of a remap kernel.
+             * @param kernel The kernel.
+             * @param interpolation Interpolation filter. AREA becomes BILINEAR
+             * and LANCZOS becomes BICUBIC.
+             */
+            static void buildRemapKernel( RemapKernel& kernel, Interpolation interpolation );
+
+            /**
+             * Warp engine: the output is processed in blocks of rows of pixels;
+             * mapRow( x, y, count, positions ) gives the source positions of
+             * count pixels of output row y from column x, as (x, y) pairs with
+             * 10 fractional bits.
+             * @param outputImage The warped image.
+             * @param inputImage An input image.
+             * @param width Output width.
+             * @param height Output height.
+             * @param interpolation Interpolation filter.
+             * @param border Border mode.
+             * @param borderValue Value of pixels outside the image for
+             * BorderMode::CONSTANT.
+             * @param mapRow Callable computing source positions.
+             */
+            template<typename Channel, typename MapRow>
+            static void warp( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                              unsigned int width, unsigned int height, Interpolation interpolation,
+                              BorderMode border, double borderValue, const MapRow& mapRow );
+
+            /**
+             * Interpolate a row of output pixels.
+             * @param output Output pixels.
+             * @param inputImage An input image.
+             * @param positions Integer source positions, as (x, y) pairs: the
+             * nearest pixel for Interpolation::NEAREST, otherwise the pixel at
+             * or before the position (the second tap of bicubic windows).
+             * @param fractions Fractional positions, fy * 32 + fx, in 1/32
+             * pixel.
+             * @param count Number of pixels.
+             * @param kernel Interpolation weights.
+             * @param border Border mode.
+             * @param borderPixel Pixel sampled outside the image for
+             * BorderMode::CONSTANT.
+             */
+            template<typename Channel>
+            static void remapRow( Channel* output, const Image<Channel>& inputImage, const int32_t* positions,
+                                  const uint16_t* fractions, unsigned int count, const RemapKernel& kernel,
+                                  BorderMode border, const Channel* borderPixel );
+            static void remapRow( BYTE* output, const ImageByte& inputImage, const int32_t* positions,
+                                  const uint16_t* fractions, unsigned int count, const RemapKernel& kernel,
+                                  BorderMode border, const BYTE* borderPixel );
+
+            /**
+             * Multiply or divide the color channels of an image by its alpha,
+             * see premultiply() and unpremultiply().
+             */
+            template<typename Channel>
+            static void scaleByAlpha( Image<Channel>& outputImage, const Image<Channel>& inputImage, bool divide );
+
+            /**
+             * Multiply or divide the color channels of a row by its alpha.
+             * BYTE rows use SIMD kernels.
+             * @param input Input pixels.
+             * @param output Output pixels. It can be the input.
+             * @param count Number of pixels.
+             * @param channels Number of channels.
+             * @param alpha Alpha channel.
+             * @param divide True to divide, false to multiply.
+             */
+            template<typename Channel>
+            static void scaleByAlphaRow( const Channel* input, Channel* output, unsigned int count,
+                                         unsigned int channels, unsigned int alpha, bool divide );
+            static void scaleByAlphaRow( const BYTE* input, BYTE* output, unsigned int count,
+                                         unsigned int channels, unsigned int alpha, bool divide );
+
+            /**
+             * Blend a row of overlay pixels over image pixels, see
+             * blendOver(). BYTE rows use SIMD kernels.
+             * @param output Image pixels, blended in place.
+             * @param channels Number of channels of the image.
+             * @param overlay Overlay pixels.
+             * @param overlayChannels Number of channels of the overlay.
+             * @param count Number of pixels.
+             * @param order Overlay channel of each image channel.
+             * @param alpha Alpha channel of the overlay.
+             * @param premultiplied True for premultiplied colors.
+             */
+            template<typename Channel>
+            static void blendOverRow( Channel* output, unsigned int channels, const Channel* overlay, unsigned int overlayChannels,
+                                      unsigned int count, const int* order, unsigned int alpha, bool premultiplied );
+            static void blendOverRow( BYTE* output, unsigned int channels, const BYTE* overlay, unsigned int overlayChannels,
+                                      unsigned int count, const int* order, unsigned int alpha, bool premultiplied );
+
+            /**
+             * Lookup tables of color conversions, over [0, 1] in 4096 steps.
+             */
+            struct ColorTables
+            {
+                float decode[4097];     // sRGB to linear
+                float encode[4097];     // Linear to sRGB
+                float cubeRoot[4097];   // f(t) of CIE L*a*b*
+            };
+
+            /**
+             * Get the color tables, built on first use.
+             */
+            static const ColorTables& colorTables();
+
+            /**
+             * Interpolate a color table.
+             * @param table A table of ColorTables.
+             * @param x A value, clamped to [0, 1].
+             * @return The interpolated value.
+             */
+            static float lookup( const float* table, float x );
+
+            /**
+             * Compute the affine matrices of a YCbCr standard.
+             * @param standard YCbCr standard.
+             * @param scale Maximum channel value.
+             * @param center Chroma value of gray.
+             * @param encode 3x4 matrix from R, G, B, 1 to Y, Cb, Cr.
+             * @param decode 3x4 matrix from Y, Cb, Cr, 1 to R, G, B.
+             */
+            static void ycbcrMatrices( YCbCrStandard standard, double scale, double center, double* encode, double* decode );
+
+            /**
+             * Convert pixels from normalized R, G, B to a color space, in
+             * place. Values are scaled to the range of the channel type.
+             * @param pixels Triplets of values.
+             * @param count Number of pixels.
+             * @param colorSpace HSV, HSL, LAB or a YCbCr color space.
+             * @param standard YCbCr standard.
+             */
+            template<typename Channel>
+            static void rgbToColor( float* pixels, unsigned int count, ColorSpace::Type colorSpace, YCbCrStandard standard );
+
+            /**
+             * Convert pixels from a color space to normalized R, G, B, in
+             * place, see rgbToColor().
+             */
+            template<typename Channel>
+            static void colorToRGB( float* pixels, unsigned int count, ColorSpace::Type colorSpace, YCbCrStandard standard );
+
+            /**
+             * Load a row of an RGB color space as normalized R, G, B triplets.
+             * @param input Input row.
+             * @param channels Number of channels of the input.
+             * @param order Input channel of R, G and B.
+             * @param count Number of pixels.
+             * @param pixels Triplets.
+             */
+            template<typename Channel>
+            static void loadRGB( const Channel* input, unsigned int channels, const int* order, unsigned int count, float* pixels );
+
+            /**
+             * Store normalized R, G, B triplets to a row of an RGB color space.
+             * @param pixels Triplets.
+             * @param output Output row.
+             * @param channels Number of channels of the output.
+             * @param order Color of each output channel, or -1 for alpha.
+             * @param count Number of pixels.
+             */
+            template<typename Channel>
+            static void storeRGB( const float* pixels, Channel* output, unsigned int channels, const int* order, unsigned int count );
+
+            /**
+             * Locate a chroma row of a 4:2:0 image, see ColorSpace::Type.
+             * @param image An I420 or NV12 image.
+             * @param frameHeight Height of the frame.
+             * @param row Chroma row.
+             * @param cb Offset of the first Cb sample of the row from the
+             * image data.
+             * @param cr Offset of the first Cr sample of the row.
+             * @param step Distance between samples of the row.
+             */
+            template<typename Channel>
+            static void chromaRow( const Image<Channel>& image, unsigned int frameHeight, unsigned int row,
+                                   std::size_t& cb, std::size_t& cr, unsigned int& step );
+
+            /**
+             * Convert a BYTE image between RGB and YCbCr, I420 or NV12 with
+             * fixed point matrices.
+             * @param outputImage The converted image, with its layout.
+             * @param inputImage An input image.
+             * @param width Width of the frame.
+             * @param height Height of the frame.
+             * @param standard YCbCr standard.
+             * @return False if the conversion is not supported.
+             */
+            template<typename Channel>
+            static bool convertColorFixedPoint( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                                unsigned int width, unsigned int height, YCbCrStandard standard );
+            static bool convertColorFixedPoint( ImageByte& outputImage, const ImageByte& inputImage,
+                                                unsigned int width, unsigned int height, YCbCrStandard standard );
+
+            /**
+             * Partial statistics of a channel, see statistics().
+             */
+            struct StatisticsAccumulator
+            {
+                uint64_t count;
+                double sum;
+                double squares;
+                double absolute;
+                double minimum;
+                double maximum;
+                unsigned int minimumX;
+                unsigned int minimumY;
+                unsigned int maximumX;
+                unsigned int maximumY;
+            };
+
+            /**
+             * Compute the statistics of an image or of the difference of two
+             * images.
+             * @param stats Statistics of each channel.
+             * @param image An input image.
+             * @param subtrahend An image subtracted from the input image, or
+             * nullptr.
+             * @param mask A grayscale mask, or nullptr.
+             */
+            template<typename Channel>
+            static void accumulateStatistics( std::vector<ChannelStats>& stats, const Image<Channel>& image,
+                                              const Image<Channel>* subtrahend, const ImageByte* mask );
+
+            /**
+             * Accumulate the statistics of a row.
+             * @param accumulators Accumulator of each channel.
+             * @param input Input row.
+             * @param subtract Row subtracted from the input, or nullptr.
+             * @param mask Mask row, or nullptr.
+             * @param width Number of pixels.
+             * @param channels Number of channels.
+             * @param y Row index.
+             * @param scratch Buffer of width * channels values.
+             */
+            template<typename Channel>
+            static void statisticsRow( StatisticsAccumulator* accumulators, const Channel* input, const Channel* subtract,
+                                       const BYTE* mask, unsigned int width, unsigned int channels, unsigned int y, BYTE* scratch );
+            static void statisticsRow( StatisticsAccumulator* accumulators, const BYTE* input, const BYTE* subtract,
+                                       const BYTE* mask, unsigned int width, unsigned int channels, unsigned int y, BYTE* scratch );
+
+            /**
+             * Compute the mean SSIM and contrast-structure terms of two images
+             * of the same layout, at least 11x11 pixels, see ssim().
+             * @param image1 An image.
+             * @param image2 An image.
+             * @param peak Dynamic range of the values.
+             * @param ssim Mean SSIM.
+             * @param contrastStructure Mean contrast-structure term.
+             */
+            template<typename Channel>
+            static void structuralSimilarity( const Image<Channel>& image1, const Image<Channel>& image2, double peak,
+                                              double& ssim, double& contrastStructure );
+
+            /**
+             * Correlate each channel of an image with a grayscale kernel at
+             * every position where the kernel fits, directly or in the
+             * frequency domain, whichever has the lower estimated cost (see
+             * crossCorrelate()).
+             * @param outputImage The correlation, already allocated.
+             * @param inputImage An input image, at least as large as kernel.
+             * @param kernel A grayscale kernel.
+             */
+            template<typename T>
+            static void correlate( Image<T>& outputImage, const Image<T>& inputImage, const Image<T>& kernel );
+
+            /**
+             * Correlate directly: each output row is the sum of the input rows
+             * under the kernel, shifted and weighted by the kernel elements.
+             */
+            template<typename T>
+            static void correlateDirect( Image<T>& outputImage, const Image<T>& inputImage, const Image<T>& kernel );
+
+            /**
+             * Correlate in the frequency domain: each channel and the kernel
+             * are zero padded to FFT::optimalSize() (so the circular
+             * correlation does not wrap around where the kernel fits), and the
+             * spectrum of the channel is multiplied by the conjugate of the
+             * spectrum of the kernel.
+             * @param paddedWidth Width of the transforms.
+             * @param paddedHeight Height of the transforms.
+             */
+            template<typename T>
+            static void correlateSpectral( Image<T>& outputImage, const Image<T>& inputImage, const Image<T>& kernel,
+                                           unsigned int paddedWidth, unsigned int paddedHeight );
+
+            /**
+             * Compute the spectrum of a real 2D array, see dft().
+             * @param spectrum Output spectrum, height rows of width / 2 + 1
+             * values.
+             * @param data Input array.
+             * @param width Number of columns.
+             * @param height Number of rows.
+             * @param stride Distance between rows of data, in elements.
+             */
+            template<typename T>
+            static void realSpectrum( std::complex<T>* spectrum, const T* data, unsigned int width, unsigned int height, std::size_t stride );
+
+            /**
+             * Compute a real 2D array from its spectrum, see inverseDft().
+             * @param data Output array.
+             * @param spectrum Input spectrum, height rows of width / 2 + 1
+             * values. Overwritten.
+             * @param width Number of columns.
+             * @param height Number of rows.
+             * @param stride Distance between rows of data, in elements.
+             * @param scale Factor applied to the output.
+             */
+            template<typename T>
+            static void inverseRealSpectrum( T* data, std::complex<T>* spectrum, unsigned int width, unsigned int height,
+                                             std::size_t stride, T scale );
+
+            /**
+             * Transform the columns of a spectrum in blocks of 8, gathered
+             * into contiguous buffers.
+             * @param spectrum A spectrum of height rows of columns values.
+             * @param columns Number of columns.
+             * @param height Number of rows.
+             * @param inverse True for the inverse transform.
+             */
+            template<typename T>
+            static void transformColumns( std::complex<T>* spectrum, unsigned int columns, unsigned int height, bool inverse );
+
+            /**
+             * Compute the codes of a row of labeling units: a 4-bit mask of the
+             * foreground pixels of each 2x2 block (top-left, top-right,
+             * bottom-left, bottom-right from bit 0) or 1 for a foreground
+             * pixel.
+             * @param mask A grayscale mask.
+             * @param unitRow Row of units.
+             * @param blocks True for 2x2 blocks, false for pixels.
+             * @param codes Output codes, one per unit.
+             */
+            static void unitCodes( const ImageByte& mask, unsigned int unitRow, bool blocks, BYTE* codes );
+
+            /**
+             * Check if two labeling units touch.
+             * @param unit Code of a unit.
+             * @param neighbor Code of its neighbor at column offset dx in the
+             * row above (-1 to 1), or on its left (dx = -1 with left true).
+             * @param dx Column offset of the neighbor.
+             * @param left True if the neighbor is on the same row.
+             * @param blocks True for 2x2 blocks (8-connectivity), false for
+             * pixels (4-connectivity).
+             * @return True if the units are connected.
+             */
+            static bool unitsTouch( BYTE unit, BYTE neighbor, int dx, bool left, bool blocks );
+
+            /**
+             * Find the root of a label in a union-find forest, halving the path
+             * on the way.
+             * @param parent Parent of each label; roots are their own parents.
+             * @param label A label.
+             * @return Root label.
+             */
+            static int32_t findRoot( std::vector<int32_t>& parent, int32_t label );
+
+            /**
+             * Merge the trees of two labels. The smaller root becomes the root,
+             * so parents always have smaller labels than their children.
+             * @param parent Parent of each label.
+             * @param a A label.
+             * @param b Another label.
+             * @return Root of the merged tree.
+             */
+            static int32_t mergeLabels( std::vector<int32_t>& parent, int32_t a, int32_t b );
+
+            /**
+             * Check if a channel of a color space is alpha.
+             * @param colorSpace A color space.
+             * @param channel Channel index.
+             * @return True if the channel holds alpha values.
+             */
+            static bool isAlpha( ColorSpace::Type colorSpace, unsigned int channel );
+
+            /**
+             * Get the alpha channel of a color space.
+             * @param colorSpace Color space.
+             * @return Channel index, or -1 if the color space has no alpha.
+             */
+            static int alphaChannel( ColorSpace::Type colorSpace );
+
+            /**
+             * Coefficients of a 1D resampling: output element i is the sum of
+             * weights[i * taps + k] * input[first[i] + k], for k < taps.
+             */
+            struct ResampleTable
+            {
+                unsigned int taps;
+                std::vector<int> first;
+                std::vector<float> weights;
+            };
+
+            /**
+             * Compute the coefficients to resample a row or column.
+             * @param table The coefficients.
+             * @param inputLength Number of input elements.
+             * @param outputLength Number of output elements.
+             * @param interpolation Resampling filter.
+             */
+            static void buildResampleTable( ResampleTable& table, unsigned int inputLength, unsigned int outputLength, Interpolation interpolation );
+
+            /**
+             * Evaluate a resampling filter.
+             * @param x Distance to the filter center, in input pixels.
+             * @param interpolation Resampling filter.
+             * @return Unnormalized weight.
+             */
+            static double resampleWeight( double x, Interpolation interpolation );
+
+            /**
+             * Pad the taps of a table with zero weights to a multiple of a
+             * number, as the SIMD paths of simd::resampleRow() require.
+             * @param table The coefficients.
+             * @param multiple Tap multiple.
+             */
+            static void padResampleTable( ResampleTable& table, unsigned int multiple );
+
+            /**
+             * Resample a region with precomputed tables, in float.
+             * @param outputImage The resized image, already allocated.
+             * @param inputImage An input image.
+             * @param region Region of inputImage.
+             * @param columns Horizontal coefficients.
+             * @param rows Vertical coefficients.
+             */
+            template<typename Channel>
+            static void resampleFloat( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Rect& region,
+                                       const ResampleTable& columns, const ResampleTable& rows );
+
+            /**
+             * Resample a region in 16-bit fixed point when the image is BYTE.
+             * @return False if the image must be resampled in float.
+             */
+            template<typename Channel>
+            static bool resampleFixedPoint( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Rect& region,
+                                            const ResampleTable& columns, const ResampleTable& rows );
+            static bool resampleFixedPoint( Image<BYTE>& outputImage, const Image<BYTE>& inputImage, const Rect& region,
+                                            const ResampleTable& columns, const ResampleTable& rows );
+            
+            /**
+             * Check if two images have the same color space and dimensions.
+             * @param imageA Input image.
+             * @param imageB Input image.
+             * @return True if they have equal color space.
+             */
+            template<typename Channel>
+            static bool areCompatible( const Image<Channel>& imageA, const Image<Channel>& imageB );
+
+            /**
+             * Check if an image has the given dimension and color space.
+             * @param image An image.
+             * @param width Width.
+             * @param height Height.
+             * @param colorSpace Color space.
+             * @return True if the image matches.
+             */
+            template<typename Channel>
+            static bool hasLayout( const Image<Channel>& image, unsigned int width, unsigned int height, ColorSpace::Type colorSpace );
+
+            /**
+             * Get the value of an opaque alpha channel.
+             * @return The maximum value of an integer channel type, or 1 for
+             * floating point types.
+             */
+            template<typename Channel>
+            static Channel opaque();
+
+            /**
+             * Map a coordinate outside [0, length) to the coordinate of the pixel
+             * that is sampled there.
+             * @param index A coordinate.
+             * @param length Image width or height.
+             * @param border Border mode.
+             * @return The mapped coordinate, or -1 for BorderMode::CONSTANT.
+             */
+            static int mapBorder( int index, int length, BorderMode border );
+
+            /**
+             * Run convolveSeparable() in 8.8 fixed point when the image is BYTE
+             * and both kernels are normalized and non-negative.
+             * @return False if the filter must be computed in float.
+             */
+            template<typename Channel>
+            static bool filterFixedPoint( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                          const std::vector<float>& kernelX, const std::vector<float>& kernelY,
+                                          BorderMode border, double borderValue );
+            static bool filterFixedPoint( Image<BYTE>& outputImage, const Image<BYTE>& inputImage,
+                                          const std::vector<float>& kernelX, const std::vector<float>& kernelY,
+                                          BorderMode border, double borderValue );
+
+            /**
+             * Quantize a normalized non-negative kernel to 8-bit fixed point
+             * weights that sum to exactly 256.
+             * @param kernel A kernel.
+             * @param weights The quantized weights.
+             * @return False if the kernel has negative elements or is not
+             * normalized.
+             */
+            static bool quantizeKernel( const std::vector<float>& kernel, std::vector<uint16_t>& weights );
+
+            /**
+             * Separable filter engine, parameterized on the type of the
+             * intermediate rows (float, or uint16_t for 8.8 fixed point).
+             * @param outputImage The filtered image, already allocated.
+             * @param inputImage An input image, distinct from outputImage.
+             * @param kernelX Horizontal weights.
+             * @param kernelY Vertical weights.
+             * @param border Border mode.
+             * @param borderValue Value of pixels outside the image for
+             * BorderMode::CONSTANT.
+             */
+            template<typename Intermediate, typename Channel, typename Weight>
+            static void separableFilter( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                         const std::vector<Weight>& kernelX, const std::vector<Weight>& kernelY,
+                                         BorderMode border, double borderValue );
+
+            /**
+             * Vertical step of separableFilter(): combine intermediate rows into
+             * an output row.
+             * @param rows Intermediate rows, one per weight.
+             * @param kernel Vertical weights.
+             * @param accumulator Scratch row.
+             * @param output Output row.
+             * @param count Number of elements in a row.
+             */
+            template<typename Channel>
+            static void combineRows( const float* const* rows, const std::vector<float>& kernel, float* accumulator, Channel* output, unsigned int count );
+            static void combineRows( const uint16_t* const* rows, const std::vector<uint16_t>& kernel, uint16_t* accumulator, BYTE* output, unsigned int count );
+    };
+    
+    
+    template<typename Channel>
+    void ImageOperator::add( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB )
+    {
+        if ( !areCompatible( imageA, imageB ) )
+        {
+            return;
+        }
+        else if ( !areCompatible( outputImage, imageA ) )
+        {
+            outputImage.create( imageA.getWidth(), imageA.getHeight(), imageA.getColorSpace() );
+        }
+        
+        // @TODO: Implement addition.
+    }
+    
+
+    template<typename Channel>
+    void ImageOperator::swizzle( Image<Channel>& outputImage, const Image<Channel>& inputImage, ColorSpace::Type colorSpace )
+    {
+        const std::string inputNames = ColorSpace::channelNames( inputImage.getColorSpace() );
+        const std::string outputNames = ColorSpace::channelNames( colorSpace );
+
+        // Channel names are only comparable between RGB color spaces, other
+        // color spaces can only be copied
+        bool related = inputImage.getColorSpace() == colorSpace ||
+                       ( ColorSpace::isRGB( inputImage.getColorSpace() ) && ColorSpace::isRGB( colorSpace ) );
+
+        if ( inputNames.empty() || outputNames.empty() || !related )
+        {
+            return;
+        }
+
+        int order[4];
+
+        for ( unsigned int k = 0; k < outputNames.size(); ++k )
+        {
+            std::string::size_type index = inputNames.find( outputNames[k] );
+
+            if ( index != std::string::npos )
+            {
+                order[k] = static_cast<int>( index );
+            }
+            else if ( outputNames[k] == 'A' )
+            {
+                order[k] = -1;
+            }
+            else if ( inputNames == "Y" )
+            {
+                order[k] = 0;
+            }
+            else
+            {
+                return;
+            }
+        }
+
+        swizzle( outputImage, inputImage, colorSpace, order );
+    }
+
+    template<typename Channel>
+    void ImageOperator::swizzle( Image<Channel>& outputImage, const Image<Channel>& inputImage, ColorSpace::Type colorSpace, const int* order )
+    {
+        const int inputChannels = inputImage.getNumberOfChannels();
+        const int outputChannels = ColorSpace::calculateNumberOfChannels( colorSpace );
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+
+        if ( outputChannels == 0 )
+        {
+            return;
+        }
+
+        for ( int k = 0; k < outputChannels; ++k )
+        {
+            if ( order[k] >= inputChannels )
+            {
+                return;
+            }
+        }
+
+        if ( &outputImage == &inputImage )
+        {
+            if ( !outputImage.setColorSpace( colorSpace ) )
+            {
+                return;
+            }
+        }
+        else if ( !hasLayout( outputImage, width, height, colorSpace ) )
+        {
+            outputImage.create( width, height, colorSpace );
+        }
+
+        // 16 pixels per block
+        unsigned int blockWidth = 0;
+        simd::ByteShuffle shuffle( 16 * outputChannels );
+
+        if ( sizeof(Channel) == 1 )
+        {
+            blockWidth = 16;
+
+            for ( unsigned int i = 0; i < 16; ++i )
+            {
+                for ( int k = 0; k < outputChannels; ++k )
+                {
+                    if ( order[k] < 0 )
+                    {
+                        shuffle.setConstant( i * outputChannels + k, 0xFF );
+                    }
+                    else
+                    {
+                        shuffle.setSource( i * outputChannels + k, 0, i * inputChannels + order[k] );
+                    }
+                }
+            }
+        }
+
+        const Channel alpha = opaque<Channel>();
+
+        for ( unsigned int row = 0; row < height; ++row )
+        {
+            const Channel* input = inputImage( row, 0 );
+            Channel* output = outputImage( row, 0 );
+            unsigned int column = 0;
+
+            for ( ; column + blockWidth <= width && blockWidth > 0; column += blockWidth )
+            {
+                const BYTE* stream = reinterpret_cast<const BYTE*>( input + column * inputChannels );
+                shuffle.apply( &stream, reinterpret_cast<BYTE*>( output + column * outputChannels ) );
+            }
+
+            for ( ; column < width; ++column )
+            {
+                Channel pixel[4];
+
+                for ( int k = 0; k < outputChannels; ++k )
+                {
+                    pixel[k] = order[k] < 0 ? alpha : input[column * inputChannels + order[k]];
+                }
+
+                for ( int k = 0; k < outputChannels; ++k )
+                {
+                    output[column * outputChannels + k] = pixel[k];
+                }
+            }
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::split( std::vector< Image<Channel> >& planes, const Image<Channel>& inputImage )
+    {
+        const int channels = inputImage.getNumberOfChannels();
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+
+        planes.resize( channels );
+
+        for ( int k = 0; k < channels; ++k )
+        {
+            if ( !hasLayout( planes[k], width, height, ColorSpace::Type::GRAYSCALE ) )
+            {
+                planes[k].create( width, height, ColorSpace::Type::GRAYSCALE );
+            }
+        }
+
+        // 16 pixels per block, one output register per plane
+        unsigned int blockWidth = 0;
+        simd::ByteShuffle shuffle( 16 * channels );
+
+        if ( sizeof(Channel) == 1 )
+        {
+            blockWidth = 16;
+
+            for ( int k = 0; k < channels; ++k )
+            {
+                for ( unsigned int i = 0; i < 16; ++i )
+                {
+                    shuffle.setSource( 16 * k + i, 0, i * channels + k );
+                }
+            }
+        }
+
+        for ( unsigned int row = 0; row < height; ++row )
+        {
+            const Channel* input = inputImage( row, 0 );
+            unsigned int column = 0;
+
+            for ( ; column + blockWidth <= width && blockWidth > 0; column += blockWidth )
+            {
+                const BYTE* stream = reinterpret_cast<const BYTE*>( input + column * channels );
+                BYTE* outputs[4];
+
+                for ( int k = 0; k < channels; ++k )
+                {
+                    outputs[k] = reinterpret_cast<BYTE*>( planes[k]( row, column ) );
+                }
+
+                shuffle.apply( &stream, outputs );
+            }
+
+            for ( ; column < width; ++column )
+            {
+                for ( int k = 0; k < channels; ++k )
+                {
+                    *planes[k]( row, column ) = input[column * channels + k];
+                }
+            }
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::merge( Image<Channel>& outputImage, const std::vector< Image<Channel> >& planes, ColorSpace::Type colorSpace )
+    {
+        const int channels = ColorSpace::calculateNumberOfChannels( colorSpace );
+
+        if ( channels == 0 || planes.size() != static_cast<unsigned int>( channels ) )
+        {
+            return;
+        }
+
+        const unsigned int width = planes[0].getWidth();
+        const unsigned int height = planes[0].getHeight();
+
+        for ( int k = 0; k < channels; ++k )
+        {
+            if ( !hasLayout( planes[k], width, height, ColorSpace::Type::GRAYSCALE ) || &planes[k] == &outputImage )
+            {
+                return;
+            }
+        }
+
+        if ( !hasLayout( outputImage, width, height, colorSpace ) )
+        {
+            outputImage.create( width, height, colorSpace );
+        }
+
+        // 16 pixels per block, one input stream per plane
+        unsigned int blockWidth = 0;
+        simd::ByteShuffle shuffle( 16 * channels );
+
+        if ( sizeof(Channel) == 1 )
+        {
+            blockWidth = 16;
+
+            for ( unsigned int i = 0; i < 16; ++i )
+            {
+                for ( int k = 0; k < channels; ++k )
+                {
+                    shuffle.setSource( i * channels + k, k, i );
+                }
+            }
+        }
+
+        for ( unsigned int row = 0; row < height; ++row )
+        {
+            Channel* output = outputImage( row, 0 );
+            unsigned int column = 0;
+
+            for ( ; column + blockWidth <= width && blockWidth > 0; column += blockWidth )
+            {
+                const BYTE* streams[4];
+
+                for ( int k = 0; k < channels; ++k )
+                {
+                    streams[k] = reinterpret_cast<const BYTE*>( planes[k]( row, column ) );
+                }
+
+                shuffle.apply( streams, reinterpret_cast<BYTE*>( output + column * channels ) );
+            }
+
+            for ( ; column < width; ++column )
+            {
+                for ( int k = 0; k < channels; ++k )
+                {
+                    output[column * channels + k] = *planes[k]( row, column );
+                }
+            }
+        }
+    }
+
+    template<typename OutputChannel, typename InputChannel>
+    void ImageOperator::convert( Image<OutputChannel>& outputImage, const Image<InputChannel>& inputImage, double scale, double offset )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int rowLength = width * inputImage.getNumberOfChannels();
+
+        if ( static_cast<const void*>( &outputImage ) != static_cast<const void*>( &inputImage ) &&
+             !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( rowLength ), [&]( unsigned int first, unsigned int last )
+        {
+            for ( unsigned int row = first; row < last; ++row )
+            {
+                simd::convert( inputImage( row, 0 ), outputImage( row, 0 ), rowLength, scale, offset );
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::convolveSeparable( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                           const std::vector<float>& kernelX, const std::vector<float>& kernelY,
+                                           BorderMode border, double borderValue )
+    {
+        if ( kernelX.empty() || kernelY.empty() )
+        {
+            return;
+        }
+
+        // Rows are read after the rows above them are written, so filter from
+        // a copy when the images are the same
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            convolveSeparable( outputImage, copy, kernelX, kernelY, border, borderValue );
+            return;
+        }
+
+        if ( !hasLayout( outputImage, inputImage.getWidth(), inputImage.getHeight(), inputImage.getColorSpace() ) )
+        {
+            outputImage.create( inputImage.getWidth(), inputImage.getHeight(), inputImage.getColorSpace() );
+        }
+
+        if ( !filterFixedPoint( outputImage, inputImage, kernelX, kernelY, border, borderValue ) )
+        {
+            separableFilter<float>( outputImage, inputImage, kernelX, kernelY, border, borderValue );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::boxFilter( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                   unsigned int radiusX, unsigned int radiusY,
+                                   BorderMode border, double borderValue )
+    {
+        typedef typename IntegralTraits<Channel>::Sum Sum;
+
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            boxFilter( outputImage, copy, radiusX, radiusY, border, borderValue );
+            return;
+        }
+
+        if ( !hasLayout( outputImage, inputImage.getWidth(), inputImage.getHeight(), inputImage.getColorSpace() ) )
+        {
+            outputImage.create( inputImage.getWidth(), inputImage.getHeight(), inputImage.getColorSpace() );
+        }
+
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const int channels = inputImage.getNumberOfChannels();
+        const int boxWidth = 2 * radiusX + 1;
+        const unsigned int boxHeight = 2 * radiusY + 1;
+        const unsigned int count = width * channels;
+        const double scale = 1.0 / ( static_cast<double>( boxWidth ) * boxHeight );
+        const Sum constant = static_cast<Sum>( simd::saturate<Channel>( borderValue ) );
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 4 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            // Ring of the row sums of the box (row y in slot (y - firstRow +
+            // radiusY) % boxHeight), so the row leaving the box is subtracted
+            // from its stored sums instead of being summed again
+            std::vector<Sum> padded( ( width + boxWidth - 1 ) * channels );
+            std::vector<Sum> rows( boxHeight * count );
+            std::vector<Sum> columnSums( count, Sum( 0 ) );
+
+            // Sums of the boxes of one row of a box of height 1
+            auto sumRow = [&]( int y, Sum* output )
+            {
+                int sourceRow = mapBorder( y, height, border );
+
+                for ( int x = -static_cast<int>( radiusX ); x < width + static_cast<int>( radiusX ); ++x )
+                {
+                    int sourceColumn = sourceRow < 0 ? -1 : mapBorder( x, width, border );
+                    Sum* pixel = &padded[( x + radiusX ) * channels];
+
+                    for ( int c = 0; c < channels; ++c )
+                    {
+                        pixel[c] = sourceColumn < 0 ? constant : static_cast<Sum>( inputImage( sourceRow, sourceColumn )[c] );
+                    }
+                }
+
+                for ( int c = 0; c < channels; ++c )
+                {
+                    Sum sum = Sum( 0 );
+
+                    for ( int x = 0; x < boxWidth; ++x )
+                    {
+                        sum += padded[x * channels + c];
+                    }
+
+                    output[c] = sum;
+                }
+
+                for ( unsigned int i = channels; i < count; ++i )
+                {
+                    output[i] = output[i - channels] + padded[i + ( boxWidth - 1 ) * channels] - padded[i - channels];
+                }
+            };
+
+            for ( unsigned int slot = 0; slot < boxHeight; ++slot )
+            {
+                Sum* row = &rows[slot * count];
+                sumRow( static_cast<int>( firstRow + slot ) - static_cast<int>( radiusY ), row );
+
+                for ( unsigned int i = 0; i < count; ++i )
+                {
+                    columnSums[i] += row[i];
+                }
+            }
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                simd::convert( &columnSums[0], outputImage( y, 0 ), count, scale, 0.0 );
+
+                if ( y + 1 < lastRow )
+                {
+                    // Row y + radiusY + 1 enters the slot of row y - radiusY
+                    Sum* row = &rows[( ( y - firstRow ) % boxHeight ) * count];
+
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        columnSums[i] -= row[i];
+                    }
+
+                    sumRow( y + radiusY + 1, row );
+
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        columnSums[i] += row[i];
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::resize( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                unsigned int width, unsigned int height, Interpolation interpolation )
+    {
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            resize( outputImage, copy, width, height, interpolation );
+            return;
+        }
+
+        resize( outputImage, inputImage, Rect( 0, 0, inputImage.getWidth(), inputImage.getHeight() ), width, height, interpolation );
+    }
+
+    template<typename Channel>
+    void ImageOperator::resize( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Rect& region,
+                                unsigned int width, unsigned int height, Interpolation interpolation )
+    {
+        if ( inputImage.getData() == nullptr || width == 0 || height == 0 ||
+             region.x >= inputImage.getWidth() || region.y >= inputImage.getHeight() )
+        {
+            return;
+        }
+
+        Rect source( region.x, region.y,
+                     std::min( region.width, inputImage.getWidth() - region.x ),
+                     std::min( region.height, inputImage.getHeight() - region.y ) );
+
+        if ( source.isEmpty() )
+        {
+            return;
+        }
+
+        // Large reductions: average blocks first, so the filter only has to
+        // cover a few source pixels per output pixel
+        bool filtered = interpolation == Interpolation::BILINEAR ||
+                        interpolation == Interpolation::BICUBIC ||
+                        interpolation == Interpolation::LANCZOS;
+
+        if ( filtered && ( source.width >= 4 * width || source.height >= 4 * height ) )
+        {
+            Image<Channel> reduced;
+            resize( reduced, inputImage, source,
+                    source.width >= 4 * width ? 2 * width : source.width,
+                    source.height >= 4 * height ? 2 * height : source.height,
+                    Interpolation::AREA );
+            resize( outputImage, reduced, width, height, interpolation );
+            return;
+        }
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        ResampleTable columns;
+        ResampleTable rows;
+        buildResampleTable( columns, source.width, width, interpolation );
+        buildResampleTable( rows, source.height, height, interpolation );
+
+        if ( interpolation == Interpolation::NEAREST )
+        {
+            const unsigned int channels = inputImage.getNumberOfChannels();
+
+            Parallel::forRange( 0, height, Parallel::calculateGrain( width * channels ), [&]( unsigned int firstRow, unsigned int lastRow )
+            {
+                for ( unsigned int y = firstRow; y < lastRow; ++y )
+                {
+                    const Channel* input = inputImage( source.y + rows.first[y], source.x );
+                    Channel* output = outputImage( y, 0 );
+
+                    for ( unsigned int x = 0; x < width; ++x )
+                    {
+                        const Channel* pixel = input + columns.first[x] * channels;
+
+                        for ( unsigned int c = 0; c < channels; ++c )
+                        {
+                            *output++ = pixel[c];
+                        }
+                    }
+                }
+            } );
+        }
+        else if ( !resampleFixedPoint( outputImage, inputImage, source, columns, rows ) )
+        {
+            resampleFloat( outputImage, inputImage, source, columns, rows );
+        }
+    }
+
+    inline void ImageOperator::buildResampleTable( ResampleTable& table, unsigned int inputLength, unsigned int outputLength, Interpolation interpolation )
+    {
+        const double scale = static_cast<double>( inputLength ) / outputLength;
+
+        table.first.resize( outputLength );
+
+        if ( interpolation == Interpolation::NEAREST )
+        {
+            table.taps = 1;
+            table.weights.assign( outputLength, 1.0f );
+
+            for ( unsigned int i = 0; i < outputLength; ++i )
+            {
+                table.first[i] = std::min( static_cast<int>( ( i + 0.5 ) * scale ), static_cast<int>( inputLength ) - 1 );
+            }
+
+            return;
+        }
+
+        // Area averaging is only defined for reductions
+        if ( interpolation == Interpolation::AREA && scale <= 1.0 )
+        {
+            interpolation = Interpolation::BILINEAR;
+        }
+
+        double support = interpolation == Interpolation::BILINEAR ? 1.0 :
+                         interpolation == Interpolation::BICUBIC ? 2.0 :
+                         interpolation == Interpolation::LANCZOS ? 3.0 : 0.5;
+
+        // Stretch the filter when reducing, so it averages out the skipped
+        // pixels instead of aliasing them
+        const double filterScale = std::max( scale, 1.0 );
+        support *= filterScale;
+
+        std::vector<std::vector<double>> weights( outputLength );
+        std::vector<int> lowest( outputLength );
+        unsigned int taps = 1;
+
+        for ( unsigned int i = 0; i < outputLength; ++i )
+        {
+            double center = ( i + 0.5 ) * scale;
+            int begin = static_cast<int>( std::floor( center - support ) );
+            int end = static_cast<int>( std::ceil( center + support ) );
+            int low = std::max( begin, 0 );
+            int high = std::min( end, static_cast<int>( inputLength ) );
+
+            std::vector<double>& w = weights[i];
+            w.assign( std::max( high - low, 1 ), 0.0 );
+            double sum = 0.0;
+
+            for ( int j = begin; j < end; ++j )
+            {
+                double weight;
+
+                if ( interpolation == Interpolation::AREA )
+                {
+                    weight = std::max( 0.0, std::min( center + support, j + 1.0 ) - std::max( center - support, static_cast<double>( j ) ) );
+                }
+                else
+                {
+                    weight = resampleWeight( ( j + 0.5 - center ) / filterScale, interpolation );
+                }
+
+                // Pixels outside the input replicate the edges
+                int k = std::min( std::max( j, low ), high - 1 ) - low;
+                w[std::max( k, 0 )] += weight;
+                sum += weight;
+            }
+
+            for ( double& weight : w )
+            {
+                weight = sum != 0.0 ? weight / sum : 1.0 / w.size();
+            }
+
+            lowest[i] = low;
+            taps = std::max( taps, static_cast<unsigned int>( w.size() ) );
+        }
+
+        taps = std::min( taps, inputLength );
+        table.taps = taps;
+        table.weights.assign( outputLength * taps, 0.0f );
+
+        for ( unsigned int i = 0; i < outputLength; ++i )
+        {
+            // Windows near the end are moved left, so all of them fit
+            int first = std::min( lowest[i], static_cast<int>( inputLength - taps ) );
+            table.first[i] = first;
+
+            for ( unsigned int k = 0; k < weights[i].size(); ++k )
+            {
+                table.weights[i * taps + lowest[i] - first + k] = static_cast<float>( weights[i][k] );
+            }
+        }
+    }
+
+    inline double ImageOperator::resampleWeight( double x, Interpolation interpolation )
+    {
+        const double pi = 3.14159265358979323846;
+        x = std::fabs( x );
+
+        switch ( interpolation )
+        {
+            case Interpolation::BILINEAR:
+                return x < 1.0 ? 1.0 - x : 0.0;
+
+            case Interpolation::BICUBIC:
+            {
+                const double a = -0.5;
+
+                if ( x < 1.0 )
+                {
+                    return ( ( a + 2.0 ) * x - ( a + 3.0 ) ) * x * x + 1.0;
+                }
+
+                if ( x < 2.0 )
+                {
+                    return ( ( x - 5.0 ) * x + 8.0 ) * x * a - 4.0 * a;
+                }
+
+                return 0.0;
+            }
+
+            case Interpolation::LANCZOS:
+            {
+                if ( x < 1e-8 )
+                {
+                    return 1.0;
+                }
+
+                if ( x >= 3.0 )
+                {
+                    return 0.0;
+                }
+
+                return 3.0 * std::sin( pi * x ) * std::sin( pi * x / 3.0 ) / ( pi * pi * x * x );
+            }
+
+            default:
+                return x < 0.5 ? 1.0 : 0.0;
+        }
+    }
+
+    inline void ImageOperator::padResampleTable( ResampleTable& table, unsigned int multiple )
+    {
+        const unsigned int taps = ( table.taps + multiple - 1 ) / multiple * multiple;
+
+        if ( taps == table.taps )
+        {
+            return;
+        }
+
+        std::vector<float> weights( table.first.size() * taps, 0.0f );
+
+        for ( unsigned int i = 0; i < table.first.size(); ++i )
+        {
+            std::copy( &table.weights[i * table.taps], &table.weights[i * table.taps] + table.taps, &weights[i * taps] );
+        }
+
+        table.taps = taps;
+        table.weights.swap( weights );
+    }
+
+    template<typename Channel>
+    void ImageOperator::resampleFloat( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Rect& region,
+                                       const ResampleTable& columnTable, const ResampleTable& rows )
+    {
+        const unsigned int width = outputImage.getWidth();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = width * channels;
+
+        ResampleTable columns( columnTable );
+        padResampleTable( columns, channels == 1 ? 4 : 1 );
+
+        const unsigned int grain = Parallel::calculateGrain( count * ( columns.taps + rows.taps ) );
+
+        Parallel::forRange( 0, outputImage.getHeight(), grain, [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            // Padded for the vector loads of simd::resampleRow()
+            std::vector<float> input( ( region.width + 4 ) * channels, 0.0f );
+            std::vector<float> ring( rows.taps * count );
+            std::vector<int> ringRows( rows.taps, -1 );
+            std::vector<const float*> window( rows.taps );
+            std::vector<float> kernel( rows.taps );
+            std::vector<float> accumulator( count );
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                for ( unsigned int k = 0; k < rows.taps; ++k )
+                {
+                    // Consecutive rows never share a slot of the ring
+                    int row = rows.first[y] + k;
+                    float* resampled = &ring[( row % rows.taps ) * count];
+
+                    if ( ringRows[row % rows.taps] != row )
+                    {
+                        simd::convert( inputImage( region.y + row, region.x ), &input[0], region.width * channels, 1.0, 0.0 );
+                        simd::resampleRow( &input[0], &columns.first[0], &columns.weights[0], columns.taps, width, channels, resampled );
+
+                        ringRows[row % rows.taps] = row;
+                    }
+
+                    window[k] = resampled;
+                    kernel[k] = rows.weights[y * rows.taps + k];
+                }
+
+                combineRows( &window[0], kernel, &accumulator[0], outputImage( y, 0 ), count );
+            }
+        } );
+    }
+
+    template<typename Channel>
+    bool ImageOperator::resampleFixedPoint( Image<Channel>&, const Image<Channel>&, const Rect&, const ResampleTable&, const ResampleTable& )
+    {
+        return false;
+    }
+
+    inline bool ImageOperator::resampleFixedPoint( Image<BYTE>& outputImage, const Image<BYTE>& inputImage, const Rect& region,
+                                                   const ResampleTable& columnTable, const ResampleTable& rows )
+    {
+        // Coefficients have 14 fractional bits. Resampled rows keep 6
+        // fractional bits in int16, which leaves room for the overshoot of
+        // bicubic and Lanczos filters. The vertical sums have 20.
+        const int coefficientBits = 14;
+        const int rowBits = 6;
+
+        auto quantize = []( const ResampleTable& table, std::vector<int16_t>& weights )
+        {
+            weights.resize( table.weights.size() );
+
+            for ( unsigned int i = 0; i < table.first.size(); ++i )
+            {
+                int total = 0;
+                unsigned int largest = i * table.taps;
+
+                for ( unsigned int k = i * table.taps; k < ( i + 1 ) * table.taps; ++k )
+                {
+                    weights[k] = static_cast<int16_t>( std::lround( table.weights[k] * ( 1 << coefficientBits ) ) );
+                    total += weights[k];
+                    largest = table.weights[k] > table.weights[largest] ? k : largest;
+                }
+
+                weights[largest] = static_cast<int16_t>( weights[largest] + ( 1 << coefficientBits ) - total );
+            }
+        };
+
+        const unsigned int width = outputImage.getWidth();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = width * channels;
+
+        ResampleTable columns( columnTable );
+        padResampleTable( columns, channels == 1 ? 8 : 2 );
+
+        std::vector<int16_t> columnWeights;
+        std::vector<int16_t> rowWeights;
+        quantize( columns, columnWeights );
+        quantize( rows, rowWeights );
+
+        const unsigned int grain = Parallel::calculateGrain( count * ( columns.taps + rows.taps ) );
+
+        Parallel::forRange( 0, outputImage.getHeight(), grain, [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            // Padded for the vector loads of simd::resampleRow()
+            std::vector<BYTE> input( region.width * channels + 16, 0 );
+            std::vector<int16_t> ring( rows.taps * count );
+            std::vector<int> ringRows( rows.taps, -1 );
+            std::vector<const int16_t*> window( rows.taps );
+            std::vector<int32_t> accumulator( count );
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                for ( unsigned int k = 0; k < rows.taps; ++k )
+                {
+                    int row = rows.first[y] + k;
+                    int16_t* resampled = &ring[( row % rows.taps ) * count];
+
+                    if ( ringRows[row % rows.taps] != row )
+                    {
+                        const BYTE* source = inputImage( region.y + row, region.x );
+                        std::copy( source, source + region.width * channels, input.begin() );
+                        simd::resampleRow( &input[0], &columns.first[0], &columnWeights[0], columns.taps, width, channels,
+                                           coefficientBits - rowBits, resampled );
+
+                        ringRows[row % rows.taps] = row;
+                    }
+
+                    window[k] = resampled;
+                }
+
+                std::fill( accumulator.begin(), accumulator.end(), 0 );
+                const int16_t* weights = &rowWeights[y * rows.taps];
+
+                for ( unsigned int k = 0; k < rows.taps; k += 2 )
+                {
+                    if ( k + 1 < rows.taps )
+                    {
+                        simd::multiplyAddPair( &accumulator[0], window[k], window[k + 1], weights[k], weights[k + 1], count );
+                    }
+                    else
+                    {
+                        simd::multiplyAddPair( &accumulator[0], window[k], window[k], weights[k], 0, count );
+                    }
+                }
+
+                simd::roundShiftPack( &accumulator[0], outputImage( y, 0 ), coefficientBits + rowBits, count );
+            }
+        } );
+
+        return true;
+    }
+
+    inline void ImageOperator::equalizeHistogram( ImageByte& outputImage, const ImageByte& inputImage )
+    {
+        Histogram histogram;
+        histogram.compute( inputImage );
+
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        std::vector<BYTE> tables( channels * 256 );
+
+        for ( unsigned int c = 0; c < channels; ++c )
+        {
+            const uint64_t* counts = histogram.getCounts( c );
+            BYTE* table = &tables[c * 256];
+            uint64_t total = histogram.getTotal( c );
+            uint64_t first = 0;
+
+            // The lowest value present maps to 0
+            for ( unsigned int v = 0; v < 256 && first == 0; ++v )
+            {
+                first = counts[v];
+            }
+
+            uint64_t sum = 0;
+
+            for ( unsigned int v = 0; v < 256; ++v )
+            {
+                sum += counts[v];
+
+                if ( isAlpha( inputImage.getColorSpace(), c ) || total == first )
+                {
+                    table[v] = static_cast<BYTE>( v );
+                }
+                else
+                {
+                    double value = static_cast<double>( sum > first ? sum - first : 0 ) * 255.0 / ( total - first );
+                    table[v] = static_cast<BYTE>( std::lround( value ) );
+                }
+            }
+        }
+
+        applyLUT( outputImage, inputImage, LUT( &tables[0], channels ) );
+    }
+
+    inline void ImageOperator::clahe( ImageByte& outputImage, const ImageByte& inputImage,
+                                      unsigned int tilesX, unsigned int tilesY, double clipLimit )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        // Clipping every bin to the mean count would still move values, as
+        // empty bins get part of the excess: disable equalization instead
+        if ( clipLimit <= 1.0 )
+        {
+            if ( &outputImage != &inputImage )
+            {
+                outputImage = inputImage;
+            }
+
+            return;
+        }
+
+        tilesX = std::max( 1u, std::min( tilesX, width ) );
+        tilesY = std::max( 1u, std::min( tilesY, height ) );
+
+        // Tile boundaries and centers
+        std::vector<unsigned int> columns( tilesX + 1 );
+        std::vector<unsigned int> rows( tilesY + 1 );
+
+        for ( unsigned int i = 0; i <= tilesX; ++i )
+        {
+            columns[i] = i * width / tilesX;
+        }
+
+        for ( unsigned int i = 0; i <= tilesY; ++i )
+        {
+            rows[i] = i * height / tilesY;
+        }
+
+        // One equalization table per tile and channel
+        std::vector<BYTE> tables( tilesX * tilesY * channels * 256 );
+
+        Parallel::forRange( 0, tilesY * tilesX, 1, [&]( unsigned int firstTile, unsigned int lastTile )
+        {
+            Histogram histogram;
+            std::vector<uint64_t> counts( 256 );
+
+            for ( unsigned int tile = firstTile; tile < lastTile; ++tile )
+            {
+                unsigned int tx = tile % tilesX;
+                unsigned int ty = tile / tilesX;
+                Rect region( columns[tx], rows[ty], columns[tx + 1] - columns[tx], rows[ty + 1] - rows[ty] );
+                uint64_t area = static_cast<uint64_t>( region.width ) * region.height;
+
+                // Tiles are already spread over the threads
+                histogram.compute( inputImage, region, false );
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    BYTE* table = &tables[( tile * channels + c ) * 256];
+                    std::copy( histogram.getCounts( c ), histogram.getCounts( c ) + 256, counts.begin() );
+
+                    // Clip the histogram and give the excess back evenly
+                    uint64_t limit = std::max<uint64_t>( 1, static_cast<uint64_t>( clipLimit * area / 256.0 ) );
+                    uint64_t excess = 0;
+
+                    for ( uint64_t& count : counts )
+                    {
+                        if ( count > limit )
+                        {
+                            excess += count - limit;
+                            count = limit;
+                        }
+                    }
+
+                    for ( unsigned int v = 0; v < 256; ++v )
+                    {
+                        counts[v] += excess / 256 + ( v < excess % 256 ? 1 : 0 );
+                    }
+
+                    uint64_t sum = 0;
+
+                    for ( unsigned int v = 0; v < 256; ++v )
+                    {
+                        sum += counts[v];
+                        table[v] = isAlpha( inputImage.getColorSpace(), c ) ? static_cast<BYTE>( v ) :
+                                   static_cast<BYTE>( std::min<uint64_t>( 255, ( sum * 255 + area / 2 ) / area ) );
+                    }
+                }
+            }
+        } );
+
+        // For each column and row: the two nearest tiles and the weight of the
+        // second one. Pixels before the first or after the last tile center
+        // use a single tile.
+        auto neighbors = []( const std::vector<unsigned int>& bounds, unsigned int length,
+                             std::vector<unsigned int>& first, std::vector<float>& weight )
+        {
+            unsigned int tiles = bounds.size() - 1;
+            first.resize( length );
+            weight.resize( length );
+
+            for ( unsigned int i = 0, tile = 0; i < length; ++i )
+            {
+                double position = i + 0.5;
+
+                while ( tile + 1 < tiles && position >= 0.5 * ( bounds[tile + 1] + bounds[tile + 2] ) )
+                {
+                    ++tile;
+                }
+
+                double center = 0.5 * ( bounds[tile] + bounds[tile + 1] );
+                double next = tile + 1 < tiles ? 0.5 * ( bounds[tile + 1] + bounds[tile + 2] ) : center;
+
+                first[i] = tile;
+                weight[i] = next > center && position > center ? static_cast<float>( ( position - center ) / ( next - center ) ) : 0.0f;
+            }
+        };
+
+        std::vector<unsigned int> tileColumn, tileRow;
+        std::vector<float> weightX, weightY;
+        neighbors( columns, width, tileColumn, weightX );
+        neighbors( rows, height, tileRow, weightY );
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 4 * width * channels ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const BYTE* input = inputImage( y, 0 );
+                BYTE* output = outputImage( y, 0 );
+                unsigned int top = tileRow[y];
+                unsigned int bottom = std::min( top + 1, tilesY - 1 );
+                float wy = weightY[y];
+
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    unsigned int left = tileColumn[x];
+                    unsigned int right = std::min( left + 1, tilesX - 1 );
+                    float wx = weightX[x];
+
+                    const BYTE* topLeft = &tables[( top * tilesX + left ) * channels * 256];
+                    const BYTE* topRight = &tables[( top * tilesX + right ) * channels * 256];
+                    const BYTE* bottomLeft = &tables[( bottom * tilesX + left ) * channels * 256];
+                    const BYTE* bottomRight = &tables[( bottom * tilesX + right ) * channels * 256];
+
+                    for ( unsigned int c = 0; c < channels; ++c, ++input, ++output )
+                    {
+                        unsigned int v = c * 256 + *input;
+                        float upper = topLeft[v] + wx * ( topRight[v] - topLeft[v] );
+                        float lower = bottomLeft[v] + wx * ( bottomRight[v] - bottomLeft[v] );
+                        *output = static_cast<BYTE>( upper + wy * ( lower - upper ) + 0.5f );
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::erode( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                               unsigned int radiusX, unsigned int radiusY, BorderMode border, double borderValue )
+    {
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            morphology( outputImage, copy, radiusX, radiusY, false, border, borderValue );
+        }
+        else
+        {
+            morphology( outputImage, inputImage, radiusX, radiusY, false, border, borderValue );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::dilate( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                unsigned int radiusX, unsigned int radiusY, BorderMode border, double borderValue )
+    {
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            morphology( outputImage, copy, radiusX, radiusY, true, border, borderValue );
+        }
+        else
+        {
+            morphology( outputImage, inputImage, radiusX, radiusY, true, border, borderValue );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::open( Image<Channel>& outputImage, const Image<Channel>& inputImage, unsigned int radiusX, unsigned int radiusY )
+    {
+        Image<Channel> eroded;
+        morphology( eroded, inputImage, radiusX, radiusY, false, BorderMode::REPLICATE, 0.0 );
+        morphology( outputImage, eroded, radiusX, radiusY, true, BorderMode::REPLICATE, 0.0 );
+    }
+
+    template<typename Channel>
+    void ImageOperator::close( Image<Channel>& outputImage, const Image<Channel>& inputImage, unsigned int radiusX, unsigned int radiusY )
+    {
+        Image<Channel> dilated;
+        morphology( dilated, inputImage, radiusX, radiusY, true, BorderMode::REPLICATE, 0.0 );
+        morphology( outputImage, dilated, radiusX, radiusY, false, BorderMode::REPLICATE, 0.0 );
+    }
+
+    template<typename Channel>
+    void ImageOperator::morphology( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                    unsigned int radiusX, unsigned int radiusY, bool dilation,
+                                    BorderMode border, double borderValue )
+    {
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = width * channels;
+        const Channel constant = simd::saturate<Channel>( borderValue );
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        // Windows of up to this many pixels are combined directly
+        const unsigned int directSize = 7;
+
+        auto combine = [dilation]( Channel* output, const Channel* a, const Channel* b, unsigned int length )
+        {
+            if ( dilation )
+            {
+                simd::maximum( output, a, b, length );
+            }
+            else
+            {
+                simd::minimum( output, a, b, length );
+            }
+        };
+
+        // van Herk/Gil-Werman: split the sequence in blocks of the window
+        // size, and compute running extrema forward (prefix) and backward
+        // (suffix) within each block. Any window spans at most two blocks,
+        // so it is the suffix of the first one combined with the prefix of
+        // the second one.
+
+        // Horizontal pass into a temporary image
+        Image<Channel> rowsImage;
+        const Image<Channel>* horizontal = &inputImage;
+
+        if ( radiusX > 0 )
+        {
+            rowsImage.create( width, height, inputImage.getColorSpace() );
+            horizontal = &rowsImage;
+
+            const unsigned int size = 2 * radiusX + 1;
+            const unsigned int length = width + 2 * radiusX;
+
+            Parallel::forRange( 0, height, Parallel::calculateGrain( 4 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+            {
+                std::vector<Channel> padded( length * channels );
+                std::vector<Channel> prefix( size > directSize ? length * channels : 0 );
+                std::vector<Channel> suffix( size > directSize ? length * channels : 0 );
+
+                for ( unsigned int y = firstRow; y < lastRow; ++y )
+                {
+                    const Channel* input = inputImage( y, 0 );
+                    Channel* output = rowsImage( y, 0 );
+
+                    for ( unsigned int i = 0; i < length; ++i )
+                    {
+                        int x = mapBorder( static_cast<int>( i ) - static_cast<int>( radiusX ), width, border );
+
+                        for ( unsigned int c = 0; c < channels; ++c )
+                        {
+                            padded[i * channels + c] = x < 0 ? constant : input[x * channels + c];
+                        }
+                    }
+
+                    if ( size <= directSize )
+                    {
+                        combine( output, &padded[0], &padded[channels], count );
+
+                        for ( unsigned int t = 2; t < size; ++t )
+                        {
+                            combine( output, output, &padded[t * channels], count );
+                        }
+
+                        continue;
+                    }
+
+                    for ( unsigned int i = 0; i < length; ++i )
+                    {
+                        unsigned int index = i * channels;
+
+                        if ( i % size == 0 )
+                        {
+                            std::copy( &padded[index], &padded[index] + channels, &prefix[index] );
+                        }
+                        else
+                        {
+                            combine( &prefix[index], &prefix[index - channels], &padded[index], channels );
+                        }
+                    }
+
+                    for ( unsigned int i = length; i-- > 0; )
+                    {
+                        unsigned int index = i * channels;
+
+                        if ( i % size == size - 1 || i == length - 1 )
+                        {
+                            std::copy( &padded[index], &padded[index] + channels, &suffix[index] );
+                        }
+                        else
+                        {
+                            combine( &suffix[index], &suffix[index + channels], &padded[index], channels );
+                        }
+                    }
+
+                    combine( output, &suffix[0], &prefix[( size - 1 ) * channels], count );
+                }
+            } );
+        }
+
+        // Vertical pass, combining whole rows
+        const unsigned int size = 2 * radiusY + 1;
+        std::vector<Channel> constantRow( border == BorderMode::CONSTANT ? count : 0, constant );
+
+        // Row of the horizontal pass at a padded index (source row + radiusY)
+        auto row = [&]( int index ) -> const Channel*
+        {
+            int y = mapBorder( index - static_cast<int>( radiusY ), height, border );
+            return y < 0 ? &constantRow[0] : ( *horizontal )( y, 0 );
+        };
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 4 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            if ( size <= directSize )
+            {
+                for ( unsigned int y = firstRow; y < lastRow; ++y )
+                {
+                    Channel* output = outputImage( y, 0 );
+
+                    if ( size == 1 )
+                    {
+                        std::copy( row( y ), row( y ) + count, output );
+                        continue;
+                    }
+
+                    combine( output, row( y ), row( y + 1 ), count );
+
+                    for ( unsigned int t = 2; t < size; ++t )
+                    {
+                        combine( output, output, row( y + t ), count );
+                    }
+                }
+
+                return;
+            }
+
+            // Output rows [start, start + size) need the suffixes of the block
+            // starting at start and the prefixes of the next block
+            std::vector<Channel> suffix( size * count );
+            std::vector<Channel> prefix( ( size - 1 ) * count );
+
+            for ( unsigned int start = firstRow; start < lastRow; start += size )
+            {
+                unsigned int rows = std::min( size, lastRow - start );
+
+                std::copy( row( start + size - 1 ), row( start + size - 1 ) + count, &suffix[( size - 1 ) * count] );
+
+                for ( unsigned int j = size - 1; j-- > 0; )
+                {
+                    combine( &suffix[j * count], row( start + j ), &suffix[( j + 1 ) * count], count );
+                }
+
+                if ( rows > 1 )
+                {
+                    std::copy( row( start + size ), row( start + size ) + count, &prefix[0] );
+                }
+
+                for ( unsigned int j = 1; j + 1 < rows; ++j )
+                {
+                    combine( &prefix[j * count], &prefix[( j - 1 ) * count], row( start + size + j ), count );
+                }
+
+                std::copy( &suffix[0], &suffix[0] + count, outputImage( start, 0 ) );
+
+                for ( unsigned int j = 1; j < rows; ++j )
+                {
+                    combine( outputImage( start + j, 0 ), &suffix[j * count], &prefix[( j - 1 ) * count], count );
+                }
+            }
+        } );
+    }
+
+    inline void ImageOperator::medianFilter( ImageByte& outputImage, const ImageByte& inputImage, unsigned int radius,
+                                             BorderMode border, double borderValue )
+    {
+        if ( &outputImage == &inputImage )
+        {
+            ImageByte copy( inputImage );
+            medianFilter( outputImage, copy, radius, border, borderValue );
+            return;
+        }
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        if ( !hasLayout( outputImage, inputImage.getWidth(), inputImage.getHeight(), inputImage.getColorSpace() ) )
+        {
+            outputImage.create( inputImage.getWidth(), inputImage.getHeight(), inputImage.getColorSpace() );
+        }
+
+        radius = std::min( radius, 127u );
+
+        if ( radius == 0 )
+        {
+            for ( unsigned int y = 0; y < inputImage.getHeight(); ++y )
+            {
+                std::copy( inputImage( y, 0 ), inputImage( y, 0 ) + inputImage.getWidth() * inputImage.getNumberOfChannels(), outputImage( y, 0 ) );
+            }
+        }
+        else if ( radius <= 2 )
+        {
+            medianNetwork( outputImage, inputImage, radius, border, simd::saturate<BYTE>( borderValue ) );
+        }
+        else
+        {
+            medianHistogram( outputImage, inputImage, radius, border, simd::saturate<BYTE>( borderValue ) );
+        }
+    }
+
+    inline void ImageOperator::medianNetwork( ImageByte& outputImage, const ImageByte& inputImage, unsigned int radius,
+                                              BorderMode border, BYTE borderValue )
+    {
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = width * channels;
+        const unsigned int size = 2 * radius + 1;
+        const unsigned int paddedLength = ( width + 2 * radius ) * channels;
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 16 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            // Rows of the window, padded horizontally
+            std::vector<BYTE> padded( size * paddedLength );
+            std::vector<const BYTE*> taps( size * size );
+            BYTE values[25];
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                for ( unsigned int j = 0; j < size; ++j )
+                {
+                    int sourceRow = mapBorder( static_cast<int>( y + j ) - static_cast<int>( radius ), height, border );
+                    BYTE* row = &padded[j * paddedLength];
+
+                    for ( int x = -static_cast<int>( radius ); x < width + static_cast<int>( radius ); ++x )
+                    {
+                        int sourceColumn = sourceRow < 0 ? -1 : mapBorder( x, width, border );
+
+                        for ( unsigned int c = 0; c < channels; ++c )
+                        {
+                            *row++ = sourceColumn < 0 ? borderValue : inputImage( sourceRow, sourceColumn )[c];
+                        }
+                    }
+
+                    for ( unsigned int i = 0; i < size; ++i )
+                    {
+                        taps[j * size + i] = &padded[j * paddedLength + i * channels];
+                    }
+                }
+
+                BYTE* output = outputImage( y, 0 );
+                unsigned int i = 0;
+
+#if defined(__AVX2__)
+                __m256i vectors[25];
+
+                for ( ; i + 32 <= count; i += 32 )
+                {
+                    for ( unsigned int k = 0; k < size * size; ++k )
+                    {
+                        vectors[k] = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( taps[k] + i ) );
+                    }
+
+                    __m256i median = size == 3 ? simd::medianOf9( vectors ) : simd::medianOf25( vectors );
+                    _mm256_storeu_si256( reinterpret_cast<__m256i*>( output + i ), median );
+                }
+#elif defined(__SSE2__)
+                __m128i vectors[25];
+
+                for ( ; i + 16 <= count; i += 16 )
+                {
+                    for ( unsigned int k = 0; k < size * size; ++k )
+                    {
+                        vectors[k] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( taps[k] + i ) );
+                    }
+
+                    __m128i median = size == 3 ? simd::medianOf9( vectors ) : simd::medianOf25( vectors );
+                    _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), median );
+                }
+#endif
+
+                for ( ; i < count; ++i )
+                {
+                    for ( unsigned int k = 0; k < size * size; ++k )
+                    {
+                        values[k] = taps[k][i];
+                    }
+
+                    output[i] = size == 3 ? simd::medianOf9( values ) : simd::medianOf25( values );
+                }
+            }
+        } );
+    }
+
+    inline void ImageOperator::medianHistogram( ImageByte& outputImage, const ImageByte& inputImage, unsigned int radius,
+                                                BorderMode border, BYTE borderValue )
+    {
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const int r = radius;
+        const unsigned int size = 2 * radius + 1;
+        const unsigned int rank = size * size / 2;
+
+        // Histograms have 256 fine bins and 16 coarse bins (of 16 values)
+        // to find the median without scanning all 256 bins
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 64 * width * channels ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<uint16_t> columnFine( width * channels * 256, 0 );
+            std::vector<uint16_t> columnCoarse( width * channels * 16, 0 );
+            std::vector<uint16_t> constantFine( 256, 0 );
+            std::vector<uint16_t> constantCoarse( 16, 0 );
+            std::vector<uint16_t> kernelFine( 256 );
+            std::vector<uint16_t> kernelCoarse( 16 );
+
+            constantFine[borderValue] = size;
+            constantCoarse[borderValue >> 4] = size;
+
+            // Add (or remove) an image row to the column histograms
+            auto updateColumns = [&]( int y, int delta )
+            {
+                int sourceRow = mapBorder( y, height, border );
+
+                for ( unsigned int i = 0; i < width * channels; ++i )
+                {
+                    BYTE value = sourceRow < 0 ? borderValue : inputImage( sourceRow, 0 )[i];
+                    columnFine[i * 256 + value] += delta;
+                    columnCoarse[i * 16 + ( value >> 4 )] += delta;
+                }
+            };
+
+            auto fine = [&]( int x, unsigned int c ) -> const uint16_t*
+            {
+                int column = mapBorder( x, width, border );
+                return column < 0 ? &constantFine[0] : &columnFine[( column * channels + c ) * 256];
+            };
+
+            auto coarse = [&]( int x, unsigned int c ) -> const uint16_t*
+            {
+                int column = mapBorder( x, width, border );
+                return column < 0 ? &constantCoarse[0] : &columnCoarse[( column * channels + c ) * 16];
+            };
+
+            for ( int y = static_cast<int>( firstRow ) - r; y <= static_cast<int>( firstRow ) + r; ++y )
+            {
+                updateColumns( y, 1 );
+            }
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                BYTE* output = outputImage( y, 0 );
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    std::fill( kernelFine.begin(), kernelFine.end(), 0 );
+                    std::fill( kernelCoarse.begin(), kernelCoarse.end(), 0 );
+
+                    for ( int x = -r; x <= r; ++x )
+                    {
+                        simd::multiplyAdd( &kernelFine[0], fine( x, c ), 1, 256 );
+                        simd::multiplyAdd( &kernelCoarse[0], coarse( x, c ), 1, 16 );
+                    }
+
+                    for ( int x = 0; x < width; ++x )
+                    {
+                        if ( x > 0 )
+                        {
+                            simd::addSubtract( &kernelFine[0], fine( x + r, c ), fine( x - r - 1, c ), 256 );
+                            simd::addSubtract( &kernelCoarse[0], coarse( x + r, c ), coarse( x - r - 1, c ), 16 );
+                        }
+
+                        // Find the coarse bin holding the median, then the value
+                        unsigned int below = 0;
+                        unsigned int bin = 0;
+
+                        while ( below + kernelCoarse[bin] <= rank )
+                        {
+                            below += kernelCoarse[bin++];
+                        }
+
+                        unsigned int value = bin * 16;
+
+                        while ( below + kernelFine[value] <= rank )
+                        {
+                            below += kernelFine[value++];
+                        }
+
+                        output[x * channels + c] = static_cast<BYTE>( value );
+                    }
+                }
+
+                if ( y + 1 < lastRow )
+                {
+                    updateColumns( static_cast<int>( y ) - r, -1 );
+                    updateColumns( static_cast<int>( y ) + r + 1, 1 );
+                }
+            }
+        } );
+    }
+
+    template<typename Derivative, typename Channel>
+    void ImageOperator::sobel( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                               unsigned int dx, unsigned int dy, BorderMode border )
+    {
+        static_assert( std::is_same<Derivative, int16_t>::value || std::is_same<Derivative, float>::value,
+                       "owl::ImageOperator assertion: derivatives must be int16_t or float." );
+
+        static const int kernels[3][3] = { { 1, 2, 1 }, { -1, 0, 1 }, { 1, -2, 1 } };
+
+        if ( dx > 2 || dy > 2 || dx + dy < 1 || dx + dy > 2 )
+        {
+            return;
+        }
+
+        if ( !derivativeFixedPoint( outputImage, inputImage, kernels[dx], kernels[dy], border ) )
+        {
+            derivativeFilter<float>( outputImage, inputImage, kernels[dx], kernels[dy], border );
+        }
+    }
+
+    template<typename Derivative, typename Channel>
+    void ImageOperator::scharr( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                                unsigned int dx, unsigned int dy, BorderMode border )
+    {
+        static_assert( std::is_same<Derivative, int16_t>::value || std::is_same<Derivative, float>::value,
+                       "owl::ImageOperator assertion: derivatives must be int16_t or float." );
+
+        static const int kernels[2][3] = { { 3, 10, 3 }, { -1, 0, 1 } };
+
+        if ( dx > 1 || dy > 1 || dx + dy != 1 )
+        {
+            return;
+        }
+
+        if ( !derivativeFixedPoint( outputImage, inputImage, kernels[dx], kernels[dy], border ) )
+        {
+            derivativeFilter<float>( outputImage, inputImage, kernels[dx], kernels[dy], border );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::gradient( ImageFloat& magnitude, ImageFloat& orientation, const Image<Channel>& inputImage,
+                                  bool useScharr, BorderMode border )
+    {
+        static const int sobelSmoothing[3] = { 1, 2, 1 };
+        static const int scharrSmoothing[3] = { 3, 10, 3 };
+        static const int difference[3] = { -1, 0, 1 };
+
+        const int* smoothing = useScharr ? scharrSmoothing : sobelSmoothing;
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = width * channels;
+        const unsigned int length = count + 2 * channels;
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        if ( static_cast<const void*>( &magnitude ) == static_cast<const void*>( &inputImage ) ||
+             static_cast<const void*>( &orientation ) == static_cast<const void*>( &inputImage ) )
+        {
+            Image<Channel> copy( inputImage );
+            gradient( magnitude, orientation, copy, useScharr, border );
+            return;
+        }
+
+        if ( !hasLayout( magnitude, width, height, inputImage.getColorSpace() ) )
+        {
+            magnitude.create( width, height, inputImage.getColorSpace() );
+        }
+
+        if ( !hasLayout( orientation, width, height, inputImage.getColorSpace() ) )
+        {
+            orientation.create( width, height, inputImage.getColorSpace() );
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 16 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            // Padded input rows, cached in 4 slots keyed by row
+            std::vector<float> cache( 4 * length );
+            int cachedRows[4] = { -2, -2, -2, -2 };
+            std::vector<float> vertical( length );
+            std::vector<float> dx( count );
+            std::vector<float> dy( count );
+
+            auto row = [&]( int y ) -> const float*
+            {
+                unsigned int slot = static_cast<unsigned int>( y + 4 ) % 4;
+
+                if ( cachedRows[slot] != y )
+                {
+                    padRow( inputImage, y, border, 1, &cache[slot * length] );
+                    cachedRows[slot] = y;
+                }
+
+                return &cache[slot * length + channels];
+            };
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const float* above = row( static_cast<int>( y ) - 1 );
+                const float* center = row( y );
+                const float* below = row( y + 1 );
+
+                filterRow3x3( above, center, below, difference, smoothing, &vertical[0], &dx[0], count, channels );
+                filterRow3x3( above, center, below, smoothing, difference, &vertical[0], &dy[0], count, channels );
+
+                float* outputMagnitude = magnitude( y, 0 );
+                float* outputOrientation = orientation( y, 0 );
+
+                for ( unsigned int i = 0; i < count; ++i )
+                {
+                    outputMagnitude[i] = std::sqrt( dx[i] * dx[i] + dy[i] * dy[i] );
+                    outputOrientation[i] = std::atan2( dy[i], dx[i] );
+                }
+            }
+        } );
+    }
+
+    inline void ImageOperator::canny( ImageByte& edges, const ImageByte& inputImage,
+                                      double lowThreshold, double highThreshold, double sigma )
+    {
+        static const int smoothing[3] = { 1, 2, 1 };
+        static const int difference[3] = { -1, 0, 1 };
+
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+
+        if ( inputImage.getData() == nullptr || inputImage.getColorSpace() != ColorSpace::Type::GRAYSCALE )
+        {
+            return;
+        }
+
+        if ( &edges == &inputImage )
+        {
+            ImageByte copy( inputImage );
+            canny( edges, copy, lowThreshold, highThreshold, sigma );
+            return;
+        }
+
+        if ( !hasLayout( edges, width, height, ColorSpace::Type::GRAYSCALE ) )
+        {
+            edges.create( width, height, ColorSpace::Type::GRAYSCALE );
+        }
+
+        const std::vector<float> kernel = sigma > 0.0 ? gaussianKernel( sigma ) : std::vector<float>( 1, 1.0f );
+        const int radius = kernel.size() / 2;
+        const unsigned int length = width + 2;
+        const float low = static_cast<float>( lowThreshold );
+        const float high = static_cast<float>( highThreshold );
+
+        // Stage of a pixel in the edge map, before hysteresis
+        const BYTE weak = 1;
+        const BYTE strong = 255;
+
+        std::vector<unsigned int> seeds;
+        std::mutex seedsMutex;
+
+        // Each band recomputes the few rows of the previous stages it needs
+        // above and below it. Rows of every stage are cached in small rings
+        // keyed by row; rows outside the image are mirrored (REFLECT).
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 64 * width ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            const unsigned int blurSlots = kernel.size() + 1;
+            std::vector<float> blurred( blurSlots * width );
+            std::vector<int> blurredRows( blurSlots, -1 );
+            std::vector<float> padded( width + 2 * radius );
+            std::vector<float> smoothed( 4 * length );
+            int smoothedRows[4] = { -1, -1, -1, -1 };
+            std::vector<float> gradients( 4 * 3 * width );
+            int gradientRows[4] = { -1, -1, -1, -1 };
+            std::vector<float> vertical( length );
+            std::vector<unsigned int> bandSeeds;
+
+            // Input row blurred horizontally
+            auto blurredRow = [&]( int y ) -> const float*
+            {
+                unsigned int slot = y % blurSlots;
+                float* output = &blurred[slot * width];
+
+                if ( blurredRows[slot] != y )
+                {
+                    padRow( inputImage, y, BorderMode::REFLECT, radius, &padded[0] );
+                    simd::multiply( output, &padded[0], kernel[0], width );
+
+                    for ( unsigned int t = 1; t < kernel.size(); ++t )
+                    {
+                        simd::multiplyAdd( output, &padded[t], kernel[t], width );
+                    }
+
+                    blurredRows[slot] = y;
+                }
+
+                return output;
+            };
+
+            // Smoothed row padded by one pixel, pointing to its first pixel
+            auto smoothedRow = [&]( int y ) -> const float*
+            {
+                y = mapBorder( y, height, BorderMode::REFLECT );
+                unsigned int slot = y % 4;
+                float* output = &smoothed[slot * length + 1];
+
+                if ( smoothedRows[slot] != y )
+                {
+                    simd::multiply( output, blurredRow( mapBorder( y - radius, height, BorderMode::REFLECT ) ), kernel[0], width );
+
+                    for ( unsigned int t = 1; t < kernel.size(); ++t )
+                    {
+                        simd::multiplyAdd( output, blurredRow( mapBorder( y - radius + t, height, BorderMode::REFLECT ) ), kernel[t], width );
+                    }
+
+                    output[-1] = output[mapBorder( -1, width, BorderMode::REFLECT )];
+                    output[width] = output[mapBorder( width, width, BorderMode::REFLECT )];
+                    smoothedRows[slot] = y;
+                }
+
+                return output;
+            };
+
+            // Derivatives and magnitude of a row, consecutive
+            auto gradientRow = [&]( int y ) -> const float*
+            {
+                unsigned int slot = y % 4;
+                float* output = &gradients[slot * 3 * width];
+
+                if ( gradientRows[slot] != y )
+                {
+                    const float* above = smoothedRow( y - 1 );
+                    const float* center = smoothedRow( y );
+                    const float* below = smoothedRow( y + 1 );
+                    float* dx = output;
+                    float* dy = output + width;
+                    float* magnitude = output + 2 * width;
+
+                    filterRow3x3( above, center, below, difference, smoothing, &vertical[0], dx, width, 1 );
+                    filterRow3x3( above, center, below, smoothing, difference, &vertical[0], dy, width, 1 );
+
+                    for ( int x = 0; x < width; ++x )
+                    {
+                        magnitude[x] = std::sqrt( dx[x] * dx[x] + dy[x] * dy[x] );
+                    }
+
+                    gradientRows[slot] = y;
+                }
+
+                return output;
+            };
+
+            // tan(22.5 degrees) and tan(67.5 degrees)
+            const float tan22 = 0.41421356f;
+            const float tan67 = 2.41421356f;
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const float* current = gradientRow( y );
+                const float* dx = current;
+                const float* dy = current + width;
+                const float* magnitude = current + 2 * width;
+                const float* above = y > 0 ? gradientRow( y - 1 ) + 2 * width : nullptr;
+                const float* below = static_cast<int>( y ) + 1 < height ? gradientRow( y + 1 ) + 2 * width : nullptr;
+                BYTE* output = edges( y, 0 );
+
+                auto at = [&]( const float* row, int x ) -> float
+                {
+                    return row != nullptr && x >= 0 && x < width ? row[x] : 0.0f;
+                };
+
+                for ( int x = 0; x < width; ++x )
+                {
+                    float m = magnitude[x];
+                    output[x] = 0;
+
+                    if ( m <= low )
+                    {
+                        continue;
+                    }
+
+                    // Keep local maxima across the edge, quantized to 4
+                    // directions; ties are broken towards the top-left
+                    float ax = std::fabs( dx[x] );
+                    float ay = std::fabs( dy[x] );
+                    float first, second;
+
+                    if ( ay <= ax * tan22 )
+                    {
+                        first = at( magnitude, x - 1 );
+                        second = at( magnitude, x + 1 );
+                    }
+                    else if ( ay > ax * tan67 )
+                    {
+                        first = at( above, x );
+                        second = at( below, x );
+                    }
+                    else if ( ( dx[x] > 0.0f ) == ( dy[x] > 0.0f ) )
+                    {
+                        first = at( above, x - 1 );
+                        second = at( below, x + 1 );
+                    }
+                    else
+                    {
+                        first = at( above, x + 1 );
+                        second = at( below, x - 1 );
+                    }
+
+                    if ( m > first && m >= second )
+                    {
+                        output[x] = m > high ? strong : weak;
+
+                        if ( m > high )
+                        {
+                            bandSeeds.push_back( y * width + x );
+                        }
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock( seedsMutex );
+            seeds.insert( seeds.end(), bandSeeds.begin(), bandSeeds.end() );
+        } );
+
+        // Hysteresis: grow strong edges into the connected weak ones
+        while ( !seeds.empty() )
+        {
+            unsigned int index = seeds.back();
+            seeds.pop_back();
+
+            int x = index % width;
+            int y = index / width;
+
+            for ( int j = std::max( y - 1, 0 ); j <= std::min( y + 1, height - 1 ); ++j )
+            {
+                BYTE* row = edges( j, 0 );
+
+                for ( int i = std::max( x - 1, 0 ); i <= std::min( x + 1, width - 1 ); ++i )
+                {
+                    if ( row[i] == weak )
+                    {
+                        row[i] = strong;
+                        seeds.push_back( j * width + i );
+                    }
+                }
+            }
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( width ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                BYTE* row = edges( y, 0 );
+
+                for ( int x = 0; x < width; ++x )
+                {
+                    row[x] = row[x] == strong ? strong : 0;
+                }
+            }
+        } );
+    }
+
+    template<typename Channel, typename Output>
+    void ImageOperator::padRow( const Image<Channel>& image, int row, BorderMode border, unsigned int padding, Output* output )
+    {
+        const int width = image.getWidth();
+        const unsigned int channels = image.getNumberOfChannels();
+        const int sourceRow = mapBorder( row, image.getHeight(), border );
+
+        if ( sourceRow < 0 )
+        {
+            std::fill( output, output + ( width + 2 * padding ) * channels, Output( 0 ) );
+            return;
+        }
+
+        const Channel* input = image( sourceRow, 0 );
+        simd::convert( input, output + padding * channels, width * channels, 1.0, 0.0 );
+
+        for ( unsigned int p = 1; p <= padding; ++p )
+        {
+            int left = mapBorder( -static_cast<int>( p ), width, border );
+            int right = mapBorder( width - 1 + p, width, border );
+            Output* leftPixel = output + ( padding - p ) * channels;
+            Output* rightPixel = output + ( padding + width - 1 + p ) * channels;
+
+            for ( unsigned int c = 0; c < channels; ++c )
+            {
+                leftPixel[c] = left < 0 ? Output( 0 ) : static_cast<Output>( input[left * channels + c] );
+                rightPixel[c] = right < 0 ? Output( 0 ) : static_cast<Output>( input[right * channels + c] );
+            }
+        }
+    }
+
+    template<typename T>
+    void ImageOperator::filterRow3x3( const T* above, const T* center, const T* below, const int* kx, const int* ky,
+                                      T* vertical, T* output, unsigned int count, unsigned int channels )
+    {
+        // Kernel elements are small integers; T( k ) wraps negative values
+        // for uint16_t, which keeps 16-bit two's complement results exact
+        const T* rows[3] = { above - channels, center - channels, below - channels };
+        const unsigned int length = count + 2 * channels;
+        bool first = true;
+
+        for ( unsigned int t = 0; t < 3; ++t )
+        {
+            if ( ky[t] != 0 )
+            {
+                if ( first )
+                {
+                    simd::multiply( vertical, rows[t], static_cast<T>( ky[t] ), length );
+                }
+                else
+                {
+                    simd::multiplyAdd( vertical, rows[t], static_cast<T>( ky[t] ), length );
+                }
+
+                first = false;
+            }
+        }
+
+        first = true;
+
+        for ( unsigned int t = 0; t < 3; ++t )
+        {
+            if ( kx[t] != 0 )
+            {
+                if ( first )
+                {
+                    simd::multiply( output, vertical + t * channels, static_cast<T>( kx[t] ), count );
+                }
+                else
+                {
+                    simd::multiplyAdd( output, vertical + t * channels, static_cast<T>( kx[t] ), count );
+                }
+
+                first = false;
+            }
+        }
+    }
+
+    template<typename Accumulator, typename Derivative, typename Channel>
+    void ImageOperator::derivativeFilter( Image<Derivative>& outputImage, const Image<Channel>& inputImage,
+                                          const int* kx, const int* ky, BorderMode border )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = width * channels;
+        const unsigned int length = count + 2 * channels;
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        if ( static_cast<const void*>( &outputImage ) == static_cast<const void*>( &inputImage ) )
+        {
+            Image<Channel> copy( inputImage );
+            derivativeFilter<Accumulator>( outputImage, copy, kx, ky, border );
+            return;
+        }
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 8 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<Accumulator> cache( 4 * length );
+            int cachedRows[4] = { -2, -2, -2, -2 };
+            std::vector<Accumulator> vertical( length );
+            std::vector<Accumulator> output( count );
+
+            auto row = [&]( int y ) -> const Accumulator*
+            {
+                unsigned int slot = static_cast<unsigned int>( y + 4 ) % 4;
+
+                if ( cachedRows[slot] != y )
+                {
+                    padRow( inputImage, y, border, 1, &cache[slot * length] );
+                    cachedRows[slot] = y;
+                }
+
+                return &cache[slot * length + channels];
+            };
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const Accumulator* above = row( static_cast<int>( y ) - 1 );
+                const Accumulator* center = row( y );
+                const Accumulator* below = row( y + 1 );
+
+                filterRow3x3( above, center, below, kx, ky, &vertical[0], &output[0], count, channels );
+                storeDerivative( &output[0], outputImage( y, 0 ), count );
+            }
+        } );
+    }
+
+    template<typename Derivative>
+    void ImageOperator::storeDerivative( const float* input, Derivative* output, unsigned int count )
+    {
+        simd::convert( input, output, count, 1.0, 0.0 );
+    }
+
+    inline void ImageOperator::storeDerivative( const uint16_t* input, int16_t* output, unsigned int count )
+    {
+        std::memcpy( output, input, count * sizeof(int16_t) );
+    }
+
+    template<typename Derivative, typename Channel>
+    bool ImageOperator::derivativeFixedPoint( Image<Derivative>&, const Image<Channel>&, const int*, const int*, BorderMode )
+    {
+        return false;
+    }
+
+    inline bool ImageOperator::derivativeFixedPoint( Image<int16_t>& outputImage, const ImageByte& inputImage,
+                                                     const int* kx, const int* ky, BorderMode border )
+    {
+        // |sum| <= 255 * 16 * 4 for all the 3x3 kernels, which fits in 16 bits
+        derivativeFilter<uint16_t>( outputImage, inputImage, kx, ky, border );
+        return true;
+    }
+
+    template<typename Channel>
+    void ImageOperator::threshold( Image<Channel>& outputImage, const Image<Channel>& inputImage, double threshold,
+                                   double maxValue, ThresholdType type )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int count = width * inputImage.getNumberOfChannels();
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        // Thresholds below the range of an integer type are not representable:
+        // every value is above them
+        const double lowest = static_cast<double>( std::numeric_limits<Channel>::lowest() );
+        const bool integer = std::numeric_limits<Channel>::is_integer;
+        const bool allAbove = integer && std::floor( threshold ) < lowest;
+        const Channel t = integer ? simd::saturate<Channel>( std::floor( threshold ) ) : static_cast<Channel>( threshold );
+        const Channel m = simd::saturate<Channel>( maxValue );
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const Channel* input = inputImage( y, 0 );
+                Channel* output = outputImage( y, 0 );
+
+                if ( allAbove )
+                {
+                    switch ( type )
+                    {
+                        case ThresholdType::BINARY: std::fill( output, output + count, m ); break;
+                        case ThresholdType::TRUNCATE: std::fill( output, output + count, t ); break;
+                        case ThresholdType::TO_ZERO: std::copy( input, input + count, output ); break;
+                        default: std::fill( output, output + count, Channel( 0 ) ); break;
+                    }
+                }
+                else
+                {
+                    simd::threshold( output, input, t, m, type, count );
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    double ImageOperator::otsuThreshold( const Image<Channel>& image, unsigned int channel )
+    {
+        Histogram histogram;
+        histogram.compute( image );
+
+        if ( channel >= histogram.getNumberOfChannels() )
+        {
+            return 0.0;
+        }
+
+        const uint64_t* counts = histogram.getCounts( channel );
+        const unsigned int bins = histogram.getNumberOfBins();
+        double total = 0.0;
+        double totalSum = 0.0;
+
+        for ( unsigned int i = 0; i < bins; ++i )
+        {
+            total += counts[i];
+            totalSum += static_cast<double>( i ) * counts[i];
+        }
+
+        // Between class variance w0 * w1 * (m0 - m1)^2 for every split
+        double lowerCount = 0.0;
+        double lowerSum = 0.0;
+        double bestVariance = -1.0;
+        int bestBin = 0;
+
+        for ( unsigned int i = 0; i + 1 < bins; ++i )
+        {
+            lowerCount += counts[i];
+            lowerSum += static_cast<double>( i ) * counts[i];
+
+            double upperCount = total - lowerCount;
+
+            if ( lowerCount == 0.0 || upperCount == 0.0 )
+            {
+                continue;
+            }
+
+            double difference = lowerSum / lowerCount - ( totalSum - lowerSum ) / upperCount;
+            double variance = lowerCount * upperCount * difference * difference;
+
+            if ( variance > bestVariance )
+            {
+                bestVariance = variance;
+                bestBin = i;
+            }
+        }
+
+        return binToThreshold<Channel>( histogram, bestBin );
+    }
+
+    template<typename Channel>
+    double ImageOperator::triangleThreshold( const Image<Channel>& image, unsigned int channel )
+    {
+        Histogram histogram;
+        histogram.compute( image );
+
+        if ( channel >= histogram.getNumberOfChannels() )
+        {
+            return 0.0;
+        }
+
+        const uint64_t* counts = histogram.getCounts( channel );
+        const int bins = histogram.getNumberOfBins();
+        int first = 0;
+        int last = bins - 1;
+        int peak = 0;
+
+        while ( first < bins && counts[first] == 0 )
+        {
+            ++first;
+        }
+
+        if ( first == bins )
+        {
+            return binToThreshold<Channel>( histogram, 0 );
+        }
+
+        while ( counts[last] == 0 )
+        {
+            --last;
+        }
+
+        for ( int i = first; i <= last; ++i )
+        {
+            peak = counts[i] > counts[peak] ? i : peak;
+        }
+
+        // The line goes from the peak to the end of the longer tail
+        const bool flipped = peak - first > last - peak;
+        const int end = flipped ? first : last;
+        const int step = flipped ? -1 : 1;
+        const double peakCount = static_cast<double>( counts[peak] );
+        const double length = std::abs( end - peak );
+        double bestDistance = -1.0;
+        int bestBin = peak;
+
+        for ( int i = peak; i != end + step; i += step )
+        {
+            // Distance below the line, up to a constant factor
+            double distance = length * ( peakCount - counts[i] ) - peakCount * std::abs( i - peak );
+
+            if ( distance > bestDistance )
+            {
+                bestDistance = distance;
+                bestBin = i;
+            }
+        }
+
+        // The threshold bin belongs to the peak side; on the flipped path
+        // the lower class keeps at least the first bin
+        return binToThreshold<Channel>( histogram, flipped ? std::max( bestBin - 1, 0 ) : bestBin );
+    }
+
+    template<typename Channel>
+    void ImageOperator::adaptiveThreshold( Image<Channel>& outputImage, const Image<Channel>& inputImage, double maxValue,
+                                           unsigned int radius, double offset, AdaptiveMethod method, ThresholdType type )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int count = width * inputImage.getNumberOfChannels();
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        // The window means only read the input through its integral image,
+        // which is computed first, so the output can be the input
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        const Channel m = simd::saturate<Channel>( maxValue );
+        const float shift = static_cast<float>( offset );
+
+        // Thresholding is fused with the last window mean, so the means of
+        // the whole image are never stored
+        auto thresholdRow = [&]( unsigned int y, const float* local )
+        {
+            const Channel* input = inputImage( y, 0 );
+            Channel* output = outputImage( y, 0 );
+
+            // One loop per type, so the compiler can vectorize them
+            switch ( type )
+            {
+                case ThresholdType::BINARY:
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        output[i] = static_cast<float>( input[i] ) > local[i] - shift ? m : Channel( 0 );
+                    }
+                    break;
+
+                case ThresholdType::BINARY_INVERTED:
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        output[i] = static_cast<float>( input[i] ) > local[i] - shift ? Channel( 0 ) : m;
+                    }
+                    break;
+
+                case ThresholdType::TRUNCATE:
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        float t = local[i] - shift;
+                        output[i] = static_cast<float>( input[i] ) > t ? simd::saturate<Channel>( t ) : input[i];
+                    }
+                    break;
+
+                case ThresholdType::TO_ZERO:
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        output[i] = static_cast<float>( input[i] ) > local[i] - shift ? input[i] : Channel( 0 );
+                    }
+                    break;
+
+                case ThresholdType::TO_ZERO_INVERTED:
+                    for ( unsigned int i = 0; i < count; ++i )
+                    {
+                        output[i] = static_cast<float>( input[i] ) > local[i] - shift ? Channel( 0 ) : input[i];
+                    }
+                    break;
+            }
+        };
+
+        if ( method == AdaptiveMethod::GAUSSIAN )
+        {
+            // Sigma of a (2 * radius + 1) wide Gaussian window, approximated
+            // by three box means whose variances add up to sigma^2
+            const double sigma = 0.3 * ( static_cast<double>( radius ) - 1.0 ) + 0.8;
+            const double variance = sigma * sigma;
+            int lower = static_cast<int>( std::sqrt( 4.0 * variance + 1.0 ) );
+            lower -= lower % 2 == 0 ? 1 : 0;
+            const int smaller = static_cast<int>( std::round( ( 12.0 * variance - 3.0 * lower * lower - 12.0 * lower - 9.0 ) / ( -4.0 * lower - 4.0 ) ) );
+
+            ImageFloat first( width, height, inputImage.getColorSpace() );
+            ImageFloat second( width, height, inputImage.getColorSpace() );
+
+            windowMean( inputImage, smaller > 0 ? ( lower - 1 ) / 2 : ( lower + 1 ) / 2, [&]( unsigned int y, const float* means )
+            {
+                std::copy( means, means + count, first( y, 0 ) );
+            } );
+
+            windowMean( first, smaller > 1 ? ( lower - 1 ) / 2 : ( lower + 1 ) / 2, [&]( unsigned int y, const float* means )
+            {
+                std::copy( means, means + count, second( y, 0 ) );
+            } );
+
+            windowMean( second, smaller > 2 ? ( lower - 1 ) / 2 : ( lower + 1 ) / 2, thresholdRow );
+        }
+        else
+        {
+            windowMean( inputImage, radius, thresholdRow );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::transpose( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        orient( outputImage, inputImage, true, false, false );
+    }
+
+    template<typename Channel>
+    void ImageOperator::rotate90( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        orient( outputImage, inputImage, true, true, false );
+    }
+
+    template<typename Channel>
+    void ImageOperator::rotate180( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        orient( outputImage, inputImage, false, true, true );
+    }
+
+    template<typename Channel>
+    void ImageOperator::rotate270( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        orient( outputImage, inputImage, true, false, true );
+    }
+
+    template<typename Channel>
+    void ImageOperator::flipHorizontal( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        orient( outputImage, inputImage, false, true, false );
+    }
+
+    template<typename Channel>
+    void ImageOperator::flipVertical( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        orient( outputImage, inputImage, false, false, true );
+    }
+
+    template<typename Channel>
+    void ImageOperator::warpAffine( Image<Channel>& outputImage, const Image<Channel>& inputImage, const double* matrix,
+                                    unsigned int width, unsigned int height, Interpolation interpolation,
+                                    BorderMode border, double borderValue )
+    {
+        const double determinant = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+
+        if ( determinant == 0.0 || !std::isfinite( determinant ) )
+        {
+            return;
+        }
+
+        // Output to input
+        const double inverse[6] =
+        {
+            matrix[4] / determinant, -matrix[1] / determinant, ( matrix[1] * matrix[5] - matrix[2] * matrix[4] ) / determinant,
+            -matrix[3] / determinant, matrix[0] / determinant, ( matrix[2] * matrix[3] - matrix[0] * matrix[5] ) / determinant
+        };
+
+        // Positions have 10 fractional bits. Saturating both terms of the
+        // sums to 2^29 keeps them in range.
+        auto toFixedPoint = []( double value )
+        {
+            const double limit = 536870912.0;
+            return static_cast<int32_t>( std::floor( std::min( limit, std::max( -limit, value * 1024.0 ) ) + 0.5 ) );
+        };
+
+        std::vector<int32_t> offsets( 2 * width );
+
+        for ( unsigned int x = 0; x < width; ++x )
+        {
+            offsets[2 * x] = toFixedPoint( inverse[0] * x );
+            offsets[2 * x + 1] = toFixedPoint( inverse[3] * x );
+        }
+
+        warp( outputImage, inputImage, width, height, interpolation, border, borderValue,
+              [&]( unsigned int x, unsigned int y, unsigned int count, int32_t* positions )
+        {
+            const int32_t originX = toFixedPoint( inverse[1] * y + inverse[2] );
+            const int32_t originY = toFixedPoint( inverse[4] * y + inverse[5] );
+            const int32_t* offset = &offsets[2 * x];
+
+            for ( unsigned int i = 0; i < 2 * count; i += 2 )
+            {
+                positions[i] = originX + offset[i];
+                positions[i + 1] = originY + offset[i + 1];
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::warpPerspective( Image<Channel>& outputImage, const Image<Channel>& inputImage, const double* matrix,
+                                         unsigned int width, unsigned int height, Interpolation interpolation,
+                                         BorderMode border, double borderValue )
+    {
+        // Adjugate of the matrix
+        double inverse[9] =
+        {
+            matrix[4] * matrix[8] - matrix[5] * matrix[7],
+            matrix[2] * matrix[7] - matrix[1] * matrix[8],
+            matrix[1] * matrix[5] - matrix[2] * matrix[4],
+            matrix[5] * matrix[6] - matrix[3] * matrix[8],
+            matrix[0] * matrix[8] - matrix[2] * matrix[6],
+            matrix[2] * matrix[3] - matrix[0] * matrix[5],
+            matrix[3] * matrix[7] - matrix[4] * matrix[6],
+            matrix[1] * matrix[6] - matrix[0] * matrix[7],
+            matrix[0] * matrix[4] - matrix[1] * matrix[3]
+        };
+
+        const double determinant = matrix[0] * inverse[0] + matrix[1] * inverse[3] + matrix[2] * inverse[6];
+
+        if ( determinant == 0.0 || !std::isfinite( determinant ) )
+        {
+            return;
+        }
+
+        for ( double& element : inverse )
+        {
+            element /= determinant;
+        }
+
+        warp( outputImage, inputImage, width, height, interpolation, border, borderValue,
+              [&]( unsigned int x, unsigned int y, unsigned int count, int32_t* positions )
+        {
+            const double limit = 536870912.0;
+            double u = inverse[0] * x + inverse[1] * y + inverse[2];
+            double v = inverse[3] * x + inverse[4] * y + inverse[5];
+            double w = inverse[6] * x + inverse[7] * y + inverse[8];
+
+            for ( unsigned int i = 0; i < 2 * count; i += 2 )
+            {
+                // Points at infinity fall far outside the image
+                double scale = w != 0.0 ? 1024.0 / w : 0.0;
+                double px = w != 0.0 ? u * scale : -limit;
+                double py = w != 0.0 ? v * scale : -limit;
+
+                positions[i] = static_cast<int32_t>( std::floor( std::min( limit, std::max( -limit, px ) ) + 0.5 ) );
+                positions[i + 1] = static_cast<int32_t>( std::floor( std::min( limit, std::max( -limit, py ) ) + 0.5 ) );
+
+                u += inverse[0];
+                v += inverse[3];
+                w += inverse[6];
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::remap( Image<Channel>& outputImage, const Image<Channel>& inputImage, const RemapTable& table,
+                               Interpolation interpolation, BorderMode border, double borderValue )
+    {
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            remap( outputImage, copy, table, interpolation, border, borderValue );
+            return;
+        }
+
+        if ( inputImage.getData() == nullptr || table.isEmpty() )
+        {
+            return;
+        }
+
+        const unsigned int width = table.getWidth();
+        const unsigned int height = table.getHeight();
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        RemapKernel kernel;
+        buildRemapKernel( kernel, interpolation );
+
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const std::vector<Channel> borderPixel( channels, simd::saturate<Channel>( borderValue ) );
+
+        const unsigned int tileWidth = table.getTileWidth();
+        const unsigned int tileHeight = table.getTileHeight();
+        const unsigned int bands = ( height + tileHeight - 1 ) / tileHeight;
+        const unsigned int grain = Parallel::calculateGrain( width * tileHeight * channels * kernel.taps * kernel.taps );
+        const unsigned int runLength = 256;
+        const bool nearest = kernel.taps == 1;
+
+        Parallel::forRange( 0, bands, grain, [&]( unsigned int firstBand, unsigned int lastBand )
+        {
+            std::vector<int32_t> positions( 2 * runLength );
+
+            for ( unsigned int band = firstBand; band < lastBand; ++band )
+            {
+                const unsigned int lastRow = std::min( height, ( band + 1 ) * tileHeight );
+
+                for ( unsigned int tile = 0; tile < width; tile += tileWidth )
+                {
+                    const unsigned int tileEnd = std::min( width, tile + tileWidth );
+
+                    for ( unsigned int y = band * tileHeight; y < lastRow; ++y )
+                    {
+                        for ( unsigned int x = tile; x < tileEnd; x += runLength )
+                        {
+                            const unsigned int count = std::min( runLength, tileEnd - x );
+                            const int16_t* entries = table.getPositions( x, y );
+                            const uint16_t* fractions = table.getFractions( x, y );
+
+                            // Nearest neighbors round the positions up from 1/2
+                            for ( unsigned int i = 0; i < count; ++i )
+                            {
+                                positions[2 * i] = entries[2 * i] + ( nearest ? ( fractions[i] >> 4 ) & 1 : 0 );
+                                positions[2 * i + 1] = entries[2 * i + 1] + ( nearest ? ( fractions[i] >> 9 ) & 1 : 0 );
+                            }
+
+                            remapRow( outputImage( y, x ), inputImage, &positions[0], fractions, count, kernel, border, &borderPixel[0] );
+                        }
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::premultiply( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        scaleByAlpha( outputImage, inputImage, false );
+    }
+
+    template<typename Channel>
+    void ImageOperator::unpremultiply( Image<Channel>& outputImage, const Image<Channel>& inputImage )
+    {
+        scaleByAlpha( outputImage, inputImage, true );
+    }
+
+    template<typename Channel>
+    void ImageOperator::blendOver( Image<Channel>& image, const Image<Channel>& overlay, int x, int y, bool premultiplied )
+    {
+        blendOver( image, overlay, Rect( 0, 0, overlay.getWidth(), overlay.getHeight() ), x, y, premultiplied );
+    }
+
+    template<typename Channel>
+    void ImageOperator::blendOver( Image<Channel>& image, const Image<Channel>& overlay, const Rect& region,
+                                   int x, int y, bool premultiplied )
+    {
+        if ( &image == &overlay )
+        {
+            Image<Channel> copy( overlay );
+            blendOver( image, copy, region, x, y, premultiplied );
+            return;
+        }
+
+        const int alpha = alphaChannel( overlay.getColorSpace() );
+        const std::string imageNames = ColorSpace::channelNames( image.getColorSpace() );
+        const std::string overlayNames = ColorSpace::channelNames( overlay.getColorSpace() );
+
+        if ( image.getData() == nullptr || overlay.getData() == nullptr || alpha < 0 || imageNames.empty() ||
+             region.x + region.width > overlay.getWidth() || region.y + region.height > overlay.getHeight() )
+        {
+            return;
+        }
+
+        int order[4];
+
+        for ( unsigned int k = 0; k < imageNames.size(); ++k )
+        {
+            std::string::size_type index = overlayNames.find( imageNames[k] );
+
+            if ( index == std::string::npos )
+            {
+                return;
+            }
+
+            order[k] = static_cast<int>( index );
+        }
+
+        // The region clipped to the image, in image coordinates
+        const long left = std::max<long>( x, 0 );
+        const long top = std::max<long>( y, 0 );
+        const long right = std::min<long>( static_cast<long>( x ) + region.width, image.getWidth() );
+        const long bottom = std::min<long>( static_cast<long>( y ) + region.height, image.getHeight() );
+
+        if ( left >= right || top >= bottom )
+        {
+            return;
+        }
+
+        const unsigned int channels = image.getNumberOfChannels();
+        const unsigned int overlayChannels = overlay.getNumberOfChannels();
+        const unsigned int count = static_cast<unsigned int>( right - left );
+        const unsigned int grain = Parallel::calculateGrain( count * channels );
+
+        Parallel::forRange( static_cast<unsigned int>( top ), static_cast<unsigned int>( bottom ), grain, [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int row = firstRow; row < lastRow; ++row )
+            {
+                const Channel* source = overlay( static_cast<unsigned int>( region.y + row - y ), static_cast<unsigned int>( region.x + left - x ) );
+                blendOverRow( image( row, static_cast<unsigned int>( left ) ), channels, source, overlayChannels, count, order, alpha, premultiplied );
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::convertColor( Image<Channel>& outputImage, const Image<Channel>& inputImage, ColorSpace::Type colorSpace,
+                                      YCbCrStandard standard )
+    {
+        const ColorSpace::Type inputSpace = inputImage.getColorSpace();
+
+        if ( &outputImage == &inputImage )
+        {
+            if ( inputSpace != colorSpace )
+            {
+                Image<Channel> copy( inputImage );
+                convertColor( outputImage, copy, colorSpace, standard );
+            }
+
+            return;
+        }
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        const bool rgbInput = ColorSpace::isRGB( inputSpace );
+        const bool rgbOutput = ColorSpace::isRGB( colorSpace );
+
+        if ( inputSpace == colorSpace )
+        {
+            outputImage = inputImage;
+            return;
+        }
+        else if ( rgbInput && rgbOutput )
+        {
+            swizzle( outputImage, inputImage, colorSpace );
+            return;
+        }
+        else if ( ColorSpace::isPlanar( inputSpace ) && ColorSpace::isPlanar( colorSpace ) )
+        {
+            // 4:2:0 layouts only differ by the order of the chroma samples
+            const unsigned int width = inputImage.getWidth();
+            const unsigned int height = inputImage.getHeight();
+
+            if ( width % 2 != 0 || height % 3 != 0 )
+            {
+                return;
+            }
+
+            if ( !hasLayout( outputImage, width, height, colorSpace ) )
+            {
+                outputImage.create( width, height, colorSpace );
+            }
+
+            const unsigned int frameHeight = height / 3 * 2;
+
+            for ( unsigned int row = 0; row < frameHeight; ++row )
+            {
+                std::memcpy( outputImage( row, 0 ), inputImage( row, 0 ), width * sizeof(Channel) );
+            }
+
+            const Channel* input = inputImage.getData();
+            Channel* output = outputImage.getData();
+
+            for ( unsigned int row = 0; row < frameHeight / 2; ++row )
+            {
+                std::size_t inputCb;
+                std::size_t inputCr;
+                std::size_t outputCb;
+                std::size_t outputCr;
+                unsigned int inputStep;
+                unsigned int outputStep;
+                chromaRow( inputImage, frameHeight, row, inputCb, inputCr, inputStep );
+                chromaRow( outputImage, frameHeight, row, outputCb, outputCr, outputStep );
+
+                for ( unsigned int x = 0; x < width / 2; ++x )
+                {
+                    output[outputCb + x * outputStep] = input[inputCb + x * inputStep];
+                    output[outputCr + x * outputStep] = input[inputCr + x * inputStep];
+                }
+            }
+
+            return;
+        }
+        else if ( !rgbInput && !rgbOutput )
+        {
+            Image<Channel> rgb;
+            convertColor( rgb, inputImage, ColorSpace::Type::RGB, standard );
+
+            if ( rgb.getData() != nullptr )
+            {
+                convertColor( outputImage, rgb, colorSpace, standard );
+            }
+
+            return;
+        }
+
+        // The color space on the other side of RGB
+        const ColorSpace::Type space = rgbInput ? colorSpace : inputSpace;
+
+        if ( ColorSpace::calculateNumberOfChannels( space ) == 0 || space == ColorSpace::Type::CMYK ||
+             colorSpace == ColorSpace::Type::GRAYSCALE )
+        {
+            return;
+        }
+
+        const unsigned int width = inputImage.getWidth();
+        unsigned int height = inputImage.getHeight();
+
+        if ( ColorSpace::isPlanar( inputSpace ) )
+        {
+            if ( width % 2 != 0 || height % 3 != 0 )
+            {
+                return;
+            }
+
+            height = height / 3 * 2;
+        }
+        else if ( ColorSpace::isPlanar( colorSpace ) && ( width % 2 != 0 || height % 2 != 0 ) )
+        {
+            return;
+        }
+
+        const unsigned int outputHeight = ColorSpace::isPlanar( colorSpace ) ? height / 2 * 3 : height;
+
+        if ( !hasLayout( outputImage, width, outputHeight, colorSpace ) )
+        {
+            outputImage.create( width, outputHeight, colorSpace );
+        }
+
+        if ( convertColorFixedPoint( outputImage, inputImage, width, height, standard ) )
+        {
+            return;
+        }
+
+        // Input channels of R, G and B, or the color of each output channel
+        const std::string names = ColorSpace::channelNames( rgbInput ? inputSpace : colorSpace );
+        const std::string colors = "RGB";
+        int order[4];
+
+        for ( unsigned int k = 0; k < 3 && rgbInput; ++k )
+        {
+            std::string::size_type index = names.find( colors[k] );
+            order[k] = index != std::string::npos ? static_cast<int>( index ) : 0;
+        }
+
+        for ( unsigned int k = 0; k < names.size() && !rgbInput; ++k )
+        {
+            std::string::size_type index = colors.find( names[k] );
+            order[k] = index != std::string::npos ? static_cast<int>( index ) : -1;
+        }
+
+        const unsigned int inputChannels = inputImage.getNumberOfChannels();
+        const unsigned int outputChannels = outputImage.getNumberOfChannels();
+
+        // Pairs of rows share the chromas of 4:2:0 frames
+        Parallel::forRange( 0, ( height + 1 ) / 2, Parallel::calculateGrain( 2 * width * 32 ), [&]( unsigned int firstPair, unsigned int lastPair )
+        {
+            std::vector<float> pixels( 6 * width );
+
+            for ( unsigned int pair = firstPair; pair < lastPair; ++pair )
+            {
+                const unsigned int row = 2 * pair;
+                const unsigned int rows = std::min( 2u, height - row );
+                std::size_t cb = 0;
+                std::size_t cr = 0;
+                unsigned int step = 0;
+
+                if ( ColorSpace::isPlanar( space ) )
+                {
+                    chromaRow( rgbInput ? outputImage : inputImage, height, pair, cb, cr, step );
+                }
+
+                if ( rgbInput )
+                {
+                    for ( unsigned int r = 0; r < rows; ++r )
+                    {
+                        loadRGB( inputImage( row + r, 0 ), inputChannels, order, width, &pixels[3 * width * r] );
+                    }
+
+                    rgbToColor<Channel>( &pixels[0], rows * width, space, standard );
+
+                    if ( !ColorSpace::isPlanar( space ) )
+                    {
+                        for ( unsigned int r = 0; r < rows; ++r )
+                        {
+                            Channel* output = outputImage( row + r, 0 );
+                            const float* input = &pixels[3 * width * r];
+
+                            for ( unsigned int i = 0; i < 3 * width; ++i )
+                            {
+                                output[i] = simd::saturate<Channel>( input[i] );
+                            }
+                        }
+
+                        continue;
+                    }
+
+                    Channel* data = outputImage.getData();
+
+                    for ( unsigned int r = 0; r < 2; ++r )
+                    {
+                        Channel* luma = outputImage( row + r, 0 );
+
+                        for ( unsigned int x = 0; x < width; ++x )
+                        {
+                            luma[x] = simd::saturate<Channel>( pixels[3 * ( r * width + x )] );
+                        }
+                    }
+
+                    for ( unsigned int x = 0; x < width / 2; ++x )
+                    {
+                        const float* top = &pixels[6 * x];
+                        const float* bottom = top + 3 * width;
+                        data[cb + x * step] = simd::saturate<Channel>( 0.25 * ( top[1] + top[4] + bottom[1] + bottom[4] ) );
+                        data[cr + x * step] = simd::saturate<Channel>( 0.25 * ( top[2] + top[5] + bottom[2] + bottom[5] ) );
+                    }
+                }
+                else
+                {
+                    for ( unsigned int r = 0; r < rows; ++r )
+                    {
+                        const Channel* input = inputImage( row + r, 0 );
+                        float* output = &pixels[3 * width * r];
+
+                        if ( !ColorSpace::isPlanar( space ) )
+                        {
+                            for ( unsigned int i = 0; i < 3 * width; ++i )
+                            {
+                                output[i] = static_cast<float>( input[i] );
+                            }
+
+                            continue;
+                        }
+
+                        const Channel* data = inputImage.getData();
+
+                        for ( unsigned int x = 0; x < width; ++x )
+                        {
+                            output[3 * x] = static_cast<float>( input[x] );
+                            output[3 * x + 1] = static_cast<float>( data[cb + x / 2 * step] );
+                            output[3 * x + 2] = static_cast<float>( data[cr + x / 2 * step] );
+                        }
+                    }
+
+                    colorToRGB<Channel>( &pixels[0], rows * width, space, standard );
+
+                    for ( unsigned int r = 0; r < rows; ++r )
+                    {
+                        storeRGB( &pixels[3 * width * r], outputImage( row + r, 0 ), outputChannels, order, width );
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::statistics( std::vector<ChannelStats>& stats, const Image<Channel>& image, const ImageByte* mask )
+    {
+        accumulateStatistics<Channel>( stats, image, nullptr, mask );
+    }
+
+    template<typename Channel>
+    void ImageOperator::differenceStatistics( std::vector<ChannelStats>& stats, const Image<Channel>& image1,
+                                              const Image<Channel>& image2, const ImageByte* mask )
+    {
+        if ( !hasLayout( image2, image1.getWidth(), image1.getHeight(), image1.getColorSpace() ) )
+        {
+            return;
+        }
+
+        accumulateStatistics( stats, image1, &image2, mask );
+    }
+
+    template<typename Channel>
+    double ImageOperator::psnr( const Image<Channel>& image1, const Image<Channel>& image2 )
+    {
+        std::vector<ChannelStats> stats;
+        differenceStatistics( stats, image1, image2 );
+
+        if ( stats.empty() || stats[0].count == 0 )
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        double squares = 0.0;
+
+        for ( const ChannelStats& s : stats )
+        {
+            squares += s.normL2 * s.normL2;
+        }
+
+        const double peak = static_cast<double>( opaque<Channel>() );
+        const double error = squares / ( static_cast<double>( stats[0].count ) * stats.size() );
+
+        return error > 0.0 ? 10.0 * std::log10( peak * peak / error ) : std::numeric_limits<double>::infinity();
+    }
+
+    template<typename Channel>
+    double ImageOperator::ssim( const Image<Channel>& image1, const Image<Channel>& image2 )
+    {
+        if ( image1.getData() == nullptr || !hasLayout( image2, image1.getWidth(), image1.getHeight(), image1.getColorSpace() ) ||
+             image1.getWidth() < 11 || image1.getHeight() < 11 )
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        double similarity;
+        double contrastStructure;
+        structuralSimilarity( image1, image2, static_cast<double>( opaque<Channel>() ), similarity, contrastStructure );
+
+        return similarity;
+    }
+
+    template<typename Channel>
+    double ImageOperator::msssim( const Image<Channel>& image1, const Image<Channel>& image2 )
+    {
+        if ( image1.getData() == nullptr || !hasLayout( image2, image1.getWidth(), image1.getHeight(), image1.getColorSpace() ) ||
+             image1.getWidth() < 11 || image1.getHeight() < 11 )
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        const double weights[5] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+        unsigned int scales = 1;
+        double total = weights[0];
+
+        while ( scales < 5 && std::min( image1.getWidth(), image1.getHeight() ) >> scales >= 11 )
+        {
+            total += weights[scales++];
+        }
+
+        ImageFloat scaled[2];
+        convert( scaled[0], image1 );
+        convert( scaled[1], image2 );
+
+        const double peak = static_cast<double>( opaque<Channel>() );
+        double result = 1.0;
+
+        for ( unsigned int scale = 0; scale < scales; ++scale )
+        {
+            double similarity;
+            double contrastStructure;
+            structuralSimilarity( scaled[0], scaled[1], peak, similarity, contrastStructure );
+
+            const double term = scale + 1 < scales ? contrastStructure : similarity;
+            result *= std::pow( std::max( 0.0, term ), weights[scale] / total );
+
+            if ( scale + 1 < scales )
+            {
+                for ( ImageFloat& image : scaled )
+                {
+                    resize( image, image, image.getWidth() / 2, image.getHeight() / 2, Interpolation::AREA );
+                }
+            }
+        }
+
+        return result;
+    }
+
+    template<typename Channel>
+    void ImageOperator::dft( std::vector< std::complex<Channel> >& spectrum, const Image<Channel>& image )
+    {
+        if ( image.getData() == nullptr || image.getNumberOfChannels() != 1 )
+        {
+            return;
+        }
+
+        const unsigned int width = image.getWidth();
+        const unsigned int height = image.getHeight();
+
+        spectrum.resize( static_cast<std::size_t>( width / 2 + 1 ) * height );
+        realSpectrum( &spectrum[0], image.getData(), width, height, image.getRowSize() / sizeof(Channel) );
+    }
+
+    template<typename Channel>
+    void ImageOperator::inverseDft( Image<Channel>& image, const std::vector< std::complex<Channel> >& spectrum,
+                                    unsigned int width, unsigned int height )
+    {
+        if ( width == 0 || height == 0 || spectrum.size() != static_cast<std::size_t>( width / 2 + 1 ) * height )
+        {
+            return;
+        }
+
+        if ( !hasLayout( image, width, height, ColorSpace::Type::GRAYSCALE ) )
+        {
+            image.create( width, height, ColorSpace::Type::GRAYSCALE );
+        }
+
+        // The columns are transformed in place
+        std::vector< std::complex<Channel> > copy( spectrum );
+        const Channel scale = static_cast<Channel>( 1.0 / ( static_cast<double>( width ) * height ) );
+
+        inverseRealSpectrum( image.getData(), &copy[0], width, height, image.getRowSize() / sizeof(Channel), scale );
+    }
+
+    template<typename Channel>
+    void ImageOperator::convolve( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Image<Channel>& kernel,
+                                  BorderMode border, double borderValue )
+    {
+        if ( inputImage.getData() == nullptr || kernel.getData() == nullptr || kernel.getNumberOfChannels() != 1 )
+        {
+            return;
+        }
+
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const int left = kernel.getWidth() / 2;
+        const int top = kernel.getHeight() / 2;
+        const int right = kernel.getWidth() - 1 - left;
+        const Channel constant = simd::saturate<Channel>( borderValue );
+
+        // The kernel fits everywhere in the image extended by the border.
+        // This is a copy, so the output can be the input.
+        Image<Channel> extended( width + kernel.getWidth() - 1, height + kernel.getHeight() - 1, inputImage.getColorSpace() );
+
+        for ( unsigned int y = 0; y < extended.getHeight(); ++y )
+        {
+            const int sourceRow = mapBorder( static_cast<int>( y ) - top, height, border );
+            Channel* output = extended( y, 0 );
+
+            if ( sourceRow < 0 )
+            {
+                std::fill( output, output + extended.getWidth() * channels, constant );
+                continue;
+            }
+
+            const Channel* input = inputImage( sourceRow, 0 );
+            std::copy( input, input + width * channels, output + left * channels );
+
+            auto extendColumn = [&]( int x )
+            {
+                const int sourceColumn = mapBorder( x, width, border );
+                Channel* pixel = output + ( x + left ) * channels;
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    pixel[c] = sourceColumn < 0 ? constant : input[sourceColumn * channels + c];
+                }
+            };
+
+            for ( int x = -left; x < 0; ++x )
+            {
+                extendColumn( x );
+            }
+
+            for ( int x = width; x < width + right; ++x )
+            {
+                extendColumn( x );
+            }
+        }
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        correlate( outputImage, extended, kernel );
+    }
+
+    template<typename Channel>
+    void ImageOperator::crossCorrelate( Image<Channel>& outputImage, const Image<Channel>& inputImage, const Image<Channel>& templateImage )
+    {
+        if ( inputImage.getData() == nullptr || templateImage.getData() == nullptr || templateImage.getNumberOfChannels() != 1 ||
+             templateImage.getWidth() > inputImage.getWidth() || templateImage.getHeight() > inputImage.getHeight() )
+        {
+            return;
+        }
+
+        // The output is smaller than the input, so it is reallocated
+        if ( &outputImage == &inputImage || &outputImage == &templateImage )
+        {
+            Image<Channel> copy( outputImage );
+            crossCorrelate( outputImage, &outputImage == &inputImage ? copy : inputImage,
+                            &outputImage == &templateImage ? copy : templateImage );
+            return;
+        }
+
+        const unsigned int width = inputImage.getWidth() - templateImage.getWidth() + 1;
+        const unsigned int height = inputImage.getHeight() - templateImage.getHeight() + 1;
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        correlate( outputImage, inputImage, templateImage );
+    }
+
+    inline unsigned int ImageOperator::connectedComponents( ImageInt& labels, std::vector<ComponentStats>& stats,
+                                                            const ImageByte& mask, unsigned int connectivity )
+    {
+        const unsigned int width = mask.getWidth();
+        const unsigned int height = mask.getHeight();
+
+        if ( mask.getData() == nullptr || mask.getColorSpace() != ColorSpace::Type::GRAYSCALE || ( connectivity != 4 && connectivity != 8 ) )
+        {
+            return 0;
+        }
+
+        if ( !hasLayout( labels, width, height, ColorSpace::Type::GRAYSCALE ) )
+        {
+            labels.create( width, height, ColorSpace::Type::GRAYSCALE );
+        }
+
+        // Labeling units are 2x2 blocks for 8-connectivity, pixels for
+        // 4-connectivity
+        const bool blocks = connectivity == 8;
+        const unsigned int shift = blocks ? 1 : 0;
+        const unsigned int unitColumns = ( width + shift ) >> shift;
+        const unsigned int unitRows = ( height + shift ) >> shift;
+
+        // Provisional label of each unit and union-find forest. A band starting
+        // at unit row r uses labels from r * unitColumns + 1, so bands never
+        // share labels. Unused labels keep parent 0.
+        std::vector<int32_t> provisional( unitColumns * unitRows );
+        std::vector<int32_t> parent( unitColumns * unitRows + 1, 0 );
+        std::vector<unsigned int> bandStarts;
+        std::mutex bandMutex;
+
+        const int dxFirst = blocks ? -1 : 0;
+        const int dxLast = blocks ? 1 : 0;
+
+        Parallel::forRange( 0, unitRows, Parallel::calculateGrain( width << ( 2 * shift ) ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<BYTE> codes( unitColumns );
+            std::vector<BYTE> previousCodes( unitColumns );
+            int32_t next = firstRow * unitColumns + 1;
+
+            for ( unsigned int u = firstRow; u < lastRow; ++u )
+            {
+                unitCodes( mask, u, blocks, &codes[0] );
+
+                int32_t* rowLabels = &provisional[u * unitColumns];
+                const int32_t* aboveLabels = u > firstRow ? rowLabels - unitColumns : nullptr;
+
+                for ( int i = 0; i < static_cast<int>( unitColumns ); ++i )
+                {
+                    const BYTE code = codes[i];
+                    int32_t label = 0;
+
+                    if ( code == 0 )
+                    {
+                        rowLabels[i] = 0;
+                        continue;
+                    }
+
+                    if ( aboveLabels != nullptr )
+                    {
+                        for ( int dx = dxFirst; dx <= dxLast; ++dx )
+                        {
+                            const int j = i + dx;
+
+                            if ( j >= 0 && j < static_cast<int>( unitColumns ) && unitsTouch( code, previousCodes[j], dx, false, blocks ) )
+                            {
+                                label = label == 0 ? aboveLabels[j] : mergeLabels( parent, label, aboveLabels[j] );
+                            }
+                        }
+                    }
+
+                    if ( i > 0 && unitsTouch( code, codes[i - 1], -1, true, blocks ) )
+                    {
+                        label = label == 0 ? rowLabels[i - 1] : mergeLabels( parent, label, rowLabels[i - 1] );
+                    }
+
+                    if ( label == 0 )
+                    {
+                        label = next++;
+                        parent[label] = label;
+                    }
+
+                    rowLabels[i] = label;
+                }
+
+                codes.swap( previousCodes );
+            }
+
+            std::lock_guard<std::mutex> lock( bandMutex );
+            bandStarts.push_back( firstRow );
+        } );
+
+        // Merge the components that cross band borders
+        std::vector<BYTE> codes( unitColumns );
+        std::vector<BYTE> previousCodes( unitColumns );
+
+        for ( unsigned int u : bandStarts )
+        {
+            if ( u == 0 )
+            {
+                continue;
+            }
+
+            unitCodes( mask, u - 1, blocks, &previousCodes[0] );
+            unitCodes( mask, u, blocks, &codes[0] );
+
+            const int32_t* rowLabels = &provisional[u * unitColumns];
+            const int32_t* aboveLabels = rowLabels - unitColumns;
+
+            for ( int i = 0; i < static_cast<int>( unitColumns ); ++i )
+            {
+                for ( int dx = dxFirst; dx <= dxLast && codes[i] != 0; ++dx )
+                {
+                    const int j = i + dx;
+
+                    if ( j >= 0 && j < static_cast<int>( unitColumns ) && unitsTouch( codes[i], previousCodes[j], dx, false, blocks ) )
+                    {
+                        mergeLabels( parent, rowLabels[i], aboveLabels[j] );
+                    }
+                }
+            }
+        }
+
+        // Flatten: parents have smaller labels, so they are final before their
+        // children are visited
+        int32_t numberOfComponents = 0;
+
+        for ( unsigned int label = 1; label < parent.size(); ++label )
+        {
+            if ( parent[label] != 0 )
+            {
+                parent[label] = parent[label] == static_cast<int32_t>( label ) ? ++numberOfComponents : parent[parent[label]];
+            }
+        }
+
+        // Final labels and statistics
+        struct Accumulator
+        {
+            uint64_t area;
+            uint64_t sumX;
+            uint64_t sumY;
+            unsigned int minX;
+            unsigned int minY;
+            unsigned int maxX;
+            unsigned int maxY;
+        };
+
+        const Accumulator empty = { 0, 0, 0, std::numeric_limits<unsigned int>::max(), std::numeric_limits<unsigned int>::max(), 0, 0 };
+        std::vector<Accumulator> totals( numberOfComponents + 1, empty );
+        std::mutex totalsMutex;
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 4 * width ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<Accumulator> band( numberOfComponents + 1, empty );
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const BYTE* input = mask( y, 0 );
+                const int32_t* units = &provisional[( y >> shift ) * unitColumns];
+                int32_t* output = labels( y, 0 );
+
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    output[x] = input[x] != 0 ? parent[units[x >> shift]] : 0;
+                }
+
+                // Statistics are accumulated per run of equal labels
+                for ( unsigned int first = 0, last = 0; first < width; first = last )
+                {
+                    const int32_t label = output[first];
+
+                    while ( last < width && output[last] == label )
+                    {
+                        ++last;
+                    }
+
+                    Accumulator& a = band[label];
+                    const uint64_t length = last - first;
+
+                    a.area += length;
+                    a.sumX += length * ( first + last - 1 ) / 2;
+                    a.sumY += length * y;
+                    a.minX = std::min( a.minX, first );
+                    a.maxX = std::max( a.maxX, last - 1 );
+                    a.minY = std::min( a.minY, y );
+                    a.maxY = std::max( a.maxY, y );
+                }
+            }
+
+            std::lock_guard<std::mutex> lock( totalsMutex );
+
+            for ( unsigned int label = 0; label < band.size(); ++label )
+            {
+                Accumulator& a = totals[label];
+                const Accumulator& b = band[label];
+
+                a.area += b.area;
+                a.sumX += b.sumX;
+                a.sumY += b.sumY;
+                a.minX = std::min( a.minX, b.minX );
+                a.maxX = std::max( a.maxX, b.maxX );
+                a.minY = std::min( a.minY, b.minY );
+                a.maxY = std::max( a.maxY, b.maxY );
+            }
+        } );
+
+        stats.assign( numberOfComponents + 1, ComponentStats() );
+
+        for ( unsigned int label = 0; label < stats.size(); ++label )
+        {
+            const Accumulator& a = totals[label];
+
+            if ( a.area > 0 )
+            {
+                stats[label].area = a.area;
+                stats[label].bounds = Rect( a.minX, a.minY, a.maxX - a.minX + 1, a.maxY - a.minY + 1 );
+                stats[label].centroidX = static_cast<double>( a.sumX ) / a.area;
+                stats[label].centroidY = static_cast<double>( a.sumY ) / a.area;
+            }
+        }
+
+        return numberOfComponents;
+    }
+
+    inline void ImageOperator::applyLUT( ImageByte& outputImage, const ImageByte& inputImage, const LUT& lut )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+
+        if ( !lut.isShared() && lut.getNumberOfTables() != channels )
+        {
+            return;
+        }
+
+        if ( !hasLayout( outputImage, width, inputImage.getHeight(), inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, inputImage.getHeight(), inputImage.getColorSpace() );
+        }
+
+        Parallel::forRange( 0, inputImage.getHeight(), Parallel::calculateGrain( width * channels ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const BYTE* input = inputImage( y, 0 );
+                BYTE* output = outputImage( y, 0 );
+
+                if ( lut.isShared() || channels == 1 )
+                {
+                    simd::lookup( lut.getTable(), input, output, width * channels );
+                    continue;
+                }
+
+                // Tables of the channels are consecutive
+                const BYTE* tables = lut.getTable( 0 );
+
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    for ( unsigned int c = 0; c < channels; ++c, ++input, ++output )
+                    {
+                        *output = tables[c * 256 + *input];
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    double ImageOperator::binToThreshold( const Histogram& histogram, int bin )
+    {
+        const double binWidth = ( histogram.getMaximum() - histogram.getMinimum() ) / histogram.getNumberOfBins();
+        const double upper = histogram.getMinimum() + ( bin + 1 ) * binWidth;
+
+        // Integer bins cover whole values: the last value of the bin
+        return std::numeric_limits<Channel>::is_integer ? upper - 1.0 : upper;
+    }
+
+    template<typename Channel, typename RowFunction>
+    void ImageOperator::windowMean( const Image<Channel>& inputImage, unsigned int radius, const RowFunction& rowFunction )
+    {
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const int channels = inputImage.getNumberOfChannels();
+        const int r = static_cast<int>( std::min( radius, static_cast<unsigned int>( std::max( width, height ) ) ) );
+
+        IntegralImage<Channel> integral( inputImage );
+
+        // Window columns and inverse widths, shared by all rows
+        std::vector<int> lefts( width );
+        std::vector<int> rights( width );
+        std::vector<double> inverseWidths( width );
+
+        for ( int x = 0; x < width; ++x )
+        {
+            lefts[x] = std::max( x - r, 0 );
+            rights[x] = std::min( x + r + 1, width );
+            inverseWidths[x] = 1.0 / ( rights[x] - lefts[x] );
+            lefts[x] *= channels;
+            rights[x] *= channels;
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 8 * width * channels ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<float> means( width * channels );
+            float* output = &means[0];
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const int top = std::max( static_cast<int>( y ) - r, 0 );
+                const int bottom = std::min( static_cast<int>( y ) + r + 1, height );
+                const double inverseHeight = 1.0 / ( bottom - top );
+                const typename IntegralImage<Channel>::Sum* above = integral.getRow( top );
+                const typename IntegralImage<Channel>::Sum* below = integral.getRow( bottom );
+
+                for ( int x = 0; x < width; ++x )
+                {
+                    const int left = lefts[x];
+                    const int right = rights[x];
+                    const double scale = inverseWidths[x] * inverseHeight;
+
+                    for ( int c = 0; c < channels; ++c )
+                    {
+                        // Unsigned wrap around cancels out
+                        typename IntegralImage<Channel>::Sum sum = below[right + c] - above[right + c] - below[left + c] + above[left + c];
+                        output[x * channels + c] = static_cast<float>( static_cast<double>( sum ) * scale );
+                    }
+                }
+
+                rowFunction( y, output );
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::orient( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                bool transpose, bool flipHorizontal, bool flipVertical )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const ColorSpace::Type colorSpace = inputImage.getColorSpace();
+
+        if ( inputImage.getData() == nullptr )
+        {
+            return;
+        }
+
+        if ( &outputImage == &inputImage )
+        {
+            // Only square images can be transposed in place
+            if ( transpose && width != height )
+            {
+                Image<Channel> copy( inputImage );
+                orient( outputImage, copy, transpose, flipHorizontal, flipVertical );
+                return;
+            }
+        }
+        else if ( !hasLayout( outputImage, transpose ? height : width, transpose ? width : height, colorSpace ) )
+        {
+            outputImage.create( transpose ? height : width, transpose ? width : height, colorSpace );
+        }
+
+        switch ( inputImage.getNumberOfChannels() )
+        {
+            case 1: orientPixels<sizeof(Channel)>( outputImage, inputImage, transpose, flipHorizontal, flipVertical ); break;
+            case 2: orientPixels<2 * sizeof(Channel)>( outputImage, inputImage, transpose, flipHorizontal, flipVertical ); break;
+            case 3: orientPixels<3 * sizeof(Channel)>( outputImage, inputImage, transpose, flipHorizontal, flipVertical ); break;
+            case 4: orientPixels<4 * sizeof(Channel)>( outputImage, inputImage, transpose, flipHorizontal, flipVertical ); break;
+            default: break;
+        }
+    }
+
+    template<unsigned int PixelSize, typename Channel>
+    void ImageOperator::orientPixels( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                      bool transpose, bool flipHorizontal, bool flipVertical )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+
+        if ( !transpose )
+        {
+            flipRows<PixelSize>( outputImage, inputImage, flipHorizontal, flipVertical );
+            return;
+        }
+
+        // In place: a square image, transposed and then flipped in a second pass
+        if ( &outputImage == &inputImage )
+        {
+            transposeSquare<PixelSize>( outputImage );
+
+            if ( flipHorizontal || flipVertical )
+            {
+                flipRows<PixelSize>( outputImage, outputImage, flipHorizontal, flipVertical );
+            }
+
+            return;
+        }
+
+        // Bands of input columns are bands of output rows
+        const unsigned int tile = transposeTileSize( PixelSize );
+        const unsigned int tileColumns = ( width + tile - 1 ) / tile;
+
+        Parallel::forRange( 0, tileColumns, Parallel::calculateGrain( height * tile * PixelSize ), [&]( unsigned int first, unsigned int last )
+        {
+            transposeBlock<PixelSize>( outputImage, inputImage, 0, height, first * tile, std::min( last * tile, width ),
+                                       flipHorizontal, flipVertical );
+        } );
+    }
+
+    template<unsigned int PixelSize, typename Channel>
+    void ImageOperator::flipRows( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                  bool flipHorizontal, bool flipVertical )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int rowSize = width * PixelSize;
+        const bool inPlace = &outputImage == &inputImage;
+
+        auto copyRow = [&]( BYTE* output, const BYTE* input )
+        {
+            if ( flipHorizontal )
+            {
+                simd::reversePixels<PixelSize>( output, input, width );
+            }
+            else if ( output != input )
+            {
+                std::memcpy( output, input, rowSize );
+            }
+        };
+
+        // Vertical flips swap pairs of rows
+        const unsigned int rows = flipVertical ? ( height + 1 ) / 2 : height;
+
+        Parallel::forRange( 0, rows, Parallel::calculateGrain( 2 * rowSize ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<BYTE> buffer( inPlace ? rowSize : 0 );
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                const unsigned int mirror = flipVertical ? height - 1 - y : y;
+                const BYTE* input = reinterpret_cast<const BYTE*>( inputImage( y, 0 ) );
+                BYTE* output = reinterpret_cast<BYTE*>( outputImage( y, 0 ) );
+
+                // Row y is overwritten first, so it is saved when in place
+                if ( inPlace && ( flipHorizontal || mirror != y ) )
+                {
+                    std::memcpy( &buffer[0], input, rowSize );
+                    input = &buffer[0];
+                }
+
+                if ( mirror != y )
+                {
+                    copyRow( output, reinterpret_cast<const BYTE*>( inputImage( mirror, 0 ) ) );
+                    copyRow( reinterpret_cast<BYTE*>( outputImage( mirror, 0 ) ), input );
+                }
+                else
+                {
+                    copyRow( output, input );
+                }
+            }
+        } );
+    }
+
+    template<unsigned int PixelSize, typename Channel>
+    void ImageOperator::transposeBlock( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                        unsigned int firstRow, unsigned int lastRow,
+                                        unsigned int firstColumn, unsigned int lastColumn,
+                                        bool flipHorizontal, bool flipVertical )
+    {
+        const unsigned int tile = transposeTileSize( PixelSize );
+        const unsigned int rows = lastRow - firstRow;
+        const unsigned int columns = lastColumn - firstColumn;
+
+        // Split the longer side in halves, on tile boundaries, until the
+        // block fits in the L1 cache
+        if ( rows * columns * PixelSize > 16384 && ( rows > tile || columns > tile ) )
+        {
+            if ( rows >= columns )
+            {
+                unsigned int middle = firstRow + ( rows / 2 + tile - 1 ) / tile * tile;
+                transposeBlock<PixelSize>( outputImage, inputImage, firstRow, middle, firstColumn, lastColumn, flipHorizontal, flipVertical );
+                transposeBlock<PixelSize>( outputImage, inputImage, middle, lastRow, firstColumn, lastColumn, flipHorizontal, flipVertical );
+            }
+            else
+            {
+                unsigned int middle = firstColumn + ( columns / 2 + tile - 1 ) / tile * tile;
+                transposeBlock<PixelSize>( outputImage, inputImage, firstRow, lastRow, firstColumn, middle, flipHorizontal, flipVertical );
+                transposeBlock<PixelSize>( outputImage, inputImage, firstRow, lastRow, middle, lastColumn, flipHorizontal, flipVertical );
+            }
+
+            return;
+        }
+
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const BYTE* tileRows[16];
+        BYTE* tileColumns[16];
+
+        for ( unsigned int y = firstRow; y < lastRow; y += tile )
+        {
+            const unsigned int tileHeight = std::min( tile, lastRow - y );
+
+            // Flipping columns of the output reverses the order of input rows
+            const unsigned int outputColumn = flipHorizontal ? height - y - tileHeight : y;
+
+            for ( unsigned int i = 0; i < tileHeight; ++i )
+            {
+                tileRows[i] = reinterpret_cast<const BYTE*>( inputImage( flipHorizontal ? y + tileHeight - 1 - i : y + i, 0 ) );
+            }
+
+            for ( unsigned int x = firstColumn; x < lastColumn; x += tile )
+            {
+                const unsigned int tileWidth = std::min( tile, lastColumn - x );
+                const BYTE* rowPointers[16];
+
+                for ( unsigned int i = 0; i < tileHeight; ++i )
+                {
+                    rowPointers[i] = tileRows[i] + x * PixelSize;
+                }
+
+                for ( unsigned int j = 0; j < tileWidth; ++j )
+                {
+                    unsigned int outputRow = flipVertical ? width - 1 - ( x + j ) : x + j;
+                    tileColumns[j] = reinterpret_cast<BYTE*>( outputImage( outputRow, outputColumn ) );
+                }
+
+                simd::transposeTile<PixelSize>( rowPointers, tileColumns, tileHeight, tileWidth );
+            }
+        }
+    }
+
+    template<unsigned int PixelSize, typename Channel>
+    void ImageOperator::transposeSquare( Image<Channel>& image )
+    {
+        const unsigned int size = image.getWidth();
+        const unsigned int tile = transposeTileSize( PixelSize );
+        const unsigned int tiles = ( size + tile - 1 ) / tile;
+
+        // Band of tile rows t handles the pairs of tiles (t, u) and (u, t) for
+        // u >= t, so bands never touch the same tiles
+        Parallel::forRange( 0, tiles, Parallel::calculateGrain( size * tile * PixelSize ), [&]( unsigned int first, unsigned int last )
+        {
+            BYTE buffers[2][16 * 16 * PixelSize];
+            const BYTE* rows[2][16];
+            BYTE* columns[16];
+
+            for ( unsigned int t = first; t < last; ++t )
+            {
+                for ( unsigned int u = t; u < tiles; ++u )
+                {
+                    // Tile k spans rows origins[k][0] and columns origins[k][1]
+                    const unsigned int origins[2][2] = { { t * tile, u * tile }, { u * tile, t * tile } };
+                    unsigned int extents[2][2];
+
+                    for ( unsigned int k = 0; k < 2; ++k )
+                    {
+                        extents[k][0] = std::min( tile, size - origins[k][0] );
+                        extents[k][1] = std::min( tile, size - origins[k][1] );
+
+                        for ( unsigned int i = 0; i < extents[k][0]; ++i )
+                        {
+                            BYTE* row = &buffers[k][i * tile * PixelSize];
+                            std::memcpy( row, image( origins[k][0] + i, origins[k][1] ), extents[k][1] * PixelSize );
+                            rows[k][i] = row;
+                        }
+                    }
+
+                    // Each tile is written transposed at the place of the other
+                    for ( unsigned int k = 0; k < ( t == u ? 1u : 2u ); ++k )
+                    {
+                        for ( unsigned int j = 0; j < extents[k][1]; ++j )
+                        {
+                            columns[j] = reinterpret_cast<BYTE*>( image( origins[k][1] + j, origins[k][0] ) );
+                        }
+
+                        simd::transposeTile<PixelSize>( rows[k], columns, extents[k][0], extents[k][1] );
+                    }
+                }
+            }
+        } );
+    }
+
+    inline unsigned int ImageOperator::transposeTileSize( unsigned int pixelSize )
+    {
+        return pixelSize < 16 && 16 % pixelSize == 0 ? 16 : 8;
+    }
+
+    inline void ImageOperator::buildRemapKernel( RemapKernel& kernel, Interpolation interpolation )
+    {
+        kernel.interpolation = interpolation == Interpolation::AREA ? Interpolation::BILINEAR :
+                               interpolation == Interpolation::LANCZOS ? Interpolation::BICUBIC : interpolation;
+        kernel.taps = kernel.interpolation == Interpolation::NEAREST ? 1 :
+                      kernel.interpolation == Interpolation::BICUBIC ? 4 : 2;
+
+        for ( unsigned int f = 0; f < 32; ++f )
+        {
+            float* weights = &kernel.weights[f * kernel.taps];
+            int16_t* fixedPoint = &kernel.fixedPoint[f * kernel.taps];
+            int total = 0;
+            unsigned int largest = 0;
+
+            // Tap k is at distance k - f / 32 from the position (k - 1 - f / 32
+            // for bicubic windows, which start one pixel before)
+            for ( unsigned int k = 0; k < kernel.taps; ++k )
+            {
+                double distance = k - f / 32.0 - ( kernel.taps == 4 ? 1.0 : 0.0 );
+                weights[k] = kernel.taps == 1 ? 1.0f : static_cast<float>( resampleWeight( distance, kernel.interpolation ) );
+                fixedPoint[k] = static_cast<int16_t>( std::lround( weights[k] * 1024.0f ) );
+                total += fixedPoint[k];
+                largest = weights[k] > weights[largest] ? k : largest;
+            }
+
+            fixedPoint[largest] = static_cast<int16_t>( fixedPoint[largest] + 1024 - total );
+        }
+    }
+
+    template<typename Channel, typename MapRow>
+    void ImageOperator::warp( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                              unsigned int width, unsigned int height, Interpolation interpolation,
+                              BorderMode border, double borderValue, const MapRow& mapRow )
+    {
+        if ( &outputImage == &inputImage )
+        {
+            Image<Channel> copy( inputImage );
+            warp( outputImage, copy, width, height, interpolation, border, borderValue, mapRow );
+            return;
+        }
+
+        if ( inputImage.getData() == nullptr || width == 0 || height == 0 )
+        {
+            return;
+        }
+
+        if ( !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        RemapKernel kernel;
+        buildRemapKernel( kernel, interpolation );
+
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const std::vector<Channel> borderPixel( channels, simd::saturate<Channel>( borderValue ) );
+
+        // Positions are rounded to the nearest pixel, or to the nearest 1/32
+        const int fractionBits = 10;
+        const int32_t rounding = kernel.taps == 1 ? 1 << ( fractionBits - 1 ) : 1 << ( fractionBits - 6 );
+
+        // A block of 128x32 output pixels reads a compact region of the input
+        // whatever the transform
+        const unsigned int blockWidth = 128;
+        const unsigned int blockHeight = 32;
+        const unsigned int bands = ( height + blockHeight - 1 ) / blockHeight;
+        const unsigned int grain = Parallel::calculateGrain( width * blockHeight * channels * kernel.taps * kernel.taps );
+
+        Parallel::forRange( 0, bands, grain, [&]( unsigned int firstBand, unsigned int lastBand )
+        {
+            std::vector<int32_t> positions( 2 * blockWidth );
+            std::vector<uint16_t> fractions( blockWidth );
+
+            for ( unsigned int band = firstBand; band < lastBand; ++band )
+            {
+                const unsigned int lastRow = std::min( height, ( band + 1 ) * blockHeight );
+
+                for ( unsigned int x = 0; x < width; x += blockWidth )
+                {
+                    const unsigned int count = std::min( blockWidth, width - x );
+
+                    for ( unsigned int y = band * blockHeight; y < lastRow; ++y )
+                    {
+                        mapRow( x, y, count, &positions[0] );
+                        simd::splitPositions( &positions[0], &fractions[0], count, fractionBits, rounding );
+                        remapRow( outputImage( y, x ), inputImage, &positions[0], &fractions[0], count, kernel, border, &borderPixel[0] );
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::remapRow( Channel* output, const Image<Channel>& inputImage, const int32_t* positions,
+                                  const uint16_t* fractions, unsigned int count, const RemapKernel& kernel,
+                                  BorderMode border, const Channel* borderPixel )
+    {
+        typedef typename std::conditional<std::is_same<Channel, double>::value, double, float>::type Accumulator;
+
+        const int width = static_cast<int>( inputImage.getWidth() );
+        const int height = static_cast<int>( inputImage.getHeight() );
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int stride = inputImage.getRowSize() / sizeof(Channel);
+        const int taps = static_cast<int>( kernel.taps );
+        const int before = taps == 4 ? 1 : 0;
+        const Channel* data = inputImage.getData();
+        Accumulator sums[4];
+
+        if ( taps == 1 )
+        {
+            for ( unsigned int i = 0; i < count; ++i, output += channels )
+            {
+                int x = positions[2 * i];
+                int y = positions[2 * i + 1];
+
+                if ( x < 0 || y < 0 || x >= width || y >= height )
+                {
+                    x = mapBorder( x, width, border );
+                    y = mapBorder( y, height, border );
+                }
+
+                const Channel* pixel = x < 0 || y < 0 ? borderPixel : data + y * stride + x * channels;
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    output[c] = pixel[c];
+                }
+            }
+
+            return;
+        }
+
+        for ( unsigned int i = 0; i < count; ++i, output += channels )
+        {
+            const int x = positions[2 * i] - before;
+            const int y = positions[2 * i + 1] - before;
+            const float* wx = &kernel.weights[( fractions[i] & 31 ) * taps];
+            const float* wy = &kernel.weights[( fractions[i] >> 5 ) * taps];
+
+            if ( x >= 0 && y >= 0 && x + taps <= width && y + taps <= height )
+            {
+                const Channel* window = data + y * stride + x * channels;
+
+                if ( taps == 2 )
+                {
+                    const Channel* lower = window + stride;
+                    const Accumulator weights[4] = { wy[0] * wx[0], wy[0] * wx[1], wy[1] * wx[0], wy[1] * wx[1] };
+
+                    for ( unsigned int c = 0; c < channels; ++c )
+                    {
+                        sums[c] = weights[0] * static_cast<Accumulator>( window[c] ) +
+                                  weights[1] * static_cast<Accumulator>( window[channels + c] ) +
+                                  weights[2] * static_cast<Accumulator>( lower[c] ) +
+                                  weights[3] * static_cast<Accumulator>( lower[channels + c] );
+                    }
+                }
+                else
+                {
+                    // Rows are interpolated first, then combined
+                    std::fill( sums, sums + channels, Accumulator( 0 ) );
+
+                    for ( int j = 0; j < 4; ++j, window += stride )
+                    {
+                        for ( unsigned int c = 0; c < channels; ++c )
+                        {
+                            const Channel* pixel = window + c;
+                            sums[c] += wy[j] * ( wx[0] * static_cast<Accumulator>( pixel[0] ) +
+                                                 wx[1] * static_cast<Accumulator>( pixel[channels] ) +
+                                                 wx[2] * static_cast<Accumulator>( pixel[2 * channels] ) +
+                                                 wx[3] * static_cast<Accumulator>( pixel[3 * channels] ) );
+                        }
+                    }
+                }
+            }
+            else if ( border == BorderMode::CONSTANT && ( x + taps <= 0 || y + taps <= 0 || x >= width || y >= height ) )
+            {
+                // Windows entirely outside the image
+                std::copy( borderPixel, borderPixel + channels, output );
+                continue;
+            }
+            else
+            {
+                std::fill( sums, sums + channels, Accumulator( 0 ) );
+
+                int columns[4];
+                int rows[4];
+
+                for ( int k = 0; k < taps; ++k )
+                {
+                    columns[k] = mapBorder( x + k, width, border );
+                    rows[k] = mapBorder( y + k, height, border );
+                }
+
+                for ( int j = 0; j < taps; ++j )
+                {
+                    for ( int k = 0; k < taps; ++k )
+                    {
+                        const Accumulator weight = wy[j] * wx[k];
+                        const Channel* pixel = rows[j] < 0 || columns[k] < 0 ? borderPixel : inputImage( rows[j], columns[k] );
+
+                        for ( unsigned int c = 0; c < channels; ++c )
+                        {
+                            sums[c] += weight * static_cast<Accumulator>( pixel[c] );
+                        }
+                    }
+                }
+            }
+
+            for ( unsigned int c = 0; c < channels; ++c )
+            {
+                output[c] = simd::saturate<Channel>( sums[c] );
+            }
+        }
+    }
+
+    inline void ImageOperator::remapRow( BYTE* output, const ImageByte& inputImage, const int32_t* positions,
+                                         const uint16_t* fractions, unsigned int count, const RemapKernel& kernel,
+                                         BorderMode border, const BYTE* borderPixel )
+    {
+        if ( kernel.taps == 1 )
+        {
+            remapRow<BYTE>( output, inputImage, positions, fractions, count, kernel, border, borderPixel );
+            return;
+        }
+
+        const int width = static_cast<int>( inputImage.getWidth() );
+        const int height = static_cast<int>( inputImage.getHeight() );
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int stride = inputImage.getRowSize();
+        const int taps = static_cast<int>( kernel.taps );
+        const int before = taps == 4 ? 1 : 0;
+        const BYTE* data = inputImage.getData();
+
+        for ( unsigned int i = 0; i < count; ++i, output += channels )
+        {
+            if ( taps == 2 && channels == 1 )
+            {
+                // Runs of windows inside the image, then one pixel here
+                unsigned int done = simd::bilinearGray( data, stride, width, height, positions + 2 * i, fractions + i, output, count - i );
+                i += done;
+                output += done;
+
+                if ( i == count )
+                {
+                    break;
+                }
+            }
+
+            const int x = positions[2 * i] - before;
+            const int y = positions[2 * i + 1] - before;
+
+            // Windows crossing the border are rare: take the generic path
+            if ( x < 0 || y < 0 || x + taps > width || y + taps > height )
+            {
+                remapRow<BYTE>( output, inputImage, positions + 2 * i, fractions + i, 1, kernel, border, borderPixel );
+                continue;
+            }
+
+            const BYTE* window = data + y * stride + x * channels;
+            const int fx = fractions[i] & 31;
+            const int fy = fractions[i] >> 5;
+
+            if ( taps == 2 )
+            {
+                // Weights with 14 fractional bits, summing to exactly 1 << 14
+                const int weights[4] =
+                {
+                    ( 32 - fx ) * ( 32 - fy ) * 16, fx * ( 32 - fy ) * 16,
+                    ( 32 - fx ) * fy * 16, fx * fy * 16
+                };
+
+                if ( channels == 1 )
+                {
+                    int sum = weights[0] * window[0] + weights[1] * window[1] +
+                              weights[2] * window[stride] + weights[3] * window[stride + 1];
+                    *output = static_cast<BYTE>( ( sum + ( 1 << 13 ) ) >> 14 );
+                    continue;
+                }
+
+                if ( channels == 4 )
+                {
+                    simd::bilinear4( window, window + stride, weights, output );
+                    continue;
+                }
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    int sum = weights[0] * window[c] + weights[1] * window[channels + c] +
+                              weights[2] * window[stride + c] + weights[3] * window[stride + channels + c];
+                    output[c] = static_cast<BYTE>( ( sum + ( 1 << 13 ) ) >> 14 );
+                }
+            }
+            else
+            {
+                // Rows are combined with 10 bits, columns with 10 more
+                const int16_t* wx = &kernel.fixedPoint[fx * 4];
+                const int16_t* wy = &kernel.fixedPoint[fy * 4];
+
+                if ( channels == 4 )
+                {
+                    simd::bicubic4( window, stride, wx, wy, output );
+                    continue;
+                }
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    const BYTE* pixel = window + c;
+                    int sum = 0;
+
+                    for ( int j = 0; j < 4; ++j, pixel += stride )
+                    {
+                        sum += wy[j] * ( wx[0] * pixel[0] + wx[1] * pixel[channels] +
+                                         wx[2] * pixel[2 * channels] + wx[3] * pixel[3 * channels] );
+                    }
+
+                    output[c] = static_cast<BYTE>( std::min( 255, std::max( 0, ( sum + ( 1 << 19 ) ) >> 20 ) ) );
+                }
+            }
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::scaleByAlpha( Image<Channel>& outputImage, const Image<Channel>& inputImage, bool divide )
+    {
+        const int alpha = alphaChannel( inputImage.getColorSpace() );
+
+        if ( inputImage.getData() == nullptr || alpha < 0 )
+        {
+            return;
+        }
+
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+
+        if ( &outputImage != &inputImage && !hasLayout( outputImage, width, height, inputImage.getColorSpace() ) )
+        {
+            outputImage.create( width, height, inputImage.getColorSpace() );
+        }
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( width * channels ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int row = firstRow; row < lastRow; ++row )
+            {
+                scaleByAlphaRow( inputImage( row, 0 ), outputImage( row, 0 ), width, channels, alpha, divide );
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::scaleByAlphaRow( const Channel* input, Channel* output, unsigned int count,
+                                         unsigned int channels, unsigned int alpha, bool divide )
+    {
+        const double opaqueValue = static_cast<double>( opaque<Channel>() );
+
+        for ( unsigned int i = 0; i < count; ++i, input += channels, output += channels )
+        {
+            const Channel a = input[alpha];
+            const double value = static_cast<double>( a );
+            const double factor = !divide ? value / opaqueValue : value != 0.0 ? opaqueValue / value : 0.0;
+
+            for ( unsigned int c = 0; c < channels; ++c )
+            {
+                output[c] = c == alpha ? a : simd::saturate<Channel>( static_cast<double>( input[c] ) * factor );
+            }
+        }
+    }
+
+    inline void ImageOperator::scaleByAlphaRow( const BYTE* input, BYTE* output, unsigned int count,
+                                                unsigned int channels, unsigned int alpha, bool divide )
+    {
+        if ( channels != 4 || ( alpha != 0 && alpha != 3 ) )
+        {
+            scaleByAlphaRow<BYTE>( input, output, count, channels, alpha, divide );
+        }
+        else if ( divide )
+        {
+            simd::unpremultiply( input, output, count, alpha );
+        }
+        else
+        {
+            simd::premultiply( input, output, count, alpha );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::blendOverRow( Channel* output, unsigned int channels, const Channel* overlay, unsigned int overlayChannels,
+                                      unsigned int count, const int* order, unsigned int alpha, bool premultiplied )
+    {
+        const double opaqueValue = static_cast<double>( opaque<Channel>() );
+        unsigned int imageAlpha = channels;
+
+        for ( unsigned int k = 0; k < channels; ++k )
+        {
+            if ( order[k] == static_cast<int>( alpha ) )
+            {
+                imageAlpha = k;
+            }
+        }
+
+        for ( unsigned int i = 0; i < count; ++i, output += channels, overlay += overlayChannels )
+        {
+            const double a = static_cast<double>( overlay[alpha] ) / opaqueValue;
+
+            if ( premultiplied )
+            {
+                for ( unsigned int k = 0; k < channels; ++k )
+                {
+                    output[k] = simd::saturate<Channel>( static_cast<double>( overlay[order[k]] ) + static_cast<double>( output[k] ) * ( 1.0 - a ) );
+                }
+            }
+            else
+            {
+                // Weights of the overlay and of the image, whose sum is the
+                // output alpha
+                const double b = imageAlpha < channels ? static_cast<double>( output[imageAlpha] ) / opaqueValue : 1.0;
+                const double imageWeight = b * ( 1.0 - a );
+                const double weight = a + imageWeight;
+
+                for ( unsigned int k = 0; k < channels; ++k )
+                {
+                    double value = weight * opaqueValue;
+
+                    if ( k != imageAlpha )
+                    {
+                        value = weight > 0.0 ? ( static_cast<double>( overlay[order[k]] ) * a + static_cast<double>( output[k] ) * imageWeight ) / weight : 0.0;
+                    }
+
+                    output[k] = simd::saturate<Channel>( value );
+                }
+            }
+        }
+    }
+
+    inline void ImageOperator::blendOverRow( BYTE* output, unsigned int channels, const BYTE* overlay, unsigned int overlayChannels,
+                                             unsigned int count, const int* order, unsigned int alpha, bool premultiplied )
+    {
+        // The SIMD kernels need the layout of the overlay, or its color
+        // channels followed by alpha over images without alpha
+        bool matching = overlayChannels == 4 && ( alpha == 0 || alpha == 3 ) && ( channels == 4 || ( channels == 3 && alpha == 3 ) );
+
+        for ( unsigned int k = 0; k < channels; ++k )
+        {
+            matching = matching && order[k] == static_cast<int>( k );
+        }
+
+        if ( matching )
+        {
+            simd::blendOver( overlay, output, count, channels, alpha, premultiplied );
+            return;
+        }
+
+        if ( overlayChannels != 4 || ( alpha != 0 && alpha != 3 ) )
+        {
+            blendOverRow<BYTE>( output, channels, overlay, overlayChannels, count, order, alpha, premultiplied );
+            return;
+        }
+
+        // Other layouts are blended in the layout of the overlay, with an
+        // opaque alpha for images without alpha, so that results do not
+        // depend on the channel order
+        const unsigned int runLength = 256;
+        BYTE pixels[4 * runLength];
+
+        for ( unsigned int first = 0; first < count; first += runLength )
+        {
+            const unsigned int run = std::min( runLength, count - first );
+            BYTE* image = output + first * channels;
+
+            for ( unsigned int i = 0; i < run; ++i )
+            {
+                pixels[4 * i + alpha] = 255;
+
+                for ( unsigned int k = 0; k < channels; ++k )
+                {
+                    pixels[4 * i + order[k]] = image[i * channels + k];
+                }
+            }
+
+            simd::blendOver( overlay + 4 * first, pixels, run, 4, alpha, premultiplied );
+
+            for ( unsigned int i = 0; i < run; ++i )
+            {
+                for ( unsigned int k = 0; k < channels; ++k )
+                {
+                    image[i * channels + k] = pixels[4 * i + order[k]];
+                }
+            }
+        }
+    }
+
+    inline const ImageOperator::ColorTables& ImageOperator::colorTables()
+    {
+        static const ColorTables tables = []()
+        {
+            ColorTables result;
+            const double knee = 6.0 / 29.0;
+
+            for ( unsigned int i = 0; i <= 4096; ++i )
+            {
+                const double x = i / 4096.0;
+                result.decode[i] = static_cast<float>( x <= 0.04045 ? x / 12.92 : std::pow( ( x + 0.055 ) / 1.055, 2.4 ) );
+                result.encode[i] = static_cast<float>( x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow( x, 1.0 / 2.4 ) - 0.055 );
+                result.cubeRoot[i] = static_cast<float>( x > knee * knee * knee ? std::cbrt( x ) : x / ( 3.0 * knee * knee ) + 4.0 / 29.0 );
+            }
+
+            return result;
+        }();
+
+        return tables;
+    }
+
+    inline float ImageOperator::lookup( const float* table, float x )
+    {
+        const float position = std::min( 1.0f, std::max( 0.0f, x ) ) * 4096.0f;
+        const unsigned int index = std::min( 4095u, static_cast<unsigned int>( position ) );
+        const float fraction = position - static_cast<float>( index );
+
+        return table[index] + ( table[index + 1] - table[index] ) * fraction;
+    }
+
+    inline void ImageOperator::ycbcrMatrices( YCbCrStandard standard, double scale, double center, double* encode, double* decode )
+    {
+        const bool bt709 = standard == YCbCrStandard::BT709_FULL || standard == YCbCrStandard::BT709_LIMITED;
+        const bool limited = standard == YCbCrStandard::BT601_LIMITED || standard == YCbCrStandard::BT709_LIMITED;
+
+        const double kr = bt709 ? 0.2126 : 0.299;
+        const double kb = bt709 ? 0.0722 : 0.114;
+        const double kg = 1.0 - kr - kb;
+
+        // Luma and chroma ranges
+        const double sy = limited ? 219.0 / 255.0 : 1.0;
+        const double sc = limited ? 224.0 / 255.0 : 1.0;
+        const double oy = limited ? 16.0 / 255.0 * scale : 0.0;
+
+        const double e[12] =
+        {
+            sy * kr, sy * kg, sy * kb, oy,
+            -sc * kr / ( 2.0 * ( 1.0 - kb ) ), -sc * kg / ( 2.0 * ( 1.0 - kb ) ), 0.5 * sc, center,
+            0.5 * sc, -sc * kg / ( 2.0 * ( 1.0 - kr ) ), -sc * kb / ( 2.0 * ( 1.0 - kr ) ), center
+        };
+
+        const double cr = 2.0 * ( 1.0 - kr ) / sc;
+        const double cb = 2.0 * ( 1.0 - kb ) / sc;
+        const double gb = 2.0 * kb * ( 1.0 - kb ) / ( kg * sc );
+        const double gr = 2.0 * kr * ( 1.0 - kr ) / ( kg * sc );
+
+        const double d[12] =
+        {
+            1.0 / sy, 0.0, cr, -oy / sy - center * cr,
+            1.0 / sy, -gb, -gr, -oy / sy + center * ( gb + gr ),
+            1.0 / sy, cb, 0.0, -oy / sy - center * cb
+        };
+
+        std::copy( e, e + 12, encode );
+        std::copy( d, d + 12, decode );
+    }
+
+    template<typename Channel>
+    void ImageOperator::rgbToColor( float* pixels, unsigned int count, ColorSpace::Type colorSpace, YCbCrStandard standard )
+    {
+        const bool integer = std::numeric_limits<Channel>::is_integer;
+        const double maxValue = static_cast<double>( opaque<Channel>() );
+        const double center = integer ? ( maxValue + 1.0 ) / 2.0 : 0.5;
+        const float scale = static_cast<float>( maxValue );
+
+        // A full turn of hue wraps around to 0 for integer types
+        const float turn = integer ? static_cast<float>( maxValue + 1.0 ) : 1.0f;
+        const float wrap = integer ? turn - 0.5f : turn;
+
+        if ( colorSpace == ColorSpace::Type::HSV || colorSpace == ColorSpace::Type::HSL )
+        {
+            const bool hsv = colorSpace == ColorSpace::Type::HSV;
+
+            for ( unsigned int i = 0; i < count; ++i, pixels += 3 )
+            {
+                const float r = pixels[0];
+                const float g = pixels[1];
+                const float b = pixels[2];
+                const float high = std::max( r, std::max( g, b ) );
+                const float low = std::min( r, std::min( g, b ) );
+                const float delta = high - low;
+                float hue = 0.0f;
+
+                if ( delta > 0.0f )
+                {
+                    hue = high == r ? ( g - b ) / delta : high == g ? ( b - r ) / delta + 2.0f : ( r - g ) / delta + 4.0f;
+                    hue = ( hue < 0.0f ? hue + 6.0f : hue ) * turn / 6.0f;
+                    hue = hue >= wrap ? hue - turn : hue;
+                }
+
+                const float lightness = 0.5f * ( high + low );
+                const float divisor = hsv ? high : 1.0f - std::fabs( 2.0f * lightness - 1.0f );
+
+                pixels[0] = hue;
+                pixels[1] = delta > 0.0f ? delta / divisor * scale : 0.0f;
+                pixels[2] = ( hsv ? high : lightness ) * scale;
+            }
+        }
+        else if ( colorSpace == ColorSpace::Type::LAB )
+        {
+            const ColorTables& tables = colorTables();
+            const float chroma = scale / 255.0f;
+
+            for ( unsigned int i = 0; i < count; ++i, pixels += 3 )
+            {
+                const float r = lookup( tables.decode, pixels[0] );
+                const float g = lookup( tables.decode, pixels[1] );
+                const float b = lookup( tables.decode, pixels[2] );
+
+                // Linear sRGB to XYZ, relative to the D65 white
+                const float fx = lookup( tables.cubeRoot, ( 0.4124564f * r + 0.3575761f * g + 0.1804375f * b ) / 0.95047f );
+                const float fy = lookup( tables.cubeRoot, 0.2126729f * r + 0.7151522f * g + 0.0721750f * b );
+                const float fz = lookup( tables.cubeRoot, ( 0.0193339f * r + 0.1191920f * g + 0.9503041f * b ) / 1.08883f );
+
+                pixels[0] = ( 116.0f * fy - 16.0f ) * scale / 100.0f;
+                pixels[1] = 500.0f * ( fx - fy ) * chroma + static_cast<float>( center );
+                pixels[2] = 200.0f * ( fy - fz ) * chroma + static_cast<float>( center );
+            }
+        }
+        else
+        {
+            double encode[12];
+            double decode[12];
+            ycbcrMatrices( standard, maxValue, center, encode, decode );
+
+            float m[12];
+
+            for ( unsigned int k = 0; k < 12; ++k )
+            {
+                m[k] = static_cast<float>( k % 4 == 3 ? encode[k] : encode[k] * maxValue );
+            }
+
+            for ( unsigned int i = 0; i < count; ++i, pixels += 3 )
+            {
+                const float r = pixels[0];
+                const float g = pixels[1];
+                const float b = pixels[2];
+
+                pixels[0] = m[0] * r + m[1] * g + m[2] * b + m[3];
+                pixels[1] = m[4] * r + m[5] * g + m[6] * b + m[7];
+                pixels[2] = m[8] * r + m[9] * g + m[10] * b + m[11];
+            }
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::colorToRGB( float* pixels, unsigned int count, ColorSpace::Type colorSpace, YCbCrStandard standard )
+    {
+        const bool integer = std::numeric_limits<Channel>::is_integer;
+        const double maxValue = static_cast<double>( opaque<Channel>() );
+        const double center = integer ? ( maxValue + 1.0 ) / 2.0 : 0.5;
+        const float scale = 1.0f / static_cast<float>( maxValue );
+        const float turn = integer ? static_cast<float>( maxValue + 1.0 ) : 1.0f;
+
+        if ( colorSpace == ColorSpace::Type::HSV || colorSpace == ColorSpace::Type::HSL )
+        {
+            const bool hsv = colorSpace == ColorSpace::Type::HSV;
+
+            for ( unsigned int i = 0; i < count; ++i, pixels += 3 )
+            {
+                const float hue = pixels[0] / turn;
+                const float saturation = pixels[1] * scale;
+                const float value = pixels[2] * scale;
+
+                // Sectors of the hue, from the phase of each color
+                for ( unsigned int c = 0; c < 3; ++c )
+                {
+                    if ( hsv )
+                    {
+                        float k = static_cast<float>( 5 - 2 * c ) + 6.0f * hue;
+                        k -= 6.0f * std::floor( k / 6.0f );
+                        pixels[c] = value - value * saturation * std::max( 0.0f, std::min( k, std::min( 4.0f - k, 1.0f ) ) );
+                    }
+                    else
+                    {
+                        float k = static_cast<float>( ( 12 - 4 * c ) % 12 ) + 12.0f * hue;
+                        k -= 12.0f * std::floor( k / 12.0f );
+                        const float a = saturation * std::min( value, 1.0f - value );
+                        pixels[c] = value - a * std::max( -1.0f, std::min( k - 3.0f, std::min( 9.0f - k, 1.0f ) ) );
+                    }
+                }
+            }
+        }
+        else if ( colorSpace == ColorSpace::Type::LAB )
+        {
+            const ColorTables& tables = colorTables();
+            const float chroma = 255.0f * scale;
+            const float knee = 6.0f / 29.0f;
+
+            auto inverse = [knee]( float t )
+            {
+                return t > knee ? t * t * t : 3.0f * knee * knee * ( t - 4.0f / 29.0f );
+            };
+
+            for ( unsigned int i = 0; i < count; ++i, pixels += 3 )
+            {
+                const float fy = ( pixels[0] * 100.0f * scale + 16.0f ) / 116.0f;
+                const float fx = fy + ( pixels[1] - static_cast<float>( center ) ) * chroma / 500.0f;
+                const float fz = fy - ( pixels[2] - static_cast<float>( center ) ) * chroma / 200.0f;
+
+                const float x = 0.95047f * inverse( fx );
+                const float y = inverse( fy );
+                const float z = 1.08883f * inverse( fz );
+
+                // XYZ to linear sRGB
+                pixels[0] = lookup( tables.encode, 3.2404542f * x - 1.5371385f * y - 0.4985314f * z );
+                pixels[1] = lookup( tables.encode, -0.9692660f * x + 1.8760108f * y + 0.0415560f * z );
+                pixels[2] = lookup( tables.encode, 0.0556434f * x - 0.2040259f * y + 1.0572252f * z );
+            }
+        }
+        else
+        {
+            double encode[12];
+            double decode[12];
+            ycbcrMatrices( standard, maxValue, center, encode, decode );
+
+            float m[12];
+
+            for ( unsigned int k = 0; k < 12; ++k )
+            {
+                m[k] = static_cast<float>( decode[k] / maxValue );
+            }
+
+            for ( unsigned int i = 0; i < count; ++i, pixels += 3 )
+            {
+                const float y = pixels[0];
+                const float cb = pixels[1];
+                const float cr = pixels[2];
+
+                pixels[0] = m[0] * y + m[1] * cb + m[2] * cr + m[3];
+                pixels[1] = m[4] * y + m[5] * cb + m[6] * cr + m[7];
+                pixels[2] = m[8] * y + m[9] * cb + m[10] * cr + m[11];
+            }
+        }
+
+        pixels -= 3 * static_cast<std::size_t>( count );
+
+        for ( unsigned int i = 0; i < 3 * count; ++i )
+        {
+            pixels[i] = std::min( 1.0f, std::max( 0.0f, pixels[i] ) );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::loadRGB( const Channel* input, unsigned int channels, const int* order, unsigned int count, float* pixels )
+    {
+        const float scale = 1.0f / static_cast<float>( opaque<Channel>() );
+
+        for ( unsigned int i = 0; i < count; ++i, input += channels, pixels += 3 )
+        {
+            pixels[0] = static_cast<float>( input[order[0]] ) * scale;
+            pixels[1] = static_cast<float>( input[order[1]] ) * scale;
+            pixels[2] = static_cast<float>( input[order[2]] ) * scale;
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::storeRGB( const float* pixels, Channel* output, unsigned int channels, const int* order, unsigned int count )
+    {
+        const double scale = static_cast<double>( opaque<Channel>() );
+
+        for ( unsigned int i = 0; i < count; ++i, output += channels, pixels += 3 )
+        {
+            for ( unsigned int k = 0; k < channels; ++k )
+            {
+                output[k] = order[k] < 0 ? opaque<Channel>() : simd::saturate<Channel>( pixels[order[k]] * scale );
+            }
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::chromaRow( const Image<Channel>& image, unsigned int frameHeight, unsigned int row,
+                                   std::size_t& cb, std::size_t& cr, unsigned int& step )
+    {
+        const std::size_t stride = image.getRowSize() / sizeof(Channel);
+        const std::size_t planes = frameHeight * stride;
+
+        if ( image.getColorSpace() == ColorSpace::Type::NV12 )
+        {
+            cb = planes + row * stride;
+            cr = cb + 1;
+            step = 2;
+        }
+        else
+        {
+            cb = planes + row * ( stride / 2 );
+            cr = planes + ( frameHeight / 2 + row ) * ( stride / 2 );
+            step = 1;
+        }
+    }
+
+    template<typename Channel>
+    bool ImageOperator::convertColorFixedPoint( Image<Channel>&, const Image<Channel>&, unsigned int, unsigned int, YCbCrStandard )
+    {
+        return false;
+    }
+
+    inline bool ImageOperator::convertColorFixedPoint( ImageByte& outputImage, const ImageByte& inputImage,
+                                                       unsigned int width, unsigned int height, YCbCrStandard standard )
+    {
+        const bool encode = ColorSpace::isRGB( inputImage.getColorSpace() );
+        const ColorSpace::Type rgbSpace = encode ? inputImage.getColorSpace() : outputImage.getColorSpace();
+        const ColorSpace::Type space = encode ? outputImage.getColorSpace() : inputImage.getColorSpace();
+        const unsigned int channels = ColorSpace::calculateNumberOfChannels( rgbSpace );
+
+        if ( channels < 3 || ( space != ColorSpace::Type::YCBCR && !ColorSpace::isPlanar( space ) ) )
+        {
+            return false;
+        }
+
+        double encodeMatrix[12];
+        double decodeMatrix[12];
+        ycbcrMatrices( standard, 255.0, 128.0, encodeMatrix, decodeMatrix );
+
+        // 4x4 matrix of 13 fractional bits between the lanes of the RGB layout
+        // and Y, Cb, Cr, 1 lanes. The constant lane holds 128.
+        auto coefficient = []( double value ) { return static_cast<int16_t>( std::lround( value * 8192.0 ) ); };
+        auto constant = []( double value ) { return static_cast<int16_t>( std::lround( value * 64.0 ) + 32 ); };
+
+        const std::string names = ColorSpace::channelNames( rgbSpace );
+        const std::string colors = "RGB";
+        const unsigned int constantChannel = encode && channels == 4 ? static_cast<unsigned int>( alphaChannel( rgbSpace ) ) : 3;
+        int16_t matrix[16] = {};
+
+        for ( unsigned int k = 0; k < 4; ++k )
+        {
+            const std::string::size_type color = k < channels ? colors.find( names[k] ) : std::string::npos;
+
+            if ( encode )
+            {
+                for ( unsigned int i = 0; i < 3; ++i )
+                {
+                    matrix[4 * i + k] = k == constantChannel ? constant( encodeMatrix[4 * i + 3] ) :
+                                        color != std::string::npos ? coefficient( encodeMatrix[4 * i + color] ) : 0;
+                }
+            }
+            else if ( color != std::string::npos )
+            {
+                for ( unsigned int j = 0; j < 3; ++j )
+                {
+                    matrix[4 * k + j] = coefficient( decodeMatrix[4 * color + j] );
+                }
+
+                matrix[4 * k + 3] = constant( decodeMatrix[4 * color + 3] );
+            }
+            else
+            {
+                matrix[4 * k + 3] = constant( 255.0 );
+            }
+        }
+
+        const unsigned int inputChannels = inputImage.getNumberOfChannels();
+        const unsigned int outputChannels = outputImage.getNumberOfChannels();
+
+        if ( space == ColorSpace::Type::YCBCR )
+        {
+            Parallel::forRange( 0, height, Parallel::calculateGrain( 4 * width ), [&]( unsigned int firstRow, unsigned int lastRow )
+            {
+                for ( unsigned int row = firstRow; row < lastRow; ++row )
+                {
+                    simd::colorMatrix( inputImage( row, 0 ), inputChannels, outputImage( row, 0 ), outputChannels,
+                                       width, matrix, constantChannel );
+                }
+            } );
+
+            return true;
+        }
+
+        // Pairs of rows and their chroma row, in runs of Y, Cb, Cr, 0 pixels
+        const unsigned int runLength = 256;
+        const ImageByte& planarImage = encode ? outputImage : inputImage;
+
+        Parallel::forRange( 0, height / 2, Parallel::calculateGrain( 8 * width ), [&]( unsigned int firstPair, unsigned int lastPair )
+        {
+            BYTE pixels[2][4 * runLength];
+
+            for ( unsigned int pair = firstPair; pair < lastPair; ++pair )
+            {
+                const unsigned int row = 2 * pair;
+                std::size_t cb;
+                std::size_t cr;
+                unsigned int step;
+                chromaRow( planarImage, height, pair, cb, cr, step );
+
+                for ( unsigned int x = 0; x < width; x += runLength )
+                {
+                    const unsigned int run = std::min( runLength, width - x );
+                    const std::size_t chroma = x / 2 * step;
+
+                    if ( encode )
+                    {
+                        BYTE* data = outputImage.getData();
+
+                        for ( unsigned int r = 0; r < 2; ++r )
+                        {
+                            simd::colorMatrix( inputImage( row + r, x ), inputChannels, pixels[r], 4, run, matrix, constantChannel );
+
+                            BYTE* luma = outputImage( row + r, x );
+
+                            for ( unsigned int i = 0; i < run; ++i )
+                            {
+                                luma[i] = pixels[r][4 * i];
+                            }
+                        }
+
+                        for ( unsigned int i = 0; i < run / 2; ++i )
+                        {
+                            const BYTE* top = &pixels[0][8 * i];
+                            const BYTE* bottom = &pixels[1][8 * i];
+                            data[cb + chroma + i * step] = static_cast<BYTE>( ( top[1] + top[5] + bottom[1] + bottom[5] + 2 ) >> 2 );
+                            data[cr + chroma + i * step] = static_cast<BYTE>( ( top[2] + top[6] + bottom[2] + bottom[6] + 2 ) >> 2 );
+                        }
+                    }
+                    else
+                    {
+                        const BYTE* data = inputImage.getData();
+
+                        for ( unsigned int r = 0; r < 2; ++r )
+                        {
+                            simd::interleaveYUV( inputImage( row + r, x ), data + cb + chroma, data + cr + chroma, step, pixels[0], run );
+                            simd::colorMatrix( pixels[0], 4, outputImage( row + r, x ), outputChannels, run, matrix, 3 );
+                        }
+                    }
+                }
+            }
+        } );
+
+        return true;
+    }
+
+    template<typename Channel>
+    void ImageOperator::accumulateStatistics( std::vector<ChannelStats>& stats, const Image<Channel>& image,
+                                              const Image<Channel>* subtrahend, const ImageByte* mask )
+    {
+        const unsigned int width = image.getWidth();
+        const unsigned int height = image.getHeight();
+        const unsigned int channels = image.getNumberOfChannels();
+
+        if ( image.getData() == nullptr ||
+             ( mask != nullptr && !hasLayout( *mask, width, height, ColorSpace::Type::GRAYSCALE ) ) )
+        {
+            return;
+        }
+
+        // Bands depend on the image only, so that partial sums are always
+        // added in the same order
+        const unsigned int bandRows = Parallel::calculateGrain( width * channels );
+        const unsigned int bands = ( height + bandRows - 1 ) / bandRows;
+
+        const double infinity = std::numeric_limits<double>::infinity();
+        const StatisticsAccumulator empty = { 0, 0.0, 0.0, 0.0, infinity, -infinity, 0, 0, 0, 0 };
+        std::vector<StatisticsAccumulator> partials( static_cast<std::size_t>( bands ) * channels, empty );
+
+        Parallel::forRange( 0, bands, 1, [&]( unsigned int firstBand, unsigned int lastBand )
+        {
+            std::vector<BYTE> scratch( mask != nullptr ? width * channels : 0 );
+
+            for ( unsigned int band = firstBand; band < lastBand; ++band )
+            {
+                const unsigned int lastRow = std::min( height, ( band + 1 ) * bandRows );
+
+                for ( unsigned int y = band * bandRows; y < lastRow; ++y )
+                {
+                    statisticsRow( &partials[band * channels], image( y, 0 ), subtrahend != nullptr ? ( *subtrahend )( y, 0 ) : nullptr,
+                                   mask != nullptr ? ( *mask )( y, 0 ) : nullptr, width, channels, y, scratch.data() );
+                }
+            }
+        } );
+
+        std::vector<StatisticsAccumulator> totals( channels, empty );
+
+        for ( unsigned int band = 0; band < bands; ++band )
+        {
+            for ( unsigned int c = 0; c < channels; ++c )
+            {
+                StatisticsAccumulator& a = totals[c];
+                const StatisticsAccumulator& b = partials[band * channels + c];
+
+                a.count += b.count;
+                a.sum += b.sum;
+                a.squares += b.squares;
+                a.absolute += b.absolute;
+
+                // Earlier bands win ties
+                if ( b.minimum < a.minimum )
+                {
+                    a.minimum = b.minimum;
+                    a.minimumX = b.minimumX;
+                    a.minimumY = b.minimumY;
+                }
+
+                if ( b.maximum > a.maximum )
+                {
+                    a.maximum = b.maximum;
+                    a.maximumX = b.maximumX;
+                    a.maximumY = b.maximumY;
+                }
+            }
+        }
+
+        stats.assign( channels, ChannelStats() );
+
+        for ( unsigned int c = 0; c < channels && totals[c].count > 0; ++c )
+        {
+            const StatisticsAccumulator& a = totals[c];
+            ChannelStats& s = stats[c];
+
+            s.count = a.count;
+            s.minimum = a.minimum;
+            s.maximum = a.maximum;
+            s.minimumX = a.minimumX;
+            s.minimumY = a.minimumY;
+            s.maximumX = a.maximumX;
+            s.maximumY = a.maximumY;
+            s.sum = a.sum;
+            s.mean = a.sum / a.count;
+            s.variance = std::max( 0.0, a.squares / a.count - s.mean * s.mean );
+            s.standardDeviation = std::sqrt( s.variance );
+            s.normL1 = a.absolute;
+            s.normL2 = std::sqrt( a.squares );
+            s.normInf = std::max( std::fabs( a.minimum ), std::fabs( a.maximum ) );
+        }
+    }
+
+    template<typename Channel>
+    void ImageOperator::statisticsRow( StatisticsAccumulator* accumulators, const Channel* input, const Channel* subtract,
+                                       const BYTE* mask, unsigned int width, unsigned int channels, unsigned int y, BYTE* )
+    {
+        for ( unsigned int x = 0; x < width; ++x, input += channels )
+        {
+            if ( mask != nullptr && mask[x] == 0 )
+            {
+                continue;
+            }
+
+            for ( unsigned int c = 0; c < channels; ++c )
+            {
+                StatisticsAccumulator& a = accumulators[c];
+                double value = static_cast<double>( input[c] );
+
+                if ( subtract != nullptr )
+                {
+                    value -= static_cast<double>( subtract[x * channels + c] );
+                }
+
+                ++a.count;
+                a.sum += value;
+                a.squares += value * value;
+                a.absolute += std::fabs( value );
+
+                if ( value < a.minimum )
+                {
+                    a.minimum = value;
+                    a.minimumX = x;
+                    a.minimumY = y;
+                }
+
+                if ( value > a.maximum )
+                {
+                    a.maximum = value;
+                    a.maximumX = x;
+                    a.maximumY = y;
+                }
+            }
+        }
+    }
+
+    inline void ImageOperator::statisticsRow( StatisticsAccumulator* accumulators, const BYTE* input, const BYTE* subtract,
+                                              const BYTE* mask, unsigned int width, unsigned int channels, unsigned int y, BYTE* scratch )
+    {
+        uint64_t count = width;
+
+        // The SIMD kernel takes a mask per channel value
+        if ( mask != nullptr )
+        {
+            count = 0;
+
+            for ( unsigned int x = 0; x < width; ++x )
+            {
+                const BYTE valid = mask[x] != 0 ? 255 : 0;
+                count += valid & 1;
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    scratch[x * channels + c] = valid;
+                }
+            }
+
+            if ( count == 0 )
+            {
+                return;
+            }
+        }
+
+        int64_t sums[4] = { 0, 0, 0, 0 };
+        uint64_t squares[4] = { 0, 0, 0, 0 };
+        uint64_t absolutes[4] = { 0, 0, 0, 0 };
+        int minimum[4] = { 256, 256, 256, 256 };
+        int maximum[4] = { -256, -256, -256, -256 };
+
+        simd::statistics( input, subtract, mask != nullptr ? scratch : nullptr, width * channels, channels,
+                          sums, squares, absolutes, minimum, maximum );
+
+        for ( unsigned int c = 0; c < channels; ++c )
+        {
+            StatisticsAccumulator& a = accumulators[c];
+
+            a.count += count;
+            a.sum += static_cast<double>( sums[c] );
+            a.squares += static_cast<double>( squares[c] );
+            a.absolute += static_cast<double>( absolutes[c] );
+
+            // Locations are searched only when the row improves an extreme
+            bool lower = minimum[c] < a.minimum;
+            bool higher = maximum[c] > a.maximum;
+
+            for ( unsigned int x = 0; x < width && ( lower || higher ); ++x )
+            {
+                if ( mask != nullptr && mask[x] == 0 )
+                {
+                    continue;
+                }
+
+                const std::size_t i = x * channels + c;
+                const int value = subtract != nullptr ? input[i] - subtract[i] : input[i];
+
+                if ( lower && value == minimum[c] )
+                {
+                    a.minimum = value;
+                    a.minimumX = x;
+                    a.minimumY = y;
+                    lower = false;
+                }
+
+                if ( higher && value == maximum[c] )
+                {
+                    a.maximum = value;
+                    a.maximumX = x;
+                    a.maximumY = y;
+                    higher = false;
+                }
+            }
+        }
+    }
+
     template<typename Channel>
-    void ImageOperator<Channel>::add( Image<Channel>& outputImage, const Image<Channel>& imageA, const Image<Channel>& imageB )
+    void ImageOperator::structuralSimilarity( const Image<Channel>& image1, const Image<Channel>& image2, double peak,
+                                              double& ssim, double& contrastStructure )
     {
-        if ( !areCompatible( imageA, imageB ) )
+        const std::vector<float> kernel = gaussianKernel( 1.5, 5 );
+        const unsigned int size = static_cast<unsigned int>( kernel.size() );
+        const unsigned int channels = image1.getNumberOfChannels();
+        const unsigned int count = image1.getWidth() * channels;
+
+        // Output pixels are those where the window fits in the images
+        const unsigned int outputHeight = image1.getHeight() - size + 1;
+        const unsigned int outputCount = ( image1.getWidth() - size + 1 ) * channels;
+
+        const float c1 = static_cast<float>( 0.01 * peak * 0.01 * peak );
+        const float c2 = static_cast<float>( 0.03 * peak * 0.03 * peak );
+
+        std::vector<double> rowSsim( outputHeight );
+        std::vector<double> rowContrastStructure( outputHeight );
+
+        // Columns are processed in tiles so that the ring stays in the L2
+        // cache. Tiles of a row are added in order.
+        const unsigned int tileLength = 512;
+        const unsigned int margin = ( size - 1 ) * channels;
+
+        Parallel::forRange( 0, outputHeight, Parallel::calculateGrain( 128 * count ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            // x, y, x^2, y^2 and xy of an input row, and the ring of their
+            // horizontally filtered rows
+            std::vector<float> products( 5 * ( tileLength + margin ) );
+            std::vector<float> ring( 5 * size * tileLength );
+            std::vector<float> moments( 5 * tileLength );
+            std::vector<const float*> taps( size );
+
+            for ( unsigned int tile = 0; tile < outputCount; tile += tileLength )
+            {
+                const unsigned int length = std::min( tileLength, outputCount - tile );
+                const unsigned int inputLength = length + margin;
+
+                for ( unsigned int row = firstRow; row < lastRow + size - 1; ++row )
+                {
+                    float* x = &products[0];
+                    float* y = x + inputLength;
+
+                    simd::convert( image1( row, 0 ) + tile, x, inputLength, 1.0, 0.0 );
+                    simd::convert( image2( row, 0 ) + tile, y, inputLength, 1.0, 0.0 );
+                    simd::multiply( y + inputLength, x, x, inputLength );
+                    simd::multiply( y + 2 * inputLength, y, y, inputLength );
+                    simd::multiply( y + 3 * inputLength, x, y, inputLength );
+
+                    float* filtered = &ring[5 * ( row % size ) * tileLength];
+
+                    for ( unsigned int m = 0; m < 5; ++m )
+                    {
+                        for ( unsigned int k = 0; k < size; ++k )
+                        {
+                            taps[k] = &products[m * inputLength + k * channels];
+                        }
+
+                        simd::weightedSum( filtered + m * length, &taps[0], &kernel[0], size, length );
+                    }
+
+                    if ( row < firstRow + size - 1 )
+                    {
+                        continue;
+                    }
+
+                    // Output row whose window ends at this row
+                    const unsigned int outputRow = row - size + 1;
+
+                    for ( unsigned int k = 0; k < size; ++k )
+                    {
+                        taps[k] = &ring[5 * ( ( outputRow + k ) % size ) * tileLength];
+                    }
+
+                    simd::weightedSum( &moments[0], &taps[0], &kernel[0], size, 5 * length );
+
+                    const float* m = &moments[0];
+                    simd::ssim( m, m + length, m + 2 * length, m + 3 * length, m + 4 * length, length, c1, c2,
+                                rowSsim[outputRow], rowContrastStructure[outputRow] );
+                }
+            }
+        } );
+
+        ssim = 0.0;
+        contrastStructure = 0.0;
+
+        for ( unsigned int row = 0; row < outputHeight; ++row )
+        {
+            ssim += rowSsim[row];
+            contrastStructure += rowContrastStructure[row];
+        }
+
+        const double pixels = static_cast<double>( outputHeight ) * outputCount;
+        ssim /= pixels;
+        contrastStructure /= pixels;
+    }
+
+    template<typename T>
+    void ImageOperator::correlate( Image<T>& outputImage, const Image<T>& inputImage, const Image<T>& kernel )
+    {
+        const unsigned int paddedWidth = FFT<T>::optimalSize( inputImage.getWidth() );
+        const unsigned int paddedHeight = FFT<T>::optimalSize( inputImage.getHeight() );
+
+        // Multiply-adds of the direct method against about 3 n log2(n) for
+        // each of the 2 transforms per channel and the one of the kernel
+        // (measured crossover)
+        const double points = static_cast<double>( paddedWidth ) * paddedHeight;
+        const double direct = static_cast<double>( outputImage.getWidth() ) * outputImage.getHeight() *
+                              outputImage.getNumberOfChannels() * kernel.getWidth() * kernel.getHeight();
+        const double spectral = 3.0 * points * std::log2( points ) * ( 2 * inputImage.getNumberOfChannels() + 1 );
+
+        if ( direct <= spectral )
+        {
+            correlateDirect( outputImage, inputImage, kernel );
+        }
+        else
+        {
+            correlateSpectral( outputImage, inputImage, kernel, paddedWidth, paddedHeight );
+        }
+    }
+
+    template<typename T>
+    void ImageOperator::correlateDirect( Image<T>& outputImage, const Image<T>& inputImage, const Image<T>& kernel )
+    {
+        const unsigned int kernelWidth = kernel.getWidth();
+        const unsigned int kernelHeight = kernel.getHeight();
+        const unsigned int taps = kernelWidth * kernelHeight;
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int count = outputImage.getWidth() * channels;
+        std::vector<T> weights( taps );
+
+        for ( unsigned int i = 0; i < kernelHeight; ++i )
+        {
+            std::copy( kernel( i, 0 ), kernel( i, 0 ) + kernelWidth, &weights[i * kernelWidth] );
+        }
+
+        Parallel::forRange( 0, outputImage.getHeight(), Parallel::calculateGrain( count * taps ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<const T*> inputs( taps );
+
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                for ( unsigned int i = 0; i < kernelHeight; ++i )
+                {
+                    for ( unsigned int j = 0; j < kernelWidth; ++j )
+                    {
+                        inputs[i * kernelWidth + j] = inputImage( y + i, j );
+                    }
+                }
+
+                simd::weightedSum( outputImage( y, 0 ), &inputs[0], &weights[0], taps, count );
+            }
+        } );
+    }
+
+    template<typename T>
+    void ImageOperator::correlateSpectral( Image<T>& outputImage, const Image<T>& inputImage, const Image<T>& kernel,
+                                           unsigned int paddedWidth, unsigned int paddedHeight )
+    {
+        const unsigned int width = inputImage.getWidth();
+        const unsigned int height = inputImage.getHeight();
+        const unsigned int channels = inputImage.getNumberOfChannels();
+        const unsigned int size = ( paddedWidth / 2 + 1 ) * paddedHeight;
+        const T scale = static_cast<T>( 1.0 / ( static_cast<double>( paddedWidth ) * paddedHeight ) );
+
+        std::vector<T> plane( static_cast<std::size_t>( paddedWidth ) * paddedHeight, T( 0 ) );
+        std::vector< std::complex<T> > kernelSpectrum( size );
+        std::vector< std::complex<T> > spectrum( size );
+
+        for ( unsigned int i = 0; i < kernel.getHeight(); ++i )
+        {
+            std::copy( kernel( i, 0 ), kernel( i, 0 ) + kernel.getWidth(), &plane[i * paddedWidth] );
+        }
+
+        realSpectrum( &kernelSpectrum[0], &plane[0], paddedWidth, paddedHeight, paddedWidth );
+
+        for ( unsigned int c = 0; c < channels; ++c )
+        {
+            std::fill( plane.begin(), plane.end(), T( 0 ) );
+
+            for ( unsigned int y = 0; y < height; ++y )
+            {
+                const T* input = inputImage( y, 0 ) + c;
+                T* row = &plane[y * paddedWidth];
+
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    row[x] = input[x * channels];
+                }
+            }
+
+            realSpectrum( &spectrum[0], &plane[0], paddedWidth, paddedHeight, paddedWidth );
+            simd::multiplyConjugate( &spectrum[0], &kernelSpectrum[0], size );
+            inverseRealSpectrum( &plane[0], &spectrum[0], paddedWidth, paddedHeight, paddedWidth, scale );
+
+            for ( unsigned int y = 0; y < outputImage.getHeight(); ++y )
+            {
+                const T* row = &plane[y * paddedWidth];
+                T* output = outputImage( y, 0 ) + c;
+
+                for ( unsigned int x = 0; x < outputImage.getWidth(); ++x )
+                {
+                    output[x * channels] = row[x];
+                }
+            }
+        }
+    }
+
+    template<typename T>
+    void ImageOperator::realSpectrum( std::complex<T>* spectrum, const T* data, unsigned int width, unsigned int height, std::size_t stride )
+    {
+        const unsigned int columns = width / 2 + 1;
+        const FFT<T> rowTransform( width );
+
+        // Rows a and b are transformed together as z = a + i b. With m the
+        // conjugate of Z at the opposite frequency, A = (Z + m) / 2 and
+        // B = (Z - m) / 2i.
+        Parallel::forRange( 0, ( height + 1 ) / 2, Parallel::calculateGrain( 20 * width ), [&]( unsigned int firstPair, unsigned int lastPair )
+        {
+            std::vector< std::complex<T> > row( width );
+            std::vector< std::complex<T> > scratch( width );
+
+            for ( unsigned int pair = firstPair; pair < lastPair; ++pair )
+            {
+                const unsigned int y = 2 * pair;
+                const T* a = data + y * stride;
+                const bool single = y + 1 == height;
+
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    row[x] = std::complex<T>( a[x], single ? T( 0 ) : a[x + stride] );
+                }
+
+                rowTransform.forward( &row[0], &scratch[0] );
+
+                std::complex<T>* outputA = spectrum + static_cast<std::size_t>( y ) * columns;
+                std::complex<T>* outputB = outputA + columns;
+
+                for ( unsigned int u = 0; u < columns; ++u )
+                {
+                    const std::complex<T> z = row[u];
+                    const std::complex<T> m = std::conj( row[u == 0 ? 0 : width - u] );
+
+                    outputA[u] = std::complex<T>( ( z.real() + m.real() ) / 2, ( z.imag() + m.imag() ) / 2 );
+
+                    if ( !single )
+                    {
+                        outputB[u] = std::complex<T>( ( z.imag() - m.imag() ) / 2, ( m.real() - z.real() ) / 2 );
+                    }
+                }
+            }
+        } );
+
+        transformColumns( spectrum, columns, height, false );
+    }
+
+    template<typename T>
+    void ImageOperator::inverseRealSpectrum( T* data, std::complex<T>* spectrum, unsigned int width, unsigned int height,
+                                             std::size_t stride, T scale )
+    {
+        const unsigned int columns = width / 2 + 1;
+        const FFT<T> rowTransform( width );
+
+        transformColumns( spectrum, columns, height, true );
+
+        // The spectra A and B of real rows a and b are combined into the
+        // spectrum of z = a + i b, A + i B, whose upper half is built from
+        // the conjugates of the lower half of A and B
+        Parallel::forRange( 0, ( height + 1 ) / 2, Parallel::calculateGrain( 20 * width ), [&]( unsigned int firstPair, unsigned int lastPair )
+        {
+            std::vector< std::complex<T> > row( width );
+            std::vector< std::complex<T> > scratch( width );
+
+            for ( unsigned int pair = firstPair; pair < lastPair; ++pair )
+            {
+                const unsigned int y = 2 * pair;
+                const bool single = y + 1 == height;
+                const std::complex<T>* inputA = spectrum + static_cast<std::size_t>( y ) * columns;
+                const std::complex<T>* inputB = inputA + columns;
+
+                for ( unsigned int u = 0; u < columns; ++u )
+                {
+                    const std::complex<T> a = inputA[u];
+                    const std::complex<T> b = single ? std::complex<T>() : inputB[u];
+
+                    row[u] = std::complex<T>( a.real() - b.imag(), a.imag() + b.real() );
+
+                    if ( u > 0 && width - u > u )
+                    {
+                        row[width - u] = std::complex<T>( a.real() + b.imag(), b.real() - a.imag() );
+                    }
+                }
+
+                rowTransform.inverse( &row[0], &scratch[0] );
+
+                T* outputA = data + y * stride;
+
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    outputA[x] = row[x].real() * scale;
+                }
+
+                if ( !single )
+                {
+                    for ( unsigned int x = 0; x < width; ++x )
+                    {
+                        outputA[x + stride] = row[x].imag() * scale;
+                    }
+                }
+            }
+        } );
+    }
+
+    template<typename T>
+    void ImageOperator::transformColumns( std::complex<T>* spectrum, unsigned int columns, unsigned int height, bool inverse )
+    {
+        const unsigned int block = 8;
+        const FFT<T> columnTransform( height );
+
+        Parallel::forRange( 0, ( columns + block - 1 ) / block, Parallel::calculateGrain( 20 * block * height ), [&]( unsigned int firstBlock, unsigned int lastBlock )
+        {
+            std::vector< std::complex<T> > buffer( block * height );
+            std::vector< std::complex<T> > scratch( height );
+
+            for ( unsigned int b = firstBlock; b < lastBlock; ++b )
+            {
+                const unsigned int firstColumn = b * block;
+                const unsigned int count = std::min( block, columns - firstColumn );
+
+                for ( unsigned int y = 0; y < height; ++y )
+                {
+                    const std::complex<T>* row = spectrum + static_cast<std::size_t>( y ) * columns + firstColumn;
+
+                    for ( unsigned int j = 0; j < count; ++j )
+                    {
+                        buffer[j * height + y] = row[j];
+                    }
+                }
+
+                for ( unsigned int j = 0; j < count; ++j )
+                {
+                    if ( inverse )
+                    {
+                        columnTransform.inverse( &buffer[j * height], &scratch[0] );
+                    }
+                    else
+                    {
+                        columnTransform.forward( &buffer[j * height], &scratch[0] );
+                    }
+                }
+
+                for ( unsigned int y = 0; y < height; ++y )
+                {
+                    std::complex<T>* row = spectrum + static_cast<std::size_t>( y ) * columns + firstColumn;
+
+                    for ( unsigned int j = 0; j < count; ++j )
+                    {
+                        row[j] = buffer[j * height + y];
+                    }
+                }
+            }
+        } );
+    }
+
+    inline void ImageOperator::unitCodes( const ImageByte& mask, unsigned int unitRow, bool blocks, BYTE* codes )
+    {
+        const unsigned int width = mask.getWidth();
+
+        if ( !blocks )
         {
+            const BYTE* row = mask( unitRow, 0 );
+
+            for ( unsigned int x = 0; x < width; ++x )
+            {
+                codes[x] = row[x] != 0 ? 1 : 0;
+            }
+
             return;
         }
-        else if ( !areCompatible( outputImage, imageA ) )
+
+        const BYTE* top = mask( 2 * unitRow, 0 );
+        const BYTE* bottom = 2 * unitRow + 1 < mask.getHeight() ? mask( 2 * unitRow + 1, 0 ) : nullptr;
+        unsigned int x = 0;
+
+        for ( ; x + 1 < width; x += 2 )
         {
-            outputImage.create( imageA.getWidth(), imageA.getHeight(), imageA.getColorSpace() );
+            codes[x / 2] = ( top[x] != 0 ? 1 : 0 ) | ( top[x + 1] != 0 ? 2 : 0 ) |
+                           ( bottom != nullptr && bottom[x] != 0 ? 4 : 0 ) | ( bottom != nullptr && bottom[x + 1] != 0 ? 8 : 0 );
+        }
+
+        if ( x < width )
+        {
+            codes[x / 2] = ( top[x] != 0 ? 1 : 0 ) | ( bottom != nullptr && bottom[x] != 0 ? 4 : 0 );
+        }
+    }
+
+    inline bool ImageOperator::unitsTouch( BYTE unit, BYTE neighbor, int dx, bool left, bool blocks )
+    {
+        if ( !blocks )
+        {
+            return neighbor != 0;
+        }
+
+        // Pixels of the unit next to the neighbor, and pixels of the neighbor
+        // next to them
+        if ( left )
+        {
+            return ( unit & 5 ) != 0 && ( neighbor & 10 ) != 0;
+        }
+
+        switch ( dx )
+        {
+            case -1: return ( unit & 1 ) != 0 && ( neighbor & 8 ) != 0;
+            case 0: return ( unit & 3 ) != 0 && ( neighbor & 12 ) != 0;
+            default: return ( unit & 2 ) != 0 && ( neighbor & 4 ) != 0;
         }
-        
-        // @TODO: Implement addition.
     }
-    
+
+    inline int32_t ImageOperator::findRoot( std::vector<int32_t>& parent, int32_t label )
+    {
+        while ( parent[label] != label )
+        {
+            parent[label] = parent[parent[label]];
+            label = parent[label];
+        }
+
+        return label;
+    }
+
+    inline int32_t ImageOperator::mergeLabels( std::vector<int32_t>& parent, int32_t a, int32_t b )
+    {
+        a = findRoot( parent, a );
+        b = findRoot( parent, b );
+
+        if ( a < b )
+        {
+            parent[b] = a;
+            return a;
+        }
+
+        parent[a] = b;
+        return b;
+    }
+
+    inline bool ImageOperator::isAlpha( ColorSpace::Type colorSpace, unsigned int channel )
+    {
+        const char* names = ColorSpace::channelNames( colorSpace );
+        return channel < std::strlen( names ) && names[channel] == 'A';
+    }
+
+    inline int ImageOperator::alphaChannel( ColorSpace::Type colorSpace )
+    {
+        const char* names = ColorSpace::channelNames( colorSpace );
+        const char* alpha = std::strchr( names, 'A' );
+        return alpha != nullptr ? static_cast<int>( alpha - names ) : -1;
+    }
+
+    template<typename Channel>
+    bool ImageOperator::filterFixedPoint( Image<Channel>&, const Image<Channel>&, const std::vector<float>&, const std::vector<float>&, BorderMode, double )
+    {
+        return false;
+    }
+
+    inline bool ImageOperator::filterFixedPoint( Image<BYTE>& outputImage, const Image<BYTE>& inputImage,
+                                                 const std::vector<float>& kernelX, const std::vector<float>& kernelY,
+                                                 BorderMode border, double borderValue )
+    {
+        std::vector<uint16_t> fixedX;
+        std::vector<uint16_t> fixedY;
+
+        if ( !quantizeKernel( kernelX, fixedX ) || !quantizeKernel( kernelY, fixedY ) )
+        {
+            return false;
+        }
+
+        separableFilter<uint16_t>( outputImage, inputImage, fixedX, fixedY, border, borderValue );
+        return true;
+    }
+
+    template<typename Channel>
+    void ImageOperator::gaussianBlur( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                      double sigmaX, double sigmaY, BorderMode border )
+    {
+        if ( sigmaY <= 0.0 )
+        {
+            sigmaY = sigmaX;
+        }
+
+        std::vector<float> kernelX = gaussianKernel( sigmaX );
+        std::vector<float> kernelY = sigmaY == sigmaX ? kernelX : gaussianKernel( sigmaY );
+
+        convolveSeparable( outputImage, inputImage, kernelX, kernelY, border );
+    }
+
+    inline std::vector<float> ImageOperator::gaussianKernel( double sigma, unsigned int radius )
+    {
+        if ( radius == 0 )
+        {
+            radius = std::max( 1, static_cast<int>( std::ceil( 3.0 * sigma ) ) );
+        }
+
+        std::vector<double> weights( 2 * radius + 1 );
+        double sum = 0.0;
+
+        for ( unsigned int i = 0; i < weights.size(); ++i )
+        {
+            double x = static_cast<double>( i ) - radius;
+            weights[i] = sigma > 0.0 ? std::exp( -x * x / ( 2.0 * sigma * sigma ) ) : ( x == 0.0 ? 1.0 : 0.0 );
+            sum += weights[i];
+        }
+
+        std::vector<float> kernel( weights.size() );
+
+        for ( unsigned int i = 0; i < weights.size(); ++i )
+        {
+            kernel[i] = static_cast<float>( weights[i] / sum );
+        }
+
+        return kernel;
+    }
+
+    template<typename Intermediate, typename Channel, typename Weight>
+    void ImageOperator::separableFilter( Image<Channel>& outputImage, const Image<Channel>& inputImage,
+                                         const std::vector<Weight>& kernelX, const std::vector<Weight>& kernelY,
+                                         BorderMode border, double borderValue )
+    {
+        const int width = inputImage.getWidth();
+        const int height = inputImage.getHeight();
+        const int channels = inputImage.getNumberOfChannels();
+        const int kernelWidth = kernelX.size();
+        const int kernelHeight = kernelY.size();
+        const int anchorX = kernelWidth / 2;
+        const int anchorY = kernelHeight / 2;
+
+        // Pixels outside the image, before weighting. Fixed point rows hold
+        // the raw 8-bit values.
+        Intermediate constant;
+        simd::convert( &borderValue, &constant, 1, 1.0, 0.0 );
+        if ( std::is_same<Intermediate, uint16_t>::value )
+        {
+            constant = simd::saturate<BYTE>( borderValue );
+        }
+
+        // Column tiles keep the ring buffer of filtered rows within L2
+        const unsigned int cacheBudget = 256 * 1024;
+        const int tileWidth = std::max( 64, std::min( width, static_cast<int>( cacheBudget / ( kernelHeight * channels * sizeof(Intermediate) ) ) ) );
+        const unsigned int grain = Parallel::calculateGrain( width * channels * ( kernelWidth + kernelHeight ) );
+
+        Parallel::forRange( 0, height, grain, [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            std::vector<Intermediate> padded( ( tileWidth + kernelWidth - 1 ) * channels );
+            std::vector<Intermediate> ring( kernelHeight * tileWidth * channels );
+            std::vector<Intermediate> accumulator( tileWidth * channels );
+            std::vector<const Intermediate*> rows( kernelHeight );
+
+            for ( int x0 = 0; x0 < width; x0 += tileWidth )
+            {
+                const int x1 = std::min( width, x0 + tileWidth );
+                const unsigned int count = ( x1 - x0 ) * channels;
+
+                // Horizontal pass of the image row y into a slot of the ring
+                auto filterRow = [&]( int y, Intermediate* output )
+                {
+                    int sourceRow = mapBorder( y, height, border );
+                    int first = x0 - anchorX;
+                    int last = x1 + kernelWidth - 1 - anchorX;
+
+                    if ( sourceRow < 0 )
+                    {
+                        std::fill( padded.begin(), padded.end(), constant );
+                    }
+                    else
+                    {
+                        const Channel* input = inputImage( sourceRow, 0 );
+                        int inner0 = std::max( first, 0 );
+                        int inner1 = std::min( last, width );
+
+                        simd::convert( input + inner0 * channels, &padded[( inner0 - first ) * channels], ( inner1 - inner0 ) * channels, 1.0, 0.0 );
+
+                        for ( int x = first; x < last; ++x )
+                        {
+                            if ( x >= inner0 && x < inner1 )
+                            {
+                                x = inner1 - 1;
+                                continue;
+                            }
+
+                            int sourceColumn = mapBorder( x, width, border );
+                            Intermediate* pixel = &padded[( x - first ) * channels];
+
+                            for ( int c = 0; c < channels; ++c )
+                            {
+                                if ( sourceColumn < 0 )
+                                {
+                                    pixel[c] = constant;
+                                }
+                                else
+                                {
+                                    simd::convert( input + sourceColumn * channels + c, pixel + c, 1, 1.0, 0.0 );
+                                }
+                            }
+                        }
+                    }
+
+                    simd::multiply( output, &padded[0], kernelX[0], count );
+
+                    for ( int t = 1; t < kernelWidth; ++t )
+                    {
+                        if ( kernelX[t] != 0 )
+                        {
+                            simd::multiplyAdd( output, &padded[t * channels], kernelX[t], count );
+                        }
+                    }
+                };
+
+                auto slot = [&]( int y ) -> Intermediate*
+                {
+                    int index = ( y - static_cast<int>( firstRow ) + kernelHeight ) % kernelHeight;
+                    return &ring[index * tileWidth * channels];
+                };
+
+                // Prime the ring with the rows above the first output row
+                for ( int t = 0; t < kernelHeight - 1; ++t )
+                {
+                    int y = static_cast<int>( firstRow ) - anchorY + t;
+                    filterRow( y, slot( y ) );
+                }
+
+                for ( int y = firstRow; y < static_cast<int>( lastRow ); ++y )
+                {
+                    int newest = y - anchorY + kernelHeight - 1;
+                    filterRow( newest, slot( newest ) );
+
+                    for ( int t = 0; t < kernelHeight; ++t )
+                    {
+                        rows[t] = slot( y - anchorY + t );
+                    }
+
+                    combineRows( &rows[0], kernelY, &accumulator[0], outputImage( y, x0 ), count );
+                }
+            }
+        } );
+    }
+
+    template<typename Channel>
+    void ImageOperator::combineRows( const float* const* rows, const std::vector<float>& kernel, float* accumulator, Channel* output, unsigned int count )
+    {
+        // Float images are accumulated in place
+        float* sum = std::is_same<Channel, float>::value ? reinterpret_cast<float*>( output ) : accumulator;
+
+        simd::multiply( sum, rows[0], kernel[0], count );
+
+        for ( unsigned int t = 1; t < kernel.size(); ++t )
+        {
+            if ( kernel[t] != 0.0f )
+            {
+                simd::multiplyAdd( sum, rows[t], kernel[t], count );
+            }
+        }
+
+        if ( sum != reinterpret_cast<float*>( output ) )
+        {
+            simd::convert( sum, output, count, 1.0, 0.0 );
+        }
+    }
+
+    inline void ImageOperator::combineRows( const uint16_t* const* rows, const std::vector<uint16_t>& kernel, uint16_t* accumulator, BYTE* output, unsigned int count )
+    {
+        // Rows are 8.8 fixed point and weights are 0.8 fixed point: each term
+        // is the high half of row * (weight << 8), which stays in 8.8
+        std::fill( accumulator, accumulator + count, 0 );
+
+        for ( unsigned int t = 0; t < kernel.size(); ++t )
+        {
+            if ( kernel[t] == 256 )
+            {
+                simd::multiplyAdd( accumulator, rows[t], 1, count );
+            }
+            else if ( kernel[t] != 0 )
+            {
+                simd::multiplyHighAdd( accumulator, rows[t], kernel[t] << 8, count );
+            }
+        }
+
+        simd::roundFixedPoint8( accumulator, output, count );
+    }
+
+    inline int ImageOperator::mapBorder( int index, int length, BorderMode border )
+    {
+        if ( index >= 0 && index < length )
+        {
+            return index;
+        }
+
+        switch ( border )
+        {
+            case BorderMode::REPLICATE:
+                return index < 0 ? 0 : length - 1;
+
+            case BorderMode::REFLECT:
+            {
+                if ( length == 1 )
+                {
+                    return 0;
+                }
+
+                int period = 2 * ( length - 1 );
+                index = std::abs( index ) % period;
+                return index < length ? index : period - index;
+            }
+
+            default:
+                return -1;
+        }
+    }
+
+    inline bool ImageOperator::quantizeKernel( const std::vector<float>& kernel, std::vector<uint16_t>& weights )
+    {
+        double sum = 0.0;
+
+        for ( float k : kernel )
+        {
+            if ( k < 0.0f )
+            {
+                return false;
+            }
+
+            sum += k;
+        }
+
+        if ( std::fabs( sum - 1.0 ) > 1e-3 )
+        {
+            return false;
+        }
+
+        // Round every weight, then give the rounding error to the largest one
+        weights.resize( kernel.size() );
+        int total = 0;
+        unsigned int largest = 0;
+
+        for ( unsigned int i = 0; i < kernel.size(); ++i )
+        {
+            weights[i] = static_cast<uint16_t>( std::lround( kernel[i] * 256.0 ) );
+            total += weights[i];
+            largest = kernel[i] > kernel[largest] ? i : largest;
+        }
+
+        weights[largest] = static_cast<uint16_t>( weights[largest] + 256 - total );
+
+        return true;
+    }
 
     template<typename Channel>
-    bool ImageOperator<Channel>::areCompatible( const Image<Channel>& imageA, const Image<Channel>& imageB )
+    bool ImageOperator::areCompatible( const Image<Channel>& imageA, const Image<Channel>& imageB )
     {
         return imageA.getWidth() == imageB.getWidth() &&
                imageA.getHeight() == imageB.getHeight() &&
                imageA.getColorSpace() == imageB.getColorSpace();
     }
+
+    template<typename Channel>
+    bool ImageOperator::hasLayout( const Image<Channel>& image, unsigned int width, unsigned int height, ColorSpace::Type colorSpace )
+    {
+        return image.getWidth() == width &&
+               image.getHeight() == height &&
+               image.getColorSpace() == colorSpace &&
+               image.getData() != nullptr;
+    }
+
+    template<typename Channel>
+    Channel ImageOperator::opaque()
+    {
+        return std::numeric_limits<Channel>::is_integer ? std::numeric_limits<Channel>::max() : Channel( 1 );
+    }
 }
 
 #endif // IMAGE_OPERATOR_H
@@ -0,0 +1,350 @@
+/**
+ * This template class is a summed-area table: element (i, j) holds the sum of
+ * all pixels above and to the left of pixel (i, j) of an image, so the sum,
+ * mean and variance of any rectangle are computed in constant time.
+ *
+ * The table has one more row and column than the image. Row 0 and column 0
+ * are zero, so the sum of the rectangle [x, x + w) x [y, y + h) is
+ *
+ *   S(y + h, x + w) - S(y, x + w) - S(y + h, x) + S(y, x)
+ *
+ * Sums of integer images use integer accumulators. Unsigned accumulators may
+ * wrap around on large images, but rectangle sums are still exact as long as
+ * the sum of the rectangle itself fits (e.g. boxes of up to 16M pixels for
+ * BYTE images with 32-bit sums).
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef INTEGRAL_IMAGE_H
+#define INTEGRAL_IMAGE_H
+
+#include <algorithm>
+#include <vector>
+#include "Image.h"
+
+
+namespace owl
+{
+    /**
+     * Accumulator types used to sum pixels of a given channel type.
+     */
+    template<typename Channel>
+    struct IntegralTraits
+    {
+        typedef double Sum;
+        typedef double SquaredSum;
+    };
+
+    template<>
+    struct IntegralTraits<BYTE>
+    {
+        typedef uint32_t Sum;
+        typedef uint64_t SquaredSum;
+    };
+
+    template<>
+    struct IntegralTraits<uint16_t>
+    {
+        typedef uint64_t Sum;
+        typedef uint64_t SquaredSum;
+    };
+
+    template<>
+    struct IntegralTraits<int16_t>
+    {
+        typedef int64_t Sum;
+        typedef uint64_t SquaredSum;
+    };
+
+    template<>
+    struct IntegralTraits<int32_t>
+    {
+        typedef int64_t Sum;
+        typedef double SquaredSum;
+    };
+
+    template<typename Channel>
+    class IntegralImage
+    {
+        public:
+
+            typedef typename IntegralTraits<Channel>::Sum Sum;
+            typedef typename IntegralTraits<Channel>::SquaredSum SquaredSum;
+
+            /**
+             * Instantiates an empty integral image.
+             */
+            IntegralImage();
+
+            /**
+             * Instantiates the integral image of an image.
+             * @param image An image.
+             * @param squaredSums (Optional) Also sum the squares of the pixels,
+             * which is needed by getSquaredSum() and getVariance(). Default is
+             * false.
+             */
+            explicit IntegralImage( const Image<Channel>& image, bool squaredSums = false );
+
+            /**
+             * Computes the integral image of an image in one pass. All previous
+             * data will be destroyed.
+             * @param image An image.
+             * @param squaredSums (Optional) Also sum the squares of the pixels.
+             * Default is false.
+             */
+            void compute( const Image<Channel>& image, bool squaredSums = false );
+
+            /**
+             * Gets the width of the source image.
+             * @return Image width.
+             */
+            unsigned int getWidth() const;
+
+            /**
+             * Gets the height of the source image.
+             * @return Image height.
+             */
+            unsigned int getHeight() const;
+
+            /**
+             * Gets the number of channels of the source image.
+             * @return Number of channels.
+             */
+            unsigned int getNumberOfChannels() const;
+
+            /**
+             * Checks if squared sums were computed.
+             * @return True if getSquaredSum() and getVariance() can be used.
+             */
+            bool hasSquaredSums() const;
+
+            /**
+             * Gets a row of the table: sums of rectangles from the origin to
+             * (row, column), interleaved by channel, for columns 0 to width.
+             * @param row Row index, from 0 to height.
+             * @return Pointer to the row.
+             */
+            const Sum* getRow( unsigned int row ) const;
+
+            /**
+             * Computes the sum of a channel over a rectangle.
+             * @param rect A rectangle inside the image.
+             * @param channel Channel index.
+             * @return Sum of the pixels.
+             */
+            Sum getSum( const Rect& rect, unsigned int channel = 0 ) const;
+
+            /**
+             * Computes the sum of the squares of a channel over a rectangle.
+             * Requires squared sums.
+             * @param rect A rectangle inside the image.
+             * @param channel Channel index.
+             * @return Sum of the squared pixels.
+             */
+            SquaredSum getSquaredSum( const Rect& rect, unsigned int channel = 0 ) const;
+
+            /**
+             * Computes the mean of a channel over a rectangle.
+             * @param rect A non-empty rectangle inside the image.
+             * @param channel Channel index.
+             * @return Mean of the pixels.
+             */
+            double getMean( const Rect& rect, unsigned int channel = 0 ) const;
+
+            /**
+             * Computes the (population) variance of a channel over a
+             * rectangle. Requires squared sums.
+             * @param rect A non-empty rectangle inside the image.
+             * @param channel Channel index.
+             * @return Variance of the pixels.
+             */
+            double getVariance( const Rect& rect, unsigned int channel = 0 ) const;
+
+
+        private:
+
+            /**
+             * Sum of a rectangle from a table laid out as mSums.
+             */
+            template<typename T>
+            T rectangleSum( const std::vector<T>& table, const Rect& rect, unsigned int channel ) const;
+
+            unsigned int mWidth;
+            unsigned int mHeight;
+            unsigned int mNumberOfChannels;
+
+            /**
+             * (mHeight + 1) x (mWidth + 1) x mNumberOfChannels tables.
+             */
+            std::vector<Sum> mSums;
+            std::vector<SquaredSum> mSquaredSums;
+    };
+
+
+    template<typename Channel>
+    IntegralImage<Channel>::IntegralImage() :
+        mWidth( 0 ),
+        mHeight( 0 ),
+        mNumberOfChannels( 0 )
+    {
+    }
+
+    template<typename Channel>
+    IntegralImage<Channel>::IntegralImage( const Image<Channel>& image, bool squaredSums ) :
+        mWidth( 0 ),
+        mHeight( 0 ),
+        mNumberOfChannels( 0 )
+    {
+        compute( image, squaredSums );
+    }
+
+    template<typename Channel>
+    void IntegralImage<Channel>::compute( const Image<Channel>& image, bool squaredSums )
+    {
+        mWidth = image.getWidth();
+        mHeight = image.getHeight();
+        mNumberOfChannels = image.getNumberOfChannels();
+
+        const unsigned int stride = ( mWidth + 1 ) * mNumberOfChannels;
+
+        mSums.assign( stride * ( mHeight + 1 ), Sum( 0 ) );
+        mSquaredSums.assign( squaredSums ? stride * ( mHeight + 1 ) : 0, SquaredSum( 0 ) );
+
+        if ( image.getData() == nullptr )
+        {
+            return;
+        }
+
+        std::vector<Sum> rowSum( mNumberOfChannels );
+        std::vector<SquaredSum> rowSquaredSum( mNumberOfChannels );
+
+        // Each element is the running sum of its row plus the element above
+        for ( unsigned int i = 0; i < mHeight; ++i )
+        {
+            const Channel* pixel = image( i, 0 );
+            const Sum* above = &mSums[i * stride + mNumberOfChannels];
+            Sum* sums = &mSums[( i + 1 ) * stride + mNumberOfChannels];
+
+            std::fill( rowSum.begin(), rowSum.end(), Sum( 0 ) );
+            std::fill( rowSquaredSum.begin(), rowSquaredSum.end(), SquaredSum( 0 ) );
+
+            if ( mNumberOfChannels == 1 )
+            {
+                // The running sum stays in a register
+                Sum sum = Sum( 0 );
+
+                for ( unsigned int j = 0; j < mWidth; ++j )
+                {
+                    sum += static_cast<Sum>( pixel[j] );
+                    sums[j] = above[j] + sum;
+                }
+            }
+            else
+            {
+                for ( unsigned int j = 0; j < mWidth * mNumberOfChannels; j += mNumberOfChannels )
+                {
+                    for ( unsigned int c = 0; c < mNumberOfChannels; ++c )
+                    {
+                        rowSum[c] += static_cast<Sum>( pixel[j + c] );
+                        sums[j + c] = above[j + c] + rowSum[c];
+                    }
+                }
+            }
+
+            if ( squaredSums )
+            {
+                const SquaredSum* squaredAbove = &mSquaredSums[i * stride + mNumberOfChannels];
+                SquaredSum* squared = &mSquaredSums[( i + 1 ) * stride + mNumberOfChannels];
+
+                for ( unsigned int j = 0; j < mWidth * mNumberOfChannels; j += mNumberOfChannels )
+                {
+                    for ( unsigned int c = 0; c < mNumberOfChannels; ++c )
+                    {
+                        SquaredSum value = static_cast<SquaredSum>( pixel[j + c] );
+                        rowSquaredSum[c] += value * value;
+                        squared[j + c] = squaredAbove[j + c] + rowSquaredSum[c];
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename Channel>
+    unsigned int IntegralImage<Channel>::getWidth() const
+    {
+        return mWidth;
+    }
+
+    template<typename Channel>
+    unsigned int IntegralImage<Channel>::getHeight() const
+    {
+        return mHeight;
+    }
+
+    template<typename Channel>
+    unsigned int IntegralImage<Channel>::getNumberOfChannels() const
+    {
+        return mNumberOfChannels;
+    }
+
+    template<typename Channel>
+    bool IntegralImage<Channel>::hasSquaredSums() const
+    {
+        return !mSquaredSums.empty();
+    }
+
+    template<typename Channel>
+    const typename IntegralImage<Channel>::Sum* IntegralImage<Channel>::getRow( unsigned int row ) const
+    {
+        return &mSums[row * ( mWidth + 1 ) * mNumberOfChannels];
+    }
+
+    template<typename Channel>
+    typename IntegralImage<Channel>::Sum IntegralImage<Channel>::getSum( const Rect& rect, unsigned int channel ) const
+    {
+        return rectangleSum( mSums, rect, channel );
+    }
+
+    template<typename Channel>
+    typename IntegralImage<Channel>::SquaredSum IntegralImage<Channel>::getSquaredSum( const Rect& rect, unsigned int channel ) const
+    {
+        return hasSquaredSums() ? rectangleSum( mSquaredSums, rect, channel ) : SquaredSum( 0 );
+    }
+
+    template<typename Channel>
+    double IntegralImage<Channel>::getMean( const Rect& rect, unsigned int channel ) const
+    {
+        return static_cast<double>( getSum( rect, channel ) ) / ( static_cast<double>( rect.width ) * rect.height );
+    }
+
+    template<typename Channel>
+    double IntegralImage<Channel>::getVariance( const Rect& rect, unsigned int channel ) const
+    {
+        double area = static_cast<double>( rect.width ) * rect.height;
+        double mean = getMean( rect, channel );
+        double variance = static_cast<double>( getSquaredSum( rect, channel ) ) / area - mean * mean;
+
+        return variance > 0.0 ? variance : 0.0;
+    }
+
+    template<typename Channel>
+    template<typename T>
+    T IntegralImage<Channel>::rectangleSum( const std::vector<T>& table, const Rect& rect, unsigned int channel ) const
+    {
+        const unsigned int stride = ( mWidth + 1 ) * mNumberOfChannels;
+        const unsigned int left = rect.x * mNumberOfChannels + channel;
+        const unsigned int right = ( rect.x + rect.width ) * mNumberOfChannels + channel;
+        const unsigned int top = rect.y * stride;
+        const unsigned int bottom = ( rect.y + rect.height ) * stride;
+
+        // Unsigned wrap around cancels out when the result fits
+        return table[bottom + right] - table[top + right] - table[bottom + left] + table[top + left];
+    }
+}
+
+#endif // INTEGRAL_IMAGE_H
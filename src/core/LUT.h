@@ -0,0 +1,265 @@
+/**
+ * This class is a lookup table for point operations on BYTE images: every
+ * channel value v is replaced by table[v]. A LUT holds either one table
+ * shared by all channels or one table per channel.
+ *
+ * Tone curves are built once with the factory methods and applied with
+ * ImageOperator::applyLUT(). Chains of curves should be folded with then(),
+ * so the whole chain costs a single pass over the image.
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef LUT_H
+#define LUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "Types.h"
+
+
+namespace owl
+{
+    class LUT
+    {
+        public:
+
+            /**
+             * Instantiates an identity table shared by all channels.
+             */
+            LUT();
+
+            /**
+             * Instantiates a LUT from tables.
+             * @param tables numberOfTables consecutive arrays of 256 entries.
+             * @param numberOfTables (Optional) 1 (default) for a table shared
+             * by all channels, otherwise one table per channel.
+             */
+            explicit LUT( const BYTE* tables, unsigned int numberOfTables = 1 );
+
+            /**
+             * Gets the number of tables.
+             * @return 1 if the table is shared by all channels, otherwise the
+             * number of channels.
+             */
+            unsigned int getNumberOfTables() const;
+
+            /**
+             * Checks if one table is shared by all channels.
+             * @return True if the LUT has a single table.
+             */
+            bool isShared() const;
+
+            /**
+             * Gets the table of a channel.
+             * @param channel Channel index. Ignored if the table is shared.
+             * @return Array of 256 entries.
+             */
+            const BYTE* getTable( unsigned int channel = 0 ) const;
+            BYTE* getTable( unsigned int channel = 0 );
+
+            /**
+             * Looks a value up.
+             * @param value A channel value.
+             * @param channel (Optional) Channel index.
+             * @return The mapped value.
+             */
+            BYTE operator()( BYTE value, unsigned int channel = 0 ) const;
+
+            /**
+             * Composes two LUTs into one: applying the result is the same as
+             * applying this LUT and then next. If either LUT has one table per
+             * channel, so does the result.
+             * @param next LUT applied after this one.
+             * @return The composed LUT.
+             */
+            LUT then( const LUT& next ) const;
+
+            /**
+             * Gamma curve: out = 255 * (in / 255)^(1 / gamma). Gamma values
+             * greater than 1 brighten midtones.
+             * @param gamma Gamma value, greater than 0.
+             * @return The LUT.
+             */
+            static LUT gamma( double gamma );
+
+            /**
+             * Linear brightness and contrast curve:
+             * out = (in - 127.5) * contrast + 127.5 + brightness.
+             * @param brightness Offset, in channel values.
+             * @param contrast Slope around mid gray. 1 keeps the contrast.
+             * @return The LUT.
+             */
+            static LUT brightnessContrast( double brightness, double contrast );
+
+            /**
+             * Inversion: out = 255 - in.
+             * @return The LUT.
+             */
+            static LUT invert();
+
+            /**
+             * Curve through control points, linearly interpolated between them
+             * and constant before the first and after the last point.
+             * @param points (in, out) pairs of channel values, sorted by in.
+             * @return The LUT. Identity if there are no points.
+             */
+            static LUT curve( const std::vector< std::pair<double, double> >& points );
+
+            /**
+             * Curve given by a function, evaluated once per entry.
+             * @param function Callable mapping a channel value (0 to 255, as
+             * double) to the output value. Results are rounded and saturated.
+             * @return The LUT.
+             */
+            template<typename Function>
+            static LUT fromFunction( const Function& function );
+
+
+        private:
+
+            /**
+             * Round and saturate a value to a channel value.
+             */
+            static BYTE toByte( double value );
+
+            unsigned int mNumberOfTables;
+
+            /**
+             * mNumberOfTables x 256 entries.
+             */
+            std::vector<BYTE> mTables;
+    };
+
+
+    inline LUT::LUT() :
+        mNumberOfTables( 1 ),
+        mTables( 256 )
+    {
+        for ( unsigned int v = 0; v < 256; ++v )
+        {
+            mTables[v] = static_cast<BYTE>( v );
+        }
+    }
+
+    inline LUT::LUT( const BYTE* tables, unsigned int numberOfTables ) :
+        mNumberOfTables( std::max( 1u, numberOfTables ) ),
+        mTables( tables, tables + 256 * std::max( 1u, numberOfTables ) )
+    {
+    }
+
+    inline unsigned int LUT::getNumberOfTables() const
+    {
+        return mNumberOfTables;
+    }
+
+    inline bool LUT::isShared() const
+    {
+        return mNumberOfTables == 1;
+    }
+
+    inline const BYTE* LUT::getTable( unsigned int channel ) const
+    {
+        return &mTables[( isShared() ? 0 : channel ) * 256];
+    }
+
+    inline BYTE* LUT::getTable( unsigned int channel )
+    {
+        return &mTables[( isShared() ? 0 : channel ) * 256];
+    }
+
+    inline BYTE LUT::operator()( BYTE value, unsigned int channel ) const
+    {
+        return getTable( channel )[value];
+    }
+
+    inline LUT LUT::then( const LUT& next ) const
+    {
+        unsigned int numberOfTables = std::max( mNumberOfTables, next.mNumberOfTables );
+        std::vector<BYTE> tables( numberOfTables * 256 );
+
+        for ( unsigned int c = 0; c < numberOfTables; ++c )
+        {
+            const BYTE* first = getTable( c );
+            const BYTE* second = next.getTable( c );
+
+            for ( unsigned int v = 0; v < 256; ++v )
+            {
+                tables[c * 256 + v] = second[first[v]];
+            }
+        }
+
+        return LUT( &tables[0], numberOfTables );
+    }
+
+    inline LUT LUT::gamma( double gamma )
+    {
+        double exponent = 1.0 / gamma;
+        return fromFunction( [exponent]( double v ) { return 255.0 * std::pow( v / 255.0, exponent ); } );
+    }
+
+    inline LUT LUT::brightnessContrast( double brightness, double contrast )
+    {
+        return fromFunction( [brightness, contrast]( double v ) { return ( v - 127.5 ) * contrast + 127.5 + brightness; } );
+    }
+
+    inline LUT LUT::invert()
+    {
+        return fromFunction( []( double v ) { return 255.0 - v; } );
+    }
+
+    inline LUT LUT::curve( const std::vector< std::pair<double, double> >& points )
+    {
+        if ( points.empty() )
+        {
+            return LUT();
+        }
+
+        return fromFunction( [&points]( double v )
+        {
+            if ( v <= points.front().first )
+            {
+                return points.front().second;
+            }
+
+            for ( unsigned int i = 1; i < points.size(); ++i )
+            {
+                if ( v <= points[i].first )
+                {
+                    const std::pair<double, double>& a = points[i - 1];
+                    const std::pair<double, double>& b = points[i];
+                    return b.first > a.first ? a.second + ( v - a.first ) * ( b.second - a.second ) / ( b.first - a.first ) : b.second;
+                }
+            }
+
+            return points.back().second;
+        } );
+    }
+
+    template<typename Function>
+    LUT LUT::fromFunction( const Function& function )
+    {
+        BYTE table[256];
+
+        for ( unsigned int v = 0; v < 256; ++v )
+        {
+            table[v] = toByte( function( static_cast<double>( v ) ) );
+        }
+
+        return LUT( table );
+    }
+
+    inline BYTE LUT::toByte( double value )
+    {
+        // NaN becomes 0
+        return static_cast<BYTE>( std::min( 255.0, std::max( 0.0, std::nearbyint( value ) ) ) );
+    }
+}
+
+#endif // LUT_H
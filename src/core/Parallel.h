@@ -0,0 +1,303 @@
+/**
+ * This class runs loops over image rows (or any other index range) in
+ * parallel, splitting the range in contiguous bands, one per thread.
+ *
+ * Bands run on a pool of persistent worker threads, started on first use and
+ * blocked on a condition variable between loops, so per-frame operators do
+ * not create threads. A thread waiting for the bands of its loop runs queued
+ * bands meanwhile, so loops nested in a band can not deadlock the pool.
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace owl
+{
+    class Parallel
+    {
+        public:
+
+            /**
+             * Gets the maximum number of threads used by parallel loops.
+             * @return Number of threads. Default is the number of hardware
+             * threads.
+             */
+            static unsigned int getNumberOfThreads();
+
+            /**
+             * Sets the maximum number of threads used by parallel loops. Can be
+             * called while other threads run loops; running loops keep their
+             * bands.
+             * @param numberOfThreads Number of threads. 1 disables threading
+             * and 0 restores the default.
+             */
+            static void setNumberOfThreads( unsigned int numberOfThreads );
+
+            /**
+             * Run body( first, last ) over contiguous bands [first, last) that
+             * cover [begin, end). Bands are processed concurrently, so the body
+             * must only write to data owned by its band. The calling thread
+             * processes the first band.
+             * @param begin First index.
+             * @param end One past the last index.
+             * @param grain Minimum number of indices per band. Ranges smaller
+             * than two grains run on the calling thread only, so small images
+             * do not pay the cost of waking the workers.
+             * @param body Callable object taking (unsigned int, unsigned int).
+             */
+            template<typename Body>
+            static void forRange( unsigned int begin, unsigned int end, unsigned int grain, const Body& body );
+
+            /**
+             * Compute the number of bands forRange() uses for a range.
+             * @param count Number of indices.
+             * @param grain Minimum number of indices per band.
+             * @return Number of bands.
+             */
+            static unsigned int calculateNumberOfBands( unsigned int count, unsigned int grain );
+
+            /**
+             * Compute a grain for loops over image rows, so that each band has
+             * at least a minimum amount of work.
+             * @param rowCost Cost of a row, e.g. its number of elements.
+             * @param minimumCost Minimum cost of a band. Default is 64K.
+             * @return Minimum number of rows per band.
+             */
+            static unsigned int calculateGrain( unsigned int rowCost, unsigned int minimumCost = 1 << 16 );
+
+
+        private:
+
+            /**
+             * Persistent threads running the bands of forRange().
+             */
+            class WorkerPool
+            {
+                public:
+
+                    WorkerPool();
+
+                    /**
+                     * Stops and joins the workers.
+                     */
+                    ~WorkerPool();
+
+                    /**
+                     * Queues a task, starting workers until there are at least
+                     * a given number.
+                     * @param task Callable object taking no arguments.
+                     * @param workers Number of workers.
+                     */
+                    void submit( std::function<void()> task, unsigned int workers );
+
+                    /**
+                     * Runs queued tasks until a counter of pending tasks
+                     * reaches 0.
+                     * @param pending Counter decremented by the tasks.
+                     */
+                    void wait( const std::atomic<unsigned int>& pending );
+
+
+                private:
+
+                    /**
+                     * Loop of a worker thread.
+                     */
+                    void work();
+
+                    std::mutex mMutex;
+                    std::condition_variable mQueued;
+                    std::condition_variable mFinished;
+                    std::deque< std::function<void()> > mTasks;
+                    std::vector<std::thread> mWorkers;
+                    bool mStopping;
+            };
+
+            /**
+             * Storage of the configured number of threads (0 = default).
+             */
+            static std::atomic<unsigned int>& threadsSetting();
+
+            /**
+             * The worker pool shared by all loops.
+             */
+            static WorkerPool& workerPool();
+    };
+
+
+    inline Parallel::WorkerPool::WorkerPool() :
+        mStopping( false )
+    {
+    }
+
+    inline Parallel::WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+            mStopping = true;
+        }
+
+        mQueued.notify_all();
+
+        for ( std::thread& worker : mWorkers )
+        {
+            worker.join();
+        }
+    }
+
+    inline void Parallel::WorkerPool::submit( std::function<void()> task, unsigned int workers )
+    {
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+
+            while ( mWorkers.size() < workers )
+            {
+                mWorkers.push_back( std::thread( [this]() { work(); } ) );
+            }
+
+            mTasks.push_back( std::move( task ) );
+        }
+
+        mQueued.notify_one();
+    }
+
+    inline void Parallel::WorkerPool::wait( const std::atomic<unsigned int>& pending )
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+
+        // Tasks decrement the counter before taking the lock to signal
+        // mFinished, so the check and the wait can not miss it
+        while ( pending.load() != 0 )
+        {
+            if ( mTasks.empty() )
+            {
+                mFinished.wait( lock );
+                continue;
+            }
+
+            std::function<void()> task = std::move( mTasks.front() );
+            mTasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+            mFinished.notify_all();
+        }
+    }
+
+    inline void Parallel::WorkerPool::work()
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+
+        for ( ;; )
+        {
+            mQueued.wait( lock, [this]() { return mStopping || !mTasks.empty(); } );
+
+            if ( mTasks.empty() )
+            {
+                return;
+            }
+
+            std::function<void()> task = std::move( mTasks.front() );
+            mTasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+            mFinished.notify_all();
+        }
+    }
+
+    inline std::atomic<unsigned int>& Parallel::threadsSetting()
+    {
+        static std::atomic<unsigned int> numberOfThreads( 0 );
+        return numberOfThreads;
+    }
+
+    inline Parallel::WorkerPool& Parallel::workerPool()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    inline unsigned int Parallel::getNumberOfThreads()
+    {
+        unsigned int numberOfThreads = threadsSetting().load();
+
+        if ( numberOfThreads == 0 )
+        {
+            numberOfThreads = std::max( 1u, std::thread::hardware_concurrency() );
+        }
+
+        return numberOfThreads;
+    }
+
+    inline void Parallel::setNumberOfThreads( unsigned int numberOfThreads )
+    {
+        threadsSetting().store( numberOfThreads );
+    }
+
+    inline unsigned int Parallel::calculateNumberOfBands( unsigned int count, unsigned int grain )
+    {
+        return std::max( 1u, std::min( getNumberOfThreads(), count / std::max( 1u, grain ) ) );
+    }
+
+    inline unsigned int Parallel::calculateGrain( unsigned int rowCost, unsigned int minimumCost )
+    {
+        return std::max( 1u, minimumCost / std::max( 1u, rowCost ) );
+    }
+
+    template<typename Body>
+    void Parallel::forRange( unsigned int begin, unsigned int end, unsigned int grain, const Body& body )
+    {
+        if ( end <= begin )
+        {
+            return;
+        }
+
+        unsigned int count = end - begin;
+        unsigned int bands = calculateNumberOfBands( count, grain );
+
+        if ( bands == 1 )
+        {
+            body( begin, end );
+            return;
+        }
+
+        WorkerPool& pool = workerPool();
+        std::atomic<unsigned int> pending( bands - 1 );
+
+        for ( unsigned int band = 1; band < bands; ++band )
+        {
+            unsigned int first = begin + static_cast<unsigned int>( static_cast<unsigned long long>( count ) * band / bands );
+            unsigned int last = begin + static_cast<unsigned int>( static_cast<unsigned long long>( count ) * ( band + 1 ) / bands );
+
+            // The decrement is the last access to this frame: the caller may
+            // return as soon as it sees the counter at 0
+            pool.submit( [&body, &pending, first, last]()
+            {
+                body( first, last );
+                --pending;
+            }, bands - 1 );
+        }
+
+        body( begin, begin + count / bands );
+        pool.wait( pending );
+    }
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,308 @@
+/**
+ * This class is a precomputed geometric mapping for ImageOperator::remap():
+ * for each output pixel it holds the input position that is sampled there.
+ * Positions are stored compactly as 16-bit whole pixel coordinates plus a
+ * 10-bit index of the fractional position in 1/32 pixel (6 bytes per pixel),
+ * so the geometry (e.g. a lens model) is evaluated once and the table is
+ * applied to every frame of a stream.
+ *
+ * Entries are stored row by row, or tile by tile for maps that jump across
+ * the input: remap() then processes one tile of 128x32 output pixels at a
+ * time, whose entries are contiguous, and the input pixels read by a tile
+ * are more likely to stay in the cache.
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef REMAP_TABLE_H
+#define REMAP_TABLE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Image.h"
+#include "Parallel.h"
+
+
+namespace owl
+{
+    class RemapTable
+    {
+        public:
+
+            /**
+             * Instantiates an empty table.
+             */
+            RemapTable();
+
+            /**
+             * Checks if the table has no entries.
+             * @return True if the table is empty.
+             */
+            bool isEmpty() const;
+
+            /**
+             * Gets the width of the output images.
+             * @return Output width.
+             */
+            unsigned int getWidth() const;
+
+            /**
+             * Gets the height of the output images.
+             * @return Output height.
+             */
+            unsigned int getHeight() const;
+
+            /**
+             * Gets the size of the tiles in which entries are stored. A table
+             * stored row by row has tiles of getWidth() x 1 pixels.
+             * @return Tile width and height.
+             */
+            unsigned int getTileWidth() const;
+            unsigned int getTileHeight() const;
+
+            /**
+             * Gets the entries of a run of output pixels. Entries are
+             * contiguous along each row of a tile.
+             * @param x Output column.
+             * @param y Output row.
+             * @return (x, y) pairs of whole pixel input coordinates, the
+             * floor of the positions.
+             */
+            const int16_t* getPositions( unsigned int x, unsigned int y ) const;
+
+            /**
+             * Gets the fractional positions of a run of output pixels.
+             * @param x Output column.
+             * @param y Output row.
+             * @return fy * 32 + fx per pixel, in 1/32 pixel.
+             */
+            const uint16_t* getFractions( unsigned int x, unsigned int y ) const;
+
+            /**
+             * Builds a table from a function giving the input position of each
+             * output pixel. The function is evaluated once per pixel, by
+             * several threads for large tables, so it must be thread safe.
+             * Positions are rounded to 1/32 pixel and saturated to the range
+             * of 16-bit coordinates.
+             * @param width Output width.
+             * @param height Output height.
+             * @param function Callable mapping output coordinates (x, y), as
+             * doubles, to a std::pair<double, double> input position.
+             * @param tiled (Optional) True to store entries tile by tile,
+             * false (default) to store them row by row.
+             * @return The table.
+             */
+            template<typename Function>
+            static RemapTable fromFunction( unsigned int width, unsigned int height, const Function& function, bool tiled = false );
+
+            /**
+             * Builds a table from maps of input coordinates.
+             * @param mapX Input column of each output pixel. Grayscale.
+             * @param mapY Input row of each output pixel, same size as mapX.
+             * @param tiled (Optional) True to store entries tile by tile.
+             * @return The table. Empty if the maps do not match.
+             */
+            static RemapTable fromMaps( const ImageFloat& mapX, const ImageFloat& mapY, bool tiled = false );
+
+            /**
+             * Builds a table that corrects lens distortion with the
+             * Brown-Conrady model: each pixel of the undistorted output
+             * samples the distorted input at
+             *     x' = x (1 + k1 r^2 + k2 r^4 + k3 r^6) + 2 p1 x y + p2 (r^2 + 2 x^2)
+             *     y' = y (1 + k1 r^2 + k2 r^4 + k3 r^6) + p1 (r^2 + 2 y^2) + 2 p2 x y
+             * where (x, y) are normalized coordinates: ( column - centerX ) /
+             * focalX and ( row - centerY ) / focalY.
+             * @param width Image width.
+             * @param height Image height.
+             * @param focalX Focal length along columns, in pixels.
+             * @param focalY Focal length along rows, in pixels.
+             * @param centerX Column of the principal point.
+             * @param centerY Row of the principal point.
+             * @param coefficients Distortion coefficients k1, k2, p1, p2, k3.
+             * @param tiled (Optional) True to store entries tile by tile.
+             * @return The table.
+             */
+            static RemapTable undistortion( unsigned int width, unsigned int height,
+                                            double focalX, double focalY, double centerX, double centerY,
+                                            const double* coefficients, bool tiled = false );
+
+
+        private:
+
+            /**
+             * Allocates the entries of a table.
+             */
+            void allocate( unsigned int width, unsigned int height, bool tiled );
+
+            /**
+             * Gets the index of the entry of an output pixel.
+             */
+            std::size_t indexOf( unsigned int x, unsigned int y ) const;
+
+            /**
+             * Stores the input position of an output pixel.
+             */
+            void set( unsigned int x, unsigned int y, double inputX, double inputY );
+
+            unsigned int mWidth;
+            unsigned int mHeight;
+            unsigned int mTileWidth;
+            unsigned int mTileHeight;
+
+            /**
+             * (x, y) pairs and fractions, one per output pixel.
+             */
+            std::vector<int16_t> mPositions;
+            std::vector<uint16_t> mFractions;
+    };
+
+
+    inline RemapTable::RemapTable() :
+        mWidth( 0 ),
+        mHeight( 0 ),
+        mTileWidth( 0 ),
+        mTileHeight( 0 )
+    {
+    }
+
+    inline bool RemapTable::isEmpty() const
+    {
+        return mFractions.empty();
+    }
+
+    inline unsigned int RemapTable::getWidth() const
+    {
+        return mWidth;
+    }
+
+    inline unsigned int RemapTable::getHeight() const
+    {
+        return mHeight;
+    }
+
+    inline unsigned int RemapTable::getTileWidth() const
+    {
+        return mTileWidth;
+    }
+
+    inline unsigned int RemapTable::getTileHeight() const
+    {
+        return mTileHeight;
+    }
+
+    inline const int16_t* RemapTable::getPositions( unsigned int x, unsigned int y ) const
+    {
+        return &mPositions[2 * indexOf( x, y )];
+    }
+
+    inline const uint16_t* RemapTable::getFractions( unsigned int x, unsigned int y ) const
+    {
+        return &mFractions[indexOf( x, y )];
+    }
+
+    template<typename Function>
+    RemapTable RemapTable::fromFunction( unsigned int width, unsigned int height, const Function& function, bool tiled )
+    {
+        RemapTable table;
+        table.allocate( width, height, tiled );
+
+        Parallel::forRange( 0, height, Parallel::calculateGrain( 16 * width ), [&]( unsigned int firstRow, unsigned int lastRow )
+        {
+            for ( unsigned int y = firstRow; y < lastRow; ++y )
+            {
+                for ( unsigned int x = 0; x < width; ++x )
+                {
+                    std::pair<double, double> position = function( static_cast<double>( x ), static_cast<double>( y ) );
+                    table.set( x, y, position.first, position.second );
+                }
+            }
+        } );
+
+        return table;
+    }
+
+    inline RemapTable RemapTable::fromMaps( const ImageFloat& mapX, const ImageFloat& mapY, bool tiled )
+    {
+        if ( mapX.getData() == nullptr || mapX.getNumberOfChannels() != 1 || mapY.getNumberOfChannels() != 1 ||
+             mapX.getWidth() != mapY.getWidth() || mapX.getHeight() != mapY.getHeight() )
+        {
+            return RemapTable();
+        }
+
+        return fromFunction( mapX.getWidth(), mapX.getHeight(), [&]( double x, double y )
+        {
+            unsigned int column = static_cast<unsigned int>( x );
+            unsigned int row = static_cast<unsigned int>( y );
+            return std::make_pair( static_cast<double>( *mapX( row, column ) ), static_cast<double>( *mapY( row, column ) ) );
+        }, tiled );
+    }
+
+    inline RemapTable RemapTable::undistortion( unsigned int width, unsigned int height,
+                                                double focalX, double focalY, double centerX, double centerY,
+                                                const double* coefficients, bool tiled )
+    {
+        const double k1 = coefficients[0];
+        const double k2 = coefficients[1];
+        const double p1 = coefficients[2];
+        const double p2 = coefficients[3];
+        const double k3 = coefficients[4];
+
+        return fromFunction( width, height, [=]( double column, double row )
+        {
+            double x = ( column - centerX ) / focalX;
+            double y = ( row - centerY ) / focalY;
+            double r2 = x * x + y * y;
+            double radial = 1.0 + r2 * ( k1 + r2 * ( k2 + r2 * k3 ) );
+            double distortedX = x * radial + 2.0 * p1 * x * y + p2 * ( r2 + 2.0 * x * x );
+            double distortedY = y * radial + p1 * ( r2 + 2.0 * y * y ) + 2.0 * p2 * x * y;
+
+            return std::make_pair( distortedX * focalX + centerX, distortedY * focalY + centerY );
+        }, tiled );
+    }
+
+    inline void RemapTable::allocate( unsigned int width, unsigned int height, bool tiled )
+    {
+        mWidth = width;
+        mHeight = height;
+        mTileWidth = tiled ? std::min( 128u, width ) : width;
+        mTileHeight = tiled ? 32 : 1;
+        mPositions.assign( 2 * static_cast<std::size_t>( width ) * height, 0 );
+        mFractions.assign( static_cast<std::size_t>( width ) * height, 0 );
+    }
+
+    inline std::size_t RemapTable::indexOf( unsigned int x, unsigned int y ) const
+    {
+        // Tiles of a band of rows follow each other, and each tile is stored
+        // row by row
+        unsigned int bandRow = y / mTileHeight * mTileHeight;
+        unsigned int tileColumn = x / mTileWidth * mTileWidth;
+        unsigned int bandHeight = std::min( mTileHeight, mHeight - bandRow );
+        unsigned int tileWidth = std::min( mTileWidth, mWidth - tileColumn );
+
+        return static_cast<std::size_t>( bandRow ) * mWidth + static_cast<std::size_t>( tileColumn ) * bandHeight +
+               ( y - bandRow ) * tileWidth + ( x - tileColumn );
+    }
+
+    inline void RemapTable::set( unsigned int x, unsigned int y, double inputX, double inputY )
+    {
+        // 1/32 pixel, saturated so that whole coordinates fit in 16 bits.
+        // NaNs become the lower limit, outside the image.
+        const double limit = 32767.0 * 32.0;
+        int32_t px = static_cast<int32_t>( std::floor( std::min( limit, std::max( -limit, inputX * 32.0 ) ) + 0.5 ) );
+        int32_t py = static_cast<int32_t>( std::floor( std::min( limit, std::max( -limit, inputY * 32.0 ) ) + 0.5 ) );
+
+        std::size_t index = indexOf( x, y );
+        mPositions[2 * index] = static_cast<int16_t>( px >> 5 );
+        mPositions[2 * index + 1] = static_cast<int16_t>( py >> 5 );
+        mFractions[index] = static_cast<uint16_t>( ( py & 31 ) << 5 | ( px & 31 ) );
+    }
+}
+
+#endif // REMAP_TABLE_H
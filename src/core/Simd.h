@@ -0,0 +1,3102 @@
+/**
+ * This file contains SIMD building blocks shared by the image operators. Each
+ * kernel has a portable implementation and is accelerated when the compiler
+ * targets an instruction set that supports it (e.g. -mssse3, -march=native).
+ *
+ * Licensed under the MIT License (MIT)
+ * Copyright (c) 2015 Eder de Almeida Perez
+ *
+ * @author: Eder Perez.
+ */
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "Types.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+namespace owl
+{
+    namespace simd
+    {
+        /**
+         * A byte permutation applied to blocks of data. Each output byte is
+         * either copied from a byte of one of the input streams or set to a
+         * constant. With SSSE3 each 16-byte output register is assembled with
+         * pshufb from the input registers that contribute to it, so channel
+         * reordering, dropping, insertion, splitting and merging of 8-bit
+         * images are all done by the same kernel.
+         */
+        class ByteShuffle
+        {
+            public:
+
+                /**
+                 * Maximum size in bytes of an output block and of each input
+                 * stream block.
+                 */
+                static const unsigned int MAX_BYTES = 64;
+
+                /**
+                 * Instantiates a shuffle with all output bytes set to zero.
+                 * @param outputBytes Size of an output block in bytes. Must be a
+                 * multiple of 16 not greater than MAX_BYTES.
+                 */
+                explicit ByteShuffle( unsigned int outputBytes );
+
+                /**
+                 * Set the source of an output byte.
+                 * @param outputByte Output byte index.
+                 * @param stream Index of the input stream.
+                 * @param inputByte Byte index in the input stream block.
+                 */
+                void setSource( unsigned int outputByte, unsigned int stream, unsigned int inputByte );
+
+                /**
+                 * Set an output byte to a constant value.
+                 * @param outputByte Output byte index.
+                 * @param value Constant value.
+                 */
+                void setConstant( unsigned int outputByte, BYTE value );
+
+                /**
+                 * Shuffle one block.
+                 * @param streams Pointers to the blocks of each input stream.
+                 * @param output Output block. It may overlap the input blocks,
+                 * since all inputs are read before the output is written.
+                 */
+                void apply( const BYTE* const* streams, BYTE* output ) const;
+
+                /**
+                 * Shuffle one block, storing each 16-byte output register to
+                 * its own location (e.g. one register per image plane).
+                 * @param streams Pointers to the blocks of each input stream.
+                 * @param outputs One pointer per 16 bytes of output.
+                 */
+                void apply( const BYTE* const* streams, BYTE* const* outputs ) const;
+
+
+            private:
+
+                /**
+                 * One pshufb: the contribution of an input register to an
+                 * output register.
+                 */
+                struct Step
+                {
+                    unsigned int stream;
+                    unsigned int inputRegister;
+                    unsigned int outputRegister;
+                    BYTE mask[16];
+                };
+
+                /**
+                 * Output block size in bytes.
+                 */
+                unsigned int mOutputBytes;
+
+                /**
+                 * Per output byte: source stream (-1 for constants), source
+                 * byte and constant value.
+                 */
+                int mStream[MAX_BYTES];
+                unsigned int mOffset[MAX_BYTES];
+                BYTE mConstant[MAX_BYTES];
+
+                /**
+                 * Non-empty pshufb steps.
+                 */
+                std::vector<Step> mSteps;
+        };
+
+
+        inline ByteShuffle::ByteShuffle( unsigned int outputBytes ) :
+            mOutputBytes( outputBytes )
+        {
+            for ( unsigned int i = 0; i < MAX_BYTES; ++i )
+            {
+                mStream[i] = -1;
+                mOffset[i] = 0;
+                mConstant[i] = 0;
+            }
+        }
+
+        inline void ByteShuffle::setSource( unsigned int outputByte, unsigned int stream, unsigned int inputByte )
+        {
+            mStream[outputByte] = stream;
+            mOffset[outputByte] = inputByte;
+            mConstant[outputByte] = 0;
+
+            unsigned int inputRegister = inputByte / 16;
+            unsigned int outputRegister = outputByte / 16;
+
+            Step* step = nullptr;
+            for ( Step& s : mSteps )
+            {
+                if ( s.stream == stream && s.inputRegister == inputRegister && s.outputRegister == outputRegister )
+                {
+                    step = &s;
+                }
+            }
+
+            if ( step == nullptr )
+            {
+                Step s;
+                s.stream = stream;
+                s.inputRegister = inputRegister;
+                s.outputRegister = outputRegister;
+                std::memset( s.mask, 0x80, sizeof(s.mask) );
+                mSteps.push_back( s );
+                step = &mSteps.back();
+            }
+
+            step->mask[outputByte % 16] = inputByte % 16;
+        }
+
+        inline void ByteShuffle::setConstant( unsigned int outputByte, BYTE value )
+        {
+            mStream[outputByte] = -1;
+            mConstant[outputByte] = value;
+
+            for ( Step& step : mSteps )
+            {
+                if ( step.outputRegister == outputByte / 16 )
+                {
+                    step.mask[outputByte % 16] = 0x80;
+                }
+            }
+        }
+
+        inline void ByteShuffle::apply( const BYTE* const* streams, BYTE* output ) const
+        {
+            BYTE* outputs[MAX_BYTES / 16];
+
+            for ( unsigned int r = 0; r < mOutputBytes / 16; ++r )
+            {
+                outputs[r] = output + 16 * r;
+            }
+
+            apply( streams, outputs );
+        }
+
+        inline void ByteShuffle::apply( const BYTE* const* streams, BYTE* const* outputs ) const
+        {
+#if defined(__SSSE3__)
+            __m128i result[MAX_BYTES / 16];
+
+            for ( unsigned int r = 0; r < mOutputBytes / 16; ++r )
+            {
+                result[r] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( mConstant + 16 * r ) );
+            }
+
+            for ( const Step& step : mSteps )
+            {
+                __m128i input = _mm_loadu_si128( reinterpret_cast<const __m128i*>( streams[step.stream] + 16 * step.inputRegister ) );
+                __m128i mask = _mm_loadu_si128( reinterpret_cast<const __m128i*>( step.mask ) );
+                result[step.outputRegister] = _mm_or_si128( result[step.outputRegister], _mm_shuffle_epi8( input, mask ) );
+            }
+
+            for ( unsigned int r = 0; r < mOutputBytes / 16; ++r )
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( outputs[r] ), result[r] );
+            }
+#else
+            BYTE result[MAX_BYTES];
+
+            for ( unsigned int i = 0; i < mOutputBytes; ++i )
+            {
+                result[i] = mStream[i] < 0 ? mConstant[i] : streams[mStream[i]][mOffset[i]];
+            }
+
+            for ( unsigned int r = 0; r < mOutputBytes / 16; ++r )
+            {
+                std::memcpy( outputs[r], result + 16 * r, 16 );
+            }
+#endif
+        }
+
+        /**
+         * Convert a value to a channel type. Integer types are rounded to
+         * nearest (ties to even) and saturated to their range.
+         * @param value A value.
+         * @return The converted value.
+         */
+        template<typename Output>
+        inline Output saturate( double value )
+        {
+            if ( std::is_integral<Output>::value )
+            {
+                value = std::nearbyint( value );
+                value = std::min( static_cast<double>( std::numeric_limits<Output>::max() ), value );
+                value = std::max( static_cast<double>( std::numeric_limits<Output>::lowest() ), value );
+            }
+
+            return static_cast<Output>( value );
+        }
+
+        /**
+         * Convert an array of channel values to another channel type,
+         * computing output = input * scale + offset and saturating as in
+         * saturate(). There are vectorized overloads for the most used type
+         * pairs.
+         * @param input Input array.
+         * @param output Output array.
+         * @param count Number of elements.
+         * @param scale Scale factor.
+         * @param offset Offset added after scaling.
+         */
+        template<typename Output, typename Input>
+        inline void convert( const Input* input, Output* output, unsigned int count, double scale, double offset )
+        {
+            // Plain casts when no value can be out of range
+            bool widening = std::is_floating_point<Output>::value ||
+                            ( std::numeric_limits<Input>::is_integer &&
+                              static_cast<double>( std::numeric_limits<Output>::lowest() ) <= static_cast<double>( std::numeric_limits<Input>::lowest() ) &&
+                              static_cast<double>( std::numeric_limits<Output>::max() ) >= static_cast<double>( std::numeric_limits<Input>::max() ) );
+
+            if ( scale == 1.0 && offset == 0.0 && widening )
+            {
+                for ( unsigned int i = 0; i < count; ++i )
+                {
+                    output[i] = static_cast<Output>( input[i] );
+                }
+            }
+            else
+            {
+                for ( unsigned int i = 0; i < count; ++i )
+                {
+                    output[i] = saturate<Output>( input[i] * scale + offset );
+                }
+            }
+        }
+
+        inline void convert( const BYTE* input, float* output, unsigned int count, double scale, double offset )
+        {
+            const float s = static_cast<float>( scale );
+            const float o = static_cast<float>( offset );
+            unsigned int i = 0;
+
+#if defined(__AVX2__)
+            const __m256 vs = _mm256_set1_ps( s );
+            const __m256 vo = _mm256_set1_ps( o );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i bytes = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( input + i ) );
+                __m256 values = _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( bytes ) );
+                _mm256_storeu_ps( output + i, _mm256_add_ps( _mm256_mul_ps( values, vs ), vo ) );
+            }
+#elif defined(__SSE2__)
+            const __m128 vs = _mm_set1_ps( s );
+            const __m128 vo = _mm_set1_ps( o );
+            const __m128i zero = _mm_setzero_si128();
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + i ) );
+                __m128i low = _mm_unpacklo_epi8( bytes, zero );
+                __m128i high = _mm_unpackhi_epi8( bytes, zero );
+
+                __m128 v0 = _mm_cvtepi32_ps( _mm_unpacklo_epi16( low, zero ) );
+                __m128 v1 = _mm_cvtepi32_ps( _mm_unpackhi_epi16( low, zero ) );
+                __m128 v2 = _mm_cvtepi32_ps( _mm_unpacklo_epi16( high, zero ) );
+                __m128 v3 = _mm_cvtepi32_ps( _mm_unpackhi_epi16( high, zero ) );
+
+                _mm_storeu_ps( output + i, _mm_add_ps( _mm_mul_ps( v0, vs ), vo ) );
+                _mm_storeu_ps( output + i + 4, _mm_add_ps( _mm_mul_ps( v1, vs ), vo ) );
+                _mm_storeu_ps( output + i + 8, _mm_add_ps( _mm_mul_ps( v2, vs ), vo ) );
+                _mm_storeu_ps( output + i + 12, _mm_add_ps( _mm_mul_ps( v3, vs ), vo ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = input[i] * s + o;
+            }
+        }
+
+        inline void convert( const float* input, BYTE* output, unsigned int count, double scale, double offset )
+        {
+            const float s = static_cast<float>( scale );
+            const float o = static_cast<float>( offset );
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            // Values are clamped before the conversion to integer, which would
+            // turn out-of-range values (and NaN) into INT_MIN
+            const __m128 vs = _mm_set1_ps( s );
+            const __m128 vo = _mm_set1_ps( o );
+            const __m128 lower = _mm_setzero_ps();
+            const __m128 upper = _mm_set1_ps( 255.0f );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m128i r[4];
+
+                for ( int k = 0; k < 4; ++k )
+                {
+                    __m128 v = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( input + i + 4 * k ), vs ), vo );
+                    v = _mm_min_ps( _mm_max_ps( v, lower ), upper );
+                    r[k] = _mm_cvtps_epi32( v );
+                }
+
+                __m128i low = _mm_packs_epi32( r[0], r[1] );
+                __m128i high = _mm_packs_epi32( r[2], r[3] );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), _mm_packus_epi16( low, high ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                float v = input[i] * s + o;
+                v = std::min( 255.0f, std::max( 0.0f, v ) );
+                output[i] = static_cast<BYTE>( std::nearbyint( v ) );
+            }
+        }
+
+        /**
+         * output[i] = input[i] * k
+         * @param output Output array.
+         * @param input Input array.
+         * @param k A scalar.
+         * @param count Number of elements.
+         */
+        inline void multiply( float* output, const float* input, float k, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX__)
+            const __m256 vk = _mm256_set1_ps( k );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                _mm256_storeu_ps( output + i, _mm256_mul_ps( _mm256_loadu_ps( input + i ), vk ) );
+            }
+#elif defined(__SSE2__)
+            const __m128 vk = _mm_set1_ps( k );
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                _mm_storeu_ps( output + i, _mm_mul_ps( _mm_loadu_ps( input + i ), vk ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = input[i] * k;
+            }
+        }
+
+        /**
+         * output[i] = a[i] * b[i]
+         * @param output Output array.
+         * @param a Input array.
+         * @param b Input array.
+         * @param count Number of elements.
+         */
+        inline void multiply( float* output, const float* a, const float* b, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX__)
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                _mm256_storeu_ps( output + i, _mm256_mul_ps( _mm256_loadu_ps( a + i ), _mm256_loadu_ps( b + i ) ) );
+            }
+#elif defined(__SSE2__)
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                _mm_storeu_ps( output + i, _mm_mul_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = a[i] * b[i];
+            }
+        }
+
+        /**
+         * output[i] = sum of weights[k] * inputs[k][i] over k, accumulated in
+         * registers (in tap order) rather than through the output array.
+         * There are overloads for float and double.
+         * @param output Output array.
+         * @param inputs Input arrays, one per tap.
+         * @param weights Weights, one per tap.
+         * @param taps Number of taps, at least 1.
+         * @param count Number of elements.
+         */
+        inline void weightedSum( float* output, const float* const* inputs, const float* weights, unsigned int taps, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX__)
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m256 sum = _mm256_mul_ps( _mm256_loadu_ps( inputs[0] + i ), _mm256_set1_ps( weights[0] ) );
+
+                for ( unsigned int k = 1; k < taps; ++k )
+                {
+                    sum = _mm256_add_ps( sum, _mm256_mul_ps( _mm256_loadu_ps( inputs[k] + i ), _mm256_set1_ps( weights[k] ) ) );
+                }
+
+                _mm256_storeu_ps( output + i, sum );
+            }
+#elif defined(__SSE2__)
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m128 sum = _mm_mul_ps( _mm_loadu_ps( inputs[0] + i ), _mm_set1_ps( weights[0] ) );
+
+                for ( unsigned int k = 1; k < taps; ++k )
+                {
+                    sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( inputs[k] + i ), _mm_set1_ps( weights[k] ) ) );
+                }
+
+                _mm_storeu_ps( output + i, sum );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                float sum = inputs[0][i] * weights[0];
+
+                for ( unsigned int k = 1; k < taps; ++k )
+                {
+                    sum += inputs[k][i] * weights[k];
+                }
+
+                output[i] = sum;
+            }
+        }
+
+        inline void weightedSum( double* output, const double* const* inputs, const double* weights, unsigned int taps, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX__)
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m256d sum = _mm256_mul_pd( _mm256_loadu_pd( inputs[0] + i ), _mm256_set1_pd( weights[0] ) );
+
+                for ( unsigned int k = 1; k < taps; ++k )
+                {
+                    sum = _mm256_add_pd( sum, _mm256_mul_pd( _mm256_loadu_pd( inputs[k] + i ), _mm256_set1_pd( weights[k] ) ) );
+                }
+
+                _mm256_storeu_pd( output + i, sum );
+            }
+#elif defined(__SSE2__)
+            for ( ; i + 2 <= count; i += 2 )
+            {
+                __m128d sum = _mm_mul_pd( _mm_loadu_pd( inputs[0] + i ), _mm_set1_pd( weights[0] ) );
+
+                for ( unsigned int k = 1; k < taps; ++k )
+                {
+                    sum = _mm_add_pd( sum, _mm_mul_pd( _mm_loadu_pd( inputs[k] + i ), _mm_set1_pd( weights[k] ) ) );
+                }
+
+                _mm_storeu_pd( output + i, sum );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                double sum = inputs[0][i] * weights[0];
+
+                for ( unsigned int k = 1; k < taps; ++k )
+                {
+                    sum += inputs[k][i] * weights[k];
+                }
+
+                output[i] = sum;
+            }
+        }
+
+        /**
+         * output[i] += input[i] * k
+         * @param output Output array.
+         * @param input Input array.
+         * @param k A scalar.
+         * @param count Number of elements.
+         */
+        inline void multiplyAdd( float* output, const float* input, float k, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX__)
+            const __m256 vk = _mm256_set1_ps( k );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m256 product = _mm256_mul_ps( _mm256_loadu_ps( input + i ), vk );
+                _mm256_storeu_ps( output + i, _mm256_add_ps( _mm256_loadu_ps( output + i ), product ) );
+            }
+#elif defined(__SSE2__)
+            const __m128 vk = _mm_set1_ps( k );
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m128 product = _mm_mul_ps( _mm_loadu_ps( input + i ), vk );
+                _mm_storeu_ps( output + i, _mm_add_ps( _mm_loadu_ps( output + i ), product ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] += input[i] * k;
+            }
+        }
+
+        /**
+         * output[i] = input[i] * k, modulo 2^16.
+         * @param output Output array.
+         * @param input Input array.
+         * @param k A scalar.
+         * @param count Number of elements.
+         */
+        inline void multiply( uint16_t* output, const uint16_t* input, uint16_t k, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX2__)
+            const __m256i vk = _mm256_set1_epi16( static_cast<short>( k ) );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m256i values = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( input + i ) );
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( output + i ), _mm256_mullo_epi16( values, vk ) );
+            }
+#elif defined(__SSE2__)
+            const __m128i vk = _mm_set1_epi16( static_cast<short>( k ) );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + i ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), _mm_mullo_epi16( values, vk ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = static_cast<uint16_t>( input[i] * k );
+            }
+        }
+
+        /**
+         * output[i] += input[i] * k, modulo 2^16.
+         * @param output Output array.
+         * @param input Input array.
+         * @param k A scalar.
+         * @param count Number of elements.
+         */
+        inline void multiplyAdd( uint16_t* output, const uint16_t* input, uint16_t k, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX2__)
+            const __m256i vk = _mm256_set1_epi16( static_cast<short>( k ) );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m256i values = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( input + i ) );
+                __m256i sum = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( output + i ) );
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( output + i ), _mm256_add_epi16( sum, _mm256_mullo_epi16( values, vk ) ) );
+            }
+#elif defined(__SSE2__)
+            const __m128i vk = _mm_set1_epi16( static_cast<short>( k ) );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + i ) );
+                __m128i sum = _mm_loadu_si128( reinterpret_cast<const __m128i*>( output + i ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), _mm_add_epi16( sum, _mm_mullo_epi16( values, vk ) ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = static_cast<uint16_t>( output[i] + input[i] * k );
+            }
+        }
+
+        /**
+         * output[i] += ( input[i] * k ) >> 16, i.e. the high half of the
+         * unsigned 16-bit product.
+         * @param output Output array.
+         * @param input Input array.
+         * @param k A scalar.
+         * @param count Number of elements.
+         */
+        inline void multiplyHighAdd( uint16_t* output, const uint16_t* input, uint16_t k, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX2__)
+            const __m256i vk = _mm256_set1_epi16( static_cast<short>( k ) );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m256i values = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( input + i ) );
+                __m256i sum = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( output + i ) );
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( output + i ), _mm256_add_epi16( sum, _mm256_mulhi_epu16( values, vk ) ) );
+            }
+#elif defined(__SSE2__)
+            const __m128i vk = _mm_set1_epi16( static_cast<short>( k ) );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + i ) );
+                __m128i sum = _mm_loadu_si128( reinterpret_cast<const __m128i*>( output + i ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), _mm_add_epi16( sum, _mm_mulhi_epu16( values, vk ) ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = static_cast<uint16_t>( output[i] + ( ( static_cast<uint32_t>( input[i] ) * k ) >> 16 ) );
+            }
+        }
+
+        /**
+         * Convert 8.8 fixed point values to bytes, rounding to nearest:
+         * output[i] = ( input[i] + 128 ) >> 8
+         * @param input Input array, values must be lower than 65408.
+         * @param output Output array.
+         * @param count Number of elements.
+         */
+        inline void roundFixedPoint8( const uint16_t* input, BYTE* output, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128i half = _mm_set1_epi16( 128 );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m128i low = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + i ) );
+                __m128i high = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + i + 8 ) );
+                low = _mm_srli_epi16( _mm_add_epi16( low, half ), 8 );
+                high = _mm_srli_epi16( _mm_add_epi16( high, half ), 8 );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), _mm_packus_epi16( low, high ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = static_cast<BYTE>( ( input[i] + 128 ) >> 8 );
+            }
+        }
+
+        /**
+         * output[i] += a[i] * ka + b[i] * kb, in 32-bit arithmetic. Pairs of
+         * 16-bit products are summed by a single pmaddwd.
+         * @param output Output array.
+         * @param a First input array.
+         * @param b Second input array.
+         * @param ka Scalar for a.
+         * @param kb Scalar for b.
+         * @param count Number of elements.
+         */
+        inline void multiplyAddPair( int32_t* output, const int16_t* a, const int16_t* b, int16_t ka, int16_t kb, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX2__)
+            const __m256i vk = _mm256_set1_epi32( static_cast<int>( static_cast<uint16_t>( ka ) | ( static_cast<uint32_t>( static_cast<uint16_t>( kb ) ) << 16 ) ) );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m256i va = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( a + i ) );
+                __m256i vb = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( b + i ) );
+
+                // Unpacking works within 128-bit lanes: elements 0-3 and 8-11
+                // land in low, 4-7 and 12-15 in high
+                __m256i low = _mm256_madd_epi16( _mm256_unpacklo_epi16( va, vb ), vk );
+                __m256i high = _mm256_madd_epi16( _mm256_unpackhi_epi16( va, vb ), vk );
+                __m256i first = _mm256_permute2x128_si256( low, high, 0x20 );
+                __m256i second = _mm256_permute2x128_si256( low, high, 0x31 );
+
+                __m256i* out = reinterpret_cast<__m256i*>( output + i );
+                _mm256_storeu_si256( out, _mm256_add_epi32( _mm256_loadu_si256( out ), first ) );
+                _mm256_storeu_si256( out + 1, _mm256_add_epi32( _mm256_loadu_si256( out + 1 ), second ) );
+            }
+#elif defined(__SSE2__)
+            const __m128i vk = _mm_set1_epi32( static_cast<int>( static_cast<uint16_t>( ka ) | ( static_cast<uint32_t>( static_cast<uint16_t>( kb ) ) << 16 ) ) );
+
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i va = _mm_loadu_si128( reinterpret_cast<const __m128i*>( a + i ) );
+                __m128i vb = _mm_loadu_si128( reinterpret_cast<const __m128i*>( b + i ) );
+                __m128i low = _mm_madd_epi16( _mm_unpacklo_epi16( va, vb ), vk );
+                __m128i high = _mm_madd_epi16( _mm_unpackhi_epi16( va, vb ), vk );
+
+                __m128i* out = reinterpret_cast<__m128i*>( output + i );
+                _mm_storeu_si128( out, _mm_add_epi32( _mm_loadu_si128( out ), low ) );
+                _mm_storeu_si128( out + 1, _mm_add_epi32( _mm_loadu_si128( out + 1 ), high ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] += a[i] * ka + b[i] * kb;
+            }
+        }
+
+        /**
+         * Horizontal pass of a resampling, for one row:
+         *     output[x * channels + c] = sum over t < taps of
+         *         weights[x * taps + t] * input[(first[x] + t) * channels + c]
+         * The BYTE version sums 16-bit weights in 32 bits and stores
+         * ( sum + 2^(shift - 1) ) >> shift. With SSE2, 1 channel rows are
+         * summed 8 taps at a time (4 for float), and 3 and 4 channel rows
+         * one pair of pixels at a time with pmaddwd (one pixel at a time
+         * for float). The vector paths need taps to be a multiple of 8 (4
+         * for float) for 1 channel and of 2 (any for float) for 3 and 4
+         * channels, padded with zero weights, and input to be readable 16
+         * bytes beyond the last pixel; other rows use the portable loop.
+         * @param input Input row.
+         * @param first First input pixel of each output pixel.
+         * @param weights taps weights per output pixel.
+         * @param taps Number of taps.
+         * @param width Number of output pixels.
+         * @param channels Number of channels.
+         * @param shift Fractional bits removed from the sums.
+         * @param output Output row.
+         */
+        inline void resampleRow( const BYTE* input, const int* first, const int16_t* weights, unsigned int taps,
+                                 unsigned int width, unsigned int channels, int shift, int16_t* output )
+        {
+            const int32_t round = 1 << ( shift - 1 );
+            unsigned int x = 0;
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+
+            if ( channels == 1 && taps % 8 == 0 )
+            {
+                for ( ; x < width; ++x )
+                {
+                    const BYTE* pixel = input + first[x];
+                    const int16_t* w = weights + x * taps;
+                    __m128i sum = _mm_setzero_si128();
+
+                    for ( unsigned int t = 0; t < taps; t += 8 )
+                    {
+                        __m128i values = _mm_unpacklo_epi8( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pixel + t ) ), zero );
+                        sum = _mm_add_epi32( sum, _mm_madd_epi16( values, _mm_loadu_si128( reinterpret_cast<const __m128i*>( w + t ) ) ) );
+                    }
+
+                    sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+                    sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                    output[x] = static_cast<int16_t>( ( _mm_cvtsi128_si32( sum ) + round ) >> shift );
+                }
+            }
+            else if ( ( channels == 3 || channels == 4 ) && taps % 2 == 0 )
+            {
+                const __m128i vround = _mm_set1_epi32( round );
+
+                for ( ; x < width; ++x )
+                {
+                    const BYTE* pixel = input + first[x] * channels;
+                    const int16_t* w = weights + x * taps;
+                    __m128i sum = _mm_setzero_si128();
+
+                    for ( unsigned int t = 0; t < taps; t += 2 )
+                    {
+                        // Pixels t and t + 1 interleaved by channel, so each
+                        // pmaddwd lane sums the two taps of one channel
+                        __m128i values = _mm_unpacklo_epi8( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pixel + t * channels ) ), zero );
+                        __m128i next = channels == 4 ? _mm_srli_si128( values, 8 ) : _mm_srli_si128( values, 6 );
+                        __m128i pair = _mm_set1_epi32( static_cast<int>( static_cast<uint16_t>( w[t] ) | ( static_cast<uint32_t>( static_cast<uint16_t>( w[t + 1] ) ) << 16 ) ) );
+                        sum = _mm_add_epi32( sum, _mm_madd_epi16( _mm_unpacklo_epi16( values, next ), pair ) );
+                    }
+
+                    __m128i packed = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( sum, vround ), shift ), zero );
+
+                    if ( channels == 4 )
+                    {
+                        _mm_storel_epi64( reinterpret_cast<__m128i*>( output + x * 4 ), packed );
+                    }
+                    else
+                    {
+                        int16_t lanes[8];
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes ), packed );
+                        std::copy( lanes, lanes + 3, output + x * 3 );
+                    }
+                }
+            }
+#endif
+
+            for ( ; x < width; ++x )
+            {
+                const int16_t* w = weights + x * taps;
+                const BYTE* pixel = input + first[x] * channels;
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    int32_t sum = 0;
+
+                    for ( unsigned int t = 0; t < taps; ++t )
+                    {
+                        sum += w[t] * pixel[t * channels + c];
+                    }
+
+                    output[x * channels + c] = static_cast<int16_t>( ( sum + round ) >> shift );
+                }
+            }
+        }
+
+        inline void resampleRow( const float* input, const int* first, const float* weights, unsigned int taps,
+                                 unsigned int width, unsigned int channels, float* output )
+        {
+            unsigned int x = 0;
+
+#if defined(__SSE2__)
+            if ( channels == 1 && taps % 4 == 0 )
+            {
+                for ( ; x < width; ++x )
+                {
+                    const float* pixel = input + first[x];
+                    const float* w = weights + x * taps;
+                    __m128 sum = _mm_setzero_ps();
+
+                    for ( unsigned int t = 0; t < taps; t += 4 )
+                    {
+                        sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( pixel + t ), _mm_loadu_ps( w + t ) ) );
+                    }
+
+                    sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+                    sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+                    output[x] = _mm_cvtss_f32( sum );
+                }
+            }
+            else if ( channels == 3 || channels == 4 )
+            {
+                for ( ; x < width; ++x )
+                {
+                    const float* pixel = input + first[x] * channels;
+                    const float* w = weights + x * taps;
+                    __m128 sum = _mm_setzero_ps();
+
+                    for ( unsigned int t = 0; t < taps; ++t )
+                    {
+                        sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( pixel + t * channels ), _mm_set1_ps( w[t] ) ) );
+                    }
+
+                    if ( channels == 4 )
+                    {
+                        _mm_storeu_ps( output + x * 4, sum );
+                    }
+                    else
+                    {
+                        float lanes[4];
+                        _mm_storeu_ps( lanes, sum );
+                        std::copy( lanes, lanes + 3, output + x * 3 );
+                    }
+                }
+            }
+#endif
+
+            for ( ; x < width; ++x )
+            {
+                const float* w = weights + x * taps;
+                const float* pixel = input + first[x] * channels;
+
+                for ( unsigned int c = 0; c < channels; ++c )
+                {
+                    float sum = 0.0f;
+
+                    for ( unsigned int t = 0; t < taps; ++t )
+                    {
+                        sum += w[t] * pixel[t * channels + c];
+                    }
+
+                    output[x * channels + c] = sum;
+                }
+            }
+        }
+
+        /**
+         * Convert fixed point values to bytes, rounding to nearest and
+         * saturating: output[i] = ( input[i] + 2^(shift - 1) ) >> shift
+         * @param input Input array.
+         * @param output Output array.
+         * @param shift Number of fractional bits, from 1 to 30.
+         * @param count Number of elements.
+         */
+        inline void roundShiftPack( const int32_t* input, BYTE* output, int shift, unsigned int count )
+        {
+            unsigned int i = 0;
+            const int32_t half = 1 << ( shift - 1 );
+
+#if defined(__SSE2__)
+            const __m128i vhalf = _mm_set1_epi32( half );
+            const __m128i vshift = _mm_cvtsi32_si128( shift );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                const __m128i* in = reinterpret_cast<const __m128i*>( input + i );
+                __m128i v0 = _mm_sra_epi32( _mm_add_epi32( _mm_loadu_si128( in ), vhalf ), vshift );
+                __m128i v1 = _mm_sra_epi32( _mm_add_epi32( _mm_loadu_si128( in + 1 ), vhalf ), vshift );
+                __m128i v2 = _mm_sra_epi32( _mm_add_epi32( _mm_loadu_si128( in + 2 ), vhalf ), vshift );
+                __m128i v3 = _mm_sra_epi32( _mm_add_epi32( _mm_loadu_si128( in + 3 ), vhalf ), vshift );
+                __m128i packed = _mm_packus_epi16( _mm_packs_epi32( v0, v1 ), _mm_packs_epi32( v2, v3 ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), packed );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                int32_t value = ( input[i] + half ) >> shift;
+                output[i] = static_cast<BYTE>( std::min( 255, std::max( 0, value ) ) );
+            }
+        }
+
+        /**
+         * output[i] = table[input[i]]. A 256-entry table does not fit a
+         * shuffle register: a pshufb lookup needs 16 shuffles plus selects per
+         * register and measured slower than scalar loads, which sustain two
+         * lookups per cycle. The loop is unrolled so the loads overlap.
+         * @param table 256-entry table.
+         * @param input Input array.
+         * @param output Output array. Can be input.
+         * @param count Number of elements.
+         */
+        inline void lookup( const BYTE* table, const BYTE* input, BYTE* output, unsigned int count )
+        {
+            unsigned int i = 0;
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                BYTE v0 = table[input[i]];
+                BYTE v1 = table[input[i + 1]];
+                BYTE v2 = table[input[i + 2]];
+                BYTE v3 = table[input[i + 3]];
+                output[i] = v0;
+                output[i + 1] = v1;
+                output[i + 2] = v2;
+                output[i + 3] = v3;
+            }
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = table[input[i]];
+            }
+        }
+
+        /**
+         * Element-wise minimum and maximum of two arrays:
+         * output[i] = min(a[i], b[i]) or max(a[i], b[i]). There are
+         * vectorized overloads for BYTE, int16_t, uint16_t and float.
+         * @param output Output array. Can be a or b.
+         * @param a First input array.
+         * @param b Second input array.
+         * @param count Number of elements.
+         */
+        template<typename T>
+        inline void minimum( T* output, const T* a, const T* b, unsigned int count )
+        {
+            for ( unsigned int i = 0; i < count; ++i )
+            {
+                output[i] = b[i] < a[i] ? b[i] : a[i];
+            }
+        }
+
+        template<typename T>
+        inline void maximum( T* output, const T* a, const T* b, unsigned int count )
+        {
+            for ( unsigned int i = 0; i < count; ++i )
+            {
+                output[i] = a[i] < b[i] ? b[i] : a[i];
+            }
+        }
+
+#if defined(__SSE2__)
+        /**
+         * Apply a two operand SIMD operation to arrays, 16 bytes at a time.
+         * @return Number of elements processed; the caller finishes the
+         * remaining ones.
+         */
+        template<typename T, typename Operation>
+        inline unsigned int applyBinary( T* output, const T* a, const T* b, unsigned int count, const Operation& operation )
+        {
+            const unsigned int lanes = 16 / sizeof(T);
+            unsigned int i = 0;
+
+            for ( ; i + lanes <= count; i += lanes )
+            {
+                __m128i va = _mm_loadu_si128( reinterpret_cast<const __m128i*>( a + i ) );
+                __m128i vb = _mm_loadu_si128( reinterpret_cast<const __m128i*>( b + i ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), operation( va, vb ) );
+            }
+
+            return i;
+        }
+
+        template<typename Operation>
+        inline unsigned int applyBinary( float* output, const float* a, const float* b, unsigned int count, const Operation& operation )
+        {
+            unsigned int i = 0;
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                _mm_storeu_ps( output + i, operation( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) ) );
+            }
+
+            return i;
+        }
+
+        inline void minimum( BYTE* output, const BYTE* a, const BYTE* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128i x, __m128i y ) { return _mm_min_epu8( x, y ); } );
+            minimum<BYTE>( output + i, a + i, b + i, count - i );
+        }
+
+        inline void maximum( BYTE* output, const BYTE* a, const BYTE* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128i x, __m128i y ) { return _mm_max_epu8( x, y ); } );
+            maximum<BYTE>( output + i, a + i, b + i, count - i );
+        }
+
+        inline void minimum( int16_t* output, const int16_t* a, const int16_t* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128i x, __m128i y ) { return _mm_min_epi16( x, y ); } );
+            minimum<int16_t>( output + i, a + i, b + i, count - i );
+        }
+
+        inline void maximum( int16_t* output, const int16_t* a, const int16_t* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128i x, __m128i y ) { return _mm_max_epi16( x, y ); } );
+            maximum<int16_t>( output + i, a + i, b + i, count - i );
+        }
+
+#if defined(__SSE4_1__)
+        inline void minimum( uint16_t* output, const uint16_t* a, const uint16_t* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128i x, __m128i y ) { return _mm_min_epu16( x, y ); } );
+            minimum<uint16_t>( output + i, a + i, b + i, count - i );
+        }
+
+        inline void maximum( uint16_t* output, const uint16_t* a, const uint16_t* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128i x, __m128i y ) { return _mm_max_epu16( x, y ); } );
+            maximum<uint16_t>( output + i, a + i, b + i, count - i );
+        }
+#endif
+
+        // minps/maxps return the second operand when either one is NaN, the
+        // operands are swapped to match the scalar versions
+        inline void minimum( float* output, const float* a, const float* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128 x, __m128 y ) { return _mm_min_ps( y, x ); } );
+            minimum<float>( output + i, a + i, b + i, count - i );
+        }
+
+        inline void maximum( float* output, const float* a, const float* b, unsigned int count )
+        {
+            unsigned int i = applyBinary( output, a, b, count, []( __m128 x, __m128 y ) { return _mm_max_ps( y, x ); } );
+            maximum<float>( output + i, a + i, b + i, count - i );
+        }
+#endif
+
+#if defined(__SSE2__)
+        /**
+         * Interleave the low or high halves of two registers, by elements of
+         * Size bytes.
+         */
+        inline __m128i unpackLow( __m128i a, __m128i b, std::integral_constant<unsigned int, 1> ) { return _mm_unpacklo_epi8( a, b ); }
+        inline __m128i unpackLow( __m128i a, __m128i b, std::integral_constant<unsigned int, 2> ) { return _mm_unpacklo_epi16( a, b ); }
+        inline __m128i unpackLow( __m128i a, __m128i b, std::integral_constant<unsigned int, 4> ) { return _mm_unpacklo_epi32( a, b ); }
+        inline __m128i unpackLow( __m128i a, __m128i b, std::integral_constant<unsigned int, 8> ) { return _mm_unpacklo_epi64( a, b ); }
+        inline __m128i unpackHigh( __m128i a, __m128i b, std::integral_constant<unsigned int, 1> ) { return _mm_unpackhi_epi8( a, b ); }
+        inline __m128i unpackHigh( __m128i a, __m128i b, std::integral_constant<unsigned int, 2> ) { return _mm_unpackhi_epi16( a, b ); }
+        inline __m128i unpackHigh( __m128i a, __m128i b, std::integral_constant<unsigned int, 4> ) { return _mm_unpackhi_epi32( a, b ); }
+        inline __m128i unpackHigh( __m128i a, __m128i b, std::integral_constant<unsigned int, 8> ) { return _mm_unpackhi_epi64( a, b ); }
+
+        /**
+         * One stage of a register transposition: b[2j] and b[2j + 1]
+         * interleave a[j] and a[j + n / 2], for n = 16 / PixelSize. Unrolled by
+         * hand (the conditions are constant), so the registers are not spilled
+         * to the stack at -O2.
+         */
+        template<unsigned int PixelSize>
+        inline void interleaveStage( const __m128i* a, __m128i* b )
+        {
+            const unsigned int h = 8 / PixelSize;
+            const std::integral_constant<unsigned int, PixelSize> size = {};
+
+            b[0] = unpackLow( a[0], a[h], size ); b[1] = unpackHigh( a[0], a[h], size );
+            if ( h > 1 ) { b[2] = unpackLow( a[1], a[h + 1], size ); b[3] = unpackHigh( a[1], a[h + 1], size ); }
+            if ( h > 2 ) { b[4] = unpackLow( a[2], a[h + 2], size ); b[5] = unpackHigh( a[2], a[h + 2], size ); }
+            if ( h > 3 ) { b[6] = unpackLow( a[3], a[h + 3], size ); b[7] = unpackHigh( a[3], a[h + 3], size ); }
+            if ( h > 4 ) { b[8] = unpackLow( a[4], a[h + 4], size ); b[9] = unpackHigh( a[4], a[h + 4], size ); }
+            if ( h > 5 ) { b[10] = unpackLow( a[5], a[h + 5], size ); b[11] = unpackHigh( a[5], a[h + 5], size ); }
+            if ( h > 6 ) { b[12] = unpackLow( a[6], a[h + 6], size ); b[13] = unpackHigh( a[6], a[h + 6], size ); }
+            if ( h > 7 ) { b[14] = unpackLow( a[7], a[h + 7], size ); b[15] = unpackHigh( a[7], a[h + 7], size ); }
+        }
+
+        /**
+         * Transpose a block of n x n pixels of PixelSize bytes held in n = 16 /
+         * PixelSize registers (16x16 bytes, 8x8 16-bit pixels, ...). Each of
+         * the log2(n) stages interleaves register j with register j + n / 2;
+         * after the last one register j holds column j.
+         * @param rows Pointers to the rows of the block.
+         * @param columns Pointers to the columns of the block.
+         * @param rowOffset Offset of the block in the rows, in bytes.
+         * @param columnOffset Offset of the block in the columns, in bytes.
+         * @return False for pixel sizes that do not divide 16 or are 16.
+         */
+        template<unsigned int PixelSize>
+        inline bool transposeRegisters( const BYTE* const*, BYTE* const*, unsigned int, unsigned int, std::false_type )
+        {
+            return false;
+        }
+
+        template<unsigned int PixelSize>
+        inline bool transposeRegisters( const BYTE* const* rows, BYTE* const* columns,
+                                        unsigned int rowOffset, unsigned int columnOffset, std::true_type )
+        {
+            const unsigned int n = 16 / PixelSize;
+            __m128i a[16];
+            __m128i b[16];
+
+            for ( unsigned int i = 0; i < n; ++i )
+            {
+                a[i] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( rows[i] + rowOffset ) );
+            }
+
+            interleaveStage<PixelSize>( a, b );
+
+            if ( n > 2 )
+            {
+                interleaveStage<PixelSize>( b, a );
+            }
+
+            if ( n > 4 )
+            {
+                interleaveStage<PixelSize>( a, b );
+            }
+
+            if ( n > 8 )
+            {
+                interleaveStage<PixelSize>( b, a );
+            }
+
+            // Odd numbers of stages end in b
+            const __m128i* result = n == 2 || n == 8 ? b : a;
+
+            for ( unsigned int j = 0; j < n; ++j )
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( columns[j] + columnOffset ), result[j] );
+            }
+
+            return true;
+        }
+#endif
+
+        /**
+         * Transpose a tile of pixels: pixel j of row i is copied to pixel i of
+         * column j. With SSE2, pixels whose size divides 16 are transposed in
+         * blocks of 16 / PixelSize pixels held in registers.
+         * @param rows Pointers to the first pixel of each row of the tile.
+         * @param columns Pointers to where each column is written, as a run
+         * of height pixels.
+         * @param height Number of rows.
+         * @param width Number of columns.
+         */
+        template<unsigned int PixelSize>
+        inline void transposeTile( const BYTE* const* rows, BYTE* const* columns, unsigned int height, unsigned int width )
+        {
+            unsigned int fullHeight = 0;
+            unsigned int fullWidth = 0;
+
+#if defined(__SSE2__)
+            typedef std::integral_constant<bool, 16 % PixelSize == 0 && PixelSize < 16> InRegisters;
+
+            if ( InRegisters::value )
+            {
+                const unsigned int n = 16 / PixelSize;
+                fullHeight = height / n * n;
+                fullWidth = width / n * n;
+
+                for ( unsigned int i = 0; i < fullHeight; i += n )
+                {
+                    for ( unsigned int j = 0; j < fullWidth; j += n )
+                    {
+                        transposeRegisters<PixelSize>( rows + i, columns + j, j * PixelSize, i * PixelSize, InRegisters() );
+                    }
+                }
+            }
+#endif
+
+            // Right and bottom borders of the tile
+            for ( unsigned int j = 0; j < width; ++j )
+            {
+                for ( unsigned int i = j < fullWidth ? fullHeight : 0; i < height; ++i )
+                {
+                    std::memcpy( columns[j] + i * PixelSize, rows[i] + j * PixelSize, PixelSize );
+                }
+            }
+        }
+
+        /**
+         * Reverse the order of the pixels of a row. With SSSE3, pixels whose
+         * size divides 16 are reversed 16 bytes at a time with pshufb.
+         * @param output Output row, distinct from input.
+         * @param input Input row.
+         * @param count Number of pixels.
+         */
+        template<unsigned int PixelSize>
+        inline void reversePixels( BYTE* output, const BYTE* input, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSSE3__)
+            if ( 16 % PixelSize == 0 && PixelSize < 16 )
+            {
+                const unsigned int n = 16 / PixelSize;
+                BYTE indices[16];
+
+                for ( unsigned int k = 0; k < 16; ++k )
+                {
+                    indices[k] = static_cast<BYTE>( ( n - 1 - k / PixelSize ) * PixelSize + k % PixelSize );
+                }
+
+                const __m128i mask = _mm_loadu_si128( reinterpret_cast<const __m128i*>( indices ) );
+
+                for ( ; i + n <= count; i += n )
+                {
+                    __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + ( count - i - n ) * PixelSize ) );
+                    _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i * PixelSize ), _mm_shuffle_epi8( block, mask ) );
+                }
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                std::memcpy( output + i * PixelSize, input + ( count - 1 - i ) * PixelSize, PixelSize );
+            }
+        }
+
+        /**
+         * Bilinear interpolation of a 4 channel BYTE pixel from its 2x2
+         * window. With SSE2, the channels of each row are interleaved into
+         * 16-bit pairs and weighted with pmaddwd.
+         * @param top The two pixels of the upper row of the window.
+         * @param bottom The two pixels of the lower row of the window.
+         * @param weights Weights of the top-left, top-right, bottom-left and
+         * bottom-right pixels, with 14 fractional bits. They must sum to 1 << 14.
+         * @param output Interpolated pixel.
+         */
+        inline void bilinear4( const BYTE* top, const BYTE* bottom, const int* weights, BYTE* output )
+        {
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            __m128i upper = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( top ) );
+            __m128i lower = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( bottom ) );
+
+            // r0 r1 g0 g1 b0 b1 a0 a1, in 16 bits
+            upper = _mm_unpacklo_epi8( _mm_unpacklo_epi8( upper, _mm_srli_si128( upper, 4 ) ), zero );
+            lower = _mm_unpacklo_epi8( _mm_unpacklo_epi8( lower, _mm_srli_si128( lower, 4 ) ), zero );
+
+            __m128i sum = _mm_add_epi32( _mm_madd_epi16( upper, _mm_set1_epi32( weights[0] | weights[1] << 16 ) ),
+                                         _mm_madd_epi16( lower, _mm_set1_epi32( weights[2] | weights[3] << 16 ) ) );
+            sum = _mm_srai_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 1 << 13 ) ), 14 );
+            sum = _mm_packs_epi32( sum, sum );
+
+            int32_t pixel = _mm_cvtsi128_si32( _mm_packus_epi16( sum, sum ) );
+            std::memcpy( output, &pixel, 4 );
+#else
+            for ( unsigned int c = 0; c < 4; ++c )
+            {
+                int sum = weights[0] * top[c] + weights[1] * top[4 + c] + weights[2] * bottom[c] + weights[3] * bottom[4 + c];
+                output[c] = static_cast<BYTE>( ( sum + ( 1 << 13 ) ) >> 14 );
+            }
+#endif
+        }
+
+        /**
+         * Bicubic interpolation of a 4 channel BYTE pixel from its 4x4
+         * window. With SSE4.1, each row is interpolated with pmaddwd and the
+         * rows are combined in 32-bit lanes.
+         * @param window Top-left pixel of the window.
+         * @param stride Size of an image row, in bytes.
+         * @param wx Horizontal weights, with 10 fractional bits.
+         * @param wy Vertical weights, with 10 fractional bits.
+         * @param output Interpolated pixel.
+         */
+        inline void bicubic4( const BYTE* window, unsigned int stride, const int16_t* wx, const int16_t* wy, BYTE* output )
+        {
+#if defined(__SSE4_1__)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i left = _mm_set1_epi32( static_cast<int>( static_cast<uint16_t>( wx[0] ) | static_cast<uint32_t>( static_cast<uint16_t>( wx[1] ) ) << 16 ) );
+            const __m128i right = _mm_set1_epi32( static_cast<int>( static_cast<uint16_t>( wx[2] ) | static_cast<uint32_t>( static_cast<uint16_t>( wx[3] ) ) << 16 ) );
+            __m128i sum = zero;
+
+            for ( unsigned int j = 0; j < 4; ++j, window += stride )
+            {
+                // Channels of pixels 0 and 1, and of pixels 2 and 3, interleaved
+                __m128i row = _mm_loadu_si128( reinterpret_cast<const __m128i*>( window ) );
+                __m128i high = _mm_srli_si128( row, 8 );
+                __m128i a = _mm_unpacklo_epi8( _mm_unpacklo_epi8( row, _mm_srli_si128( row, 4 ) ), zero );
+                __m128i b = _mm_unpacklo_epi8( _mm_unpacklo_epi8( high, _mm_srli_si128( high, 4 ) ), zero );
+
+                __m128i interpolated = _mm_add_epi32( _mm_madd_epi16( a, left ), _mm_madd_epi16( b, right ) );
+                sum = _mm_add_epi32( sum, _mm_mullo_epi32( interpolated, _mm_set1_epi32( wy[j] ) ) );
+            }
+
+            sum = _mm_srai_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 1 << 19 ) ), 20 );
+            sum = _mm_packs_epi32( sum, sum );
+
+            int32_t pixel = _mm_cvtsi128_si32( _mm_packus_epi16( sum, sum ) );
+            std::memcpy( output, &pixel, 4 );
+#else
+            for ( unsigned int c = 0; c < 4; ++c )
+            {
+                const BYTE* pixel = window + c;
+                int sum = 0;
+
+                for ( unsigned int j = 0; j < 4; ++j, pixel += stride )
+                {
+                    sum += wy[j] * ( wx[0] * pixel[0] + wx[1] * pixel[4] + wx[2] * pixel[8] + wx[3] * pixel[12] );
+                }
+
+                output[c] = static_cast<BYTE>( std::min( 255, std::max( 0, ( sum + ( 1 << 19 ) ) >> 20 ) ) );
+            }
+#endif
+        }
+
+        /**
+         * Bilinear interpolation of grayscale BYTE pixels, 4 at a time with
+         * SSE2: the 2x2 windows are gathered into 16-bit pairs and weighted
+         * with pmaddwd. Interpolation stops before the first group of 4 pixels
+         * with a window that is not inside the image, so the caller can
+         * handle it.
+         * @param data First pixel of the image.
+         * @param stride Size of an image row, in bytes.
+         * @param width Image width.
+         * @param height Image height.
+         * @param positions (x, y) pairs of the top-left pixels of the windows.
+         * @param fractions Fractional positions, fy * 32 + fx, in 1/32 pixel.
+         * @param output Interpolated pixels.
+         * @param count Number of pixels.
+         * @return Number of pixels interpolated.
+         */
+        inline unsigned int bilinearGray( const BYTE* data, unsigned int stride, unsigned int width, unsigned int height,
+                                          const int32_t* positions, const uint16_t* fractions, BYTE* output, unsigned int count )
+        {
+            unsigned int i = 0;
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                int32_t top[4];
+                int32_t bottom[4];
+                bool inside = true;
+
+                for ( unsigned int k = 0; k < 4; ++k )
+                {
+                    // Negative coordinates become large unsigned values
+                    unsigned int x = static_cast<unsigned int>( positions[2 * ( i + k )] );
+                    unsigned int y = static_cast<unsigned int>( positions[2 * ( i + k ) + 1] );
+                    inside = inside && x < width - 1 && y < height - 1;
+
+                    // Pixel pairs in 16-bit lanes
+                    if ( inside )
+                    {
+                        const BYTE* window = data + static_cast<size_t>( y ) * stride + x;
+                        top[k] = window[0] | window[1] << 16;
+                        bottom[k] = window[stride] | window[stride + 1] << 16;
+                    }
+                }
+
+                if ( !inside )
+                {
+                    break;
+                }
+
+#if defined(__SSE2__)
+                const __m128i fractionMask = _mm_set1_epi16( 31 );
+                const __m128i one = _mm_set1_epi16( 32 );
+
+                __m128i f = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( fractions + i ) );
+                __m128i fx = _mm_and_si128( f, fractionMask );
+                __m128i fy = _mm_srli_epi16( f, 5 );
+                __m128i gx = _mm_sub_epi16( one, fx );
+                __m128i gy = _mm_sub_epi16( one, fy );
+
+                // Weights with 14 fractional bits, paired as the pixels
+                __m128i upperWeights = _mm_slli_epi16( _mm_unpacklo_epi16( _mm_mullo_epi16( gx, gy ), _mm_mullo_epi16( fx, gy ) ), 4 );
+                __m128i lowerWeights = _mm_slli_epi16( _mm_unpacklo_epi16( _mm_mullo_epi16( gx, fy ), _mm_mullo_epi16( fx, fy ) ), 4 );
+
+                __m128i upper = _mm_loadu_si128( reinterpret_cast<const __m128i*>( top ) );
+                __m128i lower = _mm_loadu_si128( reinterpret_cast<const __m128i*>( bottom ) );
+
+                __m128i sum = _mm_add_epi32( _mm_madd_epi16( upper, upperWeights ), _mm_madd_epi16( lower, lowerWeights ) );
+                sum = _mm_srai_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 1 << 13 ) ), 14 );
+                sum = _mm_packs_epi32( sum, sum );
+
+                int32_t pixels = _mm_cvtsi128_si32( _mm_packus_epi16( sum, sum ) );
+                std::memcpy( output + i, &pixels, 4 );
+#else
+                for ( unsigned int k = 0; k < 4; ++k )
+                {
+                    int fx = fractions[i + k] & 31;
+                    int fy = fractions[i + k] >> 5;
+                    int sum = ( ( 32 - fx ) * ( top[k] & 0xFFFF ) + fx * ( top[k] >> 16 ) ) * ( 32 - fy ) +
+                              ( ( 32 - fx ) * ( bottom[k] & 0xFFFF ) + fx * ( bottom[k] >> 16 ) ) * fy;
+                    output[i + k] = static_cast<BYTE>( ( sum + ( 1 << 9 ) ) >> 10 );
+                }
+#endif
+            }
+
+            return i;
+        }
+
+        /**
+         * Split fixed point source positions of warps into whole pixels and
+         * 5-bit fractions.
+         * @param positions (x, y) pairs with fractionBits fractional bits (at
+         * least 5). They are replaced by the whole pixel coordinates.
+         * @param fractions Fractional positions, fy * 32 + fx, in 1/32 pixel.
+         * @param count Number of pairs.
+         * @param fractionBits Number of fractional bits of the positions.
+         * @param rounding Added to the positions before they are split.
+         */
+        inline void splitPositions( int32_t* positions, uint16_t* fractions, unsigned int count, int fractionBits, int32_t rounding )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128i add = _mm_set1_epi32( rounding );
+            const __m128i mask = _mm_set1_epi32( 31 );
+            const __m128i shift = _mm_cvtsi32_si128( fractionBits );
+            const __m128i fractionShift = _mm_cvtsi32_si128( fractionBits - 5 );
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m128i* pairs = reinterpret_cast<__m128i*>( positions + 2 * i );
+                __m128i a = _mm_add_epi32( _mm_loadu_si128( pairs ), add );
+                __m128i b = _mm_add_epi32( _mm_loadu_si128( pairs + 1 ), add );
+
+                // fx, fy of each pair, then fx + 32 * fy in the low lane
+                __m128i fa = _mm_and_si128( _mm_sra_epi32( a, fractionShift ), mask );
+                __m128i fb = _mm_and_si128( _mm_sra_epi32( b, fractionShift ), mask );
+                fa = _mm_add_epi32( fa, _mm_srli_epi64( _mm_slli_epi32( fa, 5 ), 32 ) );
+                fb = _mm_add_epi32( fb, _mm_srli_epi64( _mm_slli_epi32( fb, 5 ), 32 ) );
+
+                __m128i f = _mm_unpacklo_epi64( _mm_shuffle_epi32( fa, _MM_SHUFFLE( 3, 1, 2, 0 ) ),
+                                                _mm_shuffle_epi32( fb, _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+                f = _mm_packs_epi32( f, f );
+                _mm_storel_epi64( reinterpret_cast<__m128i*>( fractions + i ), f );
+
+                _mm_storeu_si128( pairs, _mm_sra_epi32( a, shift ) );
+                _mm_storeu_si128( pairs + 1, _mm_sra_epi32( b, shift ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                int32_t x = positions[2 * i] + rounding;
+                int32_t y = positions[2 * i + 1] + rounding;
+                fractions[i] = static_cast<uint16_t>( ( ( y >> ( fractionBits - 5 ) ) & 31 ) << 5 | ( ( x >> ( fractionBits - 5 ) ) & 31 ) );
+                positions[2 * i] = x >> fractionBits;
+                positions[2 * i + 1] = y >> fractionBits;
+            }
+        }
+
+        /**
+         * Threshold an array: output[i] is computed from input[i] > threshold
+         * as described by ThresholdType. There are vectorized overloads for
+         * BYTE, int16_t, uint16_t and float.
+         * @param output Output array. Can be input.
+         * @param input Input array.
+         * @param threshold Threshold.
+         * @param maxValue Value of BINARY and BINARY_INVERTED outputs.
+         * @param type Threshold type.
+         * @param count Number of elements.
+         */
+        template<typename T>
+        inline void threshold( T* output, const T* input, T threshold, T maxValue, ThresholdType type, unsigned int count )
+        {
+            for ( unsigned int i = 0; i < count; ++i )
+            {
+                T value = input[i];
+                bool above = threshold < value;
+
+                switch ( type )
+                {
+                    case ThresholdType::BINARY: output[i] = above ? maxValue : T( 0 ); break;
+                    case ThresholdType::BINARY_INVERTED: output[i] = above ? T( 0 ) : maxValue; break;
+                    case ThresholdType::TRUNCATE: output[i] = above ? threshold : value; break;
+                    case ThresholdType::TO_ZERO: output[i] = above ? value : T( 0 ); break;
+                    case ThresholdType::TO_ZERO_INVERTED: output[i] = above ? T( 0 ) : value; break;
+                }
+            }
+        }
+
+#if defined(__SSE2__)
+        /**
+         * Select between two registers: mask ? a : b, bitwise.
+         */
+        inline __m128i select( __m128i mask, __m128i a, __m128i b )
+        {
+            return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+        }
+
+        inline __m128 select( __m128 mask, __m128 a, __m128 b )
+        {
+            return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+        }
+
+        /**
+         * Threshold 16 bytes at a time, given the broadcast threshold and
+         * maximum value and a comparison returning the mask of elements
+         * greater than the threshold.
+         * @return Number of elements processed; the caller finishes the
+         * remaining ones.
+         */
+        template<typename T, typename V, typename Greater>
+        inline unsigned int applyThreshold( T* output, const T* input, V threshold, V maxValue, ThresholdType type,
+                                            unsigned int count, const Greater& greater )
+        {
+            const unsigned int lanes = sizeof(V) / sizeof(T);
+            const V zero = V();
+            unsigned int i = 0;
+
+            for ( ; i + lanes <= count; i += lanes )
+            {
+                V value;
+                std::memcpy( &value, input + i, sizeof(V) );
+                V mask = greater( value, threshold );
+                V result;
+
+                switch ( type )
+                {
+                    case ThresholdType::BINARY: result = select( mask, maxValue, zero ); break;
+                    case ThresholdType::BINARY_INVERTED: result = select( mask, zero, maxValue ); break;
+                    case ThresholdType::TRUNCATE: result = select( mask, threshold, value ); break;
+                    case ThresholdType::TO_ZERO: result = select( mask, value, zero ); break;
+                    default: result = select( mask, zero, value ); break;
+                }
+
+                std::memcpy( output + i, &result, sizeof(V) );
+            }
+
+            return i;
+        }
+
+        // There are no unsigned comparisons: flipping the sign bits maps
+        // unsigned order to signed order
+        inline void threshold( BYTE* output, const BYTE* input, BYTE t, BYTE maxValue, ThresholdType type, unsigned int count )
+        {
+            const __m128i sign = _mm_set1_epi8( -128 );
+            const __m128i biased = _mm_xor_si128( _mm_set1_epi8( t ), sign );
+
+            unsigned int i = applyThreshold( output, input, _mm_set1_epi8( t ), _mm_set1_epi8( maxValue ), type, count,
+                                             [&]( __m128i x, __m128i ) { return _mm_cmpgt_epi8( _mm_xor_si128( x, sign ), biased ); } );
+            threshold<BYTE>( output + i, input + i, t, maxValue, type, count - i );
+        }
+
+        inline void threshold( int16_t* output, const int16_t* input, int16_t t, int16_t maxValue, ThresholdType type, unsigned int count )
+        {
+            unsigned int i = applyThreshold( output, input, _mm_set1_epi16( t ), _mm_set1_epi16( maxValue ), type, count,
+                                             []( __m128i x, __m128i y ) { return _mm_cmpgt_epi16( x, y ); } );
+            threshold<int16_t>( output + i, input + i, t, maxValue, type, count - i );
+        }
+
+        inline void threshold( uint16_t* output, const uint16_t* input, uint16_t t, uint16_t maxValue, ThresholdType type, unsigned int count )
+        {
+            const __m128i sign = _mm_set1_epi16( -32768 );
+            const __m128i biased = _mm_xor_si128( _mm_set1_epi16( t ), sign );
+
+            unsigned int i = applyThreshold( output, input, _mm_set1_epi16( t ), _mm_set1_epi16( maxValue ), type, count,
+                                             [&]( __m128i x, __m128i ) { return _mm_cmpgt_epi16( _mm_xor_si128( x, sign ), biased ); } );
+            threshold<uint16_t>( output + i, input + i, t, maxValue, type, count - i );
+        }
+
+        // NaNs compare false, as in the scalar version
+        inline void threshold( float* output, const float* input, float t, float maxValue, ThresholdType type, unsigned int count )
+        {
+            unsigned int i = applyThreshold( output, input, _mm_set1_ps( t ), _mm_set1_ps( maxValue ), type, count,
+                                             []( __m128 x, __m128 y ) { return _mm_cmpgt_ps( x, y ); } );
+            threshold<float>( output + i, input + i, t, maxValue, type, count - i );
+        }
+#endif
+
+        /**
+         * Divide by 255, rounding to nearest. Exact for x <= 255 * 255.
+         * @param x A value.
+         * @return The rounded quotient.
+         */
+        inline unsigned int divide255( unsigned int x )
+        {
+            x += 128;
+            return ( x + ( x >> 8 ) ) >> 8;
+        }
+
+#if defined(__SSE2__)
+        /**
+         * Divide 16-bit lanes by 255 as in divide255( unsigned int ). Lanes
+         * up to 255 * 255 do not overflow.
+         */
+        inline __m128i divide255( __m128i x )
+        {
+            x = _mm_add_epi16( x, _mm_set1_epi16( 128 ) );
+            return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+        }
+
+        /**
+         * Copy the alpha channel of 4 channel pixels to all their lanes: two
+         * pixels in 16-bit lanes, or one pixel in float lanes.
+         */
+        template<unsigned int AlphaIndex>
+        inline __m128i broadcastAlpha( __m128i pixels )
+        {
+            return _mm_shufflehi_epi16( _mm_shufflelo_epi16( pixels, AlphaIndex * 0x55 ), AlphaIndex * 0x55 );
+        }
+
+        template<unsigned int AlphaIndex>
+        inline __m128 broadcastAlpha( __m128 pixel )
+        {
+            return _mm_shuffle_ps( pixel, pixel, AlphaIndex * 0x55 );
+        }
+
+        /**
+         * Mask of the alpha lanes of 4 channel pixels, in 16-bit lanes or in
+         * float lanes.
+         */
+        template<unsigned int AlphaIndex>
+        inline __m128i alphaLanes16()
+        {
+            const int64_t lane = static_cast<int64_t>( 0xFFFF ) << ( 16 * AlphaIndex );
+            return _mm_set_epi64x( lane, lane );
+        }
+
+        template<unsigned int AlphaIndex>
+        inline __m128 alphaLanes32()
+        {
+            return _mm_castsi128_ps( _mm_set_epi32( AlphaIndex == 3 ? -1 : 0, AlphaIndex == 2 ? -1 : 0,
+                                                    AlphaIndex == 1 ? -1 : 0, AlphaIndex == 0 ? -1 : 0 ) );
+        }
+
+        /**
+         * Convert 4 pixels of 4 BYTE channels to floats, one register per
+         * pixel.
+         */
+        inline void widenPixels( __m128i block, __m128* pixels )
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i low = _mm_unpacklo_epi8( block, zero );
+            const __m128i high = _mm_unpackhi_epi8( block, zero );
+
+            pixels[0] = _mm_cvtepi32_ps( _mm_unpacklo_epi16( low, zero ) );
+            pixels[1] = _mm_cvtepi32_ps( _mm_unpackhi_epi16( low, zero ) );
+            pixels[2] = _mm_cvtepi32_ps( _mm_unpacklo_epi16( high, zero ) );
+            pixels[3] = _mm_cvtepi32_ps( _mm_unpackhi_epi16( high, zero ) );
+        }
+
+        /**
+         * Round 4 pixels of non-negative floats to nearest (ties up) and pack
+         * them to BYTE channels, saturating.
+         */
+        inline __m128i narrowPixels( const __m128* pixels )
+        {
+            const __m128 half = _mm_set1_ps( 0.5f );
+            __m128i a = _mm_cvttps_epi32( _mm_add_ps( pixels[0], half ) );
+            __m128i b = _mm_cvttps_epi32( _mm_add_ps( pixels[1], half ) );
+            __m128i c = _mm_cvttps_epi32( _mm_add_ps( pixels[2], half ) );
+            __m128i d = _mm_cvttps_epi32( _mm_add_ps( pixels[3], half ) );
+
+            return _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) );
+        }
+
+        /**
+         * Spread 4 pixels of 3 BYTE channels to 16-bit lanes, 4 lanes per
+         * pixel as in 4 channel images: pixels 0 and 1 in low, 2 and 3 in
+         * high. The fourth lane of each pixel is not used.
+         */
+        inline void expandPixels3( const BYTE* pixels, __m128i& low, __m128i& high )
+        {
+            int32_t last;
+            std::memcpy( &last, pixels + 8, 4 );
+
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i block = _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pixels ) ), _mm_cvtsi32_si128( last ) );
+            const __m128i a = _mm_unpacklo_epi8( block, zero );
+            const __m128i b = _mm_unpacklo_epi8( _mm_srli_si128( block, 6 ), zero );
+
+            low = _mm_unpacklo_epi64( a, _mm_srli_si128( a, 6 ) );
+            high = _mm_unpacklo_epi64( b, _mm_srli_si128( b, 6 ) );
+        }
+
+        /**
+         * Pack 4 pixels spread by expandPixels3() back to 3 BYTE channels,
+         * saturating.
+         */
+        inline void compactPixels3( __m128i low, __m128i high, BYTE* pixels )
+        {
+            // Drop the fourth byte of each pixel within 64-bit lanes, then
+            // close the gap between the lanes
+            const __m128i firstPixel = _mm_set1_epi64x( 0x0000000000FFFFFF );
+            const __m128i secondPixel = _mm_set1_epi64x( 0x00FFFFFF00000000 );
+            const __m128i firstLane = _mm_set_epi64x( 0, -1 );
+
+            __m128i block = _mm_packus_epi16( low, high );
+            block = _mm_or_si128( _mm_and_si128( block, firstPixel ), _mm_srli_epi64( _mm_and_si128( block, secondPixel ), 8 ) );
+            block = _mm_or_si128( _mm_and_si128( block, firstLane ), _mm_srli_si128( _mm_andnot_si128( firstLane, block ), 2 ) );
+
+            _mm_storel_epi64( reinterpret_cast<__m128i*>( pixels ), block );
+            int32_t last = _mm_cvtsi128_si32( _mm_srli_si128( block, 8 ) );
+            std::memcpy( pixels + 8, &last, 4 );
+        }
+#endif
+
+        /**
+         * Multiply the color channels of 4 channel BYTE pixels by their
+         * alpha, see premultiply().
+         */
+        template<unsigned int AlphaIndex>
+        inline void premultiplyPixels( const BYTE* input, BYTE* output, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i alpha = alphaLanes16<AlphaIndex>();
+
+            // Alpha lanes are multiplied by 255, which keeps them
+            const __m128i opaque = _mm_and_si128( alpha, _mm_set1_epi16( 255 ) );
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + 4 * i ) );
+                __m128i low = _mm_unpacklo_epi8( block, zero );
+                __m128i high = _mm_unpackhi_epi8( block, zero );
+
+                low = divide255( _mm_mullo_epi16( low, _mm_or_si128( _mm_andnot_si128( alpha, broadcastAlpha<AlphaIndex>( low ) ), opaque ) ) );
+                high = divide255( _mm_mullo_epi16( high, _mm_or_si128( _mm_andnot_si128( alpha, broadcastAlpha<AlphaIndex>( high ) ), opaque ) ) );
+
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + 4 * i ), _mm_packus_epi16( low, high ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                const BYTE* pixel = input + 4 * i;
+                const unsigned int a = pixel[AlphaIndex];
+
+                for ( unsigned int c = 0; c < 4; ++c )
+                {
+                    output[4 * i + c] = static_cast<BYTE>( c == AlphaIndex ? a : divide255( pixel[c] * a ) );
+                }
+            }
+        }
+
+        /**
+         * Divide the color channels of 4 channel BYTE pixels by their alpha,
+         * see unpremultiply(). With SSE2 the quotients are computed in float,
+         * which gives the exact rounded results: they are at least 1/510 away
+         * from a tie unless they are ties.
+         */
+        template<unsigned int AlphaIndex>
+        inline void unpremultiplyPixels( const BYTE* input, BYTE* output, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps( 1.0f );
+            const __m128 alpha = alphaLanes32<AlphaIndex>();
+            const __m128 scale = select( alpha, one, _mm_set1_ps( 255.0f ) );
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m128 pixels[4];
+                widenPixels( _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + 4 * i ) ), pixels );
+
+                for ( unsigned int k = 0; k < 4; ++k )
+                {
+                    // Transparent pixels become 0
+                    __m128 a = broadcastAlpha<AlphaIndex>( pixels[k] );
+                    __m128 numerator = _mm_and_ps( _mm_mul_ps( pixels[k], scale ), _mm_cmpneq_ps( a, zero ) );
+                    pixels[k] = _mm_div_ps( numerator, select( alpha, one, _mm_max_ps( a, one ) ) );
+                }
+
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + 4 * i ), narrowPixels( pixels ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                const BYTE* pixel = input + 4 * i;
+                const unsigned int a = pixel[AlphaIndex];
+
+                for ( unsigned int c = 0; c < 4; ++c )
+                {
+                    unsigned int value = a == 0 ? 0 : ( 510 * pixel[c] + a ) / ( 2 * a );
+                    output[4 * i + c] = static_cast<BYTE>( c == AlphaIndex ? a : std::min( 255u, value ) );
+                }
+            }
+        }
+
+        /**
+         * Premultiply 4 channel BYTE pixels: colors become color * alpha / 255,
+         * rounded to nearest. The division is exact with 16-bit arithmetic:
+         * (x + 128 + ((x + 128) >> 8)) >> 8.
+         * @param input Input pixels.
+         * @param output Output pixels. It can be the input.
+         * @param count Number of pixels.
+         * @param alphaIndex Channel of alpha, 0 or 3.
+         */
+        inline void premultiply( const BYTE* input, BYTE* output, unsigned int count, unsigned int alphaIndex )
+        {
+            if ( alphaIndex == 0 )
+            {
+                premultiplyPixels<0>( input, output, count );
+            }
+            else
+            {
+                premultiplyPixels<3>( input, output, count );
+            }
+        }
+
+        /**
+         * Unpremultiply 4 channel BYTE pixels: colors become color * 255 /
+         * alpha, rounded to nearest (ties up) and saturated, or 0 where alpha
+         * is 0.
+         * @param input Input pixels.
+         * @param output Output pixels. It can be the input.
+         * @param count Number of pixels.
+         * @param alphaIndex Channel of alpha, 0 or 3.
+         */
+        inline void unpremultiply( const BYTE* input, BYTE* output, unsigned int count, unsigned int alphaIndex )
+        {
+            if ( alphaIndex == 0 )
+            {
+                unpremultiplyPixels<0>( input, output, count );
+            }
+            else
+            {
+                unpremultiplyPixels<3>( input, output, count );
+            }
+        }
+
+        /**
+         * Blend overlay pixels over image pixels, see blendOver(). Opaque
+         * images and premultiplied pixels are blended with exact 16-bit
+         * divisions by 255. Straight 4 channel pixels need a division by the
+         * output alpha, done in float where all the products are exact.
+         */
+        template<unsigned int Channels, unsigned int AlphaIndex, bool Premultiplied>
+        inline void blendOverPixels( const BYTE* overlay, BYTE* image, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            if ( Channels == 4 && !Premultiplied )
+            {
+                const __m128 one = _mm_set1_ps( 1.0f );
+                const __m128 full = _mm_set1_ps( 255.0f );
+                const __m128 alpha = alphaLanes32<AlphaIndex>();
+
+                for ( ; i + 4 <= count; i += 4 )
+                {
+                    __m128 sources[4];
+                    __m128 destinations[4];
+                    widenPixels( _mm_loadu_si128( reinterpret_cast<const __m128i*>( overlay + 4 * i ) ), sources );
+                    widenPixels( _mm_loadu_si128( reinterpret_cast<const __m128i*>( image + 4 * i ) ), destinations );
+
+                    for ( unsigned int k = 0; k < 4; ++k )
+                    {
+                        // The output alpha is weight / 255
+                        __m128 a = broadcastAlpha<AlphaIndex>( sources[k] );
+                        __m128 sourceWeight = _mm_mul_ps( a, full );
+                        __m128 destinationWeight = _mm_mul_ps( broadcastAlpha<AlphaIndex>( destinations[k] ), _mm_sub_ps( full, a ) );
+                        __m128 weight = _mm_add_ps( sourceWeight, destinationWeight );
+                        __m128 sum = _mm_add_ps( _mm_mul_ps( sources[k], sourceWeight ), _mm_mul_ps( destinations[k], destinationWeight ) );
+
+                        destinations[k] = _mm_div_ps( select( alpha, weight, sum ), select( alpha, full, _mm_max_ps( weight, one ) ) );
+                    }
+
+                    _mm_storeu_si128( reinterpret_cast<__m128i*>( image + 4 * i ), narrowPixels( destinations ) );
+                }
+            }
+            else
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i full = _mm_set1_epi16( 255 );
+
+                for ( ; i + 4 <= count; i += 4 )
+                {
+                    __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( overlay + 4 * i ) );
+                    __m128i sources[2] = { _mm_unpacklo_epi8( block, zero ), _mm_unpackhi_epi8( block, zero ) };
+                    __m128i destinations[2];
+
+                    if ( Channels == 4 )
+                    {
+                        block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( image + 4 * i ) );
+                        destinations[0] = _mm_unpacklo_epi8( block, zero );
+                        destinations[1] = _mm_unpackhi_epi8( block, zero );
+                    }
+                    else
+                    {
+                        expandPixels3( image + 3 * i, destinations[0], destinations[1] );
+                    }
+
+                    for ( unsigned int k = 0; k < 2; ++k )
+                    {
+                        __m128i a = broadcastAlpha<AlphaIndex>( sources[k] );
+                        __m128i transparency = _mm_sub_epi16( full, a );
+
+                        if ( Premultiplied )
+                        {
+                            destinations[k] = _mm_add_epi16( sources[k], divide255( _mm_mullo_epi16( destinations[k], transparency ) ) );
+                        }
+                        else
+                        {
+                            destinations[k] = divide255( _mm_add_epi16( _mm_mullo_epi16( sources[k], a ), _mm_mullo_epi16( destinations[k], transparency ) ) );
+                        }
+                    }
+
+                    if ( Channels == 4 )
+                    {
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( image + 4 * i ), _mm_packus_epi16( destinations[0], destinations[1] ) );
+                    }
+                    else
+                    {
+                        compactPixels3( destinations[0], destinations[1], image + 3 * i );
+                    }
+                }
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                const BYTE* source = overlay + 4 * i;
+                BYTE* destination = image + Channels * i;
+                const unsigned int a = source[AlphaIndex];
+
+                if ( Premultiplied )
+                {
+                    for ( unsigned int c = 0; c < Channels; ++c )
+                    {
+                        destination[c] = static_cast<BYTE>( std::min( 255u, source[c] + divide255( destination[c] * ( 255 - a ) ) ) );
+                    }
+                }
+                else if ( Channels == 3 )
+                {
+                    for ( unsigned int c = 0; c < 3; ++c )
+                    {
+                        destination[c] = static_cast<BYTE>( divide255( source[c] * a + destination[c] * ( 255 - a ) ) );
+                    }
+                }
+                else
+                {
+                    // The operations of the vectorized version
+                    const float sourceWeight = static_cast<float>( a * 255 );
+                    const float destinationWeight = static_cast<float>( destination[AlphaIndex] * ( 255 - a ) );
+                    const float weight = sourceWeight + destinationWeight;
+                    float values[4];
+
+                    for ( unsigned int c = 0; c < 4; ++c )
+                    {
+                        values[c] = c == AlphaIndex ? weight / 255.0f :
+                                    ( source[c] * sourceWeight + destination[c] * destinationWeight ) / std::max( weight, 1.0f );
+                    }
+
+                    for ( unsigned int c = 0; c < 4; ++c )
+                    {
+                        destination[c] = static_cast<BYTE>( values[c] + 0.5f );
+                    }
+                }
+            }
+        }
+
+        /**
+         * Porter-Duff "over" of 4 channel BYTE overlay pixels onto image
+         * pixels with the same color channel order.
+         * @param overlay Overlay pixels.
+         * @param image Image pixels, blended in place. 4 channels, or the 3
+         * color channels of the overlay, which must then have alpha last.
+         * @param count Number of pixels.
+         * @param channels Number of channels of the image, 3 or 4.
+         * @param alphaIndex Channel of alpha in the overlay, 0 or 3.
+         * @param premultiplied True if the colors of both the overlay and
+         * the image are premultiplied by their alpha.
+         */
+        inline void blendOver( const BYTE* overlay, BYTE* image, unsigned int count, unsigned int channels,
+                               unsigned int alphaIndex, bool premultiplied )
+        {
+            if ( channels == 3 && premultiplied )
+            {
+                blendOverPixels<3, 3, true>( overlay, image, count );
+            }
+            else if ( channels == 3 )
+            {
+                blendOverPixels<3, 3, false>( overlay, image, count );
+            }
+            else if ( alphaIndex == 0 && premultiplied )
+            {
+                blendOverPixels<4, 0, true>( overlay, image, count );
+            }
+            else if ( alphaIndex == 0 )
+            {
+                blendOverPixels<4, 0, false>( overlay, image, count );
+            }
+            else if ( premultiplied )
+            {
+                blendOverPixels<4, 3, true>( overlay, image, count );
+            }
+            else
+            {
+                blendOverPixels<4, 3, false>( overlay, image, count );
+            }
+        }
+
+        /**
+         * Multiply BYTE pixels by a 4x4 fixed point color matrix: output
+         * channel i is the sum of matrix[4 * i + j] * input channel j,
+         * shifted right by 13 bits and saturated. Input channel
+         * constantChannel is replaced by 128, so that its coefficients add
+         * offsets and rounding. Pixels of 3 channels are the first 3 channels
+         * of 4. With SSE2, the channel pairs of each pixel are broadcast and
+         * weighted with pmaddwd.
+         * @param input Input pixels.
+         * @param inputChannels Number of input channels, 3 or 4.
+         * @param output Output pixels, distinct from input.
+         * @param outputChannels Number of output channels, 3 or 4.
+         * @param count Number of pixels.
+         * @param matrix Coefficients, with 13 fractional bits.
+         * @param constantChannel Input channel replaced by 128.
+         */
+        inline void colorMatrix( const BYTE* input, unsigned int inputChannels, BYTE* output, unsigned int outputChannels,
+                                 unsigned int count, const int16_t* matrix, unsigned int constantChannel )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            // Coefficients of the input channel pairs 0-1 and 2-3 of each
+            // output channel
+            const __m128i low = _mm_set_epi16( matrix[13], matrix[12], matrix[9], matrix[8], matrix[5], matrix[4], matrix[1], matrix[0] );
+            const __m128i high = _mm_set_epi16( matrix[15], matrix[14], matrix[11], matrix[10], matrix[7], matrix[6], matrix[3], matrix[2] );
+
+            const int64_t lane = static_cast<int64_t>( 0xFFFF ) << ( 16 * constantChannel );
+            const __m128i constantLanes = _mm_set_epi64x( lane, lane );
+            const __m128i constant = _mm_and_si128( constantLanes, _mm_set1_epi16( 128 ) );
+            const __m128i zero = _mm_setzero_si128();
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                __m128i pixels[2];
+
+                if ( inputChannels == 4 )
+                {
+                    __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + 4 * i ) );
+                    pixels[0] = _mm_unpacklo_epi8( block, zero );
+                    pixels[1] = _mm_unpackhi_epi8( block, zero );
+                }
+                else
+                {
+                    expandPixels3( input + 3 * i, pixels[0], pixels[1] );
+                }
+
+                __m128i sums[4];
+
+                for ( unsigned int k = 0; k < 2; ++k )
+                {
+                    __m128i p = _mm_or_si128( _mm_andnot_si128( constantLanes, pixels[k] ), constant );
+
+                    sums[2 * k] = _mm_add_epi32( _mm_madd_epi16( _mm_shuffle_epi32( p, 0x00 ), low ), _mm_madd_epi16( _mm_shuffle_epi32( p, 0x55 ), high ) );
+                    sums[2 * k + 1] = _mm_add_epi32( _mm_madd_epi16( _mm_shuffle_epi32( p, 0xAA ), low ), _mm_madd_epi16( _mm_shuffle_epi32( p, 0xFF ), high ) );
+                }
+
+                __m128i first = _mm_packs_epi32( _mm_srai_epi32( sums[0], 13 ), _mm_srai_epi32( sums[1], 13 ) );
+                __m128i second = _mm_packs_epi32( _mm_srai_epi32( sums[2], 13 ), _mm_srai_epi32( sums[3], 13 ) );
+
+                if ( outputChannels == 4 )
+                {
+                    _mm_storeu_si128( reinterpret_cast<__m128i*>( output + 4 * i ), _mm_packus_epi16( first, second ) );
+                }
+                else
+                {
+                    compactPixels3( first, second, output + 3 * i );
+                }
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                int pixel[4] = { 0, 0, 0, 0 };
+
+                for ( unsigned int j = 0; j < inputChannels; ++j )
+                {
+                    pixel[j] = input[i * inputChannels + j];
+                }
+
+                pixel[constantChannel] = 128;
+
+                for ( unsigned int c = 0; c < outputChannels; ++c )
+                {
+                    const int16_t* row = matrix + 4 * c;
+                    int sum = row[0] * pixel[0] + row[1] * pixel[1] + row[2] * pixel[2] + row[3] * pixel[3];
+                    output[i * outputChannels + c] = static_cast<BYTE>( std::min( 255, std::max( 0, sum >> 13 ) ) );
+                }
+            }
+        }
+
+        /**
+         * Interleave a row of 4:2:0 luma samples with the chroma samples that
+         * cover it into 4 channel pixels: luma, Cb, Cr and 0.
+         * @param y Luma samples.
+         * @param u Cb samples, one per 2 pixels.
+         * @param v Cr samples, one per 2 pixels.
+         * @param chromaStep Distance between chroma samples: 1 for planes of
+         * Cb and Cr, 2 for interleaved pairs (v is then u + 1).
+         * @param output Output pixels.
+         * @param count Number of pixels.
+         */
+        inline void interleaveYUV( const BYTE* y, const BYTE* u, const BYTE* v, unsigned int chromaStep, BYTE* output, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i lowBytes = _mm_set1_epi16( 0xFF );
+
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m128i cb;
+                __m128i cr;
+
+                if ( chromaStep == 2 )
+                {
+                    __m128i pairs = _mm_loadu_si128( reinterpret_cast<const __m128i*>( u + i ) );
+                    cb = _mm_packus_epi16( _mm_and_si128( pairs, lowBytes ), zero );
+                    cr = _mm_packus_epi16( _mm_srli_epi16( pairs, 8 ), zero );
+                }
+                else
+                {
+                    cb = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( u + i / 2 ) );
+                    cr = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( v + i / 2 ) );
+                }
+
+                // Each chroma sample covers 2 pixels
+                cb = _mm_unpacklo_epi8( cb, cb );
+                cr = _mm_unpacklo_epi8( cr, cr );
+
+                __m128i luma = _mm_loadu_si128( reinterpret_cast<const __m128i*>( y + i ) );
+                __m128i lowPairs = _mm_unpacklo_epi8( luma, cb );
+                __m128i highPairs = _mm_unpackhi_epi8( luma, cb );
+                __m128i lowCr = _mm_unpacklo_epi8( cr, zero );
+                __m128i highCr = _mm_unpackhi_epi8( cr, zero );
+
+                __m128i* pixels = reinterpret_cast<__m128i*>( output + 4 * i );
+                _mm_storeu_si128( pixels, _mm_unpacklo_epi16( lowPairs, lowCr ) );
+                _mm_storeu_si128( pixels + 1, _mm_unpackhi_epi16( lowPairs, lowCr ) );
+                _mm_storeu_si128( pixels + 2, _mm_unpacklo_epi16( highPairs, highCr ) );
+                _mm_storeu_si128( pixels + 3, _mm_unpackhi_epi16( highPairs, highCr ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[4 * i] = y[i];
+                output[4 * i + 1] = u[i / 2 * chromaStep];
+                output[4 * i + 2] = v[i / 2 * chromaStep];
+                output[4 * i + 3] = 0;
+            }
+        }
+
+        /**
+         * Accumulate per channel statistics of a row of BYTE values, or of
+         * the differences of two rows: sums, sums of squares, sums of
+         * absolute values, minima and maxima. Results are exact. With SSE2,
+         * values are widened to 16-bit lanes whose channel is fixed (lanes
+         * of 3 channels repeat every 3 registers), accumulated in 16 and
+         * 32-bit lanes and folded into the outputs every 128 registers.
+         * @param input Values.
+         * @param subtract Values subtracted from the input, or nullptr.
+         * @param mask 0 or 255 per value: values with 0 are skipped, nullptr
+         * to use all values.
+         * @param count Number of values, a multiple of channels.
+         * @param channels Number of interleaved channels, 1 to 4.
+         * @param sums Sums, one per channel, added to.
+         * @param squares Sums of squares, added to.
+         * @param absolutes Sums of absolute values, added to.
+         * @param minimum Minima, updated.
+         * @param maximum Maxima, updated.
+         */
+        inline void statistics( const BYTE* input, const BYTE* subtract, const BYTE* mask, unsigned int count, unsigned int channels,
+                                int64_t* sums, uint64_t* squares, uint64_t* absolutes, int* minimum, int* maximum )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const unsigned int period = channels == 3 ? 3 : 1;
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i largest = _mm_set1_epi16( 32767 );
+            const __m128i smallest = _mm_set1_epi16( -32768 );
+
+            __m128i sum16[3][2];
+            __m128i absolute16[3][2];
+            __m128i square32[3][4];
+            __m128i low[3][2];
+            __m128i high[3][2];
+
+            for ( unsigned int j = 0; j < 3; ++j )
+            {
+                for ( unsigned int h = 0; h < 2; ++h )
+                {
+                    sum16[j][h] = zero;
+                    absolute16[j][h] = zero;
+                    square32[j][2 * h] = zero;
+                    square32[j][2 * h + 1] = zero;
+                    low[j][h] = largest;
+                    high[j][h] = smallest;
+                }
+            }
+
+            // Adds the lanes to the outputs of their channels
+            auto fold = [&]()
+            {
+                for ( unsigned int j = 0; j < period; ++j )
+                {
+                    int16_t lanes[4][16];
+                    uint32_t lanes32[16];
+
+                    for ( unsigned int h = 0; h < 2; ++h )
+                    {
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes[0] + 8 * h ), sum16[j][h] );
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes[1] + 8 * h ), absolute16[j][h] );
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes[2] + 8 * h ), low[j][h] );
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes[3] + 8 * h ), high[j][h] );
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes32 + 8 * h ), square32[j][2 * h] );
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes32 + 8 * h + 4 ), square32[j][2 * h + 1] );
+
+                        sum16[j][h] = zero;
+                        absolute16[j][h] = zero;
+                        square32[j][2 * h] = zero;
+                        square32[j][2 * h + 1] = zero;
+                    }
+
+                    for ( unsigned int k = 0; k < 16; ++k )
+                    {
+                        const unsigned int c = ( 16 * j + k ) % channels;
+                        sums[c] += lanes[0][k];
+                        absolutes[c] += static_cast<uint64_t>( subtract != nullptr ? lanes[1][k] : lanes[0][k] );
+                        squares[c] += lanes32[k];
+                        minimum[c] = std::min<int>( minimum[c], lanes[2][k] );
+                        maximum[c] = std::max<int>( maximum[c], lanes[3][k] );
+                    }
+                }
+            };
+
+            unsigned int registers = 0;
+
+            for ( ; i + 16 * period <= count; i += 16 * period )
+            {
+                for ( unsigned int j = 0; j < period; ++j )
+                {
+                    const unsigned int offset = i + 16 * j;
+                    const __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( input + offset ) );
+                    __m128i values[2] = { _mm_unpacklo_epi8( bytes, zero ), _mm_unpackhi_epi8( bytes, zero ) };
+                    __m128i valid[2] = { zero, zero };
+
+                    if ( subtract != nullptr )
+                    {
+                        const __m128i other = _mm_loadu_si128( reinterpret_cast<const __m128i*>( subtract + offset ) );
+                        values[0] = _mm_sub_epi16( values[0], _mm_unpacklo_epi8( other, zero ) );
+                        values[1] = _mm_sub_epi16( values[1], _mm_unpackhi_epi8( other, zero ) );
+                    }
+
+                    if ( mask != nullptr )
+                    {
+                        const __m128i m = _mm_loadu_si128( reinterpret_cast<const __m128i*>( mask + offset ) );
+                        valid[0] = _mm_unpacklo_epi8( m, m );
+                        valid[1] = _mm_unpackhi_epi8( m, m );
+                        values[0] = _mm_and_si128( values[0], valid[0] );
+                        values[1] = _mm_and_si128( values[1], valid[1] );
+                    }
+
+                    for ( unsigned int h = 0; h < 2; ++h )
+                    {
+                        const __m128i v = values[h];
+                        const __m128i square = _mm_mullo_epi16( v, v );
+
+                        sum16[j][h] = _mm_add_epi16( sum16[j][h], v );
+                        square32[j][2 * h] = _mm_add_epi32( square32[j][2 * h], _mm_unpacklo_epi16( square, zero ) );
+                        square32[j][2 * h + 1] = _mm_add_epi32( square32[j][2 * h + 1], _mm_unpackhi_epi16( square, zero ) );
+
+                        if ( subtract != nullptr )
+                        {
+                            absolute16[j][h] = _mm_add_epi16( absolute16[j][h], _mm_max_epi16( v, _mm_sub_epi16( zero, v ) ) );
+                        }
+
+                        // Skipped values are zero: they become the largest
+                        // value for the minimum and the smallest for the
+                        // maximum
+                        __m128i lowCandidate = v;
+                        __m128i highCandidate = v;
+
+                        if ( mask != nullptr )
+                        {
+                            lowCandidate = _mm_or_si128( v, _mm_andnot_si128( valid[h], largest ) );
+                            highCandidate = _mm_or_si128( v, _mm_andnot_si128( valid[h], smallest ) );
+                        }
+
+                        low[j][h] = _mm_min_epi16( low[j][h], lowCandidate );
+                        high[j][h] = _mm_max_epi16( high[j][h], highCandidate );
+                    }
+                }
+
+                // 16-bit sums stay below 128 * 255
+                if ( ++registers == 128 )
+                {
+                    fold();
+                    registers = 0;
+                }
+            }
+
+            fold();
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                if ( mask != nullptr && mask[i] == 0 )
+                {
+                    continue;
+                }
+
+                const unsigned int c = i % channels;
+                const int value = subtract != nullptr ? input[i] - subtract[i] : input[i];
+
+                sums[c] += value;
+                squares[c] += static_cast<uint64_t>( value * value );
+                absolutes[c] += static_cast<uint64_t>( std::abs( value ) );
+                minimum[c] = std::min( minimum[c], value );
+                maximum[c] = std::max( maximum[c], value );
+            }
+        }
+
+        /**
+         * Accumulate the structural similarity of pixels from their local
+         * moments: with variances vx = mxx - mx^2, vy = myy - my^2 and
+         * covariance cv = mxy - mx my, the contrast-structure term is
+         * (2 cv + c2) / (vx + vy + c2) and SSIM is that term times
+         * (2 mx my + c1) / (mx^2 + my^2 + c1). Terms are computed in float
+         * and summed in double.
+         * @param mx Local means of the first image.
+         * @param my Local means of the second image.
+         * @param mxx Local means of the squares of the first image.
+         * @param myy Local means of the squares of the second image.
+         * @param mxy Local means of the products.
+         * @param count Number of pixels.
+         * @param c1 Luminance stabilizer.
+         * @param c2 Contrast stabilizer.
+         * @param ssim Sum of SSIM, added to.
+         * @param contrastStructure Sum of the contrast-structure terms,
+         * added to.
+         */
+        inline void ssim( const float* mx, const float* my, const float* mxx, const float* myy, const float* mxy,
+                          unsigned int count, float c1, float c2, double& ssim, double& contrastStructure )
+        {
+            unsigned int i = 0;
+
+#if defined(__SSE2__)
+            const __m128 k1 = _mm_set1_ps( c1 );
+            const __m128 k2 = _mm_set1_ps( c2 );
+            __m128d sums[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                const __m128 x = _mm_loadu_ps( mx + i );
+                const __m128 y = _mm_loadu_ps( my + i );
+                const __m128 xx = _mm_mul_ps( x, x );
+                const __m128 yy = _mm_mul_ps( y, y );
+                const __m128 xy = _mm_mul_ps( x, y );
+
+                const __m128 variances = _mm_sub_ps( _mm_add_ps( _mm_loadu_ps( mxx + i ), _mm_loadu_ps( myy + i ) ), _mm_add_ps( xx, yy ) );
+                const __m128 covariance = _mm_sub_ps( _mm_loadu_ps( mxy + i ), xy );
+
+                const __m128 cs = _mm_div_ps( _mm_add_ps( _mm_add_ps( covariance, covariance ), k2 ), _mm_add_ps( variances, k2 ) );
+                const __m128 luminance = _mm_div_ps( _mm_add_ps( _mm_add_ps( xy, xy ), k1 ), _mm_add_ps( _mm_add_ps( xx, yy ), k1 ) );
+                const __m128 s = _mm_mul_ps( luminance, cs );
+
+                sums[0] = _mm_add_pd( sums[0], _mm_cvtps_pd( s ) );
+                sums[1] = _mm_add_pd( sums[1], _mm_cvtps_pd( _mm_movehl_ps( s, s ) ) );
+                sums[2] = _mm_add_pd( sums[2], _mm_cvtps_pd( cs ) );
+                sums[3] = _mm_add_pd( sums[3], _mm_cvtps_pd( _mm_movehl_ps( cs, cs ) ) );
+            }
+
+            double lanes[4];
+            _mm_storeu_pd( lanes, _mm_add_pd( sums[0], sums[1] ) );
+            _mm_storeu_pd( lanes + 2, _mm_add_pd( sums[2], sums[3] ) );
+            ssim += lanes[0] + lanes[1];
+            contrastStructure += lanes[2] + lanes[3];
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                const float xy = mx[i] * my[i];
+                const float squares = mx[i] * mx[i] + my[i] * my[i];
+                const float cs = ( 2.0f * ( mxy[i] - xy ) + c2 ) / ( mxx[i] + myy[i] - squares + c2 );
+
+                ssim += static_cast<double>( ( 2.0f * xy + c1 ) / ( squares + c1 ) * cs );
+                contrastStructure += static_cast<double>( cs );
+            }
+        }
+
+        /**
+         * One complex number in two scalars, with interleaved real and
+         * imaginary parts like std::complex. This and the SIMD types below
+         * have the same static interface, so the FFT butterflies are written
+         * once for scalars and registers.
+         */
+        template<typename T>
+        struct ScalarComplex
+        {
+            enum { size = 1 };
+
+            T real;
+            T imaginary;
+
+            static ScalarComplex load( const std::complex<T>* input )
+            {
+                const T* parts = reinterpret_cast<const T*>( input );
+                ScalarComplex a = { parts[0], parts[1] };
+                return a;
+            }
+
+            static void store( std::complex<T>* output, const ScalarComplex& a )
+            {
+                T* parts = reinterpret_cast<T*>( output );
+                parts[0] = a.real;
+                parts[1] = a.imaginary;
+            }
+
+            static ScalarComplex broadcast( const std::complex<T>& value )
+            {
+                ScalarComplex a = { value.real(), value.imag() };
+                return a;
+            }
+
+            static ScalarComplex add( const ScalarComplex& a, const ScalarComplex& b )
+            {
+                ScalarComplex sum = { a.real + b.real, a.imaginary + b.imaginary };
+                return sum;
+            }
+
+            static ScalarComplex subtract( const ScalarComplex& a, const ScalarComplex& b )
+            {
+                ScalarComplex difference = { a.real - b.real, a.imaginary - b.imaginary };
+                return difference;
+            }
+
+            static ScalarComplex scale( const ScalarComplex& a, T k )
+            {
+                ScalarComplex product = { a.real * k, a.imaginary * k };
+                return product;
+            }
+
+            /**
+             * a * w, or a * conj(w) if Conjugate.
+             */
+            template<bool Conjugate>
+            static ScalarComplex multiply( const ScalarComplex& a, const ScalarComplex& w )
+            {
+                const T imaginary = Conjugate ? -w.imaginary : w.imaginary;
+                ScalarComplex product = { a.real * w.real - a.imaginary * imaginary, a.imaginary * w.real + a.real * imaginary };
+                return product;
+            }
+
+            /**
+             * a * -i, or a * i if Inverse.
+             */
+            template<bool Inverse>
+            static ScalarComplex rotate( const ScalarComplex& a )
+            {
+                ScalarComplex rotated = { Inverse ? -a.imaginary : a.imaginary, Inverse ? a.real : -a.real };
+                return rotated;
+            }
+        };
+
+#if defined(__SSE2__)
+        /**
+         * Two float complex numbers in a register: real0, imaginary0, real1,
+         * imaginary1.
+         */
+        struct FloatComplexPair
+        {
+            enum { size = 2 };
+
+            __m128 v;
+
+            static FloatComplexPair load( const std::complex<float>* input )
+            {
+                FloatComplexPair a = { _mm_loadu_ps( reinterpret_cast<const float*>( input ) ) };
+                return a;
+            }
+
+            static void store( std::complex<float>* output, const FloatComplexPair& a )
+            {
+                _mm_storeu_ps( reinterpret_cast<float*>( output ), a.v );
+            }
+
+            static FloatComplexPair broadcast( const std::complex<float>& value )
+            {
+                FloatComplexPair a = { _mm_setr_ps( value.real(), value.imag(), value.real(), value.imag() ) };
+                return a;
+            }
+
+            static FloatComplexPair add( const FloatComplexPair& a, const FloatComplexPair& b )
+            {
+                FloatComplexPair sum = { _mm_add_ps( a.v, b.v ) };
+                return sum;
+            }
+
+            static FloatComplexPair subtract( const FloatComplexPair& a, const FloatComplexPair& b )
+            {
+                FloatComplexPair difference = { _mm_sub_ps( a.v, b.v ) };
+                return difference;
+            }
+
+            static FloatComplexPair scale( const FloatComplexPair& a, float k )
+            {
+                FloatComplexPair product = { _mm_mul_ps( a.v, _mm_set1_ps( k ) ) };
+                return product;
+            }
+
+            template<bool Conjugate>
+            static FloatComplexPair multiply( const FloatComplexPair& a, const FloatComplexPair& w )
+            {
+                // (ar wr, ai wr) -/+ (ai wi, ar wi), with the sign flipped on
+                // the real or the imaginary parts
+                const __m128 sign = Conjugate ? _mm_setr_ps( 0.0f, -0.0f, 0.0f, -0.0f ) : _mm_setr_ps( -0.0f, 0.0f, -0.0f, 0.0f );
+                const __m128 real = _mm_shuffle_ps( w.v, w.v, _MM_SHUFFLE( 2, 2, 0, 0 ) );
+                const __m128 imaginary = _mm_shuffle_ps( w.v, w.v, _MM_SHUFFLE( 3, 3, 1, 1 ) );
+                const __m128 swapped = _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+                const __m128 cross = _mm_xor_ps( _mm_mul_ps( swapped, imaginary ), sign );
+                FloatComplexPair product = { _mm_add_ps( _mm_mul_ps( a.v, real ), cross ) };
+                return product;
+            }
+
+            template<bool Inverse>
+            static FloatComplexPair rotate( const FloatComplexPair& a )
+            {
+                const __m128 sign = Inverse ? _mm_setr_ps( -0.0f, 0.0f, -0.0f, 0.0f ) : _mm_setr_ps( 0.0f, -0.0f, 0.0f, -0.0f );
+                FloatComplexPair rotated = { _mm_xor_ps( _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( 2, 3, 0, 1 ) ), sign ) };
+                return rotated;
+            }
+        };
+
+        /**
+         * One double complex number in a register: real, imaginary.
+         */
+        struct DoubleComplex
+        {
+            enum { size = 1 };
+
+            __m128d v;
+
+            static DoubleComplex load( const std::complex<double>* input )
+            {
+                DoubleComplex a = { _mm_loadu_pd( reinterpret_cast<const double*>( input ) ) };
+                return a;
+            }
+
+            static void store( std::complex<double>* output, const DoubleComplex& a )
+            {
+                _mm_storeu_pd( reinterpret_cast<double*>( output ), a.v );
+            }
+
+            static DoubleComplex broadcast( const std::complex<double>& value )
+            {
+                DoubleComplex a = { _mm_setr_pd( value.real(), value.imag() ) };
+                return a;
+            }
+
+            static DoubleComplex add( const DoubleComplex& a, const DoubleComplex& b )
+            {
+                DoubleComplex sum = { _mm_add_pd( a.v, b.v ) };
+                return sum;
+            }
+
+            static DoubleComplex subtract( const DoubleComplex& a, const DoubleComplex& b )
+            {
+                DoubleComplex difference = { _mm_sub_pd( a.v, b.v ) };
+                return difference;
+            }
+
+            static DoubleComplex scale( const DoubleComplex& a, double k )
+            {
+                DoubleComplex product = { _mm_mul_pd( a.v, _mm_set1_pd( k ) ) };
+                return product;
+            }
+
+            template<bool Conjugate>
+            static DoubleComplex multiply( const DoubleComplex& a, const DoubleComplex& w )
+            {
+                const __m128d sign = Conjugate ? _mm_setr_pd( 0.0, -0.0 ) : _mm_setr_pd( -0.0, 0.0 );
+                const __m128d real = _mm_unpacklo_pd( w.v, w.v );
+                const __m128d imaginary = _mm_unpackhi_pd( w.v, w.v );
+                const __m128d swapped = _mm_shuffle_pd( a.v, a.v, 1 );
+                const __m128d cross = _mm_xor_pd( _mm_mul_pd( swapped, imaginary ), sign );
+                DoubleComplex product = { _mm_add_pd( _mm_mul_pd( a.v, real ), cross ) };
+                return product;
+            }
+
+            template<bool Inverse>
+            static DoubleComplex rotate( const DoubleComplex& a )
+            {
+                const __m128d sign = Inverse ? _mm_setr_pd( -0.0, 0.0 ) : _mm_setr_pd( 0.0, -0.0 );
+                DoubleComplex rotated = { _mm_xor_pd( _mm_shuffle_pd( a.v, a.v, 1 ), sign ) };
+                return rotated;
+            }
+        };
+#endif
+
+        /**
+         * The widest complex type of a precision: FloatComplexPair or
+         * DoubleComplex with SSE2, else ScalarComplex.
+         */
+        template<typename T>
+        struct ComplexVector
+        {
+            typedef ScalarComplex<T> Type;
+        };
+
+#if defined(__SSE2__)
+        template<>
+        struct ComplexVector<float>
+        {
+            typedef FloatComplexPair Type;
+        };
+
+        template<>
+        struct ComplexVector<double>
+        {
+            typedef DoubleComplex Type;
+        };
+#endif
+
+        /**
+         * output[i] *= conj(input[i])
+         * @param output Output array.
+         * @param input Input array.
+         * @param count Number of elements.
+         */
+        template<typename T>
+        inline void multiplyConjugate( std::complex<T>* output, const std::complex<T>* input, unsigned int count )
+        {
+            typedef typename ComplexVector<T>::Type Vector;
+            typedef ScalarComplex<T> Scalar;
+            unsigned int i = 0;
+
+            for ( ; i + Vector::size <= count; i += Vector::size )
+            {
+                Vector::store( output + i, Vector::template multiply<true>( Vector::load( output + i ), Vector::load( input + i ) ) );
+            }
+
+            for ( ; i < count; ++i )
+            {
+                Scalar::store( output + i, Scalar::template multiply<true>( Scalar::load( output + i ), Scalar::load( input + i ) ) );
+            }
+        }
+
+        /**
+         * Butterflies of one FFT stage with complex type V (see fftStage()).
+         */
+        template<typename V, typename T, bool Inverse>
+        inline void fftButterflies( const std::complex<T>* input, std::complex<T>* output, unsigned int n, unsigned int radix,
+                                    unsigned int span, const std::complex<T>* twiddles, const std::complex<T>* roots )
+        {
+            const unsigned int stride = n / radix;
+            const unsigned int blocks = stride / span;
+            std::vector< std::complex<T> > terms( radix > 5 ? radix * V::size : 0 );
+
+            for ( unsigned int b = 0; b < blocks; ++b )
+            {
+                for ( unsigned int k = 0; k < span; k += V::size )
+                {
+                    const std::complex<T>* x = input + b * span + k;
+                    const std::complex<T>* w = twiddles + k;
+                    std::complex<T>* y = output + b * radix * span + k;
+
+                    // Inputs after the first are multiplied by their twiddles
+                    V x0 = V::load( x );
+                    V x1 = V::template multiply<Inverse>( V::load( x + stride ), V::load( w ) );
+
+                    if ( radix == 2 )
+                    {
+                        V::store( y, V::add( x0, x1 ) );
+                        V::store( y + span, V::subtract( x0, x1 ) );
+                        continue;
+                    }
+
+                    V x2 = V::template multiply<Inverse>( V::load( x + 2 * stride ), V::load( w + span ) );
+
+                    if ( radix == 3 )
+                    {
+                        const T sin60 = static_cast<T>( 0.86602540378443864676 );
+                        V sum = V::add( x1, x2 );
+                        V middle = V::add( x0, V::scale( sum, static_cast<T>( -0.5 ) ) );
+                        V rotated = V::scale( V::template rotate<Inverse>( V::subtract( x1, x2 ) ), sin60 );
+                        V::store( y, V::add( x0, sum ) );
+                        V::store( y + span, V::add( middle, rotated ) );
+                        V::store( y + 2 * span, V::subtract( middle, rotated ) );
+                        continue;
+                    }
+
+                    V x3 = V::template multiply<Inverse>( V::load( x + 3 * stride ), V::load( w + 2 * span ) );
+
+                    if ( radix == 4 )
+                    {
+                        V t0 = V::add( x0, x2 );
+                        V t1 = V::subtract( x0, x2 );
+                        V t2 = V::add( x1, x3 );
+                        V t3 = V::template rotate<Inverse>( V::subtract( x1, x3 ) );
+                        V::store( y, V::add( t0, t2 ) );
+                        V::store( y + span, V::add( t1, t3 ) );
+                        V::store( y + 2 * span, V::subtract( t0, t2 ) );
+                        V::store( y + 3 * span, V::subtract( t1, t3 ) );
+                        continue;
+                    }
+
+                    V x4 = V::template multiply<Inverse>( V::load( x + 4 * stride ), V::load( w + 3 * span ) );
+
+                    if ( radix == 5 )
+                    {
+                        // cos and sin of 2 pi / 5 and 4 pi / 5
+                        const T cos1 = static_cast<T>( 0.30901699437494742410 );
+                        const T cos2 = static_cast<T>( -0.80901699437494742410 );
+                        const T sin1 = static_cast<T>( 0.95105651629515357212 );
+                        const T sin2 = static_cast<T>( 0.58778525229247312917 );
+
+                        V a1 = V::add( x1, x4 );
+                        V a2 = V::add( x2, x3 );
+                        V b1 = V::subtract( x1, x4 );
+                        V b2 = V::subtract( x2, x3 );
+                        V m1 = V::add( x0, V::add( V::scale( a1, cos1 ), V::scale( a2, cos2 ) ) );
+                        V m2 = V::add( x0, V::add( V::scale( a1, cos2 ), V::scale( a2, cos1 ) ) );
+                        V n1 = V::template rotate<Inverse>( V::add( V::scale( b1, sin1 ), V::scale( b2, sin2 ) ) );
+                        V n2 = V::template rotate<Inverse>( V::subtract( V::scale( b1, sin2 ), V::scale( b2, sin1 ) ) );
+
+                        V::store( y, V::add( x0, V::add( a1, a2 ) ) );
+                        V::store( y + span, V::add( m1, n1 ) );
+                        V::store( y + 2 * span, V::add( m2, n2 ) );
+                        V::store( y + 3 * span, V::subtract( m2, n2 ) );
+                        V::store( y + 4 * span, V::subtract( m1, n1 ) );
+                        continue;
+                    }
+
+                    // Other primes: direct DFT of the twiddled inputs
+                    std::complex<T>* t = &terms[0];
+                    V::store( t, x0 );
+                    V::store( t + V::size, x1 );
+                    V::store( t + 2 * V::size, x2 );
+                    V::store( t + 3 * V::size, x3 );
+                    V::store( t + 4 * V::size, x4 );
+
+                    for ( unsigned int q = 5; q < radix; ++q )
+                    {
+                        V::store( t + q * V::size, V::template multiply<Inverse>( V::load( x + q * stride ), V::load( w + ( q - 1 ) * span ) ) );
+                    }
+
+                    for ( unsigned int r = 0; r < radix; ++r )
+                    {
+                        V sum = V::load( t );
+
+                        for ( unsigned int q = 1; q < radix; ++q )
+                        {
+                            V root = V::broadcast( roots[q * r % radix] );
+                            sum = V::add( sum, V::template multiply<Inverse>( V::load( t + q * V::size ), root ) );
+                        }
+
+                        V::store( y + r * span, sum );
+                    }
+                }
+            }
+        }
+
+        /**
+         * One radix-p stage of a Stockham (self-sorting) FFT of n points. The
+         * previous stages combined the inputs into n / span transforms of
+         * span points; this stage combines each p of them into transforms of
+         * p * span points: for b < n / (p * span), k < span and r < p,
+         *     output[b p span + r span + k] = sum over q < p of
+         *         input[b span + k + q n / p] w^(q k) e^(-2 pi i q r / p)
+         * with w = e^(-2 pi i / (p span)), or the conjugate roots if Inverse.
+         * Radices 2, 3, 4 and 5 have dedicated butterflies; other primes use
+         * a direct DFT in O(p^2). Butterflies are computed on as many
+         * complexes as fit in a SIMD register when span allows it.
+         * @param input Input array of n complexes.
+         * @param output Output array of n complexes, not input.
+         * @param n Transform size.
+         * @param radix Radix p of the stage.
+         * @param span Size of the transforms of the previous stages.
+         * @param twiddles w^(q k) for 1 <= q < p, k < span, with k varying
+         * fastest.
+         * @param roots e^(-2 pi i j / p) for j < p.
+         */
+        template<typename T, bool Inverse>
+        inline void fftStage( const std::complex<T>* input, std::complex<T>* output, unsigned int n, unsigned int radix,
+                              unsigned int span, const std::complex<T>* twiddles, const std::complex<T>* roots )
+        {
+            typedef typename ComplexVector<T>::Type Vector;
+
+            if ( span % Vector::size == 0 )
+            {
+                fftButterflies<Vector, T, Inverse>( input, output, n, radix, span, twiddles, roots );
+            }
+            else
+            {
+                fftButterflies<ScalarComplex<T>, T, Inverse>( input, output, n, radix, span, twiddles, roots );
+            }
+        }
+
+        /**
+         * output[i] += add[i] - subtract[i], modulo 2^16. Used to slide
+         * histograms.
+         * @param output Output array.
+         * @param add Array to be added.
+         * @param subtract Array to be subtracted.
+         * @param count Number of elements.
+         */
+        inline void addSubtract( uint16_t* output, const uint16_t* add, const uint16_t* subtract, unsigned int count )
+        {
+            unsigned int i = 0;
+
+#if defined(__AVX2__)
+            for ( ; i + 16 <= count; i += 16 )
+            {
+                __m256i sum = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( output + i ) );
+                __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( add + i ) );
+                __m256i b = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( subtract + i ) );
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( output + i ), _mm256_add_epi16( sum, _mm256_sub_epi16( a, b ) ) );
+            }
+#elif defined(__SSE2__)
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                __m128i sum = _mm_loadu_si128( reinterpret_cast<const __m128i*>( output + i ) );
+                __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( add + i ) );
+                __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( subtract + i ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( output + i ), _mm_add_epi16( sum, _mm_sub_epi16( a, b ) ) );
+            }
+#endif
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = static_cast<uint16_t>( output[i] + add[i] - subtract[i] );
+            }
+        }
+
+        /**
+         * Compare-exchange of a sorting network: a becomes the minimum and b
+         * the maximum. There are overloads for bytes and for registers of 16
+         * or 32 bytes, so the networks below work on scalars and vectors.
+         */
+        inline void sortPair( BYTE& a, BYTE& b )
+        {
+            BYTE low = std::min( a, b );
+            b = std::max( a, b );
+            a = low;
+        }
+
+#if defined(__SSE2__)
+        inline void sortPair( __m128i& a, __m128i& b )
+        {
+            __m128i low = _mm_min_epu8( a, b );
+            b = _mm_max_epu8( a, b );
+            a = low;
+        }
+#endif
+
+#if defined(__AVX2__)
+        inline void sortPair( __m256i& a, __m256i& b )
+        {
+            __m256i low = _mm256_min_epu8( a, b );
+            b = _mm256_max_epu8( a, b );
+            a = low;
+        }
+#endif
+
+        /**
+         * Median of 9 values with a 19 comparator network.
+         * @param p 9 values, which are reordered.
+         * @return The median.
+         */
+        template<typename V>
+        inline V medianOf9( V* p )
+        {
+            sortPair( p[1], p[2] ); sortPair( p[4], p[5] ); sortPair( p[7], p[8] );
+            sortPair( p[0], p[1] ); sortPair( p[3], p[4] ); sortPair( p[6], p[7] );
+            sortPair( p[1], p[2] ); sortPair( p[4], p[5] ); sortPair( p[7], p[8] );
+            sortPair( p[0], p[3] ); sortPair( p[5], p[8] ); sortPair( p[4], p[7] );
+            sortPair( p[3], p[6] ); sortPair( p[1], p[4] ); sortPair( p[2], p[5] );
+            sortPair( p[4], p[7] ); sortPair( p[4], p[2] ); sortPair( p[6], p[4] );
+            sortPair( p[4], p[2] );
+
+            return p[4];
+        }
+
+        /**
+         * Median of 25 values by forgetful selection: 14 values are kept;
+         * their minimum and maximum, which can not be the median, are
+         * dropped and the next value is taken in, until 3 values are left.
+         * @param p 25 values, which are overwritten.
+         * @return The median.
+         */
+        template<typename V>
+        inline V medianOf25( V* p )
+        {
+            V* kept = p;
+            unsigned int size = 14;
+
+            for ( unsigned int next = 14; ; ++next )
+            {
+                // Bubble the maximum to the end and the minimum to the front
+                for ( unsigned int i = 0; i + 1 < size; ++i )
+                {
+                    sortPair( kept[i], kept[i + 1] );
+                }
+
+                for ( unsigned int i = size - 2; i > 0; --i )
+                {
+                    sortPair( kept[i - 1], kept[i] );
+                }
+
+                if ( next == 25 )
+                {
+                    return kept[1];
+                }
+
+                kept[size - 1] = p[next];
+                ++kept;
+                --size;
+            }
+        }
+
+#if defined(__SSE4_1__)
+        /**
+         * Load 4 channel values as floats / store 4 floats as channel values,
+         * rounding to nearest and saturating.
+         */
+        inline __m128 load4( const float* input )
+        {
+            return _mm_loadu_ps( input );
+        }
+
+        inline __m128 load4( const uint16_t* input )
+        {
+            return _mm_cvtepi32_ps( _mm_cvtepu16_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( input ) ) ) );
+        }
+
+        inline __m128 load4( const int16_t* input )
+        {
+            return _mm_cvtepi32_ps( _mm_cvtepi16_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( input ) ) ) );
+        }
+
+        inline void store4( float* output, __m128 values )
+        {
+            _mm_storeu_ps( output, values );
+        }
+
+        inline void store4( uint16_t* output, __m128 values )
+        {
+            values = _mm_min_ps( _mm_max_ps( values, _mm_setzero_ps() ), _mm_set1_ps( 65535.0f ) );
+            __m128i integers = _mm_cvtps_epi32( values );
+            _mm_storel_epi64( reinterpret_cast<__m128i*>( output ), _mm_packus_epi32( integers, integers ) );
+        }
+
+        inline void store4( int16_t* output, __m128 values )
+        {
+            values = _mm_min_ps( _mm_max_ps( values, _mm_set1_ps( -32768.0f ) ), _mm_set1_ps( 32767.0f ) );
+            __m128i integers = _mm_cvtps_epi32( values );
+            _mm_storel_epi64( reinterpret_cast<__m128i*>( output ), _mm_packs_epi32( integers, integers ) );
+        }
+
+#if defined(__F16C__)
+        inline __m128 load4( const Half* input )
+        {
+            return _mm_cvtph_ps( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( input ) ) );
+        }
+
+        inline void store4( Half* output, __m128 values )
+        {
+            _mm_storel_epi64( reinterpret_cast<__m128i*>( output ), _mm_cvtps_ph( values, _MM_FROUND_TO_NEAREST_INT ) );
+        }
+#endif
+
+        /**
+         * Convert through float, 4 elements at a time, for the type pairs that
+         * have load4()/store4().
+         */
+        template<typename Output, typename Input>
+        inline void convertThroughFloat( const Input* input, Output* output, unsigned int count, double scale, double offset )
+        {
+            const float s = static_cast<float>( scale );
+            const float o = static_cast<float>( offset );
+            const __m128 vs = _mm_set1_ps( s );
+            const __m128 vo = _mm_set1_ps( o );
+            unsigned int i = 0;
+
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                store4( output + i, _mm_add_ps( _mm_mul_ps( load4( input + i ), vs ), vo ) );
+            }
+
+            for ( ; i < count; ++i )
+            {
+                output[i] = saturate<Output>( static_cast<float>( input[i] ) * s + o );
+            }
+        }
+
+        inline void convert( const uint16_t* input, float* output, unsigned int count, double scale, double offset )
+        {
+            convertThroughFloat( input, output, count, scale, offset );
+        }
+
+        inline void convert( const float* input, uint16_t* output, unsigned int count, double scale, double offset )
+        {
+            convertThroughFloat( input, output, count, scale, offset );
+        }
+
+        inline void convert( const int16_t* input, float* output, unsigned int count, double scale, double offset )
+        {
+            convertThroughFloat( input, output, count, scale, offset );
+        }
+
+        inline void convert( const float* input, int16_t* output, unsigned int count, double scale, double offset )
+        {
+            convertThroughFloat( input, output, count, scale, offset );
+        }
+
+#if defined(__F16C__)
+        inline void convert( const Half* input, float* output, unsigned int count, double scale, double offset )
+        {
+            convertThroughFloat( input, output, count, scale, offset );
+        }
+
+        inline void convert( const float* input, Half* output, unsigned int count, double scale, double offset )
+        {
+            convertThroughFloat( input, output, count, scale, offset );
+        }
+#endif
+#endif
+    }
+}
+
+#endif // SIMD_H
@@ -11,6 +11,12 @@
 #define TYPES_H
 
 #include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 
 namespace owl
@@ -19,18 +25,321 @@ namespace owl
      *  8-bits data type for color channel representation.
      */
     typedef uint8_t BYTE;
-    
+
+    /**
+     * IEEE 754 half precision (16-bit) floating point data type for color
+     * channel representation. Arithmetic is done in float: a Half converts
+     * implicitly to and from float, rounding to nearest even. Conversions use
+     * the F16C instructions when the compiler targets them.
+     */
+    class Half
+    {
+        public:
+
+            Half() : mBits( 0 ) {}
+
+            Half( float value ) : mBits( fromFloat( value ) ) {}
+
+            operator float() const { return toFloat( mBits ); }
+
+            /**
+             * Build a Half from its binary representation.
+             * @param bits IEEE 754 binary16 bits.
+             * @return The Half value.
+             */
+            static Half fromBits( uint16_t bits )
+            {
+                Half half;
+                half.mBits = bits;
+                return half;
+            }
+
+            /**
+             * Gets the binary representation.
+             * @return IEEE 754 binary16 bits.
+             */
+            uint16_t getBits() const { return mBits; }
+
+            /**
+             * Convert a float to binary16 bits, rounding to nearest even.
+             * Values too large become infinity.
+             * @param value A float value.
+             * @return IEEE 754 binary16 bits.
+             */
+            static uint16_t fromFloat( float value )
+            {
+#if defined(__F16C__)
+                return _cvtss_sh( value, 0 );
+#else
+                uint32_t bits;
+                std::memcpy( &bits, &value, sizeof(bits) );
+
+                uint32_t sign = ( bits >> 16 ) & 0x8000;
+                uint32_t exponent = ( bits >> 23 ) & 0xFF;
+                uint32_t mantissa = bits & 0x7FFFFF;
+
+                // Infinity and NaN (keeping NaNs quiet)
+                if ( exponent == 0xFF )
+                {
+                    return sign | 0x7C00 | ( mantissa != 0 ? 0x200 | ( mantissa >> 13 ) : 0 );
+                }
+
+                int halfExponent = static_cast<int>( exponent ) - 127 + 15;
+
+                if ( halfExponent >= 31 )
+                {
+                    return sign | 0x7C00;
+                }
+
+                if ( halfExponent <= 0 )
+                {
+                    // Subnormal half (or zero)
+                    if ( halfExponent < -10 )
+                    {
+                        return sign;
+                    }
+
+                    mantissa |= 0x800000;
+                    uint32_t shift = 14 - halfExponent;
+                    uint32_t half = mantissa >> shift;
+                    uint32_t remainder = mantissa & ( ( 1u << shift ) - 1 );
+                    uint32_t halfway = 1u << ( shift - 1 );
+
+                    if ( remainder > halfway || ( remainder == halfway && ( half & 1 ) ) )
+                    {
+                        ++half;
+                    }
+
+                    return sign | half;
+                }
+
+                // A carry out of the mantissa correctly increments the exponent
+                uint32_t half = ( halfExponent << 10 ) | ( mantissa >> 13 );
+                uint32_t remainder = mantissa & 0x1FFF;
+
+                if ( remainder > 0x1000 || ( remainder == 0x1000 && ( half & 1 ) ) )
+                {
+                    ++half;
+                }
+
+                return sign | half;
+#endif
+            }
+
+            /**
+             * Convert binary16 bits to a float. The conversion is exact.
+             * @param bits IEEE 754 binary16 bits.
+             * @return The float value.
+             */
+            static float toFloat( uint16_t bits )
+            {
+#if defined(__F16C__)
+                return _cvtsh_ss( bits );
+#else
+                uint32_t sign = static_cast<uint32_t>( bits & 0x8000 ) << 16;
+                uint32_t exponent = ( bits >> 10 ) & 0x1F;
+                uint32_t mantissa = bits & 0x3FF;
+                uint32_t result;
+
+                if ( exponent == 0 )
+                {
+                    if ( mantissa == 0 )
+                    {
+                        result = sign;
+                    }
+                    else
+                    {
+                        // Subnormal half, normal float
+                        uint32_t floatExponent = 127 - 15 + 1;
+
+                        while ( ( mantissa & 0x400 ) == 0 )
+                        {
+                            mantissa <<= 1;
+                            --floatExponent;
+                        }
+
+                        result = sign | ( floatExponent << 23 ) | ( ( mantissa & 0x3FF ) << 13 );
+                    }
+                }
+                else if ( exponent == 31 )
+                {
+                    result = sign | 0x7F800000 | ( mantissa << 13 );
+                }
+                else
+                {
+                    result = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+                }
+
+                float value;
+                std::memcpy( &value, &result, sizeof(value) );
+                return value;
+#endif
+            }
+
+
+        private:
+
+            /**
+             * IEEE 754 binary16 bits.
+             */
+            uint16_t mBits;
+    };
+
+    /**
+     * Axis-aligned rectangle in pixel coordinates. As in owl::Image, the
+     * origin is the top-left corner, x grows along columns and y along rows.
+     */
+    struct Rect
+    {
+        Rect() : x( 0 ), y( 0 ), width( 0 ), height( 0 ) {}
+
+        Rect( unsigned int x, unsigned int y, unsigned int width, unsigned int height ) :
+            x( x ), y( y ), width( width ), height( height ) {}
+
+        /**
+         * Check if the rectangle has no area.
+         * @return True if width or height is zero.
+         */
+        bool isEmpty() const { return width == 0 || height == 0; }
+
+        unsigned int x;
+        unsigned int y;
+        unsigned int width;
+        unsigned int height;
+    };
+
+    /**
+     * Statistics of a connected component of an image.
+     */
+    struct ComponentStats
+    {
+        ComponentStats() : area( 0 ), centroidX( 0.0 ), centroidY( 0.0 ) {}
+
+        uint64_t area;      // Number of pixels
+        Rect bounds;        // Bounding box
+        double centroidX;   // Mean column of the pixels
+        double centroidY;   // Mean row of the pixels
+    };
+
+    /**
+     * Statistics of a channel of an image, or of the difference of two
+     * images, see ImageOperator::statistics(). Locations are those of the
+     * first extreme value in row order.
+     */
+    struct ChannelStats
+    {
+        ChannelStats() : count( 0 ), minimum( 0.0 ), maximum( 0.0 ), minimumX( 0 ), minimumY( 0 ), maximumX( 0 ), maximumY( 0 ),
+                         sum( 0.0 ), mean( 0.0 ), variance( 0.0 ), standardDeviation( 0.0 ), normL1( 0.0 ), normL2( 0.0 ), normInf( 0.0 ) {}
+
+        uint64_t count;             // Number of pixels
+        double minimum;
+        double maximum;
+        unsigned int minimumX;      // Column of the minimum
+        unsigned int minimumY;      // Row of the minimum
+        unsigned int maximumX;
+        unsigned int maximumY;
+        double sum;
+        double mean;
+        double variance;            // Population variance
+        double standardDeviation;
+        double normL1;              // Sum of absolute values
+        double normL2;              // Square root of the sum of squares
+        double normInf;             // Largest absolute value
+    };
+
+    /**
+     * How filters and geometric operators sample pixels outside the image.
+     */
+    enum class BorderMode
+    {
+        REPLICATE,  // aaa|abcd|ddd
+        REFLECT,    // dcb|abcd|cba (the edge pixel is not repeated)
+        CONSTANT    // kkk|abcd|kkk, for a given constant k
+    };
+
+    /**
+     * How resampling operators compute pixels between source pixels.
+     */
+    enum class Interpolation
+    {
+        NEAREST,
+        BILINEAR,
+        BICUBIC,    // Keys cubic convolution, a = -0.5
+        LANCZOS,    // Lanczos windowed sinc, 3 lobes
+        AREA        // Average of the covered source pixels (bilinear when upscaling)
+    };
+
+    /**
+     * How threshold operators map a value v, given a threshold t and a
+     * maximum value m.
+     */
+    enum class ThresholdType
+    {
+        BINARY,             // v > t ? m : 0
+        BINARY_INVERTED,    // v > t ? 0 : m
+        TRUNCATE,           // v > t ? t : v
+        TO_ZERO,            // v > t ? v : 0
+        TO_ZERO_INVERTED    // v > t ? 0 : v
+    };
+
+    /**
+     * How adaptive thresholding computes the threshold of each pixel from its
+     * neighborhood.
+     */
+    enum class AdaptiveMethod
+    {
+        MEAN,       // Mean of the window
+        GAUSSIAN    // Gaussian weighted mean of the window
+    };
+
+    /**
+     * Standards of YCbCr encodings: the luma coefficients (BT.601 for SD video
+     * and JPEG, BT.709 for HD video) and the range of the values. Full range
+     * values span the whole channel range; limited (video) range lumas span
+     * [16, 235] and chromas [16, 240] in 8 bits.
+     */
+    enum class YCbCrStandard
+    {
+        BT601_FULL,
+        BT601_LIMITED,
+        BT709_FULL,
+        BT709_LIMITED
+    };
+
     namespace ColorSpace
     {
         /**
          * Definition of color space types.
+         *
+         * HSV, HSL, YCBCR and LAB channels are scaled to the range of the
+         * channel type, as RGB channels (e.g. [0, 255] for BYTE, [0, 1] for
+         * float): hue is a fraction of a turn, wrapping around for integer
+         * types; CIE L*a*b* (D65 white) maps L* from [0, 100] and a*, b*
+         * from [-128, 127] around the center of the range, as YCbCr chromas.
+         *
+         * I420 and NV12 are planar 4:2:0 YCbCr frames, stored as one
+         * channel images 3/2 as high as the frame: the luma rows are
+         * followed by the chroma samples of each 2x2 block, as a Cb plane
+         * and a Cr plane with half rows (I420), or as one plane of
+         * interleaved Cb, Cr pairs (NV12). Frames have even sizes.
          */
         enum class Type
         {
             UNKNOWN,
             GRAYSCALE,
             RGB,
-            RGBA
+            RGBA,
+            BGR,
+            BGRA,
+            ARGB,
+            ABGR,
+            CMYK,
+            HSV,
+            HSL,
+            YCBCR,
+            LAB,
+            I420,
+            NV12
         };
         
         /**
@@ -43,19 +352,121 @@ namespace owl
             switch (colorSpace)
             {
                 case Type::RGB:
+                case Type::BGR:
+                case Type::HSV:
+                case Type::HSL:
+                case Type::YCBCR:
+                case Type::LAB:
                     return 3;
 
                 case Type::RGBA:
+                case Type::BGRA:
+                case Type::ARGB:
+                case Type::ABGR:
+                case Type::CMYK:
                     return 4;
 
                 case Type::GRAYSCALE:
+                case Type::I420:
+                case Type::NV12:
                     return 1;
 
                 default:
                     return 0;
             }
         }
+
+        /**
+         * Check if a color space holds gray levels or RGB colors, with or
+         * without alpha, whose channels are related by name.
+         * @param colorSpace Color space.
+         * @return True for grayscale and RGB color spaces.
+         */
+        inline bool isRGB(Type colorSpace)
+        {
+            switch (colorSpace)
+            {
+                case Type::GRAYSCALE:
+                case Type::RGB:
+                case Type::RGBA:
+                case Type::BGR:
+                case Type::BGRA:
+                case Type::ARGB:
+                case Type::ABGR:
+                    return true;
+
+                default:
+                    return false;
+            }
+        }
+
+        /**
+         * Check if a color space stores its channels in separate planes
+         * rather than in pixels.
+         * @param colorSpace Color space.
+         * @return True for I420 and NV12.
+         */
+        inline bool isPlanar(Type colorSpace)
+        {
+            return colorSpace == Type::I420 || colorSpace == Type::NV12;
+        }
+
+        /**
+         * Get the names of the channels of a color space, in memory order.
+         * Grayscale is "Y", YCbCr is "Yuv" and CIE L*a*b* is "Lab" (the
+         * lower case letters are not alpha or blue).
+         * @param colorSpace Color space.
+         * @return A string with one letter per channel (e.g. "BGRA"), or an
+         * empty string for unknown and planar color spaces.
+         */
+        inline const char* channelNames(Type colorSpace)
+        {
+            switch (colorSpace)
+            {
+                case Type::GRAYSCALE: return "Y";
+                case Type::RGB: return "RGB";
+                case Type::RGBA: return "RGBA";
+                case Type::BGR: return "BGR";
+                case Type::BGRA: return "BGRA";
+                case Type::ARGB: return "ARGB";
+                case Type::ABGR: return "ABGR";
+                case Type::CMYK: return "CMYK";
+                case Type::HSV: return "HSV";
+                case Type::HSL: return "HSL";
+                case Type::YCBCR: return "Yuv";
+                case Type::LAB: return "Lab";
+                default: return "";
+            }
+        }
     }
 }
 
+namespace std
+{
+    /**
+     * Numeric limits of owl::Half, so that generic code can query the range of
+     * any channel type.
+     */
+    template<>
+    class numeric_limits<owl::Half>
+    {
+        public:
+            static const bool is_specialized = true;
+            static const bool is_signed = true;
+            static const bool is_integer = false;
+            static const bool is_exact = false;
+            static const bool has_infinity = true;
+            static const bool has_quiet_NaN = true;
+            static const int digits = 11;
+            static const int radix = 2;
+
+            static owl::Half min() { return owl::Half::fromBits( 0x0400 ); }
+            static owl::Half max() { return owl::Half::fromBits( 0x7BFF ); }
+            static owl::Half lowest() { return owl::Half::fromBits( 0xFBFF ); }
+            static owl::Half epsilon() { return owl::Half::fromBits( 0x1400 ); }
+            static owl::Half infinity() { return owl::Half::fromBits( 0x7C00 ); }
+            static owl::Half quiet_NaN() { return owl::Half::fromBits( 0x7E00 ); }
+    };
+}
+
 #endif // TYPES_H